@@ -21,13 +21,26 @@
 
 #include <map>
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <RCF/Export.hpp>
 #include <RCF/Filter.hpp>
 #include <RCF/ByteBuffer.hpp>
 
 namespace RCF {
 
+    // Compresses server-side HTTP response bodies. Gets the request's 
+    // Accept-Encoding header and the body, returns the Content-Encoding token 
+    // with the encoded body in encoded, or an empty string to send the body 
+    // as it is.
+    typedef boost::function<std::string (
+        const std::string & acceptEncoding, 
+        const std::vector<ByteBuffer> & body, 
+        std::vector<char> & encoded)> HttpContentEncoder;
+
+    RCF_EXPORT void setHttpContentEncoder(HttpContentEncoder contentEncoder);
+
     class HttpFrameFilter : public Filter
     {
     public:
@@ -51,13 +64,20 @@ namespace RCF {
 
         virtual std::size_t getFrameSize();
 
+        // False when the current request asked for the connection to be 
+        // closed after the response.
+        bool isKeepAlive() const;
+
     private:
 
+        const std::string & getHeader(const char * name) const;
+
         std::string mServerAddr;
         int mServerPort;
 
         std::vector<ByteBuffer> mWriteBuffers;
         std::size_t mWritePos;
+        std::size_t mOrigWriteLength;
 
         ByteBuffer mOrigReadBuffer;
         std::size_t mOrigBytesRequested;
@@ -69,6 +89,9 @@ namespace RCF {
         std::size_t mHeaderLen;
         std::size_t mContentLen;
 
+        // Bytes of pipelined requests that arrived along with the current one.
+        std::vector<char> mPendingBytes;
+
         std::string mRequestLine;
         std::string mResponseLine;
         std::map<std::string, std::string> mHeaders;
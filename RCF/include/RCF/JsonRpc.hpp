@@ -34,13 +34,20 @@ namespace RCF {
     {
     public:
         JsonRpcRequest(ByteBuffer message);
+
+        // One call of an already parsed JSON-RPC 2.0 batch.
+        JsonRpcRequest(const json_spirit::Value & request);
+
         bool isNotification() const;
+        bool isJsonRpc2() const;
         const std::string & getMethodName() const;
         const json_spirit::Array & getJsonParams() const;
         boost::uint64_t getRequestId() const;
 
     private:
 
+        void init();
+
         ByteBuffer mMessageBuffer;
 
         json_spirit::Value mJsonRequest;
@@ -48,6 +55,7 @@ namespace RCF {
 
         std::string mMethodName;
         bool mIsNotification;
+        bool mIsJsonRpc2;
         boost::uint64_t mRequestId;
     };
 
@@ -58,9 +66,17 @@ namespace RCF {
         JsonRpcResponse(boost::uint64_t requestId);
         json_spirit::mObject & getJsonResponse();
 
+        // Already encoded JSON, sent as "result" instead of the value in 
+        // getJsonResponse(). The string is swapped in, not copied.
+        void setRawResult(std::string & json);
+        const std::string & getRawResult() const;
+        bool hasRawResult() const;
+
     private:
 
         json_spirit::mObject mJsonResponse;
+        std::string mRawResult;
+        bool mHasRawResult;
 
     };
 
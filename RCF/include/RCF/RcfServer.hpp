@@ -104,6 +104,17 @@ namespace RCF {
     class JsonRpcRequest;
     class JsonRpcResponse;
 
+    struct JsonRpcMethodStats
+    {
+        JsonRpcMethodStats() : mCalls(0), mErrors(0), mTotalUs(0), mMaxUs(0)
+        {}
+
+        boost::uint64_t mCalls;
+        boost::uint64_t mErrors;
+        boost::uint64_t mTotalUs;
+        boost::uint64_t mMaxUs;
+    };
+
     class SspiFilter;
 
     class RCF_EXPORT RcfServer : boost::noncopyable
@@ -229,6 +240,14 @@ namespace RCF {
         typedef std::map<std::string, JsonRpcMethod>    JsonRpcMethods;
         JsonRpcMethods                                  mJsonRpcMethods;
 
+        Mutex                                           mJsonRpcStatsMutex;
+        std::map<std::string, JsonRpcMethodStats>       mJsonRpcStats;
+
+        void addJsonRpcStats(
+            const std::string & jsonRpcName, 
+            boost::uint64_t durationUs, 
+            bool failed);
+
         Mutex                                           mSessionsMutex;
         std::set<RcfSessionWeakPtr>                     mSessions;
 
@@ -440,6 +459,11 @@ namespace RCF {
 #ifdef RCF_USE_JSON
         void bindJsonRpc(JsonRpcMethod jsonRpcMethod, const std::string & jsonRpcName);
         void unbindJsonRpc(const std::string & jsonRpcName);
+
+        typedef std::map<std::string, JsonRpcMethodStats> JsonRpcStats;
+
+        // Calls, failed calls and time spent per JSON-RPC method since the server started.
+        void getJsonRpcStats(JsonRpcStats & stats);
 #endif
         
         void setSupportedTransportProtocols(
@@ -24,6 +24,7 @@
 #include <boost/any.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <RCF/Filter.hpp>
@@ -33,6 +34,10 @@
 #include <RCF/ServerTransport.hpp>
 #include <RCF/StubEntry.hpp>
 
+#ifdef RCF_USE_JSON
+#include <RCF/JsonRpc.hpp>
+#endif
+
 #ifdef RCF_USE_BOOST_FILESYSTEM
 #include <RCF/FileDownload.hpp>
 #include <RCF/FileUpload.hpp>
@@ -409,6 +414,10 @@ namespace RCF {
         void onWriteCompleted();
 
         void processJsonRpcRequest();
+#ifdef RCF_USE_JSON
+        bool processJsonRpcCall(const json_spirit::Value & jsonCall, boost::scoped_ptr<JsonRpcResponse> & jsonResponsePtr);
+        void writeJsonRpcResponse(JsonRpcResponse & jsonResponse, std::ostream & os);
+#endif
 
         void processRequest();
         void invokeServant();
@@ -783,6 +783,17 @@ namespace RCF {
             }
             else
             {
+                if (    !mCloseAfterWrite
+                    &&  (mTransport.mWireProtocol == Wp_Http || mTransport.mWireProtocol == Wp_Https))
+                {
+                    // HTTP/1.0 clients and those that sent "Connection: close" 
+                    // wait for the server to close the connection.
+                    HttpFrameFilter & httpFrameFilter = 
+                        static_cast<HttpFrameFilter &>(*mWireFilters.front());
+
+                    mCloseAfterWrite = !httpFrameFilter.isKeepAlive();
+                }
+
                 if (mCloseAfterWrite)
                 {
                     // For TCP sockets, call shutdown() so client receives 
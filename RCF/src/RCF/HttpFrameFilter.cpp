@@ -19,12 +19,22 @@
 #include <RCF/HttpFrameFilter.hpp>
 
 #include <RCF/Exception.hpp>
+#include <RCF/MinMax.hpp>
+
+#include <algorithm>
 
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
 namespace RCF  {
 
+    static HttpContentEncoder gHttpContentEncoder;
+
+    void setHttpContentEncoder(HttpContentEncoder contentEncoder)
+    {
+        gHttpContentEncoder = contentEncoder;
+    }
+
     void splitString(
         const std::string & stringToSplit, 
         const std::string & splitAt, 
@@ -61,12 +71,14 @@ namespace RCF  {
     {
         mWriteBuffers.clear();
         mWritePos = 0;
+        mOrigWriteLength = 0;
         //mBytesRequested = 0;
         mReadVectorPtr.reset( new std::vector<char>() );
         mBytesReceived = 0;
         mReadPos = 0;
         mHeaderLen = 0;
         mContentLen = 0;
+        mPendingBytes.clear();
     }
 
     void HttpFrameFilter::read(
@@ -88,6 +100,18 @@ namespace RCF  {
             mOrigReadBuffer = byteBuffer;
             mOrigBytesRequested = bytesRequested;
 
+            if (!mPendingBytes.empty())
+            {
+                // A pipelined request has already been received, at least 
+                // partially, along with the previous one.
+                std::size_t pendingLen = mPendingBytes.size();
+                mReadVectorPtr->resize( RCF_MAX(pendingLen, std::size_t(1024)) );
+                memcpy(& (*mReadVectorPtr)[0], & mPendingBytes[0], pendingLen);
+                mPendingBytes.clear();
+                onReadCompleted( ByteBuffer(ByteBuffer(mReadVectorPtr), 0, pendingLen) );
+                return;
+            }
+
             mpPostFilter->read(
                 ByteBuffer(mReadVectorPtr), 
                 mReadVectorPtr->size());
@@ -136,10 +160,15 @@ namespace RCF  {
             // See if we can pick out the HTTP request header.
             // Scan bytes for CRLF CRLF to mark end of HTTP header.
             
+            // The buffer isn't null-terminated and may hold stale bytes past 
+            // mBytesReceived, so the search is bounded.
             const char * szBuffer = & (*mReadVectorPtr)[0];
             std::size_t szBufferLen = mBytesReceived;
-            const char * pChar = strstr(szBuffer, "\r\n\r\n");
-            if (pChar)
+            const char * szCrLfCrLf = "\r\n\r\n";
+            const char * pChar = std::search(
+                szBuffer, szBuffer + szBufferLen, 
+                szCrLfCrLf, szCrLfCrLf + 4);
+            if (pChar != szBuffer + szBufferLen)
             {
                 mHeaderLen = pChar - szBuffer + 4;
 
@@ -185,13 +214,26 @@ namespace RCF  {
                         if (boost::iequals(headerName, "Content-Length"))
                         {
                             mContentLen = atoi(headerValue.c_str());
-                            if (mContentLen)
-                            {
-                                mReadVectorPtr->resize(mHeaderLen + mContentLen);
-                            }
                         }
                     }
                 }
+
+                if (mContentLen)
+                {
+                    // Anything past this message belongs to the next one.
+                    std::size_t messageLen = mHeaderLen + mContentLen;
+                    if (mBytesReceived > messageLen)
+                    {
+                        mPendingBytes.assign(
+                            szBuffer + messageLen, 
+                            szBuffer + mBytesReceived);
+
+                        mBytesReceived = messageLen;
+                        szBufferLen = messageLen;
+                    }
+                    mReadVectorPtr->resize(messageLen);
+                    szBuffer = & (*mReadVectorPtr)[0];
+                }
             }
 
             if (mHeaderLen == 0)
@@ -261,6 +303,35 @@ namespace RCF  {
         return mContentLen;
     }
 
+    const std::string & HttpFrameFilter::getHeader(const char * name) const
+    {
+        static const std::string empty;
+
+        std::map<std::string, std::string>::const_iterator iter;
+        for (iter = mHeaders.begin(); iter != mHeaders.end(); ++iter)
+        {
+            if (boost::iequals(iter->first, name))
+            {
+                return iter->second;
+            }
+        }
+        return empty;
+    }
+
+    bool HttpFrameFilter::isKeepAlive() const
+    {
+        const std::string & connection = getHeader("Connection");
+        if (boost::icontains(connection, "close"))
+        {
+            return false;
+        }
+        if (boost::iends_with(mRequestLine, "HTTP/1.0"))
+        {
+            return boost::icontains(connection, "keep-alive");
+        }
+        return true;
+    }
+
     void HttpFrameFilter::write(const std::vector<ByteBuffer> & byteBuffers)
     {
         mWriteBuffers = byteBuffers;
@@ -269,6 +340,27 @@ namespace RCF  {
         unsigned int messageLength = static_cast<unsigned int>(
             lengthByteBuffers(byteBuffers));
 
+        // The layers above get the length of what they passed in, whatever 
+        // goes on the wire.
+        mOrigWriteLength = messageLength;
+
+        std::string contentEncoding;
+        if (mServerAddr.empty() && gHttpContentEncoder && messageLength > 0)
+        {
+            const std::string & acceptEncoding = getHeader("Accept-Encoding");
+            if (!acceptEncoding.empty())
+            {
+                boost::shared_ptr< std::vector<char> > encodedPtr( new std::vector<char>() );
+                contentEncoding = gHttpContentEncoder(acceptEncoding, byteBuffers, *encodedPtr);
+                if (!contentEncoding.empty())
+                {
+                    messageLength = static_cast<unsigned int>(encodedPtr->size());
+                    mWriteBuffers.clear();
+                    mWriteBuffers.push_back( ByteBuffer(encodedPtr) );
+                }
+            }
+        }
+
         std::ostringstream os;
 
         if (mServerAddr.size() > 0)
@@ -285,6 +377,19 @@ namespace RCF  {
                 "Content-Length: " << messageLength << "\r\n"
                 "\r\n";
         }
+        else if (messageLength == 0)
+        {
+            // Server-side response without a body, e.g. to a batch made 
+            // only of notifications.
+
+            mWriteBuffers.clear();
+
+            os <<  
+                "HTTP/1.1 204 No Content\r\n"
+                "Access-Control-Allow-Origin: *\r\n" //+ CORS, allow for all
+                "Connection: " << (isKeepAlive() ? "keep-alive" : "close") << "\r\n"
+                "\r\n";
+        }
         else
         {
             // Server-side response.
@@ -292,6 +397,16 @@ namespace RCF  {
             os <<  
                 "HTTP/1.1 200 OK\r\n"
                 "Access-Control-Allow-Origin: *\r\n" //+ CORS, allow for all
+                "Connection: " << (isKeepAlive() ? "keep-alive" : "close") << "\r\n";
+
+            if (!contentEncoding.empty())
+            {
+                os <<
+                    "Content-Encoding: " << contentEncoding << "\r\n"
+                    "Vary: Accept-Encoding\r\n";
+            }
+
+            os <<
                 "Content-Length: " << messageLength << "\r\n"
                 "\r\n";
         }
@@ -315,8 +430,7 @@ namespace RCF  {
         }
         else
         {
-            std::size_t bytesWritten = mWritePos - mWriteBuffers.front().getLength();
-            mpPreFilter->onWriteCompleted(bytesWritten);
+            mpPreFilter->onWriteCompleted(mOrigWriteLength);
         }
     }
 
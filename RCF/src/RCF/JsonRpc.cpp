@@ -22,7 +22,11 @@
 
 namespace RCF {
 
-    JsonRpcRequest::JsonRpcRequest(ByteBuffer message) : mMessageBuffer(message)
+    JsonRpcRequest::JsonRpcRequest(ByteBuffer message) : 
+        mMessageBuffer(message),
+        mIsNotification(true),
+        mIsJsonRpc2(false),
+        mRequestId(0)
     {
         MemIstream is(message.getPtr(), message.getLength());
         bool parsedOk = json_spirit::read_stream(is, mJsonRequest);
@@ -30,7 +34,22 @@ namespace RCF {
         {
             RCF_THROW(Exception(_RcfError_ParseJsonRpcRequest()));
         }
-        json_spirit::Object obj = mJsonRequest.get_obj();
+        init();
+    }
+
+    JsonRpcRequest::JsonRpcRequest(const json_spirit::Value & request) : 
+        mJsonRequest(request),
+        mIsNotification(true),
+        mIsJsonRpc2(false),
+        mRequestId(0)
+    {
+        init();
+    }
+
+    void JsonRpcRequest::init()
+    {
+        // Without an "id" member it's a JSON-RPC 2.0 notification.
+        const json_spirit::Object & obj = mJsonRequest.get_obj();
 
         for(json_spirit::Object::size_type i=0; i!=obj.size(); ++i)
         {
@@ -60,6 +79,10 @@ namespace RCF {
             {
                 mJsonParams = value.get_array();
             }
+            else if (name == "jsonrpc")
+            {
+                mIsJsonRpc2 = (value.type() == json_spirit::str_type && value.get_str() == "2.0");
+            }
         }
 
     }
@@ -69,6 +92,11 @@ namespace RCF {
         return mIsNotification;
     }
 
+    bool JsonRpcRequest::isJsonRpc2() const
+    {
+        return mIsJsonRpc2;
+    }
+
     const std::string & JsonRpcRequest::getMethodName() const
     {
         return mMethodName;
@@ -84,7 +112,8 @@ namespace RCF {
         return mRequestId;
     }
 
-    JsonRpcResponse::JsonRpcResponse(boost::uint64_t requestId)
+    JsonRpcResponse::JsonRpcResponse(boost::uint64_t requestId) :
+        mHasRawResult(false)
     {
         mJsonResponse["id"] = requestId;
         mJsonResponse["result"] = json_spirit::mValue();
@@ -96,4 +125,20 @@ namespace RCF {
         return mJsonResponse;
     }
 
+    void JsonRpcResponse::setRawResult(std::string & json)
+    {
+        mRawResult.swap(json);
+        mHasRawResult = true;
+    }
+
+    const std::string & JsonRpcResponse::getRawResult() const
+    {
+        return mRawResult;
+    }
+
+    bool JsonRpcResponse::hasRawResult() const
+    {
+        return mHasRawResult;
+    }
+
 } // namespace RCF
@@ -71,6 +71,8 @@ namespace RCF { class FileTransferService {}; }
 
 #ifdef RCF_USE_JSON
 #include <RCF/JsonRpc.hpp>
+#include <RCF/MemStream.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #endif
 
 #ifdef BOOST_WINDOWS
@@ -901,18 +903,90 @@ namespace RCF {
 
         CurrentRcfSessionSentry guard(*this);
 
-        boost::scoped_ptr<JsonRpcResponse> jsonResponsePtr;
+        MemOstreamPtr osPtr = getObjectPool().getMemOstreamPtr();
+        bool isOneway = true;
+
+        json_spirit::Value jsonRequest;
+        MemIstream is(readByteBuffer.getPtr(), readByteBuffer.getLength());
+        bool parsedOk = json_spirit::read_stream(is, jsonRequest);
+
+        if (    parsedOk 
+            &&  jsonRequest.type() == json_spirit::array_type 
+            &&  !jsonRequest.get_array().empty())
+        {
+            // JSON-RPC 2.0 batch. The responses go back in one array, 
+            // notifications don't get any.
+            const json_spirit::Array & jsonCalls = jsonRequest.get_array();
+            *osPtr << "[";
+            for (std::size_t i=0; i<jsonCalls.size(); ++i)
+            {
+                boost::scoped_ptr<JsonRpcResponse> jsonResponsePtr;
+                if (processJsonRpcCall(jsonCalls[i], jsonResponsePtr))
+                {
+                    if (!isOneway)
+                    {
+                        *osPtr << ",";
+                    }
+                    isOneway = false;
+                    writeJsonRpcResponse(*jsonResponsePtr, *osPtr);
+                }
+            }
+            *osPtr << "]";
+        }
+        else if (parsedOk && jsonRequest.type() == json_spirit::obj_type)
+        {
+            boost::scoped_ptr<JsonRpcResponse> jsonResponsePtr;
+            isOneway = !processJsonRpcCall(jsonRequest, jsonResponsePtr);
+            if (!isOneway)
+            {
+                writeJsonRpcResponse(*jsonResponsePtr, *osPtr);
+            }
+        }
+        else
+        {
+            JsonRpcResponse jsonResponse(0);
+            jsonResponse.getJsonResponse()["error"] = 
+                std::string("Unable to parse JSON-RPC request.");
+            writeJsonRpcResponse(jsonResponse, *osPtr);
+            isOneway = false;
+        }
+
+        setTlsRcfSessionPtr();
+
+        ThreadLocalCached< std::vector<ByteBuffer> > tlcByteBuffers;
+        std::vector<ByteBuffer> & buffers = tlcByteBuffers.get();
+        if (!isOneway)
+        {
+            ByteBuffer buffer(osPtr->str(), static_cast<std::size_t>(osPtr->tellp()), osPtr);
+            buffers.push_back(buffer);
+        }
+
+        // JSON-RPC runs over HTTP, so even notifications need an answer. 
+        // HttpFrameFilter turns an empty body into a 204.
+        getSessionState().postWrite(buffers);
+    }
+
+    // Returns false for notifications, which don't get a response.
+    bool RcfSession::processJsonRpcCall(
+        const json_spirit::Value & jsonCall,
+        boost::scoped_ptr<JsonRpcResponse> & jsonResponsePtr)
+    {
         bool isOneway = false;
+        bool isJsonRpc2 = false;
         boost::uint64_t jsonRequestId = 0;
+        std::string jsonRpcName;
+        bool measured = false;
+        boost::posix_time::ptime callStart;
 
         try
         {
-            JsonRpcRequest jsonRequest(readByteBuffer);
+            JsonRpcRequest jsonRequest(jsonCall);
             jsonRequestId = jsonRequest.getRequestId();
             jsonResponsePtr.reset( new JsonRpcResponse(jsonRequestId) );
 
-            std::string jsonRpcName = jsonRequest.getMethodName();
+            jsonRpcName = jsonRequest.getMethodName();
             isOneway = jsonRequest.isNotification();
+            isJsonRpc2 = jsonRequest.isJsonRpc2();
 
             RcfServer::JsonRpcMethod jsonRpcMethod;
 
@@ -927,7 +1001,13 @@ namespace RCF {
 
             if (jsonRpcMethod)
             {
+                measured = true;
+                callStart = boost::posix_time::microsec_clock::universal_time();
                 jsonRpcMethod(jsonRequest, *jsonResponsePtr);
+                mRcfServer.addJsonRpcStats(
+                    jsonRpcName, 
+                    (boost::posix_time::microsec_clock::universal_time() - callStart).total_microseconds(),
+                    !jsonResponsePtr->getJsonResponse()["error"].is_null());
             }
             else
             {
@@ -959,28 +1039,49 @@ namespace RCF {
                 errMsg = "Caught C++ exception of unknown type.";
             }
 
+            if (measured)
+            {
+                mRcfServer.addJsonRpcStats(
+                    jsonRpcName, 
+                    (boost::posix_time::microsec_clock::universal_time() - callStart).total_microseconds(),
+                    true);
+            }
+
             jsonResponsePtr.reset( new JsonRpcResponse(jsonRequestId) );
             jsonResponsePtr->getJsonResponse()["result"] = json_spirit::mValue();
             jsonResponsePtr->getJsonResponse()["error"] = errMsg;
         }
 
-        setTlsRcfSessionPtr();
+        if (isJsonRpc2)
+        {
+            jsonResponsePtr->getJsonResponse()["jsonrpc"] = std::string("2.0");
+        }
 
-        if (isOneway)
+        return !isOneway;
+    }
+
+    void RcfSession::writeJsonRpcResponse(
+        JsonRpcResponse & jsonResponse, 
+        std::ostream & os)
+    {
+        json_spirit::mObject & obj = jsonResponse.getJsonResponse();
+        if (jsonResponse.hasRawResult())
         {
-            onWriteCompleted();
+            // The result is already JSON, only the envelope is written here.
+            os << "{";
+            if (obj.count("jsonrpc"))
+            {
+                os << "\"jsonrpc\":\"2.0\",";
+            }
+            os << "\"error\":";
+            json_spirit::write_stream(obj["error"], os);
+            os << ",\"id\":";
+            json_spirit::write_stream(obj["id"], os);
+            os << ",\"result\":" << jsonResponse.getRawResult() << "}";
         }
         else
         {
-            json_spirit::mObject & obj = jsonResponsePtr->getJsonResponse();
-
-            MemOstreamPtr osPtr = getObjectPool().getMemOstreamPtr();
-            json_spirit::write_stream(json_spirit::mValue(obj), *osPtr, json_spirit::pretty_print);
-            ByteBuffer buffer(osPtr->str(), static_cast<std::size_t>(osPtr->tellp()), osPtr);
-            ThreadLocalCached< std::vector<ByteBuffer> > tlcByteBuffers;
-            std::vector<ByteBuffer> & buffers = tlcByteBuffers.get();
-            buffers.push_back(buffer);
-            getSessionState().postWrite(buffers);
+            json_spirit::write_stream(json_spirit::mValue(obj), os);
         }
     }
 
@@ -1220,6 +1321,28 @@ namespace RCF {
         }
     }
 
+    void RcfServer::getJsonRpcStats(JsonRpcStats & stats)
+    {
+        Lock lock(mJsonRpcStatsMutex);
+        stats = mJsonRpcStats;
+    }
+
+    void RcfServer::addJsonRpcStats(
+        const std::string & jsonRpcName, 
+        boost::uint64_t durationUs, 
+        bool failed)
+    {
+        Lock lock(mJsonRpcStatsMutex);
+        JsonRpcMethodStats & stats = mJsonRpcStats[jsonRpcName];
+        ++stats.mCalls;
+        if (failed)
+        {
+            ++stats.mErrors;
+        }
+        stats.mTotalUs += durationUs;
+        stats.mMaxUs = RCF_MAX(stats.mMaxUs, durationUs);
+    }
+
 #endif
 
     FilterPtr RcfServer::createFilter(int filterId)
@@ -0,0 +1,237 @@
+// SegmentSim.cpp : Runs the segment picking of QueueItem::getNextSegment (SegmentPicker)
+// against simulated sources and prints the completion time of a download.
+//
+// Built from client/SegmentPicker.cpp and this file only, e.g.
+//   cl /EHsc /O2 /D_CONSOLE /I..\boost SegmentSim.cpp ..\client\SegmentPicker.cpp
+//
+// The model: every source has a fixed speed, a connection sets up a chunk in CONNECT_DELAY,
+// the chunk size of a source follows UserConnection::updateChunkSize and its speed estimate
+// DownloadManager::endData. An overlapped chunk races the original one for its tail: the first
+// to finish disconnects the other, which keeps its bytes up to the last block boundary, as
+// QueueManager::putDownload does.
+// Partial sources are not simulated.
+
+#include "../client/stdinc.h"
+#include "../client/SegmentPicker.h"
+
+using namespace dcpp;
+
+static const int64_t BLOCK_SIZE = 1024 * 1024;
+static const uint64_t STEP = 100;          // ms per step
+static const uint64_t CONNECT_DELAY = 500; // ms to request a chunk
+static const uint64_t GIVE_UP = 24 * 3600 * 1000;
+
+// as UserConnection::updateChunkSize
+static const int64_t SEGMENT_TIME = 120 * 1000;
+static const int64_t MIN_CHUNK_SIZE = 64 * 1024;
+
+struct SimSource
+{
+	SimSource(int64_t p_speed) : m_speed(p_speed), m_estimate(0), m_chunk_size(0), m_busy(false), m_ready(0), m_pos(0), m_start(0) { }
+
+	int64_t m_speed;      // real speed, bytes per second
+	int64_t m_estimate;   // UserConnection::getSpeed
+	int64_t m_chunk_size; // UserConnection::getChunkSize
+	bool m_busy;
+	uint64_t m_ready;     // tick the chunk starts to flow
+	Segment m_segment;
+	int64_t m_pos;
+	uint64_t m_start;
+
+	void updateChunkSize(int64_t p_last_chunk, uint64_t p_ticks)
+	{
+		if (m_chunk_size == 0)
+		{
+			m_chunk_size = std::max(MIN_CHUNK_SIZE, std::min(p_last_chunk, (int64_t)1024 * 1024));
+			return;
+		}
+		if (p_ticks <= 10)
+		{
+			m_chunk_size *= 2;
+			return;
+		}
+		const double l_msecs = 1000. * m_chunk_size / ((1000. * p_last_chunk) / p_ticks);
+		if (l_msecs < SEGMENT_TIME / 4)
+			m_chunk_size *= 2;
+		else if (l_msecs < SEGMENT_TIME / 1.25)
+			m_chunk_size += BLOCK_SIZE;
+		else if (l_msecs < SEGMENT_TIME * 1.25)
+			;
+		else if (l_msecs < SEGMENT_TIME * 4)
+			m_chunk_size = MIN_CHUNK_SIZE; // targetSize - chunkSize in the client
+		else
+			m_chunk_size = std::max(MIN_CHUNK_SIZE, m_chunk_size / 2);
+	}
+};
+
+// as QueueItem::addSegment, the done segments are merged
+static void addDone(SegmentPicker::SegmentSet& p_done, const Segment& p_segment)
+{
+	Segment l_merged = p_segment;
+	for (auto i = p_done.begin(); i != p_done.end();)
+	{
+		if (i->getStart() <= l_merged.getEnd() && l_merged.getStart() <= i->getEnd())
+		{
+			const int64_t l_start = std::min(i->getStart(), l_merged.getStart());
+			const int64_t l_end = std::max(i->getEnd(), l_merged.getEnd());
+			l_merged = Segment(l_start, l_end - l_start);
+			p_done.erase(i++);
+		}
+		else
+		{
+			++i;
+		}
+	}
+	p_done.insert(l_merged);
+}
+
+struct SimResult
+{
+	SimResult() : m_ms(0), m_chunks(0), m_overlaps(0), m_cancelled(0) { }
+	uint64_t m_ms;
+	int m_chunks;
+	int m_overlaps;
+	int m_cancelled; // chunks that lost a race
+};
+
+static SimResult simulate(int64_t p_size, const vector<int64_t>& p_speeds, bool p_overlap)
+{
+	vector<SimSource> l_sources(p_speeds.begin(), p_speeds.end());
+	SegmentPicker::SegmentSet l_done;
+	SimResult l_result;
+
+	// ticks start at 1, a chunk start of 0 means "not started" for the picker
+	for (uint64_t l_now = 1; l_now < GIVE_UP; l_now += STEP)
+	{
+		if (l_done.size() == 1 && l_done.begin()->getStart() == 0 && l_done.begin()->getSize() == p_size)
+		{
+			l_result.m_ms = l_now - 1;
+			return l_result;
+		}
+
+		// idle sources ask for a segment, once per second like the connection attempts
+		for (size_t s = 0; s < l_sources.size(); ++s)
+		{
+			SimSource& l_source = l_sources[s];
+			if (l_source.m_busy || (l_now - 1) % 1000 != 0)
+				continue;
+
+			SegmentPicker::ChunkList l_running;
+			int64_t l_downloaded = 0;
+			for (auto i = l_done.cbegin(); i != l_done.cend(); ++i)
+				l_downloaded += i->getSize();
+			for (auto i = l_sources.cbegin(); i != l_sources.cend(); ++i)
+			{
+				if (!i->m_busy)
+					continue;
+				SegmentPicker::Chunk l_chunk;
+				l_chunk.m_segment = i->m_segment;
+				l_chunk.m_pos = i->m_pos;
+				l_chunk.m_start = i->m_start;
+				// Transfer::getAverageSpeed has no samples the first second
+				l_chunk.m_speed = l_now >= i->m_ready + 1000 ? static_cast<double>(i->m_speed) : 0;
+				l_chunk.m_seconds_left = l_chunk.m_speed > 0 ? static_cast<int64_t>((i->m_segment.getSize() - i->m_pos) / l_chunk.m_speed) : 0;
+				l_running.push_back(l_chunk);
+				l_downloaded += i->m_pos;
+			}
+
+			SegmentPicker l_picker(p_size, BLOCK_SIZE, l_done, l_running);
+			l_picker.setDownloaded(l_downloaded);
+			l_picker.setOverlap(p_overlap, l_now);
+			const Segment l_segment = l_picker.pick(l_source.m_chunk_size, l_source.m_estimate);
+			if (l_segment.getSize() <= 0)
+				continue;
+
+			if (l_segment.getOverlapped())
+			{
+				// Download::Download: the original chunk keeps running and isn't overlapped again
+				for (auto i = l_sources.begin(); i != l_sources.end(); ++i)
+				{
+					if (i->m_busy && i->m_segment.contains(l_segment))
+					{
+						i->m_segment.setOverlapped(true);
+						break;
+					}
+				}
+				++l_result.m_overlaps;
+			}
+
+			l_source.m_busy = true;
+			l_source.m_segment = Segment(l_segment.getStart(), l_segment.getSize());
+			l_source.m_pos = 0;
+			l_source.m_start = l_now;
+			l_source.m_ready = l_now + CONNECT_DELAY;
+			++l_result.m_chunks;
+		}
+
+		for (auto i = l_sources.begin(); i != l_sources.end(); ++i)
+		{
+			if (!i->m_busy || l_now < i->m_ready)
+				continue;
+			i->m_pos = std::min(i->m_segment.getSize(), i->m_pos + i->m_speed * static_cast<int64_t>(STEP) / 1000);
+			if (i->m_pos < i->m_segment.getSize())
+				continue;
+
+			// DownloadManager::endData
+			addDone(l_done, i->m_segment);
+			i->m_estimate = i->m_estimate ? (i->m_estimate + i->m_speed) / 2 : i->m_speed;
+			i->updateChunkSize(i->m_segment.getSize(), l_now + STEP - i->m_start);
+			i->m_busy = false;
+
+			// QueueManager::putDownload: the chunk that lost the race is disconnected, its whole blocks are kept
+			for (auto j = l_sources.begin(); j != l_sources.end(); ++j)
+			{
+				if (!j->m_busy || !j->m_segment.overlaps(i->m_segment))
+					continue;
+				const int64_t l_kept = j->m_pos - j->m_pos % BLOCK_SIZE;
+				if (l_kept > 0)
+					addDone(l_done, Segment(j->m_segment.getStart(), l_kept));
+				j->m_busy = false;
+				++l_result.m_cancelled;
+			}
+		}
+	}
+
+	l_result.m_ms = GIVE_UP;
+	return l_result;
+}
+
+int __cdecl main(int argc, char* argv[])
+{
+	const int64_t l_size = (argc > 1 ? _atoi64(argv[1]) : 700) * 1024 * 1024;
+	const int64_t KB = 1024;
+
+	struct Scenario
+	{
+		const char* m_name;
+		vector<int64_t> m_speeds;
+	};
+	vector<Scenario> l_scenarios(4);
+	l_scenarios[0].m_name = "equal (4 x 500 KiB/s)";
+	l_scenarios[0].m_speeds.assign(4, 500 * KB);
+	l_scenarios[1].m_name = "mixed (2 MiB/s .. 20 KiB/s)";
+	l_scenarios[1].m_speeds.push_back(2048 * KB);
+	l_scenarios[1].m_speeds.push_back(1024 * KB);
+	l_scenarios[1].m_speeds.push_back(500 * KB);
+	l_scenarios[1].m_speeds.push_back(100 * KB);
+	l_scenarios[1].m_speeds.push_back(20 * KB);
+	l_scenarios[2].m_name = "one fast, many slow";
+	l_scenarios[2].m_speeds.push_back(4096 * KB);
+	l_scenarios[2].m_speeds.insert(l_scenarios[2].m_speeds.end(), 8, 10 * KB);
+	l_scenarios[3].m_name = "two fast, one crawling";
+	l_scenarios[3].m_speeds.push_back(1024 * KB);
+	l_scenarios[3].m_speeds.push_back(1024 * KB);
+	l_scenarios[3].m_speeds.push_back(2 * KB);
+
+	printf("file %d MiB, block %d KiB\n", static_cast<int>(l_size / (1024 * 1024)), static_cast<int>(BLOCK_SIZE / KB));
+	printf("%-30s %10s %12s %12s %8s %8s %8s\n", "sources", "ideal s", "overlap s", "no overlap s", "chunks", "overlaps", "lost");
+	for (auto i = l_scenarios.cbegin(); i != l_scenarios.cend(); ++i)
+	{
+		const int64_t l_total = std::accumulate(i->m_speeds.begin(), i->m_speeds.end(), int64_t(0));
+		const SimResult l_overlap = simulate(l_size, i->m_speeds, true);
+		const SimResult l_plain = simulate(l_size, i->m_speeds, false);
+		printf("%-30s %10.1f %12.1f %12.1f %8d %8d %8d\n", i->m_name, static_cast<double>(l_size) / l_total,
+		       l_overlap.m_ms / 1000., l_plain.m_ms / 1000., l_overlap.m_chunks, l_overlap.m_overlaps, l_overlap.m_cancelled);
+	}
+	return 0;
+}
@@ -290,9 +290,8 @@ bool ADLSearch::searchAll(const string& s) const
 	return !stringSearches.empty();
 }
 
-ADLSearchManager::ADLSearchManager() : user(UserPtr(), Util::emptyString), breakOnFirst(false), sentRaw(false)
+ADLSearchManager::ADLSearchManager() : user(UserPtr(), Util::emptyString), breakOnFirst(false), sentRaw(false), loaded(false)
 {
-	load();
 }
 
 ADLSearchManager::~ADLSearchManager()
@@ -300,10 +299,19 @@ ADLSearchManager::~ADLSearchManager()
 	save();
 }
 
+ADLSearchManager::SearchCollection& ADLSearchManager::getCollection()
+{
+	Lock l(cs);
+	if (!loaded)
+		load();
+	return collection;
+}
+
 void ADLSearchManager::load()
 {
 	// Clear current
 	collection.clear();
+	loaded = true;
 	
 	// Load file as a string
 	try
@@ -389,6 +397,10 @@ void ADLSearchManager::load()
 
 void ADLSearchManager::save() const
 {
+	// never read, so nothing changed either
+	if (!loaded)
+		return;
+		
 	// Prepare xml string for saving
 	try
 	{
@@ -642,6 +654,7 @@ void ADLSearchManager::finalizeDestinationDirectories(DestDirList& destDirVector
 
 void ADLSearchManager::matchListing(DirectoryListing& aDirList) noexcept
 {
+	getCollection();
 	StringMap params;
 	if (aDirList.getUser())
 	{
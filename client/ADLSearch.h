@@ -124,9 +124,9 @@ class ADLSearchManager : public Singleton<ADLSearchManager>
 		ADLSearchManager();
 		~ADLSearchManager();
 		
-		// Search collection
+		// Search collection, ADLSearch.xml is read the first time it's needed
 		typedef vector<ADLSearch> SearchCollection;
-		SearchCollection collection;
+		SearchCollection& getCollection();
 		
 		// Load/save search collection to XML file
 		void load();
@@ -141,6 +141,10 @@ class ADLSearchManager : public Singleton<ADLSearchManager>
 		void matchListing(DirectoryListing& /*aDirList*/) noexcept;
 		
 	private:
+		SearchCollection collection;
+		bool loaded;
+		CriticalSection cs;
+		
 		// @internal
 		void matchRecurse(DestDirList& /*aDestList*/, DirectoryListing::Directory* /*aDir*/, string& /*aPath*/);
 		// Search for file match
@@ -28,15 +28,57 @@ template<size_t N>
 class BloomFilter
 {
 	public:
-		BloomFilter(size_t tableSize)
+		/**
+		 * @param tableSize Number of bits, rounded up to a power of two
+		 * @param counting Keep a counter per bit so that entries can be removed again
+		 */
+		BloomFilter(size_t tableSize, bool counting = false) : shift(32 - 6), outFactor(1)
 		{
-			table.resize(tableSize);
+			size_t l_size = 64;
+			while (l_size < tableSize && shift > 0)
+			{
+				l_size <<= 1;
+				--shift;
+			}
+			table.resize(l_size / 64);
+			if (counting)
+			{
+				counters.resize(l_size);
+			}
+			for (size_t i = 1; i < N; ++i)
+			{
+				outFactor *= BASE;
+			}
 		}
 		~BloomFilter() { }
 		
 		void add(const string& s)
 		{
-			xadd(s, N);
+			for (NGramHash i(s, outFactor); i.valid(); i.next())
+			{
+				const size_t l_pos = getPos(i.get());
+				if (!counters.empty() && counters[l_pos] != MAX_COUNT)
+				{
+					++counters[l_pos];
+				}
+				table[l_pos / 64] |= uint64_t(1) << (l_pos % 64);
+			}
+		}
+		/** Undo add(s), only possible for counting filters. Saturated counters stay set. */
+		void remove(const string& s)
+		{
+			dcassert(!counters.empty());
+			if (counters.empty())
+				return;
+				
+			for (NGramHash i(s, outFactor); i.valid(); i.next())
+			{
+				const size_t l_pos = getPos(i.get());
+				if (counters[l_pos] != MAX_COUNT && counters[l_pos] != 0 && --counters[l_pos] == 0)
+				{
+					table[l_pos / 64] &= ~(uint64_t(1) << (l_pos % 64));
+				}
+			}
 		}
 		bool match(const StringList& s) const
 		{
@@ -49,67 +91,103 @@ class BloomFilter
 		}
 		bool match(const string& s) const
 		{
-			if (s.length() >= N)
+			for (NGramHash i(s, outFactor); i.valid(); i.next())
 			{
-				string::size_type l = s.length() - N;
-				for (string::size_type i = 0; i <= l; ++i)
+				const size_t l_pos = getPos(i.get());
+				if (!(table[l_pos / 64] & (uint64_t(1) << (l_pos % 64))))
 				{
-					if (!table[getPos(s, i, N)])
-					{
-						return false;
-					}
+					return false;
 				}
 			}
 			return true;
 		}
 		void clear()
 		{
-#ifdef _DEBUG
-			std::vector<bool> l_test_vector = table;
-			l_test_vector.clear();
-			l_test_vector.resize(table.size());
-#endif
-			std::fill_n(table.begin(), table.size(), false);
-			dcassert(l_test_vector == table);
+			std::fill(table.begin(), table.end(), 0);
+			std::fill(counters.begin(), counters.end(), 0);
+		}
+		
+		/** The bits and the counters as they are, to save the filter and load it back without adding everything again */
+		const vector<uint64_t>& getTable() const
+		{
+			return table;
+		}
+		const vector<uint8_t>& getCounters() const
+		{
+			return counters;
+		}
+		/** @return False if the saved filter has another size */
+		bool load(const uint64_t* p_table, size_t p_words, const uint8_t* p_counters, size_t p_counters_size)
+		{
+			if (p_words != table.size() || p_counters_size != counters.size())
+				return false;
+			std::copy(p_table, p_table + p_words, table.begin());
+			std::copy(p_counters, p_counters + p_counters_size, counters.begin());
+			return true;
 		}
 #ifdef TESTER
 		void print_table_status()
 		{
+			const size_t l_size = table.size() * 64;
 			int tot = 0;
-			for (unsigned int i = 0; i < table.size(); ++i) if (table[i] == true) ++tot;
+			for (size_t i = 0; i < l_size; ++i) if (table[i / 64] & (uint64_t(1) << (i % 64))) ++tot;
 			
-			std::cout << "table status: " << tot << " of " << table.size()
-			          << " filled, for an occupancy percentage of " << (100.*tot) / table.size()
+			std::cout << "table status: " << tot << " of " << l_size
+			          << " filled, for an occupancy percentage of " << (100.*tot) / l_size
 			          << '%' << std::endl;
 		}
 #endif
 	private:
-		void xadd(const string& s, size_t n)
+		enum { BASE = 257, MAX_COUNT = 0xFF };
+		
+		/** Polynomial hash of consecutive N-grams, rolled forward in O(1) per position */
+		class NGramHash
 		{
-			if (s.length() >= n)
-			{
-				string::size_type l = s.length() - n;
-				for (string::size_type i = 0; i <= l; ++i)
+			public:
+				NGramHash(const string& s, uint32_t outFactor) : cur(reinterpret_cast<const uint8_t*>(s.data())), out(outFactor), h(0),
+					left(s.length() >= N ? s.length() - N + 1 : 0)
 				{
-					table[getPos(s, i, n)] = true;
+					if (left)
+					{
+						for (size_t i = 0; i < N; ++i)
+						{
+							h = h * BASE + cur[i];
+						}
+					}
 				}
-			}
-		}
+				bool valid() const
+				{
+					return left != 0;
+				}
+				uint32_t get() const
+				{
+					return h;
+				}
+				void next()
+				{
+					if (--left)
+					{
+						h = (h - cur[0] * out) * BASE + cur[N];
+						++cur;
+					}
+				}
+			private:
+				const uint8_t* cur;
+				const uint32_t out;
+				uint32_t h;
+				size_t left;
+		};
 		
-		/* This is roughly how boost::hash does it */
-		size_t getPos(const string& s, size_t i, size_t l) const
+		/* Fibonacci hashing: the top bits of the product index the power of two table */
+		size_t getPos(uint32_t h) const
 		{
-			size_t h = 0;
-			const char* c = s.data() + i;
-			const char* end = s.data() + i + l;
-			for (; c < end; ++c)
-			{
-				h ^= *c + 0x9e3779b9 + (h << 6) + (h >> 2); //-V104
-			}
-			return (h % table.size());
+			return static_cast<uint32_t>(h * 0x9E3779B1U) >> shift;
 		}
 		
-		vector<bool> table;
+		vector<uint64_t> table;
+		vector<uint8_t> counters;
+		unsigned shift;
+		uint32_t outFactor;
 };
 
 } // namespace dcpp
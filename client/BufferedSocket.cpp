@@ -47,9 +47,21 @@ boost::atomic<long> BufferedSocket::sockets(0);
 
 BufferedSocket::~BufferedSocket()
 {
+	if (sock.get() && ThrottleManager::isValidInstance())
+	{
+		ThrottleManager::getInstance()->removeSocket(sock.get());
+	}
 	--sockets;
 }
 
+void BufferedSocket::setExtraSlot(bool p_extra_slot)
+{
+	if (hasSocket())
+	{
+		ThrottleManager::getInstance()->setClass(sock.get(), p_extra_slot ? ThrottleManager::CLASS_MINISLOT : ThrottleManager::CLASS_NORMAL);
+	}
+}
+
 void BufferedSocket::setMode(Modes aMode, size_t aRollback)
 {
 	if (mode == aMode)
@@ -64,6 +76,8 @@ void BufferedSocket::setMode(Modes aMode, size_t aRollback)
 			break;
 		case MODE_ZPIPE:
 			filterIn = std::unique_ptr<UnZFilter>(new UnZFilter);
+			if (zbuf.empty())
+				zbuf.resize(64 * 1024);
 			break;
 		case MODE_DATA:
 			break;
@@ -236,15 +250,14 @@ void BufferedSocket::threadRead()
 		{
 			case MODE_ZPIPE:
 			{
-				const int BUF_SIZE = 1024;
 				// Special to autodetect nmdc connections...
 				string::size_type pos = 0; //  warning C6246: Local declaration of 'pos' hides declaration of the same name in outer scope.
-				std::unique_ptr<char[]> buffer(new char[BUF_SIZE]);
+				char* buffer = reinterpret_cast<char*>(&zbuf[0]);
 				l = line;
 				// decompress all input data and store in l.
 				while (left)
 				{
-					size_t in = BUF_SIZE;
+					size_t in = zbuf.size();
 					size_t used = left;
 					bool ret = (*filterIn)(&inbuf[0] + total - left, used, &buffer[0], in);
 					left -= used;
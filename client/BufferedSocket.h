@@ -138,6 +138,8 @@ class BufferedSocket : public Speaker<BufferedSocketListener>, private Thread
 		{
 			return sock->getKeyprint();
 		}
+		/** Extra slot transfers get a bigger share of the throttled bandwidth */
+		void setExtraSlot(bool p_extra_slot);
 		
 		void write(const string& aData)
 		{
@@ -230,6 +232,7 @@ class BufferedSocket : public Speaker<BufferedSocketListener>, private Thread
 		ByteVector inbuf;
 		ByteVector writeBuf;
 		ByteVector sendBuf;
+		ByteVector zbuf; // [+] scratch buffer for MODE_ZPIPE, allocated once per socket
 		
 		string line;
 		int64_t dataBytes;
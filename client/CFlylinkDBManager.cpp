@@ -95,6 +95,9 @@ void CFlylinkDBManager::errorDB(const string& p_txt, bool p_critical)
 //========================================================================================================
 CFlylinkDBManager::CFlylinkDBManager()
 {
+	m_tree_cache_size = 0;
+	m_tree_cache_hits = 0;
+	m_tree_cache_misses = 0;
 	m_last_path_id = -1;
 	m_convert_ftype_stop_key = 0;
 	m_first_ratio_cache = false;
@@ -942,6 +945,15 @@ __int64 CFlylinkDBManager::getBlockSize(const TTHValue& p_root, __int64 p_size)
 	static int l_count = 0;
 	dcdebug("CFlylinkDBManager::getBlockSize TTH = %s [count = %d]\n", p_root.toBase32().c_str(), ++l_count);
 #endif
+	{
+		Lock l(m_tree_cache_cs);
+		CFlyTreeIndex::const_iterator i = m_tree_cache_index.find(p_root);
+		if (i != m_tree_cache_index.end())
+		{
+			++m_tree_cache_hits;
+			return i->second->getBlockSize();
+		}
+	}
 	Lock l(m_cs);
 	if (const __int64 l_tth_id = get_tth_id(p_root, false))
 	{
@@ -976,8 +988,67 @@ __int64 CFlylinkDBManager::getBlockSize(const TTHValue& p_root, __int64 p_size)
 	return l_blocksize;
 }
 //========================================================================================================
+// [+] Budget of the Tiger tree cache, in bytes of leaves
+static const size_t TREE_CACHE_SIZE = 8 * 1024 * 1024;
+// [+] Accounted per cached tree in addition to its leaves
+static const size_t TREE_CACHE_OVERHEAD = 128;
+
+static size_t getTreeCacheCost(const TigerTree& p_tt)
+{
+	return p_tt.getLeaves().size() * TTHValue::BYTES + TREE_CACHE_OVERHEAD;
+}
+
+bool CFlylinkDBManager::findCachedTree(const TTHValue& p_root, TigerTree& p_tt)
+{
+	Lock l(m_tree_cache_cs);
+	CFlyTreeIndex::const_iterator i = m_tree_cache_index.find(p_root);
+	if (i == m_tree_cache_index.end())
+	{
+		++m_tree_cache_misses;
+		return false;
+	}
+	++m_tree_cache_hits;
+	m_tree_cache.splice(m_tree_cache.begin(), m_tree_cache, i->second);
+	p_tt = *i->second;
+	return true;
+}
+//========================================================================================================
+void CFlylinkDBManager::addCachedTree(const TigerTree& p_tt)
+{
+	const size_t l_cost = getTreeCacheCost(p_tt);
+	if (l_cost > TREE_CACHE_SIZE / 8)
+		return;
+		
+	Lock l(m_tree_cache_cs);
+	removeCachedTree(p_tt.getRoot());
+	while (!m_tree_cache.empty() && m_tree_cache_size + l_cost > TREE_CACHE_SIZE)
+	{
+		m_tree_cache_size -= getTreeCacheCost(m_tree_cache.back());
+		m_tree_cache_index.erase(m_tree_cache.back().getRoot());
+		m_tree_cache.pop_back();
+	}
+	m_tree_cache.push_front(p_tt);
+	m_tree_cache_index[p_tt.getRoot()] = m_tree_cache.begin();
+	m_tree_cache_size += l_cost;
+}
+//========================================================================================================
+void CFlylinkDBManager::removeCachedTree(const TTHValue& p_root)
+{
+	Lock l(m_tree_cache_cs);
+	CFlyTreeIndex::iterator i = m_tree_cache_index.find(p_root);
+	if (i != m_tree_cache_index.end())
+	{
+		m_tree_cache_size -= getTreeCacheCost(*i->second);
+		m_tree_cache.erase(i->second);
+		m_tree_cache_index.erase(i);
+	}
+}
+//========================================================================================================
 bool CFlylinkDBManager::getTree(const TTHValue& p_root, TigerTree& p_tt)
 {
+	if (findCachedTree(p_root, p_tt))
+		return true;
+		
 	Lock l(m_cs);
 	if (const __int64 l_tth_id = get_tth_id(p_root, false))
 	{
@@ -997,6 +1068,7 @@ bool CFlylinkDBManager::getTree(const TTHValue& p_root, TigerTree& p_tt)
 				if (l_file_size <= MIN_BLOCK_SIZE)
 				{
 					p_tt = TigerTree(l_file_size, l_blocksize, p_root);
+					addCachedTree(p_tt);
 					return true;
 				}
 				vector<uint8_t> l_buf;
@@ -1004,7 +1076,10 @@ bool CFlylinkDBManager::getTree(const TTHValue& p_root, TigerTree& p_tt)
 				if (!l_buf.empty())
 				{
 					p_tt = TigerTree(l_file_size, l_blocksize, &l_buf[0], l_buf.size());
-					return p_tt.getRoot() == p_root;
+					if (p_tt.getRoot() != p_root)
+						return false;
+					addCachedTree(p_tt);
+					return true;
 				}
 				else
 					return false;
@@ -1173,6 +1248,7 @@ __int64 CFlylinkDBManager::addTree(const TigerTree& p_tt)
 		l_sql->bind(4, p_tt.getBlockSize());
 		l_sql->executenonquery();
 		l_trans.commit();
+		removeCachedTree(p_tt.getRoot());
 		return l_tth_id;
 	}
 	catch (const database_error& e)
@@ -1184,6 +1260,7 @@ __int64 CFlylinkDBManager::addTree(const TigerTree& p_tt)
 //========================================================================================================
 CFlylinkDBManager::~CFlylinkDBManager()
 {
+	dcdebug("CFlylinkDBManager tree cache: hits = " U64_FMT ", misses = " U64_FMT "\n", m_tree_cache_hits, m_tree_cache_misses);
 	flush_ratio();
 }
 //========================================================================================================
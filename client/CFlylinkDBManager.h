@@ -123,6 +123,17 @@ class CFlylinkDBManager : public Singleton<CFlylinkDBManager>
 		const TTHValue* get_tth(const __int64 p_tth_id);
 		bool getTree(const TTHValue& p_root, TigerTree& p_tt);
 		__int64 getBlockSize(const TTHValue& p_root, __int64 p_size);
+		// [+] Tiger tree cache statistics
+		uint64_t getTreeCacheHits() const
+		{
+			Lock l(m_tree_cache_cs);
+			return m_tree_cache_hits;
+		}
+		uint64_t getTreeCacheMisses() const
+		{
+			Lock l(m_tree_cache_cs);
+			return m_tree_cache_misses;
+		}
 		__int64 get_path_id(const string& p_path, bool p_create);
 		__int64 addTree(const TigerTree& tt);
 		const TTHValue* findTTH(const string& aPath, const string& aFileName);
@@ -143,6 +154,21 @@ class CFlylinkDBManager : public Singleton<CFlylinkDBManager>
 	private:
 		mutable CriticalSection m_cs;
 		sqlite3_connection m_flySQLiteDB;
+		
+		// [+] LRU cache of Tiger trees in front of getTree/getBlockSize, most recent first.
+		// Has its own lock so cache hits don't wait for hashing or ratio writes under m_cs.
+		typedef std::list<TigerTree> CFlyTreeList;
+		typedef unordered_map<TTHValue, CFlyTreeList::iterator> CFlyTreeIndex;
+		CFlyTreeList m_tree_cache;
+		CFlyTreeIndex m_tree_cache_index;
+		size_t m_tree_cache_size;
+		uint64_t m_tree_cache_hits;
+		uint64_t m_tree_cache_misses;
+		mutable CriticalSection m_tree_cache_cs;
+		bool findCachedTree(const TTHValue& p_root, TigerTree& p_tt);
+		void addCachedTree(const TigerTree& p_tt);
+		void removeCachedTree(const TTHValue& p_root);
+		
 		CFlyPathCache m_path_cache;
 		auto_ptr<sqlite3_command> m_add_tree_find;
 		auto_ptr<sqlite3_command> m_select_ratio_load;
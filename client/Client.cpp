@@ -36,7 +36,7 @@ boost::atomic<long> Client::counts[COUNT_UNCOUNTED];
 Client::Client(const string& hubURL, char separator_, bool secure_) :
 	myIdentity(ClientManager::getInstance()->getMe(), 0),
 	reconnDelay(120), lastActivity(GET_TICK()), registered(false), autoReconnect(false),
-	m_last_encoding(Text::systemCharset), state(STATE_DISCONNECTED), sock(0),
+	m_last_encoding(Text::systemCharset), state(STATE_DISCONNECTED), searchInterval(0), sock(0),
 	hubUrl(hubURL), port(0), separator(separator_),
 	secure(secure_), countType(COUNT_UNCOUNTED), availableBytes(0)
 {
@@ -322,31 +322,6 @@ string Client::getLocalIp() const
 	return localIp;
 }
 
-uint64_t Client::search(int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* owner)
-{
-	dcdebug("Queue search %s\n", aString.c_str());
-	
-	if (searchQueue.interval)
-	{
-		Search s;
-		s.fileType = aFileType;
-		s.size     = aSize;
-		s.query    = aString;
-		s.sizeType = aSizeMode;
-		s.token    = aToken;
-		s.exts     = aExtList;
-		s.owners.insert(owner);
-		
-		searchQueue.add(s);
-		
-		return searchQueue.getSearchTime(owner) - GET_TICK();
-	}
-	
-	search(aSizeMode, aSize, aFileType , aString, aToken, aExtList);
-	return 0;
-	
-}
-
 void Client::on(Line, const string& aLine) noexcept
 {
 	updateActivity();
@@ -360,18 +335,6 @@ void Client::on(Second, uint64_t aTick) noexcept
 		// Try to reconnect...
 		connect();
 	}
-	
-	if (!searchQueue.interval) return;
-	
-	if (isConnected())
-	{
-		Search s;
-		
-		if (searchQueue.pop(s))
-		{
-			search(s.sizeType, s.size, s.fileType , s.query, s.token, s.exts);
-		}
-	}
 }
 
 } // namespace dcpp
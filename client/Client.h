@@ -31,7 +31,6 @@
 #include "TimerManager.h"
 #include "ClientListener.h"
 #include "DebugManager.h"
-#include "SearchQueue.h"
 #include "OnlineUser.h"
 #include "BufferedSocket.h"
 #include "ChatMessage.h"
@@ -79,12 +78,6 @@ class Client : public ClientBase, public Speaker<ClientListener>, public Buffere
 		virtual void privateMessage(const OnlineUserPtr& user, const string& aMessage, bool thirdPerson = false) = 0;
 		virtual void sendUserCmd(const UserCommand& command, const StringMap& params) = 0;
 		
-		uint64_t search(int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* owner);
-		void cancelSearch(void* aOwner)
-		{
-			searchQueue.cancelSearch(aOwner);
-		}
-		
 		virtual void password(const string& pwd) = 0;
 		virtual void info(bool force) = 0;
 		
@@ -189,12 +182,12 @@ class Client : public ClientBase, public Speaker<ClientListener>, public Buffere
 		void setSearchInterval(uint32_t aInterval)
 		{
 			// min interval is 10 seconds
-			searchQueue.interval = max(aInterval + 2000, (uint32_t)(10 * 1000));
+			searchInterval = max(aInterval + 2000, (uint32_t)(10 * 1000));
 		}
 		
 		uint32_t getSearchInterval() const
 		{
-			return searchQueue.interval;
+			return searchInterval;
 		}
 		
 		void cheatMessage(const string& msg)
@@ -275,6 +268,7 @@ class Client : public ClientBase, public Speaker<ClientListener>, public Buffere
 		
 	protected:
 		friend class ClientManager;
+		friend class SearchQueue;
 		Client(const string& hubURL, char separator, bool secure_);
 		virtual ~Client();
 		
@@ -298,7 +292,8 @@ class Client : public ClientBase, public Speaker<ClientListener>, public Buffere
 			STATE_DISCONNECTED  ///< Nothing in particular
 		} state;
 		
-		SearchQueue searchQueue;
+		/** by milli-seconds, the searches to this hub are sent by SearchQueue no more often than that */
+		uint32_t searchInterval;
 		BufferedSocket* sock;
 		
 		int64_t availableBytes;
@@ -70,6 +70,22 @@ Client* ClientManager::getClient(const string& aHubURL)
 	return c;
 }
 
+Client* ClientManager::findOrCreateClient(const string& aHubURL, bool& p_created)
+{
+	Lock l_create(m_create_cs);
+	{
+		Lock l(cs);
+		Client::List::const_iterator i = clients.find(aHubURL);
+		if (i != clients.end())
+		{
+			p_created = false;
+			return i->second;
+		}
+	}
+	p_created = true;
+	return getClient(aHubURL);
+}
+
 void ClientManager::putClient(Client* aClient)
 {
 	fire(ClientManagerListener::ClientDisconnected(), aClient);
@@ -431,6 +447,7 @@ void ClientManager::putOffline(OnlineUser* ou, bool disconnect) noexcept
 		updateNick(*ou);
 		if (disconnect)
 			ConnectionManager::getInstance()->disconnect(u);
+		ConnectionManager::getInstance()->userOffline(u);
 		fire(ClientManagerListener::UserDisconnected(), u);
 	}
 }
@@ -682,49 +699,79 @@ void ClientManager::search(int aSizeMode, int64_t aSize, int aFileType, const st
 	if (BOOLSETTING(USE_DHT) && aFileType == SearchManager::TYPE_TTH)
 		dht::DHT::getInstance()->findFile(aString);
 		
-	Lock l(cs);
-	
-	for (auto i = clients.begin(); i != clients.end(); ++i)
-	{
-		Client* c = i->second;
-		if (c->isConnected())
-		{
-			c->search(aSizeMode, aSize, aFileType, aString, aToken, StringList() /*ExtList*/, aOwner);
-		}
-	}
+	queueSearch(StringList(), aSizeMode, aSize, aFileType, aString, aToken, StringList() /*ExtList*/, aOwner,
+	            aToken == "auto" ? SearchQueue::PRIORITY_AUTO : SearchQueue::PRIORITY_INTERACTIVE);
 }
 
-uint64_t ClientManager::search(StringList& who, int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* aOwner)
+uint64_t ClientManager::search(StringList& who, int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* aOwner, SearchQueue::Priority aPriority)
 {
 	if (BOOLSETTING(USE_DHT) && aFileType == SearchManager::TYPE_TTH)
 		dht::DHT::getInstance()->findFile(aString, aToken);
 		
-	Lock l(cs);
-	
-	uint64_t estimateSearchSpan = 0;
+	return queueSearch(who, aSizeMode, aSize, aFileType, aString, aToken, aExtList, aOwner, aPriority);
+}
 
-    if(who.empty()){
-        for(auto it = clients.cbegin(); it != clients.cend(); ++it){
-            if(it->second->isConnected()){
-			    uint64_t ret = it->second->search(aSizeMode, aSize, aFileType, aString, aToken, aExtList, aOwner);
-			    estimateSearchSpan = max(estimateSearchSpan, ret);
-            }
-        }
-        return estimateSearchSpan;
-    }
+uint64_t ClientManager::queueSearch(const StringList& who, int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* aOwner, SearchQueue::Priority aPriority)
+{
+	Search s;
+	s.fileType = aFileType;
+	s.size     = aSize;
+	s.query    = aString;
+	s.sizeType = aSizeMode;
+	s.token    = aToken;
+	s.exts     = aExtList;
+	s.owners.insert(aOwner);
 	
-	for (StringIter it = who.begin(); it != who.end(); ++it)
+	StringList l_hubs;
 	{
-		const string& client = *it;
+		Lock l(cs);
 		
-		auto i = clients.find(client);
-		if (i != clients.end() && i->second->isConnected())
+		if (who.empty())
 		{
-			uint64_t ret = i->second->search(aSizeMode, aSize, aFileType, aString, aToken, aExtList, aOwner);
-			estimateSearchSpan = max(estimateSearchSpan, ret);
+			for (auto i = clients.cbegin(); i != clients.cend(); ++i)
+			{
+				if (i->second->isConnected())
+					l_hubs.push_back(i->first);
+			}
+		}
+		else
+		{
+			for (auto it = who.cbegin(); it != who.cend(); ++it)
+			{
+				auto i = clients.find(*it);
+				if (i != clients.end() && i->second->isConnected())
+					l_hubs.push_back(i->first);
+			}
+		}
+		
+		// no interval yet, nothing to queue for
+		for (auto it = l_hubs.begin(); it != l_hubs.end();)
+		{
+			Client* c = clients.find(*it)->second;
+			if (c->getSearchInterval())
+			{
+				++it;
+				continue;
+			}
+			c->search(aSizeMode, aSize, aFileType, aString, aToken, aExtList);
+			it = l_hubs.erase(it);
 		}
 	}
 	
+	if (l_hubs.empty())
+		return 0;
+		
+	SearchQueue* l_queue = SearchQueue::getInstance();
+	l_queue->add(s, l_hubs, aPriority);
+	
+	uint64_t estimateSearchSpan = 0;
+	Lock l(cs);
+	for (auto it = l_hubs.cbegin(); it != l_hubs.cend(); ++it)
+	{
+		auto i = clients.find(*it);
+		if (i != clients.end())
+			estimateSearchSpan = max(estimateSearchSpan, l_queue->getSearchTime(*it, i->second->getSearchInterval(), aOwner));
+	}
 	return estimateSearchSpan;
 }
 
@@ -846,12 +893,7 @@ int ClientManager::getMode(const string& aHubUrl) const
 
 void ClientManager::cancelSearch(void* aOwner)
 {
-	Lock l(cs);
-	
-	for (auto i = clients.cbegin(); i != clients.cend(); ++i)
-	{
-		i->second->cancelSearch(aOwner);
-	}
+	SearchQueue::getInstance()->cancelSearch(aOwner);
 }
 
 OnlineUserPtr ClientManager::findDHTNode(const CID& cid) const
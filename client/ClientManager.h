@@ -22,6 +22,7 @@
 #include "TimerManager.h"
 
 #include "Client.h"
+#include "SearchQueue.h"
 #include "Singleton.h"
 #include "SettingsManager.h"
 #include "OnlineUser.h"
@@ -44,6 +45,8 @@ class ClientManager : public Speaker<ClientManagerListener>,
 {
 	public:
 		Client* getClient(const string& aHubURL);
+		/** Returns the hub already open for aHubURL, or creates it; p_created tells which one happened */
+		Client* findOrCreateClient(const string& aHubURL, bool& p_created);
 		void putClient(Client* aClient);
 		
 		StringList getHubs(const CID& cid, const string& hintUrl) const;
@@ -77,7 +80,12 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		bool isConnected(const string& aUrl) const;
 		
 		void search(int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, void* aOwner = 0);
-		uint64_t search(StringList& who, int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* aOwner = 0);
+		/**
+		 * Queue the search in SearchQueue for the hubs in who (all the connected ones if empty).
+		 * @return Milliseconds until the search goes out to the last of the hubs
+		 */
+		uint64_t search(StringList& who, int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* aOwner = 0,
+		                SearchQueue::Priority aPriority = SearchQueue::PRIORITY_INTERACTIVE);
 		
 		void cancelSearch(void* aOwner);
 		
@@ -187,6 +195,8 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		
 		Client::List clients;
 		mutable CriticalSection cs;
+		// Serializes findOrCreateClient; a hub isn't created under cs since its constructor registers with TimerManager
+		CriticalSection m_create_cs;
 		
 		UserMap users;
 		OnlineMap onlineUsers;
@@ -209,6 +219,8 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		}
 		
 		void updateNick(const OnlineUser& user) noexcept;
+		uint64_t queueSearch(const StringList& who, int aSizeMode, int64_t aSize, int aFileType, const string& aString, const string& aToken, const StringList& aExtList, void* aOwner,
+		                     SearchQueue::Priority aPriority);
 		
 		/// @return OnlineUser* found by CID and hint; discard any user that doesn't match the hint.
 		OnlineUser* findOnlineUserHint(const CID& cid, const string& hintUrl) const
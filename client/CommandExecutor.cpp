@@ -0,0 +1,105 @@
+#include "stdinc.h"
+#include "CommandExecutor.h"
+
+#include "LogManager.h"
+
+namespace dcpp
+{
+
+CommandExecutor::CommandExecutor() : m_stop(false)
+{
+	for (size_t i = 0; i < WORKERS; ++i)
+	{
+		unique_ptr<Worker> l_worker(new Worker(*this));
+		try
+		{
+			l_worker->start();
+			m_workers.push_back(move(l_worker));
+		}
+		catch (const ThreadException& e)
+		{
+			LogManager::getInstance()->message("CommandExecutor: " + e.getError()); // [!] TODO translate
+		}
+	}
+}
+
+CommandExecutor::~CommandExecutor()
+{
+	shutdown();
+}
+
+bool CommandExecutor::post(unique_ptr<Command>&& p_command)
+{
+	{
+		Lock l(m_cs);
+		if (m_stop || m_workers.empty() || m_commands.size() >= MAX_QUEUED)
+			return false;
+		m_commands.push_back(move(p_command));
+	}
+	m_sem.signal();
+	return true;
+}
+
+void CommandExecutor::shutdown()
+{
+	// post() reads m_workers under the lock, so they are taken out under it too
+	vector<unique_ptr<Worker>> l_workers;
+	{
+		Lock l(m_cs);
+		m_stop = true;
+		l_workers.swap(m_workers);
+	}
+	for (size_t i = 0; i < l_workers.size(); ++i)
+	{
+		m_sem.signal();
+	}
+	for (auto i = l_workers.begin(); i != l_workers.end(); ++i)
+	{
+		(*i)->join();
+	}
+
+	Lock l(m_cs);
+	m_commands.clear();
+}
+
+size_t CommandExecutor::getQueued() const
+{
+	Lock l(m_cs);
+	return m_commands.size();
+}
+
+unique_ptr<CommandExecutor::Command> CommandExecutor::take()
+{
+	Lock l(m_cs);
+	if (m_commands.empty())
+		return unique_ptr<Command>();
+	unique_ptr<Command> l_command = move(m_commands.front());
+	m_commands.pop_front();
+	return l_command;
+}
+
+int CommandExecutor::Worker::run()
+{
+	while (!m_executor.m_stop)
+	{
+		m_executor.m_sem.wait();
+		if (m_executor.m_stop)
+			break;
+
+		unique_ptr<Command> l_command = m_executor.take();
+		if (!l_command)
+			continue;
+
+		try
+		{
+			l_command->execute();
+		}
+		catch (const Exception& e)
+		{
+			LogManager::getInstance()->message("CommandExecutor: " + e.getError()); // [!] TODO translate
+		}
+	}
+	return 0;
+}
+
+} // namespace dcpp
@@ -0,0 +1,72 @@
+#ifndef DCPLUSPLUS_DCPP_COMMAND_EXECUTOR_H
+#define DCPLUSPLUS_DCPP_COMMAND_EXECUTOR_H
+
+#include <boost/atomic.hpp>
+
+#include "Singleton.h"
+#include "Thread.h"
+#include "Semaphore.h"
+
+namespace dcpp
+{
+
+/**
+ * Runs commands of the remote control (RPC) clients on its own threads.
+ * The commands call the managers directly, so they don't wait for the UI message loop.
+ * The queue is bounded: when it's full, post() refuses the command and the caller
+ * reports it instead of piling up work.
+ */
+class CommandExecutor : public Singleton<CommandExecutor>
+{
+	public:
+		class Command
+		{
+			public:
+				virtual ~Command() { }
+				virtual void execute() = 0;
+		};
+
+		/**
+		 * Queue a command, any thread may post.
+		 * @return False if the queue is full or the executor is shutting down
+		 */
+		bool post(unique_ptr<Command>&& p_command);
+
+		/** Stop the workers, the commands still queued are dropped */
+		void shutdown();
+
+		size_t getQueued() const;
+
+	private:
+		friend class Singleton<CommandExecutor>;
+
+		CommandExecutor();
+		~CommandExecutor();
+
+		enum
+		{
+			WORKERS = 2,
+			MAX_QUEUED = 256
+		};
+
+		class Worker : public Thread
+		{
+			public:
+				explicit Worker(CommandExecutor& p_executor) : m_executor(p_executor) { }
+			private:
+				int run();
+				CommandExecutor& m_executor;
+		};
+
+		unique_ptr<Command> take();
+
+		deque<unique_ptr<Command>> m_commands;
+		mutable CriticalSection m_cs;
+		Semaphore m_sem;
+		boost::atomic<bool> m_stop;
+		vector<unique_ptr<Worker>> m_workers;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_COMMAND_EXECUTOR_H)
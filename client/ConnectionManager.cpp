@@ -33,8 +33,9 @@ namespace dcpp
 
 uint16_t ConnectionManager::iConnToMeCount = 0;
 
-ConnectionManager::ConnectionManager() : floodCounter(0), server(0), secureServer(0), shuttingDown(false)
+ConnectionManager::ConnectionManager() : inFlight(0), floodCounter(0), server(0), secureServer(0), shuttingDown(false)
 {
+	memzero(&attemptStats, sizeof(attemptStats));
 	TimerManager::getInstance()->addListener(this);
 	
 	features.push_back(UserConnection::FEATURE_MINISLOTS);
@@ -93,6 +94,7 @@ ConnectionQueueItem* ConnectionManager::getCQI(const HintedUser& aUser, bool dow
 	{
 		dcassert(find(downloads.begin(), downloads.end(), aUser.user) == downloads.end());
 		downloads.push_back(cqi);
+		scheduleAttempt(cqi, GET_TICK());
 	}
 	else
 	{
@@ -111,6 +113,9 @@ void ConnectionManager::putCQI(ConnectionQueueItem* cqi)
 	{
 		dcassert(find(downloads.begin(), downloads.end(), cqi) != downloads.end());
 		downloads.erase(remove(downloads.begin(), downloads.end(), cqi), downloads.end());
+		if (cqi->getState() == ConnectionQueueItem::CONNECTING)
+			--inFlight;
+		unschedule(cqi);
 	}
 	else
 	{
@@ -144,99 +149,163 @@ void ConnectionManager::putConnection(UserConnection* aConn)
 	userConnections.erase(remove(userConnections.begin(), userConnections.end(), aConn), userConnections.end());
 }
 
+uint64_t ConnectionManager::getRetryDelay(int aErrors)
+{
+	const int l_shift = min(max(aErrors, 1) - 1, 5);
+	return min<uint64_t>(static_cast<uint64_t>(RETRY_DELAY) << l_shift, MAX_RETRY_DELAY) + Util::rand(5000);
+}
+
+void ConnectionManager::unschedule(ConnectionQueueItem* cqi)
+{
+	const Schedule::value_type l_key(cqi->deadline, cqi);
+	attemptSchedule.erase(l_key);
+	timeoutSchedule.erase(l_key);
+}
+
+void ConnectionManager::scheduleAttempt(ConnectionQueueItem* cqi, uint64_t aTime)
+{
+	dcassert(cqi->getDownload() && cqi->getState() != ConnectionQueueItem::CONNECTING);
+	unschedule(cqi);
+	cqi->deadline = aTime;
+	attemptSchedule.insert(make_pair(aTime, cqi));
+}
+
+void ConnectionManager::setDownloadState(ConnectionQueueItem* cqi, ConnectionQueueItem::State aState)
+{
+	if (cqi->getState() == ConnectionQueueItem::CONNECTING)
+	{
+		dcassert(inFlight > 0);
+		--inFlight;
+	}
+	unschedule(cqi);
+	cqi->setState(aState);
+	if (aState == ConnectionQueueItem::CONNECTING)
+	{
+		++inFlight;
+		cqi->deadline = cqi->getLastAttempt() + CONNECT_TIMEOUT;
+		timeoutSchedule.insert(make_pair(cqi->deadline, cqi));
+	}
+}
+
+ConnectionManager::AttemptStats ConnectionManager::getAttemptStats() const
+{
+	Lock l(cs);
+	AttemptStats l_stats = attemptStats;
+	l_stats.m_in_flight = inFlight;
+	l_stats.m_waiting = attemptSchedule.size();
+	return l_stats;
+}
+
 void ConnectionManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept
 {
-	UserList passiveUsers;
 	ConnectionQueueItem::List removed;
 	
 	{
 		Lock l(cs);
 		
-		uint16_t attempts = 0;
+		while (!timeoutSchedule.empty() && timeoutSchedule.begin()->first < aTick)
+		{
+			ConnectionQueueItem* cqi = timeoutSchedule.begin()->second;
+			ClientManager::getInstance()->connectionTimeout(cqi->getUser());
+			
+			cqi->setErrors(cqi->getErrors() + 1);
+			++attemptStats.m_timeouts;
+			fire(ConnectionManagerListener::Failed(), cqi, STRING(CONNECTION_TIMEOUT));
+			setDownloadState(cqi, ConnectionQueueItem::WAITING);
+			scheduleAttempt(cqi, max(cqi->getLastAttempt() + getRetryDelay(cqi->getErrors()), aTick + 1000));
+		}
 		
-		for (ConnectionQueueItem::Iter i = downloads.begin(); i != downloads.end(); ++i)
+		// only the items whose time has come are looked at, the limits leave the rest for the next seconds
+		const int l_per_second = SETTING(DOWNCONN_PER_SEC);
+		int l_attempts = 0;
+		int l_checks = 0;
+		int l_deferrals = 0;
+		unordered_map<string, int> l_hub_attempts;
+		ConnectionQueueItem::List l_postponed;
+		
+		while (!attemptSchedule.empty() && attemptSchedule.begin()->first <= aTick && l_checks < MAX_CHECKS &&
+		        l_deferrals < MAX_DEFERRALS && inFlight < MAX_IN_FLIGHT && (l_per_second == 0 || l_attempts < l_per_second))
 		{
-			ConnectionQueueItem* cqi = *i;
+			ConnectionQueueItem* cqi = attemptSchedule.begin()->second;
+			attemptSchedule.erase(attemptSchedule.begin());
+			++l_checks;
 			
-			if (cqi->getState() != ConnectionQueueItem::ACTIVE)
+			if (!cqi->getUser().user->isOnline())
 			{
-				if (!cqi->getUser().user->isOnline())
-				{
-					// Not online anymore...remove it from the pending...
-					removed.push_back(cqi);
-					continue;
-				}
-				
-				/*if(   cqi->getUser().user->isSet(User::PASSIVE) &&
-				    !ClientManager::getInstance()->isActive(cqi->getUser().hint))
-				{
-				    passiveUsers.push_back(cqi->getUser());
-				    removed.push_back(cqi);
-				    continue;
-				}*/
-				
-				if (cqi->getErrors() == -1 && cqi->getLastAttempt() != 0)
+				// Not online anymore...remove it from the pending...
+				removed.push_back(cqi);
+				continue;
+			}
+			
+			if (cqi->getErrors() == -1 && cqi->getLastAttempt() != 0)
+			{
+				// protocol error, don't reconnect except after a forced attempt
+				scheduleAttempt(cqi, aTick + MAX_RETRY_DELAY);
+				continue;
+			}
+			
+			int& l_hub = l_hub_attempts[cqi->getUser().hint];
+			if (cqi->getState() == ConnectionQueueItem::WAITING && l_hub >= MAX_HUB_ATTEMPTS)
+			{
+				// a busy hub does not use up the checks of the others; the put off items go behind
+				// everything due now, so stopping at MAX_DEFERRALS doesn't starve the other hubs
+				--l_checks;
+				++l_deferrals;
+				l_postponed.push_back(cqi);
+				continue;
+			}
+			
+			cqi->setLastAttempt(aTick);
+			
+			QueueItem::Priority prio = QueueManager::getInstance()->hasDownload(cqi->getUser());
+			
+			if (prio == QueueItem::PAUSED)
+			{
+				removed.push_back(cqi);
+				continue;
+			}
+			
+			bool startDown = DownloadManager::getInstance()->startDownload(prio);
+			
+			if (cqi->getState() == ConnectionQueueItem::WAITING)
+			{
+				if (startDown)
 				{
-					// protocol error, don't reconnect except after a forced attempt
+					setDownloadState(cqi, ConnectionQueueItem::CONNECTING);
+					ClientManager::getInstance()->connect(cqi->getUser(), cqi->getToken());
+					fire(ConnectionManagerListener::StatusChanged(), cqi);
+					++l_attempts;
+					++l_hub;
+					++attemptStats.m_attempts;
 					continue;
 				}
-				
-				if (cqi->getLastAttempt() == 0 || ((SETTING(DOWNCONN_PER_SEC) == 0 || attempts < SETTING(DOWNCONN_PER_SEC)) &&
-				                                   cqi->getLastAttempt() + 60 * 1000 * max(1, cqi->getErrors()) < aTick))
-				{
-					cqi->setLastAttempt(aTick);
-					
-					QueueItem::Priority prio = QueueManager::getInstance()->hasDownload(cqi->getUser());
-					
-					if (prio == QueueItem::PAUSED)
-					{
-						removed.push_back(cqi);
-						continue;
-					}
-					
-					bool startDown = DownloadManager::getInstance()->startDownload(prio);
-					
-					if (cqi->getState() == ConnectionQueueItem::WAITING)
-					{
-						if (startDown)
-						{
-							cqi->setState(ConnectionQueueItem::CONNECTING);
-							ClientManager::getInstance()->connect(cqi->getUser(), cqi->getToken());
-							fire(ConnectionManagerListener::StatusChanged(), cqi);
-							attempts++;
-						}
-						else
-						{
-							cqi->setState(ConnectionQueueItem::NO_DOWNLOAD_SLOTS);
-							fire(ConnectionManagerListener::Failed(), cqi, STRING(ALL_DOWNLOAD_SLOTS_TAKEN));
-						}
-					}
-					else if (cqi->getState() == ConnectionQueueItem::NO_DOWNLOAD_SLOTS && startDown)
-					{
-						cqi->setState(ConnectionQueueItem::WAITING);
-					}
-				}
-				else if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt() + 50 * 1000 < aTick)
-				{
-					ClientManager::getInstance()->connectionTimeout(cqi->getUser());
-					
-					cqi->setErrors(cqi->getErrors() + 1);
-					fire(ConnectionManagerListener::Failed(), cqi, STRING(CONNECTION_TIMEOUT));
-					cqi->setState(ConnectionQueueItem::WAITING);
-				}
+				cqi->setState(ConnectionQueueItem::NO_DOWNLOAD_SLOTS);
+				fire(ConnectionManagerListener::Failed(), cqi, STRING(ALL_DOWNLOAD_SLOTS_TAKEN));
+				scheduleAttempt(cqi, aTick + getRetryDelay(cqi->getErrors()));
+			}
+			else if (startDown)
+			{
+				// a slot is free, connect on the next second
+				cqi->setState(ConnectionQueueItem::WAITING);
+				scheduleAttempt(cqi, aTick + 1000);
+			}
+			else
+			{
+				scheduleAttempt(cqi, aTick + getRetryDelay(cqi->getErrors()));
 			}
 		}
 		
+		// the hub had its share of this second, its items are looked at again on the next one
+		for (auto i = l_postponed.cbegin(); i != l_postponed.cend(); ++i)
+		{
+			scheduleAttempt(*i, aTick + 1000);
+		}
+		attemptStats.m_hub_deferred += l_postponed.size();
+		
 		for (ConnectionQueueItem::Iter m = removed.begin(); m != removed.end(); ++m)
 		{
 			putCQI(*m);
 		}
-		
-	}
-	
-	for (UserList::iterator ui = passiveUsers.begin(); ui != passiveUsers.end(); ++ui)
-	{
-		QueueManager::getInstance()->removeSource(*ui, QueueItem::Source::FLAG_PASSIVE);
 	}
 }
 
@@ -762,7 +831,9 @@ void ConnectionManager::addDownloadConnection(UserConnection* uc)
 			cqi = *i;
 			if (cqi->getState() == ConnectionQueueItem::WAITING || cqi->getState() == ConnectionQueueItem::CONNECTING)
 			{
-				cqi->setState(ConnectionQueueItem::ACTIVE);
+				if (cqi->getState() == ConnectionQueueItem::CONNECTING)
+					++attemptStats.m_connected;
+				setDownloadState(cqi, ConnectionQueueItem::ACTIVE);
 				uc->setFlag(UserConnection::FLAG_ASSOCIATED);
 				
 #ifdef FLYLINKDC_USE_CONNECTED_EVENT
@@ -921,12 +992,30 @@ void ConnectionManager::force(const UserPtr& aUser)
 	Lock l(cs);
 	
 	ConnectionQueueItem::Iter i = find(downloads.begin(), downloads.end(), aUser);
-	if (i == downloads.end())
+	if (i == downloads.end() || (*i)->getState() == ConnectionQueueItem::ACTIVE)
 	{
 		return;
 	}
 	
 	(*i)->setLastAttempt(0);
+	if ((*i)->getState() == ConnectionQueueItem::CONNECTING)
+		setDownloadState(*i, ConnectionQueueItem::WAITING);
+	scheduleAttempt(*i, 0);
+}
+
+/**
+ * The user left the last hub, the pending download connection goes away with its backoff,
+ * getDownloadConnection starts a fresh one as soon as the user is back.
+ */
+void ConnectionManager::userOffline(const UserPtr& aUser)
+{
+	Lock l(cs);
+	
+	ConnectionQueueItem::Iter i = find(downloads.begin(), downloads.end(), aUser);
+	if (i != downloads.end() && (*i)->getState() != ConnectionQueueItem::ACTIVE)
+	{
+		putCQI(*i);
+	}
 }
 
 bool ConnectionManager::checkKeyprint(UserConnection *aSource)
@@ -976,9 +1065,11 @@ void ConnectionManager::failed(UserConnection* aSource, const string& aError, bo
 			ConnectionQueueItem::Iter i = find(downloads.begin(), downloads.end(), aSource->getUser());
 			dcassert(i != downloads.end());
 			ConnectionQueueItem* cqi = *i;
-			cqi->setState(ConnectionQueueItem::WAITING);
+			setDownloadState(cqi, ConnectionQueueItem::WAITING);
 			cqi->setLastAttempt(GET_TICK());
 			cqi->setErrors(protocolError ? -1 : (cqi->getErrors() + 1));
+			// after a protocol error it's only checked whether the user is still online
+			scheduleAttempt(cqi, cqi->getLastAttempt() + (protocolError ? static_cast<uint64_t>(MAX_RETRY_DELAY) : getRetryDelay(cqi->getErrors())));
 			fire(ConnectionManagerListener::Failed(), cqi, aError);
 		}
 		else if (aSource->isSet(UserConnection::FLAG_UPLOAD))
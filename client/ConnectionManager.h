@@ -51,7 +51,7 @@ class ConnectionQueueItem
 		};
 		
 		ConnectionQueueItem(const HintedUser& aUser, bool aDownload) : token(Util::toString(Util::rand())),
-			lastAttempt(0), errors(0), state(WAITING), download(aDownload), user(aUser) { }
+			lastAttempt(0), errors(0), state(WAITING), download(aDownload), deadline(0), user(aUser) { }
 			
 		GETSET(string, token, Token);
 		GETSET(uint64_t, lastAttempt, LastAttempt);
@@ -65,6 +65,9 @@ class ConnectionQueueItem
 		}
 		
 	private:
+		friend class ConnectionManager;
+		/** When ConnectionManager looks at the item next, its key in the schedule */
+		uint64_t deadline;
 		HintedUser user;
 };
 
@@ -122,6 +125,7 @@ class ConnectionManager : public Speaker<ConnectionManagerListener>,
 		
 		void getDownloadConnection(const HintedUser& aUser);
 		void force(const UserPtr& aUser);
+		void userOffline(const UserPtr& aUser);
 		
 		void disconnect(const UserPtr& aUser); // disconnect downloads and uploads
 		void disconnect(const UserPtr& aUser, int isDownload);
@@ -145,7 +149,33 @@ class ConnectionManager : public Speaker<ConnectionManagerListener>,
 			return secureServer ? static_cast<uint16_t>(secureServer->getPort()) : 0;
 		}
 		static uint16_t iConnToMeCount;
+		
+		struct AttemptStats
+		{
+			uint64_t m_attempts;   // ConnectToMe / CTM sent for downloads
+			uint64_t m_connected;  // attempts answered with a download connection
+			uint64_t m_timeouts;   // attempts nobody answered
+			uint64_t m_hub_deferred; // attempts postponed by the limit of their hub
+			size_t m_in_flight;
+			size_t m_waiting;
+		};
+		AttemptStats getAttemptStats() const;
+		
 	private:
+		enum
+		{
+			/** Attempts waiting for an answer at the same time */
+			MAX_IN_FLIGHT = 64,
+			/** ConnectToMe / CTM per hub and second, the hubs kick for flooding */
+			MAX_HUB_ATTEMPTS = 5,
+			/** Items looked at per second at most, each asks QueueManager for the download */
+			MAX_CHECKS = 200,
+			/** Items of busy hubs put off per second at most, the rest stay due for the next second */
+			MAX_DEFERRALS = 200,
+			CONNECT_TIMEOUT = 50 * 1000,
+			RETRY_DELAY = 60 * 1000,
+			MAX_RETRY_DELAY = 32 * 60 * 1000
+		};
 	
 		class Server : public Thread
 		{
@@ -172,12 +202,19 @@ class ConnectionManager : public Speaker<ConnectionManagerListener>,
 		
 		friend class Server;
 		
-		CriticalSection cs;
+		mutable CriticalSection cs;
 		
 		/** All ConnectionQueueItems */
 		ConnectionQueueItem::List downloads;
 		ConnectionQueueItem::List uploads;
 		
+		/** Downloads by deadline: the next attempt of the waiting ones, the timeout of the connecting ones */
+		typedef set<pair<uint64_t, ConnectionQueueItem*> > Schedule;
+		Schedule attemptSchedule;
+		Schedule timeoutSchedule;
+		size_t inFlight;
+		AttemptStats attemptStats;
+		
 		/** All active connections */
 		UserConnectionList userConnections;
 		
@@ -211,6 +248,13 @@ class ConnectionManager : public Speaker<ConnectionManagerListener>,
 		ConnectionQueueItem* getCQI(const HintedUser& aUser, bool download);
 		void putCQI(ConnectionQueueItem* cqi);
 		
+		/** State of a download, keeps the count of the attempts in flight and the schedules */
+		void setDownloadState(ConnectionQueueItem* cqi, ConnectionQueueItem::State aState);
+		void scheduleAttempt(ConnectionQueueItem* cqi, uint64_t aTime);
+		void unschedule(ConnectionQueueItem* cqi);
+		/** Exponential in the number of errors, with some jitter so that the retries don't come in bursts */
+		static uint64_t getRetryDelay(int aErrors);
+		
 		void accept(const Socket& sock, bool secure) noexcept;
 		
 		bool checkKeyprint(UserConnection *aSource);
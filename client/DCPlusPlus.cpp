@@ -42,6 +42,8 @@
 #include "DetectionManager.h"
 #include "WebServerManager.h"
 #include "ThrottleManager.h"
+#include "CommandExecutor.h"
+#include "TransferStats.h"
 #include "File.h"
 
 #include "../dht/dht.h"
@@ -53,6 +55,94 @@
 namespace dcpp
 {
 
+/**
+ * One load of the startup. The loads of a phase don't depend on each other and run
+ * on threads of their own, the next phase starts when all of them are done.
+ */
+class StartupTask : public Thread
+{
+	public:
+		typedef void (*Func)();
+		
+		StartupTask(const char* p_name, Func p_func) : m_name(p_name), m_func(p_func), m_time(0) { }
+		
+		void execute()
+		{
+			const uint64_t l_start = GET_TICK();
+			m_func();
+			m_time = GET_TICK() - l_start;
+		}
+		const char* getName() const
+		{
+			return m_name;
+		}
+		uint64_t getTime() const
+		{
+			return m_time;
+		}
+	private:
+		int run()
+		{
+			execute();
+			return 0;
+		}
+		
+		const char* m_name;
+		const Func m_func;
+		uint64_t m_time;
+};
+
+/** Run the tasks of a phase, the first one on the calling thread, and log how long each took */
+static void runPhase(const char* p_phase, StartupTask** p_tasks, size_t p_count)
+{
+	const uint64_t l_start = GET_TICK();
+	for (size_t i = 1; i < p_count; ++i)
+	{
+		try
+		{
+			p_tasks[i]->start();
+		}
+		catch (const ThreadException&)
+		{
+			p_tasks[i]->execute();
+		}
+	}
+	p_tasks[0]->execute();
+	string l_times;
+	for (size_t i = 0; i < p_count; ++i)
+	{
+		p_tasks[i]->join();
+		l_times += (i ? ", " : " (") + string(p_tasks[i]->getName()) + ' ' + Util::toString(p_tasks[i]->getTime()) + " ms";
+	}
+	LogManager::getInstance()->message("Startup: " + string(p_phase) + ' ' + Util::toString(GET_TICK() - l_start) + " ms" + l_times + ')'); // [!] TODO translate
+}
+
+static void loadLocations()
+{
+	Util::load_customlocations(); //[+]FlylinkDC++
+	Util::load_compress_ext();//[+]FlylinkDC++
+}
+
+static void loadFavorites()
+{
+	FavoriteManager::getInstance()->load();
+}
+
+static void loadCertificates()
+{
+	CryptoManager::getInstance()->loadCertificates();
+}
+
+static void loadShare()
+{
+	ShareManager::getInstance()->refresh(true, false, true);
+}
+
+static void loadQueue()
+{
+	QueueManager::getInstance()->loadQueue();
+}
+
 void startup(void (*f)(void*, const tstring&), void* p)
 {
 	// "Dedicated to the near-memory of Nev. Let's start remembering people while they're still alive."
@@ -72,12 +162,15 @@ void startup(void (*f)(void*, const tstring&), void* p)
 	
 	LogManager::newInstance();
 	g_fly_server_config.loadConfig();
+	const uint64_t l_start = GET_TICK();
 	CFlylinkDBManager::newInstance();
+	const uint64_t l_database = GET_TICK() - l_start;
 	TimerManager::newInstance();
 	HashManager::newInstance();
 	CryptoManager::newInstance();
 	SearchManager::newInstance();
 	ClientManager::newInstance();
+	SearchQueue::newInstance();
 	ConnectionManager::newInstance();
 	DownloadManager::newInstance();
 	UploadManager::newInstance();
@@ -86,6 +179,8 @@ void startup(void (*f)(void*, const tstring&), void* p)
 	ShareManager::newInstance();
 	FavoriteManager::newInstance();
 	FinishedManager::newInstance();
+	TransferStats::newInstance();
+	// ADLSearch.xml, Profiles.xml, IPGuard.xml and IPTrust.ini are read on first use
 	ADLSearchManager::newInstance();
 	ConnectivityManager::newInstance();
 	MappingManager::newInstance();
@@ -94,6 +189,7 @@ void startup(void (*f)(void*, const tstring&), void* p)
 	PopupManager::newInstance();
 	IpGuard::newInstance();
 	PGLoader::newInstance();
+	CommandExecutor::newInstance();
 	
 	SettingsManager::getInstance()->load();
 	
@@ -107,13 +203,15 @@ void startup(void (*f)(void*, const tstring&), void* p)
 	else
 		ResourceManager::getInstance()->loadLanguage("Russian.xml");
 		
-		
-	Util::load_customlocations(); //[+]FlylinkDC++
-	Util::load_compress_ext();//[+]FlylinkDC++
-	FavoriteManager::getInstance()->load();
+	LogManager::getInstance()->message("Startup: managers " + Util::toString(GET_TICK() - l_start) + " ms (database " + Util::toString(l_database) + " ms)"); // [!] TODO translate
 	
-	CryptoManager::getInstance()->loadCertificates();
-	DetectionManager::getInstance()->load();
+	{
+		StartupTask l_favorites("favorites", &loadFavorites);
+		StartupTask l_certificates("certificates", &loadCertificates);
+		StartupTask l_locations("locations", &loadLocations);
+		StartupTask* l_tasks[] = { &l_favorites, &l_certificates, &l_locations };
+		runPhase("settings", l_tasks, _countof(l_tasks));
+	}
 	WebServerManager::newInstance();
 	
 	DHT::newInstance();
@@ -123,14 +221,20 @@ void startup(void (*f)(void*, const tstring&), void* p)
 	HashManager::getInstance()->startup();
 	if (f != NULL)
 		(*f)(p, TSTRING(SHARED_FILES));
-	ShareManager::getInstance()->refresh(true, false, true);
-	if (f != NULL)
-		(*f)(p, TSTRING(DOWNLOAD_QUEUE));
-	QueueManager::getInstance()->loadQueue();
+	{
+		// the share is mapped from Share.dat (or parsed from files.xml.bz2) while the queue loads
+		StartupTask l_share("share", &loadShare);
+		StartupTask l_queue("queue", &loadQueue);
+		StartupTask* l_tasks[] = { &l_share, &l_queue };
+		runPhase("share and queue", l_tasks, _countof(l_tasks));
+	}
+	LogManager::getInstance()->message("Startup: " + Util::toString(GET_TICK() - l_start) + " ms"); // [!] TODO translate
 }
 
 void shutdown()
 {
+	// remote commands call the managers, so they go first
+	CommandExecutor::deleteInstance();
 	TimerManager::getInstance()->shutdown();
 	HashManager::getInstance()->shutdown();
 	ConnectionManager::getInstance()->shutdown();
@@ -149,6 +253,7 @@ void shutdown()
 	IpGuard::deleteInstance();
 	PopupManager::deleteInstance();
 	ADLSearchManager::deleteInstance();
+	TransferStats::deleteInstance();
 	FinishedManager::deleteInstance();
 	ShareManager::deleteInstance();
 	CryptoManager::deleteInstance();
@@ -157,6 +262,7 @@ void shutdown()
 	UploadManager::deleteInstance();
 	QueueManager::deleteInstance();
 	ConnectionManager::deleteInstance();
+	SearchQueue::deleteInstance();
 	SearchManager::deleteInstance();
 	FavoriteManager::deleteInstance();
 	ClientManager::deleteInstance();
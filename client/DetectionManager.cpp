@@ -28,6 +28,7 @@ namespace dcpp
 
 void DetectionManager::load()
 {
+	loaded = true;
 	try
 	{
 		Util::migrate(Util::getPath(Util::PATH_USER_CONFIG) + "Profiles.xml");
@@ -189,6 +190,7 @@ const DetectionManager::DetectionItems& DetectionManager::reload()
 const DetectionManager::DetectionItems& DetectionManager::reloadFromHttp(bool bz2 /*= false*/)
 {
 	Lock l(cs);
+	ensureLoaded();
 	if (bz2)
 		loadCompressedProfiles();
 		
@@ -346,6 +348,10 @@ void DetectionManager::importProfiles(SimpleXML& xml)
 
 void DetectionManager::save()
 {
+	// never read, so nothing changed either
+	if (!loaded)
+		return;
+		
 	try
 	{
 		SimpleXML xml;
@@ -454,6 +460,12 @@ void DetectionManager::save()
 	}
 }
 
+void DetectionManager::ensureLoaded()
+{
+	if (!loaded)
+		load();
+}
+
 void DetectionManager::loadCompressedProfiles()
 {
 	string xml;
@@ -495,6 +507,7 @@ void DetectionManager::loadCompressedProfiles()
 void DetectionManager::addDetectionItem(DetectionEntry& e)
 {
 	Lock l(cs);
+	ensureLoaded();
 	if (det.size() >= 2147483647)
 		throw Exception("No more items can be added!");
 		
@@ -575,6 +588,7 @@ void DetectionManager::validateItem(const DetectionEntry& e, bool checkIds)
 void DetectionManager::removeDetectionItem(const uint32_t id) noexcept
 {
 	Lock l(cs);
+	ensureLoaded();
 	for (auto i = det.cbegin(); i != det.cend(); ++i)
 	{
 		if (i->Id == id)
@@ -588,6 +602,7 @@ void DetectionManager::removeDetectionItem(const uint32_t id) noexcept
 void DetectionManager::updateDetectionItem(const uint32_t aOrigId, const DetectionEntry& e)
 {
 	Lock l(cs);
+	ensureLoaded();
 	validateItem(e, e.Id != aOrigId);
 	for (auto i = det.begin(); i != det.end(); ++i)
 	{
@@ -602,6 +617,7 @@ void DetectionManager::updateDetectionItem(const uint32_t aOrigId, const Detecti
 bool DetectionManager::getDetectionItem(const uint32_t aId, DetectionEntry& e) noexcept
 {
 	Lock l(cs);
+	ensureLoaded();
 	for (auto i = det.cbegin(); i != det.cend(); ++i)
 	{
 		if (i->Id == aId)
@@ -616,6 +632,7 @@ bool DetectionManager::getDetectionItem(const uint32_t aId, DetectionEntry& e) n
 bool DetectionManager::getNextDetectionItem(const uint32_t aId, int pos, DetectionEntry& e) noexcept
 {
 	Lock l(cs);
+	ensureLoaded();
 	for (auto i = det.cbegin(); i != det.cend(); ++i)
 	{
 		if (i->Id == aId)
@@ -635,6 +652,7 @@ bool DetectionManager::getNextDetectionItem(const uint32_t aId, int pos, Detecti
 bool DetectionManager::moveDetectionItem(const uint32_t aId, int pos)
 {
 	Lock l(cs);
+	ensureLoaded();
 	for (auto i = det.begin(); i != det.end(); ++i)
 	{
 		if (i->Id == aId)
@@ -649,6 +667,7 @@ bool DetectionManager::moveDetectionItem(const uint32_t aId, int pos)
 void DetectionManager::setItemEnabled(const uint32_t aId, bool enabled) noexcept
 {
 	Lock l(cs);
+	ensureLoaded();
 	for (auto i = det.begin(); i != det.end(); ++i)
 	{
 		if (i->Id == aId)
@@ -31,7 +31,7 @@ class DetectionManager : public Singleton<DetectionManager>
 	public:
 		typedef vector<DetectionEntry> DetectionItems;
 		
-		DetectionManager() : profileVersion("N/A"), profileMessage("N/A"), profileUrl("N/A"), lastId(0) { }
+		DetectionManager() : profileVersion("N/A"), profileMessage("N/A"), profileUrl("N/A"), lastId(0), loaded(false) { }
 		~DetectionManager() noexcept
 		{
 			save();
@@ -56,12 +56,14 @@ class DetectionManager : public Singleton<DetectionManager>
 		const DetectionItems& getProfiles() noexcept
 		{
 			Lock l(cs);
+			ensureLoaded();
 			return det;
 		}
 		
 		const DetectionItems& getProfiles(StringMap& p) noexcept
 		{
 			Lock l(cs);
+			ensureLoaded();
 			// don't override other params
 			for (auto i = params.cbegin(); i != params.cend(); ++i)
 				p[i->first] = i->second;
@@ -71,6 +73,7 @@ class DetectionManager : public Singleton<DetectionManager>
 		StringMap& getParams() noexcept
 		{
 			Lock l(cs);
+			ensureLoaded();
 			return params;
 		}
 		
@@ -80,11 +83,14 @@ class DetectionManager : public Singleton<DetectionManager>
 		
 	private:
 		void loadCompressedProfiles();
+		/** Profiles.xml is read on first use, not at startup; the caller holds cs */
+		void ensureLoaded();
 		
 		DetectionItems det;
 		
 		StringMap params;
 		uint32_t lastId;
+		bool loaded;
 		
 		void validateItem(const DetectionEntry& e, bool checkIds);
 		void importProfiles(SimpleXML& xml);
@@ -422,7 +422,9 @@ void DownloadManager::endData(UserConnection* aSource)
 			return;
 		}
 		
-		aSource->setSpeed(static_cast<int64_t>(d->getAverageSpeed()));
+		// one slow or fast chunk only moves the estimate of the source halfway
+		const int64_t l_speed = static_cast<int64_t>(d->getAverageSpeed());
+		aSource->setSpeed(aSource->getSpeed() ? (aSource->getSpeed() + l_speed) / 2 : l_speed);
 		aSource->updateChunkSize(d->getTigerTree().getBlockSize(), d->getSize(), GET_TICK() - d->getStart());
 		
 		dcdebug("Download finished: %s, size " I64_FMT ", downloaded " I64_FMT "\n", d->getPath().c_str(), d->getSize(), d->getPos());
@@ -449,6 +451,18 @@ int64_t DownloadManager::getRunningAverage()
 	return avg;
 }
 
+void DownloadManager::getSnapshots(Transfer::SnapshotList& p_list)
+{
+	Lock l(cs);
+	p_list.reserve(p_list.size() + downloads.size());
+	for (auto i = downloads.cbegin(); i != downloads.cend(); ++i)
+	{
+		p_list.push_back(Transfer::Snapshot());
+		(*i)->getSnapshot(p_list.back());
+		p_list.back().m_download = true;
+	}
+}
+
 void DownloadManager::on(UserConnectionListener::MaxedOut, UserConnection* aSource, string param) noexcept
 {
 	noSlots(aSource, param);
@@ -28,6 +28,7 @@
 #include "Singleton.h"
 #include "MerkleTree.h"
 #include "Speaker.h"
+#include "Transfer.h"
 
 namespace dcpp
 {
@@ -61,6 +62,9 @@ class DownloadManager : public Speaker<DownloadManagerListener>,
 		
 		bool startDownload(QueueItem::Priority prio);
 		
+		/** Appends a copy of every running download */
+		void getSnapshots(Transfer::SnapshotList& p_list);
+		
 	private:
 	
 		CriticalSection cs;
@@ -22,6 +22,10 @@
 #include "FilteredFile.h"
 #include "BZUtils.h"
 #endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 namespace dcpp
 {
 
@@ -220,6 +224,42 @@ size_t File::write(const void* buf, size_t len)
 	}
 	return x;
 }
+size_t File::pread(void* buf, size_t len, int64_t pos)
+{
+	OVERLAPPED ov = { 0 };
+	ov.Offset = (DWORD)pos;
+	ov.OffsetHigh = (DWORD)(pos >> 32);
+	DWORD x = 0;
+	if (!::ReadFile(h, buf, (DWORD)len, &x, &ov))
+	{
+		if (GetLastError() == ERROR_HANDLE_EOF)
+			return 0;
+		throw FileException(Util::translateError(GetLastError()));
+	}
+	return x;
+}
+
+size_t File::pwrite(const void* buf, size_t len, int64_t pos)
+{
+	OVERLAPPED ov = { 0 };
+	ov.Offset = (DWORD)pos;
+	ov.OffsetHigh = (DWORD)(pos >> 32);
+	DWORD x = 0;
+	if (!::WriteFile(h, buf, (DWORD)len, &x, &ov))
+	{
+		throw FileException(Util::translateError(GetLastError()));
+	}
+	if (x != len)
+	{
+		throw FileException("Error in File::pwrite x != len");
+	}
+	return x;
+}
+
+void File::willNeed(int64_t /*pos*/, int64_t /*len*/) noexcept
+{
+}
+
 void File::setEOF()
 {
 	dcassert(isOpen());
@@ -236,23 +276,40 @@ size_t File::flush()
 	return 0;
 }
 
-void File::renameFile(const string& source, const string& target)
+void File::renameFile(const string& source, const string& target, CopyProgress* p_progress /*= nullptr */)
 {
 	if (!::MoveFile(Text::toT(source).c_str(), Text::toT(target).c_str()))
 	{
 		// Can't move, try copy/delete...
-		copyFile(source, target);
+		copyFile(source, target, p_progress);
 		deleteFile(source);
 	}
 }
 
-void File::copyFile(const string& src, const string& target)
+static DWORD CALLBACK copyProgressRoutine(LARGE_INTEGER p_total, LARGE_INTEGER p_transferred, LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID p_data)
 {
-	if (!::CopyFile(Text::toT(src).c_str(), Text::toT(target).c_str(), FALSE))
+	static_cast<File::CopyProgress*>(p_data)->onCopyProgress(p_transferred.QuadPart, p_total.QuadPart);
+	return PROGRESS_CONTINUE;
+}
+
+void File::copyFile(const string& src, const string& target, CopyProgress* p_progress /*= nullptr */)
+{
+	if (!::CopyFileEx(Text::toT(src).c_str(), Text::toT(target).c_str(), p_progress ? &copyProgressRoutine : nullptr, p_progress, nullptr, 0))
 	{
 		throw FileException(Util::translateError(GetLastError()));
 	}
 }
+
+string File::getDeviceKey(const string& p_path) noexcept
+{
+	// "\\server\share" for network paths, the drive otherwise
+	if (p_path.compare(0, 2, "\\\\") == 0)
+	{
+		const string::size_type l_server = p_path.find(PATH_SEPARATOR, 2);
+		return Text::toLower(p_path.substr(0, l_server == string::npos ? l_server : p_path.find(PATH_SEPARATOR, l_server + 1)));
+	}
+	return Text::toLower(p_path.substr(0, 2));
+}
 #ifndef _CONSOLE
 size_t File::bz2CompressFile(const wstring& p_file, const wstring& p_file_bz2)
 {
@@ -474,6 +531,46 @@ size_t File::write(const void* buf, size_t len)
 	return len;
 }
 
+size_t File::pread(void* buf, size_t len, int64_t pos)
+{
+	ssize_t result;
+	while ((result = ::pread(h, buf, len, (off_t)pos)) == -1)
+	{
+		if (errno != EINTR)
+			throw FileException(Util::translateError(errno));
+	}
+	return (size_t)result;
+}
+
+size_t File::pwrite(const void* buf, size_t len, int64_t pos)
+{
+	const char* pointer = (const char*)buf;
+	size_t left = len;
+	while (left > 0)
+	{
+		const ssize_t result = ::pwrite(h, pointer, left, (off_t)pos);
+		if (result == -1)
+		{
+			if (errno != EINTR)
+				throw FileException(Util::translateError(errno));
+		}
+		else
+		{
+			pointer += result;
+			pos += result;
+			left -= result;
+		}
+	}
+	return len;
+}
+
+void File::willNeed(int64_t pos, int64_t len) noexcept
+{
+#ifdef POSIX_FADV_WILLNEED
+	::posix_fadvise(h, (off_t)pos, (off_t)len, POSIX_FADV_WILLNEED);
+#endif
+}
+
 // some ftruncate implementations can't extend files like SetEndOfFile,
 // not sure if the client code needs this...
 int File::extendFile(int64_t len) noexcept
@@ -527,38 +624,119 @@ size_t File::flush()
  * filesystem to be mounted at multiple points, but rename(2) does not
  * work across different mount points, even if the same filesystem is mounted on both.)
 */
-void File::renameFile(const string& source, const string& target)
+void File::renameFile(const string& source, const string& target, CopyProgress* p_progress /*= nullptr */)
 {
 	int ret = ::rename(Text::fromUtf8(source).c_str(), Text::fromUtf8(target).c_str());
 	if (ret != 0 && errno == EXDEV)
 	{
-		copyFile(source, target);
+		try
+		{
+			copyFile(source, target, p_progress);
+		}
+		catch (const FileException&)
+		{
+			deleteFile(target);
+			throw;
+		}
 		deleteFile(source);
 	}
 	else if (ret != 0)
 		throw FileException(source + Util::translateError(errno));
 }
 
-// This doesn't assume all bytes are written in one write call, it is a bit safer
-void File::copyFile(const string& source, const string& target)
+/**
+ * Tries a reflink first (instant on btrfs/xfs), then lets the kernel copy the data
+ * with copy_file_range and only falls back to a user-space copy when neither works.
+ * Holes of sparse files are skipped so the target stays sparse.
+ */
+void File::copyFile(const string& source, const string& target, CopyProgress* p_progress /*= nullptr */)
 {
-	const size_t BUF_SIZE = 64 * 1024;
-	std::unique_ptr<char[]> buffer(new char[BUF_SIZE]);
-	size_t count = BUF_SIZE;
 	File src(source, File::READ, 0);
 	File dst(target, File::WRITE, File::CREATE | File::TRUNCATE);
-
-	while (src.read(&buffer[0], count) > 0)
+	int64_t size = src.getSize();
+	
+#ifdef FICLONE
+	if (::ioctl(dst.h, FICLONE, src.h) == 0)
 	{
-		char* p = &buffer[0];
-		while (count > 0)
+		if (p_progress)
+			p_progress->onCopyProgress(size, size);
+		return;
+	}
+#endif
+	
+	const int64_t CHUNK_SIZE = 8 * 1024 * 1024;
+	const size_t BUF_SIZE = 1024 * 1024;
+	std::unique_ptr<char[]> buffer;
+	bool kernelCopy = true;
+	int64_t pos = 0;
+	while (pos < size)
+	{
+		int64_t end = size;
+#ifdef SEEK_DATA
+		const off_t data = ::lseek(src.h, (off_t)pos, SEEK_DATA);
+		if (data == -1 && errno == ENXIO)
+			break; // only a hole is left
+		if (data != -1)
 		{
-			size_t ret = dst.write(p, count);
-			p += ret;
-			count -= ret;
+			pos = data;
+			const off_t hole = ::lseek(src.h, data, SEEK_HOLE);
+			if (hole != -1)
+				end = min((int64_t)hole, size);
 		}
-		count = BUF_SIZE;
+#endif
+		while (pos < end)
+		{
+			const size_t chunk = (size_t)min(end - pos, CHUNK_SIZE);
+			ssize_t ret = -1;
+#ifdef __linux__
+			if (kernelCopy)
+			{
+				off64_t in = pos, out = pos;
+				ret = ::copy_file_range(src.h, &in, dst.h, &out, chunk, 0);
+				if (ret == -1 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+					kernelCopy = false;
+			}
+#else
+			kernelCopy = false;
+#endif
+			if (!kernelCopy)
+			{
+				if (!buffer)
+					buffer.reset(new char[BUF_SIZE]);
+				ret = ::pread(src.h, &buffer[0], min(chunk, BUF_SIZE), (off_t)pos);
+				for (ssize_t written = 0; ret > 0 && written < ret;)
+				{
+					const ssize_t n = ::pwrite(dst.h, &buffer[written], ret - written, (off_t)(pos + written));
+					if (n == -1 && errno != EINTR)
+						throw FileException(Util::translateError(errno));
+					if (n > 0)
+						written += n;
+				}
+			}
+			if (ret == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				throw FileException(Util::translateError(errno));
+			}
+			if (ret == 0)
+			{
+				// the source got shorter
+				end = size = pos;
+				break;
+			}
+			pos += ret;
+			if (p_progress)
+				p_progress->onCopyProgress(pos, size);
+		}
+		pos = end;
 	}
+	
+	// a trailing hole isn't written by the loop
+	if (::ftruncate(dst.h, (off_t)size) == -1)
+		throw FileException(Util::translateError(errno));
+	if (p_progress)
+		p_progress->onCopyProgress(size, size);
 }
 
 void File::deleteFile(const string& aFileName) noexcept
@@ -591,6 +769,15 @@ bool File::isAbsolute(const string& path) noexcept
 	return path.size() > 1 && path[0] == '/';
 }
 
+string File::getDeviceKey(const string& p_path) noexcept
+{
+	struct stat s;
+	if (::stat(Text::fromUtf8(p_path).c_str(), &s) == -1)
+		return p_path;
+		
+	return Util::toString(static_cast<unsigned long long>(s.st_dev));
+}
+
 #endif // !_WIN32
 
 string File::read(size_t len)
@@ -99,13 +99,28 @@ class File : public IOStream
 		size_t write(const void* buf, size_t len);
 		size_t flush();
 		
+		/** Positional I/O, doesn't depend on the file pointer so several threads may use the same handle */
+		size_t pread(void* buf, size_t len, int64_t pos);
+		size_t pwrite(const void* buf, size_t len, int64_t pos);
+		/** Read-ahead hint for the range (posix_fadvise), does nothing where not supported */
+		void willNeed(int64_t pos, int64_t len) noexcept;
+		
 		uint32_t getLastWriteTime()const noexcept; //[+]PPA
 //	uint32_t getLastModified() const noexcept;
 #ifndef _CONSOLE
 		static size_t bz2CompressFile(const wstring& p_file, const wstring& p_file_bz2);
 #endif
-		static void copyFile(const string& src, const string& target);
-		static void renameFile(const string& source, const string& target);
+		/** Receives the progress of copyFile() and of renameFile() when it has to copy */
+		class CopyProgress
+		{
+			public:
+				virtual ~CopyProgress() { }
+				virtual void onCopyProgress(int64_t p_copied, int64_t p_total) noexcept = 0;
+		};
+		static void copyFile(const string& src, const string& target, CopyProgress* p_progress = nullptr);
+		static void renameFile(const string& source, const string& target, CopyProgress* p_progress = nullptr);
+		/** Identifies the volume the path is on: drive or network share on Windows, device number elsewhere */
+		static string getDeviceKey(const string& p_path) noexcept;
 		static bool deleteFile(const string& aFileName) noexcept;
 		static bool deleteFileT(const tstring& aFileName) noexcept
 		{
@@ -210,6 +210,15 @@ class FilteredInputStream : public InputStream
 			if (managed) delete f;
 		}
 		
+		const Filter& getFilter() const
+		{
+			return filter;
+		}
+		Filter& getFilter()
+		{
+			return filter;
+		}
+		
 		/**
 		* Read data through filter, keep calling until len returns 0.
 		* @param rbuf Data buffer
@@ -32,19 +32,21 @@ void HashBloom::add(const TTHValue& tth)
 {
 	for (size_t i = 0; i < k; ++i)
 	{
-		bloom[pos(tth, i)] = true;
+		const size_t p = pos(tth, i);
+		bloom[p / 8] |= static_cast<uint8_t>(1 << (p % 8));
 	}
 }
 
 bool HashBloom::match(const TTHValue& tth) const
 {
-	if (bloom.empty())
+	if (bits == 0)
 	{
 		return false;
 	}
 	for (size_t i = 0; i < k; ++i)
 	{
-		if (!bloom[pos(tth, i)])
+		const size_t p = pos(tth, i);
+		if (!(bloom[p / 8] & (1 << (p % 8))))
 		{
 			return false;
 		}
@@ -54,12 +56,21 @@ bool HashBloom::match(const TTHValue& tth) const
 
 void HashBloom::push_back(bool v)
 {
-	bloom.push_back(v);
+	if (bits % 8 == 0)
+	{
+		bloom.push_back(0);
+	}
+	if (v)
+	{
+		bloom[bits / 8] |= static_cast<uint8_t>(1 << (bits % 8));
+	}
+	++bits;
 }
 
 void HashBloom::reset(size_t k_, size_t m, size_t h_)
 {
-	bloom.resize(m);
+	bloom.assign((m + 7) / 8, 0);
+	bits = m;
 	k = k_;
 	h = h_;
 }
@@ -85,15 +96,15 @@ size_t HashBloom::pos(const TTHValue& tth, size_t n) const
 			x |= (1i64 << i);
 		}
 	}
-	return x % bloom.size();
+	return x % bits;
 }
 
 void HashBloom::copy_to(ByteVector& v) const
 {
-	v.resize(bloom.size() / 8);
-	for (size_t i = 0; i < bloom.size(); ++i)
+	v.resize(bits / 8);
+	if (!v.empty())
 	{
-		v[i / 8] |= bloom[i] << (i % 8);
+		memcpy(&v[0], &bloom[0], v.size());
 	}
 }
 
@@ -18,7 +18,7 @@ namespace dcpp
 class HashBloom
 {
 	public:
-		HashBloom() : k(0), h(0) { }
+		HashBloom() : bits(0), k(0), h(0) { }
 		
 		/** Return a suitable value for k based on n */
 		static size_t get_k(size_t n, size_t h);
@@ -31,11 +31,18 @@ class HashBloom
 		void push_back(bool v);
 		
 		void copy_to(ByteVector& v) const;
+		
+		size_t size() const
+		{
+			return bits;
+		}
 	private:
 	
 		size_t pos(const TTHValue& tth, size_t n) const;
 		
-		std::vector<bool> bloom;
+		// [!] Packed bits, LSB first as sent on the wire
+		ByteVector bloom;
+		size_t bits;
 		size_t k;
 		size_t h;
 };
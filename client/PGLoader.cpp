@@ -9,13 +9,14 @@
 namespace dcpp
 {
 
-PGLoader::PGLoader()
+PGLoader::PGLoader() : m_count_trust(0), m_loaded(false)
 {
-	LoadIPFilters();
 }
-bool PGLoader::getIPBlockBool(const string& p_IP) const
+bool PGLoader::getIPBlockBool(const string& p_IP)
 {
 	Lock l(m_cs);
+	if (!m_loaded)
+		LoadIPFilters();
 	if (m_IPTrust.size() == 0)
 		return false;
 	unsigned u1, u2, u3, u4;
@@ -48,6 +49,7 @@ bool PGLoader::getIPBlockBool(const string& p_IP) const
 void PGLoader::LoadIPFilters()
 {
 	Lock l(m_cs);
+	m_loaded = true;
 	m_count_trust = 0;
 	m_IPTrust.clear();
 	try
@@ -17,7 +17,8 @@ class PGLoader : public Singleton<PGLoader>
 		~PGLoader()
 		{
 		}
-		bool getIPBlockBool(const string& p_IP) const;
+		/** IPTrust.ini is read by the first check, not at startup */
+		bool getIPBlockBool(const string& p_IP);
 		void LoadIPFilters();
 	private:
 		mutable CriticalSection m_cs;
@@ -33,6 +34,7 @@ class PGLoader : public Singleton<PGLoader>
 		typedef vector<CustomIPFilter> CustomIPFilterList;
 		CustomIPFilterList m_IPTrust;
 		uint32_t m_count_trust;
+		bool m_loaded;
 };
 }
 #endif
@@ -22,6 +22,7 @@
 #include "Download.h"
 #include "File.h"
 #include "Util.h"
+#include "SegmentPicker.h"
 
 namespace dcpp
 {
@@ -43,7 +44,7 @@ QueueItem::QueueItem(const std::string& aTarget, int64_t aSize, Priority aPriori
 	size(aSize), priority(aPriority), added(aAdded),
 	m_tthRoot(p_tth), autoPriority(false), nextPublishingTime(0),
 //	m_dirty(true),
-	m_block_size(0)
+	m_parts_generation(0), m_block_size(0), m_done_bytes(0), m_bytes_left_total(nullptr)
 //	m_downloadedBytes(0),
 //	m_averageSpeed(0)
 {
@@ -185,150 +186,67 @@ Segment QueueItem::getNextSegment(int64_t  blockSize, int64_t wantedSize, int64_
 		return Segment(-1, 0);
 	}
 	
-	/* added for PFS */
-	vector<int64_t> posArray;
-	vector<Segment> neededParts;
+	SegmentPicker::ChunkList running;
+	running.reserve(downloads.size());
+	for (auto i = downloads.cbegin(); i != downloads.cend(); ++i)
+	{
+		const Download* d = *i;
+		SegmentPicker::Chunk chunk;
+		chunk.m_segment = d->getSegment();
+		chunk.m_pos = d->getPos();
+		chunk.m_speed = d->getAverageSpeed();
+		chunk.m_seconds_left = d->getSecondsLeft();
+		chunk.m_start = d->getStart();
+		running.push_back(chunk);
+	}
+	
+	SegmentPicker picker(getSize(), blockSize, done, running);
+	picker.setDownloaded(static_cast<int64_t>(getDownloadedBytes()));
+	picker.setOverlap(BOOLSETTING(OVERLAP_CHUNKS), GET_TICK());
 	
 	if (partialSource)
 	{
+		/* added for PFS */
+		vector<int64_t> posArray;
 		posArray.reserve(partialSource->getPartialInfo().size());
 		
 		// Convert block index to file position
 		for (PartsInfo::const_iterator i = partialSource->getPartialInfo().begin(); i != partialSource->getPartialInfo().end(); ++i)
 			posArray.push_back(min(getSize(), (int64_t)(*i) * blockSize));
-	}
-	
-	/***************************/
-	
-	double donePart = static_cast<double>(getDownloadedBytes()) / getSize();
-	
-	// We want smaller blocks at the end of the transfer, squaring gives a nice curve...
-	int64_t targetSize = static_cast<int64_t>(static_cast<double>(wantedSize) * std::max(0.25, (1. - (donePart * donePart))));
-	
-	if (targetSize > blockSize)
-	{
-		// Round off to nearest block size
-		targetSize = Util::roundDown(targetSize, blockSize);
-	}
-	else
-	{
-		targetSize = blockSize;
-	}
-	
-	int64_t start = 0;
-	int64_t curSize = targetSize;
-	
-	while (start < getSize())
-	{
-		int64_t end = std::min(getSize(), start + curSize);
-		Segment block(start, end - start);
-		bool overlaps = false;
-		for (SegmentConstIter i = done.begin(); !overlaps && i != done.end(); ++i)
-		{
-			if (curSize <= blockSize)
-			{
-				int64_t dstart = i->getStart();
-				int64_t dend = i->getEnd();
-				// We accept partial overlaps, only consider the block done if it is fully consumed by the done block
-				if (dstart <= start && dend >= end)
-				{
-					overlaps = true;
-				}
-			}
-			else
-			{
-				overlaps = block.overlaps(*i);
-			}
-		}
-		
-		for (auto i = downloads.begin(); !overlaps && i != downloads.end(); ++i)
-		{
-			overlaps = block.overlaps((*i)->getSegment());
-		}
-		
-		if (!overlaps)
-		{
-			if (partialSource)
-			{
-				// store all chunks we could need
-				for (vector<int64_t>::const_iterator j = posArray.begin(); j < posArray.end(); j += 2)
-				{
-					if ((*j <= start && start < * (j + 1)) || (start <= *j && *j < end))
-					{
-						int64_t b = max(start, *j);
-						int64_t e = min(end, *(j + 1));
-						
-						// segment must be blockSize aligned
-						dcassert(b % blockSize == 0);
-						dcassert(e % blockSize == 0 || e == getSize());
-						
-						neededParts.push_back(Segment(b, e - b));
-					}
-				}
-			}
-			else
-			{
-				return block;
-			}
-		}
-		
-		if (overlaps && (curSize > blockSize))
+			
+		picker.setPartial(posArray, [this, blockSize](int64_t aPos)
 		{
-			curSize -= blockSize;
-		}
-		else
+			return countPartialHolders(aPos, blockSize);
+		}, [](uint32_t aMax)
 		{
-			start = end;
-			curSize = targetSize;
-		}
-	}
-	
-	if (!neededParts.empty())
-	{
-		// select random chunk for download
-		dcdebug("Found chunks: %d\n", neededParts.size());
-		
-		Segment& selected = neededParts[Util::rand(0, neededParts.size())];
-		selected.setSize(std::min(selected.getSize(), targetSize)); // request only wanted size
-		
-		return selected;
+			return Util::rand(aMax);
+		});
 	}
 	
-	if (partialSource == NULL && BOOLSETTING(OVERLAP_CHUNKS) && lastSpeed > 0)
+	return picker.pick(wantedSize, lastSpeed);
+}
+
+size_t QueueItem::countPartialHolders(int64_t aPos, int64_t blockSize) const
+{
+	const int64_t block = aPos / blockSize;
+	size_t holders = 0;
+	for (auto i = sources.cbegin(); i != sources.cend(); ++i)
 	{
-		// overlap slow running chunk
-		
-		for (auto i = downloads.begin(); i != downloads.end(); ++i)
+		const PartialSource::Ptr& ps = i->getPartialSource();
+		if (!ps)
+			continue;
+		const PartsInfo& parts = ps->getPartialInfo();
+		// pairs of block indexes, the end is exclusive
+		for (size_t j = 0; j + 1 < parts.size(); j += 2)
 		{
-			Download* d = *i;
-			
-			// current chunk mustn't be already overlapped
-			if (d->getOverlapped())
-				continue;
-				
-			// current chunk must be running at least for 2 seconds
-			if (d->getStart() == 0 || GET_TICK() - d->getStart() < 2000)
-				continue;
-				
-			// current chunk mustn't be finished in next 10 seconds
-			if (d->getSecondsLeft() < 10)
-				continue;
-				
-			// overlap current chunk at last block boundary
-			int64_t pos = d->getPos() - (d->getPos() % blockSize);
-			int64_t size = d->getSize() - pos;
-			
-			// new user should finish this chunk more than 2x faster
-			int64_t newChunkLeft = size / lastSpeed;
-			if (2 * newChunkLeft < d->getSecondsLeft())
+			if (parts[j] <= block && block < parts[j + 1])
 			{
-				dcdebug("Overlapping... old user: %I64d s, new user: %I64d s\n", d->getSecondsLeft(), newChunkLeft);
-				return Segment(d->getStartPos() + pos, size, true);
+				++holders;
+				break;
 			}
 		}
 	}
-	
-	return Segment(0, 0);
+	return holders;
 }
 
 uint64_t QueueItem::getDownloadedBytes() const
@@ -344,7 +262,21 @@ uint64_t QueueItem::getDownloadedBytes() const
 	// count running segments
 	for (auto i = downloads.begin(); i != downloads.end(); ++i)
 	{
-		total += (*i)->getPos();// [!] crash-strong-full-r6555.dmp
+		int64_t l_pos = (*i)->getPos();// [!] crash-strong-full-r6555.dmp
+		if ((*i)->isSet(Download::FLAG_OVERLAP))
+		{
+			// racing the tail of another chunk, the blocks both of them have count once
+			for (auto j = downloads.begin(); j != downloads.end(); ++j)
+			{
+				if (*j != *i && (*j)->getSegment().contains((*i)->getSegment()))
+				{
+					const int64_t l_shared = (*j)->getStartPos() + (*j)->getPos() - (*i)->getStartPos();
+					l_pos -= min(l_pos, max<int64_t>(l_shared, 0));
+					break;
+				}
+			}
+		}
+		total += l_pos;
 	}
 	
 	return total;
@@ -353,28 +285,36 @@ uint64_t QueueItem::getDownloadedBytes() const
 void QueueItem::addSegment(const Segment& segment)
 {
 	dcassert(segment.getOverlapped() == false);
+	const int64_t l_before = getBytesLeft();
 	done.insert(segment);
 	
 	// Consolidate segments
-	if (done.size() == 1)
-		return;
-		
-	for (SegmentSet::iterator i = ++done.begin() ; i != done.end();)
+	if (done.size() > 1)
 	{
-		SegmentSet::iterator prev = i;
-		prev--;
-		if (prev->getEnd() >= i->getStart())
-		{
-			Segment big(prev->getStart(), i->getEnd() - prev->getStart());
-			done.erase(prev);
-			done.erase(i++);
-			done.insert(big);
-		}
-		else
+		for (SegmentSet::iterator i = ++done.begin() ; i != done.end();)
 		{
-			++i;
+			SegmentSet::iterator prev = i;
+			prev--;
+			if (prev->getEnd() >= i->getStart())
+			{
+				Segment big(prev->getStart(), i->getEnd() - prev->getStart());
+				done.erase(prev);
+				done.erase(i++);
+				done.insert(big);
+			}
+			else
+			{
+				++i;
+			}
 		}
 	}
+	
+	m_done_bytes = 0;
+	for (auto i = done.cbegin(); i != done.cend(); ++i)
+	{
+		m_done_bytes += i->getSize();
+	}
+	updateBytesLeft(l_before);
 }
 
 bool QueueItem::isNeededPart(const PartsInfo& partsInfo, int64_t blockSize)
@@ -118,8 +118,8 @@ class QueueItem : public Flags,  public intrusive_ptr_base<QueueItem>
 					| FLAG_NO_TREE | FLAG_TTH_INCONSISTENCY | FLAG_UNTRUSTED
 				};
 				
-				Source(const HintedUser& aUser) : user(aUser), partialSource(NULL) { }
-				Source(const Source& aSource) : Flags(aSource), user(aSource.user), partialSource(aSource.partialSource) { }
+				Source(const HintedUser& aUser) : user(aUser), partialSource(NULL), queueOrder(0) { }
+				Source(const Source& aSource) : Flags(aSource), user(aSource.user), partialSource(aSource.partialSource), queueOrder(aSource.queueOrder) { }
 				
 				bool operator==(const UserPtr& aUser) const
 				{
@@ -132,6 +132,8 @@ class QueueItem : public Flags,  public intrusive_ptr_base<QueueItem>
 				
 				GETSET(HintedUser, user, User);
 				GETSET(PartialSource::Ptr, partialSource, PartialSource);
+				/** Place of the item among the items of this user with the same priority, see QueueManager::UserQueue */
+				GETSET(uint64_t, queueOrder, QueueOrder);
 		};
 		
 		typedef vector<Source> SourceList;
@@ -251,12 +253,39 @@ class QueueItem : public Flags,  public intrusive_ptr_base<QueueItem>
 		
 		/** Next segment that is not done and not being downloaded, zero-sized segment returned if there is none is found */
 		Segment getNextSegment(int64_t blockSize, int64_t wantedSize, int64_t lastSpeed, const PartialSource::Ptr& partialSource) const;
+		/** Partial sources that have the block at aPos */
+		size_t countPartialHolders(int64_t aPos, int64_t blockSize) const;
 		// [+]PVS   V801    Decreased performance. It is better to redefine the fourth function argument as a reference. Consider replacing 'const .. partialSource' with 'const .. &partialSource'.    client  queueitem.cpp   103 False
 		
 		void addSegment(const Segment& segment);
 		void resetDownloaded()
 		{
+			const int64_t l_before = getBytesLeft();
 			done.clear();
+			m_done_bytes = 0;
+			updateBytesLeft(l_before);
+			invalidateParts();
+		}
+		
+		/** Bytes of the file not in a done segment, 0 while the size is unknown */
+		int64_t getBytesLeft() const
+		{
+			return size > 0 ? std::max<int64_t>(size - m_done_bytes, 0) : 0;
+		}
+		/** The file queue's total of getBytesLeft(), kept up to date while the item is queued */
+		void setBytesLeftTotal(int64_t* p_total)
+		{
+			m_bytes_left_total = p_total;
+		}
+		
+		/** Changes when a part may have become needed again, a source without needed parts has to be checked again */
+		uint32_t getPartsGeneration() const
+		{
+			return m_parts_generation;
+		}
+		void invalidateParts()
+		{
+			++m_parts_generation;
 		}
 		
 		bool isFinished() const
@@ -295,8 +324,17 @@ class QueueItem : public Flags,  public intrusive_ptr_base<QueueItem>
 	private:
 		const TTHValue m_tthRoot;
 		//bool m_dirty;
+		uint32_t m_parts_generation;
 		int64_t m_block_size; // TODO: please fix the architect error, if this possible, see details here: http://code.google.com/p/flylinkdc/source/detail?r=12761
 		void calcBlockSize();
+		
+		int64_t m_done_bytes;
+		int64_t* m_bytes_left_total;
+		void updateBytesLeft(int64_t p_before)
+		{
+			if (m_bytes_left_total)
+				*m_bytes_left_total += getBytesLeft() - p_before;
+		}
 	public:
 		const TTHValue& getTTH() const
 		{
@@ -311,12 +349,30 @@ class QueueItem : public Flags,  public intrusive_ptr_base<QueueItem>
 			return m_block_size;
 		}
 		
-		GETSET(SegmentSet, done, Done);
+	private:
+		SegmentSet done;
+	public:
+		const SegmentSet& getDone() const
+		{
+			return done;
+		}
+		int64_t getSize() const
+		{
+			return size;
+		}
+		void setSize(int64_t aSize)
+		{
+			const int64_t l_before = getBytesLeft();
+			size = aSize;
+			updateBytesLeft(l_before);
+		}
 		GETSET(DownloadList, downloads, Downloads);
 		GETSET(string, target, Target);
 		GETSET(uint64_t, fileBegin, FileBegin);
 		GETSET(uint64_t, nextPublishingTime, NextPublishingTime);
-		GETSET(int64_t, size, Size);
+	private:
+		int64_t size;
+	public:
 		GETSET(time_t, added, Added);
 		GETSET(Priority, priority, Priority);
 		GETSET(uint8_t, maxSegments, MaxSegments);
@@ -19,6 +19,7 @@
 #include "stdinc.h"
 #include "QueueManager.h"
 
+#include <boost/atomic.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/algorithm/for_each.hpp>
 
@@ -31,6 +32,7 @@
 #include "LogManager.h"
 #include "ResourceManager.h"
 #include "SearchManager.h"
+#include "Semaphore.h"
 #include "ShareManager.h"
 #include "SimpleXML.h"
 #include "StringTokenizer.h"
@@ -40,7 +42,6 @@
 #include "version.h"
 #include "SearchResult.h"
 #include "SharedFileStream.h"
-#include "MerkleCheckOutputStream.h"
 
 #include "../dht/IndexManager.h"
 
@@ -82,7 +83,10 @@ class DirectoryItem
 QueueManager::FileQueue::~FileQueue()
 {
 	for (auto i = queue.begin(); i != queue.end(); ++i)
+	{
+		i->second->setBytesLeftTotal(nullptr);
 		i->second->dec();
+	}
 }
 
 QueueItem* QueueManager::FileQueue::add(const string& aTarget, int64_t aSize,
@@ -152,11 +156,15 @@ QueueItem* QueueManager::FileQueue::add(const string& aTarget, int64_t aSize,
 void QueueManager::FileQueue::add(QueueItem* qi)
 {
 	queue.insert(make_pair(const_cast<string*>(&qi->getTarget()), qi));
+	m_bytes_left += qi->getBytesLeft();
+	qi->setBytesLeftTotal(&m_bytes_left);
 }
 
 void QueueManager::FileQueue::remove(QueueItem* qi)
 {
 	queue.erase(const_cast<string*>(&qi->getTarget()));
+	m_bytes_left -= qi->getBytesLeft();
+	qi->setBytesLeftTotal(nullptr);
 	qi->dec();
 }
 
@@ -261,9 +269,10 @@ QueueItem* QueueManager::FileQueue::findAutoSearch(deque<string>& recent) const
 
 void QueueManager::FileQueue::move(QueueItem* qi, const string& aTarget)
 {
+	// only the key changes, the bytes left stay counted
 	queue.erase(const_cast<string*>(&qi->getTarget()));
 	qi->setTarget(aTarget);
-	add(qi);
+	queue.insert(make_pair(const_cast<string*>(&qi->getTarget()), qi));
 }
 
 void QueueManager::UserQueue::add(QueueItem* qi)
@@ -276,96 +285,111 @@ void QueueManager::UserQueue::add(QueueItem* qi)
 
 void QueueManager::UserQueue::add(QueueItem* qi, const UserPtr& aUser)
 {
-	auto& l = userQueue[qi->getPriority()][aUser];
+	QueueItem::SourceIter source = qi->getSource(aUser);
+	dcassert(source != qi->getSources().end());
 	
+	// begun items go before the others, the last one first
 	if (qi->getDownloadedBytes() > 0 || qi->isSet(QueueItem::FLAG_USER_CHECK))
 	{
-		l.push_front(qi);
+		source->setQueueOrder(--m_front);
 	}
 	else
 	{
-		l.push_back(qi);
+		source->setQueueOrder(m_back++);
 	}
+	userQueue[aUser].insert(Entry(qi, source->getQueueOrder()));
 }
 
 QueueItem* QueueManager::UserQueue::getNext(const UserPtr& aUser, QueueItem::Priority minPrio, int64_t wantedSize, int64_t lastSpeed, bool allowRemove)
 {
-	int p = QueueItem::LAST - 1;
 	lastError = Util::emptyString;
 	
-	do
+	auto i = userQueue.find(aUser);
+	if (i == userQueue.end())
+		return NULL;
+		
+	ItemSet& l_items = i->second;
+	dcassert(!l_items.empty());
+	for (auto j = l_items.begin(); j != l_items.end() && j->m_priority >= minPrio;)
 	{
-		auto i = userQueue[p].find(aUser);
-		if (i != userQueue[p].end())
+		QueueItem* qi = j->m_qi;
+		
+		QueueItem::SourceConstIter source = qi->getSource(aUser);
+		if (allowRemove && source->isSet(QueueItem::Source::FLAG_PARTIAL))
 		{
-			dcassert(!i->second.empty());
-			for (auto j = i->second.begin(); j != i->second.end(); ++j)
+			// check partial source
+			const int64_t blockSize = qi->getBlockSize();
+			dcassert(blockSize);
+			Segment segment = qi->getNextSegment(blockSize, wantedSize, lastSpeed, source->getPartialSource());
+			if (segment.getStart() != -1 && segment.getSize() == 0)
+			{
+				// no other partial chunk from this user, remove him from queue
+				const bool l_last = l_items.size() == 1;
+				++j;
+				remove(qi, aUser);
+				qi->removeSource(aUser, QueueItem::Source::FLAG_NO_NEED_PARTS);
+				lastError = STRING(NO_NEEDED_PART);
+				if (l_last)
+					return NULL;
+				continue;
+			}
+		}
+		
+		if (qi->isWaiting())
+		{
+			// check maximum simultaneous files setting
+			if (SETTING(FILE_SLOTS) == 0 || qi->isSet(QueueItem::FLAG_USER_LIST) || m_running_files < (size_t)SETTING(FILE_SLOTS))
 			{
-				QueueItem* qi = *j;
-				
-				QueueItem::SourceConstIter source = qi->getSource(aUser);
-				if (source->isSet(QueueItem::Source::FLAG_PARTIAL))
-				{
-					// check partial source
-					const int64_t blockSize = qi->getBlockSize();
-					dcassert(blockSize);
-					Segment segment = qi->getNextSegment(blockSize, wantedSize, lastSpeed, source->getPartialSource());
-					if (allowRemove && segment.getStart() != -1 && segment.getSize() == 0)
-					{
-						// no other partial chunk from this user, remove him from queue
-						remove(qi, aUser);
-						qi->removeSource(aUser, QueueItem::Source::FLAG_NO_NEED_PARTS);
-						lastError = STRING(NO_NEEDED_PART);
-						p++;
-						break;
-					}
-				}
-				
-				if (qi->isWaiting())
-				{
-					// check maximum simultaneous files setting
-					if (SETTING(FILE_SLOTS) == 0 || qi->isSet(QueueItem::FLAG_USER_LIST) ||
-					        QueueManager::getInstance()->getRunningFiles().size() < (size_t)SETTING(FILE_SLOTS))
-					{
-						return qi;
-					}
-					else
-					{
-						lastError = STRING(ALL_FILE_SLOTS_TAKEN);
-						continue;
-					}
-				}
-				
-				// No segmented downloading when getting the tree
-				if (!qi->getDownloads().empty() && qi->getDownloads().front()->getType() == Transfer::TYPE_TREE)
-				{
-					continue;
-				}
-				if (!qi->isSet(QueueItem::FLAG_USER_LIST))
-				{
-					const int64_t blockSize = qi->getBlockSize();
-					dcassert(blockSize);
-					
-					Segment segment = qi->getNextSegment(blockSize, wantedSize, lastSpeed, source->getPartialSource());
-					if (segment.getSize() == 0)
-					{
-						lastError = segment.getStart() == -1 ? STRING(ALL_DOWNLOAD_SLOTS_TAKEN) : STRING(NO_FREE_BLOCK);
-						dcdebug("No segment for %s in %s, block " I64_FMT "\n", aUser->getCID().toBase32().c_str(), qi->getTarget().c_str(), blockSize);
-						continue;
-					}
-				}
 				return qi;
 			}
+			else
+			{
+				lastError = STRING(ALL_FILE_SLOTS_TAKEN);
+				++j;
+				continue;
+			}
+		}
+		
+		// No segmented downloading when getting the tree
+		if (!qi->getDownloads().empty() && qi->getDownloads().front()->getType() == Transfer::TYPE_TREE)
+		{
+			++j;
+			continue;
 		}
-		p--;
+		if (!qi->isSet(QueueItem::FLAG_USER_LIST))
+		{
+			if (j->m_no_parts == qi->getPartsGeneration() + 1)
+			{
+				// the parts of this partial source are all done or being downloaded, nothing changed since
+				lastError = STRING(NO_FREE_BLOCK);
+				++j;
+				continue;
+			}
+			
+			const int64_t blockSize = qi->getBlockSize();
+			dcassert(blockSize);
+			
+			Segment segment = qi->getNextSegment(blockSize, wantedSize, lastSpeed, source->getPartialSource());
+			if (segment.getSize() == 0)
+			{
+				lastError = segment.getStart() == -1 ? STRING(ALL_DOWNLOAD_SLOTS_TAKEN) : STRING(NO_FREE_BLOCK);
+				dcdebug("No segment for %s in %s, block " I64_FMT "\n", aUser->getCID().toBase32().c_str(), qi->getTarget().c_str(), blockSize);
+				if (segment.getStart() != -1 && source->isSet(QueueItem::Source::FLAG_PARTIAL))
+					j->m_no_parts = qi->getPartsGeneration() + 1;
+				++j;
+				continue;
+			}
+		}
+		return qi;
 	}
-	while (p >= minPrio);
 	
 	return NULL;
 }
 
 void QueueManager::UserQueue::addDownload(QueueItem* qi, Download* d)
 {
+	if (qi->getDownloads().empty())
+		++m_running_files;
 	qi->getDownloads().push_back(d);
 	
 	// Only one download per user...
@@ -382,6 +406,10 @@ void QueueManager::UserQueue::removeDownload(QueueItem* qi, const UserPtr& user)
 		if ((*i)->getUser() == user)
 		{
 			qi->getDownloads().erase(i);
+			if (qi->getDownloads().empty())
+				--m_running_files;
+			// what it was downloading may be needed again
+			qi->invalidateParts();
 			break;
 		}
 	}
@@ -415,51 +443,342 @@ void QueueManager::UserQueue::remove(QueueItem* qi, const UserPtr& aUser, bool r
 		removeDownload(qi, aUser);
 	}
 	
-	dcassert(qi->isSource(aUser));
-	auto& ulm = userQueue[qi->getPriority()];
-	auto j = ulm.find(aUser);
-	dcassert(j != ulm.end());
+	QueueItem::SourceConstIter source = qi->getSource(aUser);
+	dcassert(source != qi->getSources().end());
+	auto j = userQueue.find(aUser);
+	dcassert(j != userQueue.end());
 	auto& l = j->second;
-	auto i = find(l.begin(), l.end(), qi);
-	dcassert(i != l.end());
-	l.erase(i);
+	const size_t l_erased = l.erase(Entry(qi, source->getQueueOrder()));
+	dcassert(l_erased == 1);
 	
 	if (l.empty())
 	{
-		ulm.erase(j);
+		userQueue.erase(j);
 	}
 }
 
+QueueManager::FileMover::FileMover()
+{
+	for (size_t i = 0; i < MOVER_THREADS; ++i)
+		m_workers[i].m_mover = this;
+}
+
+QueueManager::FileMover::~FileMover()
+{
+	// let the running moves finish, the queued ones are picked up by the same workers
+	for (size_t i = 0; i < MOVER_THREADS; ++i)
+		m_workers[i].join();
+}
+
 void QueueManager::FileMover::moveFile(const string& source, const string& target)
 {
-	Lock l(cs);
-	files.push_back(make_pair(source, target));
-	if (!active)
+	FileMove l_move;
+	l_move.m_source = source;
+	l_move.m_target = target;
+	l_move.m_device = File::getDeviceKey(Util::getFilePath(target));
+	l_move.m_size = File::getSize(source);
+	
 	{
-		active = true;
-		start();
+		Lock l(m_cs);
+		m_moves.push_back(l_move);
+		if (m_devices[l_move.m_device] >= MOVER_DEVICE_THREADS)
+			return; // a worker moving to the same device takes it afterwards
+			
+		bool l_busy = false;
+		for (size_t i = 0; i < MOVER_THREADS; ++i)
+		{
+			Worker& l_worker = m_workers[i];
+			if (l_worker.m_active)
+			{
+				l_busy = true;
+				continue;
+			}
+			try
+			{
+				l_worker.start();
+				l_worker.m_active = true;
+				return;
+			}
+			catch (const ThreadException& e)
+			{
+				LogManager::getInstance()->message("FileMover: " + e.getError()); // [!] TODO translate
+				break;
+			}
+		}
+		if (l_busy)
+			return;
+		// no thread could be started, move it here
+		m_moves.pop_back();
+	}
+	moveFile_(source, target);
+}
+
+QueueManager::FileMoveList QueueManager::FileMover::getMoves() const
+{
+	Lock l(m_cs);
+	return FileMoveList(m_moves.begin(), m_moves.end());
+}
+
+bool QueueManager::FileMover::pop(FileMove*& p_move)
+{
+	for (auto i = m_moves.begin(); i != m_moves.end(); ++i)
+	{
+		if (!i->m_running && m_devices[i->m_device] < MOVER_DEVICE_THREADS)
+		{
+			++m_devices[i->m_device];
+			i->m_running = true;
+			p_move = &*i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void QueueManager::FileMover::done(FileMove* p_move)
+{
+	if (--m_devices[p_move->m_device] == 0)
+		m_devices.erase(p_move->m_device);
+		
+	for (auto i = m_moves.begin(); i != m_moves.end(); ++i)
+	{
+		if (&*i == p_move)
+		{
+			m_moves.erase(i);
+			break;
+		}
 	}
 }
 
-int QueueManager::FileMover::run()
+int QueueManager::FileMover::Worker::run()
 {
 	for (;;)
 	{
-		FilePair next;
+		FileMove l_move;
 		{
-			Lock l(cs);
-			if (files.empty())
+			Lock l(m_mover->m_cs);
+			if (m_move)
 			{
-				active = false;
+				m_mover->done(m_move);
+				m_move = nullptr;
+			}
+			if (!m_mover->pop(m_move))
+			{
+				m_active = false;
 				return 0;
 			}
-			next = files.back();
-			files.pop_back();
+			l_move = *m_move;
 		}
-		moveFile_(next.first, next.second);
+		m_last_fire = 0;
+		moveFile_(l_move.m_source, l_move.m_target, this);
 	}
 }
 
+void QueueManager::FileMover::Worker::onCopyProgress(int64_t p_copied, int64_t p_total) noexcept
+{
+	string l_target;
+	{
+		Lock l(m_mover->m_cs);
+		m_move->m_moved = p_copied;
+		m_move->m_size = p_total;
+		
+		const uint64_t l_tick = GET_TICK();
+		if (l_tick - m_last_fire < 1000 && p_copied < p_total)
+			return;
+		m_last_fire = l_tick;
+		l_target = m_move->m_target;
+	}
+	QueueManager::getInstance()->fire(QueueManagerListener::FileMoveProgress(), l_target, p_copied, p_total);
+}
+
+/**
+ * Verifies the blocks of a temp file against its tree on several threads.
+ * Every worker reads through its own file handle and takes runs of
+ * consecutive blocks, so the disk still sees mostly sequential reads while
+ * the hashing is spread over the cores. Blocks are reported as soon as they
+ * are verified, the caller doesn't have to wait for the whole file.
+ */
+class RecheckBlocks
+{
+	public:
+		RecheckBlocks(const string& p_file, const TigerTree& p_tree, int64_t p_size) :
+			m_file(p_file), m_tree(p_tree), m_size(p_size), m_block_size(p_tree.getBlockSize()),
+			m_blocks((size_t)((p_size + p_tree.getBlockSize() - 1) / p_tree.getBlockSize())),
+			m_run(max((size_t)1, (size_t)(RUN_SIZE / p_tree.getBlockSize()))),
+			m_next(0), m_checked(0), m_bad(0), m_stop(false), m_running(0)
+		{
+		}
+		~RecheckBlocks()
+		{
+			stop();
+		}
+		
+		void start()
+		{
+			const size_t l_count = min((size_t)max(1u, boost::thread::hardware_concurrency()), min((size_t)MAX_WORKERS, (m_blocks + m_run - 1) / m_run));
+			for (size_t i = 0; i < l_count; ++i)
+			{
+				unique_ptr<Worker> l_worker(new Worker(*this));
+				try
+				{
+					l_worker->start();
+				}
+				catch (const ThreadException& e)
+				{
+					dcdebug("RecheckBlocks: %s\n", e.getError().c_str());
+					break;
+				}
+				m_workers.push_back(std::move(l_worker));
+				++m_running;
+			}
+			if (m_workers.empty())
+			{
+				// no threads available, check in the caller's thread
+				work();
+			}
+		}
+		
+		/** @return True when all the blocks have been processed */
+		bool wait(uint32_t p_millis)
+		{
+			const uint64_t l_until = GET_TICK() + p_millis;
+			while (m_running > 0)
+			{
+				const uint64_t l_now = GET_TICK();
+				if (l_now >= l_until || !m_finished.wait((uint32_t)(l_until - l_now)))
+					return false;
+				--m_running;
+			}
+			return true;
+		}
+		
+		void stop()
+		{
+			m_stop = true;
+			for (auto i = m_workers.cbegin(); i != m_workers.cend(); ++i)
+				(*i)->join();
+			m_workers.clear();
+			m_running = 0;
+		}
+		
+		/** Move the indices of the blocks verified so far to p_blocks */
+		void takeGood(vector<size_t>& p_blocks)
+		{
+			Lock l(m_cs);
+			p_blocks.insert(p_blocks.end(), m_good.begin(), m_good.end());
+			m_good.clear();
+		}
+		
+		bool hasBadBlocks() const
+		{
+			return m_bad > 0;
+		}
+		int64_t getChecked() const
+		{
+			return m_checked;
+		}
+		
+	private:
+		static const size_t MAX_WORKERS = 8;
+		static const int64_t RUN_SIZE = 4 * 1024 * 1024;
+		
+		class Worker : public Thread
+		{
+			public:
+				explicit Worker(RecheckBlocks& p_owner) : m_owner(p_owner) { }
+				~Worker()
+				{
+					join();
+				}
+			private:
+				int run()
+				{
+					m_owner.work();
+					m_owner.m_finished.signal();
+					return 0;
+				}
+				RecheckBlocks& m_owner;
+		};
+		
+		void work()
+		{
+			try
+			{
+				File l_file(m_file, File::READ, File::OPEN);
+				vector<uint8_t> l_buf((size_t)min((int64_t)1024 * 1024, m_block_size));
+				while (!m_stop)
+				{
+					const size_t l_first = m_next.fetch_add(m_run);
+					if (l_first >= m_blocks)
+						break;
+					const size_t l_last = min(l_first + m_run, m_blocks);
+					for (size_t i = l_first; i < l_last && !m_stop; ++i)
+					{
+						const int64_t l_start = (int64_t)i * m_block_size;
+						const int64_t l_len = min(m_size - l_start, m_block_size); //Take care of the last incomplete block
+						if (checkBlock(l_file, l_buf, i, l_start, l_len))
+						{
+							Lock l(m_cs);
+							m_good.push_back(i);
+						}
+						else
+						{
+							++m_bad;
+							dcdebug("Found bad block at " I64_FMT "\n", l_start);
+						}
+						m_checked += l_len;
+					}
+				}
+			}
+			catch (const FileException& e)
+			{
+				// the blocks left unchecked can't be trusted
+				dcdebug("RecheckBlocks: %s\n", e.getError().c_str());
+				++m_bad;
+				m_stop = true;
+			}
+		}
+		
+		bool checkBlock(File& p_file, vector<uint8_t>& p_buf, size_t p_block, int64_t p_start, int64_t p_len)
+		{
+			if (p_block >= m_tree.getLeaves().size())
+				return false;
+				
+			TigerTree l_cur(m_block_size);
+			p_file.setPos(p_start);
+			int64_t l_left = p_len;
+			while (l_left > 0)
+			{
+				size_t n = (size_t)min((int64_t)p_buf.size(), l_left);
+				p_file.read(&p_buf[0], n);
+				if (n == 0)
+					return false;
+				l_cur.update(&p_buf[0], n);
+				l_left -= n;
+			}
+			l_cur.finalize();
+			return l_cur.getRoot() == m_tree.getLeaves()[p_block];
+		}
+		
+		const string m_file;
+		const TigerTree& m_tree;
+		const int64_t m_size;
+		const int64_t m_block_size;
+		const size_t m_blocks;
+		const size_t m_run; // blocks taken by a worker at once
+		
+		boost::atomic<size_t> m_next;
+		boost::atomic<int64_t> m_checked;
+		boost::atomic<size_t> m_bad;
+		boost::atomic<bool> m_stop;
+		
+		CriticalSection m_cs;
+		vector<size_t> m_good;
+		
+		vector<unique_ptr<Worker> > m_workers;
+		size_t m_running;
+		Semaphore m_finished;
+};
+
 void QueueManager::Rechecker::add(const string& file)
 {
 	Lock l(cs);
@@ -556,52 +875,45 @@ int QueueManager::Rechecker::run()
 		}
 		
 		//Merklecheck
-		int64_t startPos = 0;
-		DummyOutputStream dummy;
-		int64_t blockSize = tt.getBlockSize();
-		bool hasBadBlocks = false;
-		
-		vector<uint8_t> buf((size_t)min((int64_t)1024 * 1024, blockSize));
-		
-		typedef pair<int64_t, int64_t> SizePair;
-		typedef vector<SizePair> Sizes;
-		Sizes sizes;
+		RecheckBlocks checker(tempTarget, tt, tempSize);
+		checker.start();
 		
+		const uint64_t startTick = GET_TICK();
+		vector<size_t> good;
+		bool finished = false;
+		while (!finished)
 		{
-			File inFile(tempTarget, File::READ, File::OPEN);
+			// wake up once a second to publish the verified blocks and the progress
+			finished = checker.wait(1000);
+			checker.takeGood(good);
+			
+			Lock l(qm->cs);
 			
-			while (startPos < tempSize)
+			// get q again in case it has been (re)moved
+			q = qm->fileQueue.find(file);
+			if (!q)
+				break;
+				
+			for (auto i = good.cbegin(); i != good.cend(); ++i)
 			{
-				try
-				{
-					MerkleCheckOutputStream<TigerTree, false> check(tt, &dummy, startPos);
-					
-					inFile.setPos(startPos);
-					int64_t bytesLeft = min((tempSize - startPos), blockSize); //Take care of the last incomplete block
-					int64_t segmentSize = bytesLeft;
-					while (bytesLeft > 0)
-					{
-						size_t n = (size_t)min((int64_t)buf.size(), bytesLeft);
-						size_t nr = inFile.read(&buf[0], n);
-						check.write(&buf[0], nr);
-						bytesLeft -= nr;
-						if (bytesLeft > 0 && nr == 0)
-						{
-							// Huh??
-							throw Exception();
-						}
-					}
-					check.flush();
-					
-					sizes.push_back(make_pair(startPos, segmentSize));
-				}
-				catch (const Exception&)
-				{
-					hasBadBlocks = true;
-					dcdebug("Found bad block at " I64_FMT "\n", startPos);
-				}
-				startPos += blockSize;
+				const int64_t startPos = *i * tt.getBlockSize();
+				q->addSegment(Segment(startPos, min(tempSize - startPos, tt.getBlockSize())));
 			}
+			if (!good.empty())
+			{
+				good.clear();
+				qm->fire(QueueManagerListener::StatusUpdated(), q);
+			}
+			
+			const uint64_t elapsed = GET_TICK() - startTick;
+			const int64_t checked = checker.getChecked();
+			qm->fire(QueueManagerListener::RecheckProgress(), q->getTarget(), checked, tempSize, elapsed ? checked * 1000 / (int64_t)elapsed : 0);
+		}
+		
+		if (!finished)
+		{
+			checker.stop();
+			continue;
 		}
 		
 		Lock l(qm->cs);
@@ -612,15 +924,12 @@ int QueueManager::Rechecker::run()
 			continue;
 			
 		//If no bad blocks then the file probably got stuck in the temp folder for some reason
-		if (!hasBadBlocks)
+		if (!checker.hasBadBlocks())
 		{
 			qm->moveStuckFile(q);
 			continue;
 		}
 		
-		for (Sizes::const_iterator i = sizes.begin(); i != sizes.end(); ++i)
-			q->addSegment(Segment(i->first, i->second));
-			
 		qm->rechecked(q);
 	}
 	return 0;
@@ -629,7 +938,7 @@ int QueueManager::Rechecker::run()
 QueueManager::QueueManager() :
 	lastSave(0),
 	rechecker(this),
-	dirty(true),
+	store(Util::getPath(Util::PATH_USER_CONFIG) + "Queue"),
 	nextSearch(0)
 {
 	queueFile = Util::getPath(Util::PATH_USER_CONFIG) + "Queue.xml";
@@ -860,6 +1169,7 @@ void QueueManager::add(const string& aTarget, int64_t aSize, const TTHValue& roo
 		if (!q)
 		{
 			q = fileQueue.add(target, aSize, aFlags, QueueItem::DEFAULT, tempTarget, GET_TIME(), root);
+			store.putItem(q);
 			fire(QueueManagerListener::Added(), q);
 			
 			newItem = !q->isSet(QueueItem::FLAG_USER_LIST);
@@ -884,7 +1194,6 @@ void QueueManager::add(const string& aTarget, int64_t aSize, const TTHValue& roo
 		}
 		
 		wantConnection = aUser.user && addSource(q, aUser, (Flags::MaskType)(addBad ? QueueItem::Source::FLAG_MASK : 0));
-		setDirty();
 	}
 	
 	if (wantConnection && aUser.user->isOnline())
@@ -913,15 +1222,6 @@ void QueueManager::readd(const string& target, const HintedUser& aUser) throw(Qu
 		ConnectionManager::getInstance()->getDownloadConnection(aUser);
 }
 
-void QueueManager::setDirty()
-{
-	if (!dirty)
-	{
-		dirty = true;
-		lastSave = GET_TICK();
-	}
-}
-
 string QueueManager::checkTarget(const string& aTarget, bool checkExistence) throw(QueueException, FileException)
 {
 #ifdef _WIN32
@@ -996,7 +1296,7 @@ bool QueueManager::addSource(QueueItem* qi, const HintedUser& aUser, Flags::Mask
 	}
 	
 	fire(QueueManagerListener::SourcesUpdated(), qi);
-	setDirty();
+	store.addSource(qi->getTarget(), aUser);
 	
 	return wantConnection;
 }
@@ -1018,7 +1318,6 @@ void QueueManager::addDirectory(const string& aDir, const HintedUser& aUser, con
 		// Unique directory, fine...
 		directories.insert(make_pair(aUser, new DirectoryItem(aUser, aDir, aTarget, p)));
 		needList = (dp.first == dp.second);
-		setDirty();
 	}
 	
 	if (needList)
@@ -1130,9 +1429,10 @@ void QueueManager::move(const string& aSource, const string& aTarget) noexcept
 		{
 			// Good, update the target and move in the queue...
 			fire(QueueManagerListener::Moved(), qs, aSource);
+			store.removeItem(qs->getTarget());
 			fileQueue.move(qs, target);
 			fire(QueueManagerListener::Added(), qs);
-			setDirty();
+			store.putItem(qs);
 		}
 		else
 		{
@@ -1263,6 +1563,7 @@ Download* QueueManager::getDownload(UserConnection& aSource, string& aMessage) n
 		{
 			// Temp target gone?
 			q->resetDownloaded();
+			store.putItem(q);
 		}
 	}
 	
@@ -1341,7 +1642,7 @@ void QueueManager::setFile(Download* d)
 			d->setOverlapped(false);
 			
 			bool found = false;
-			// ok, we got a fast slot, so it's possible to disconnect original user now
+			// the original chunk keeps running, the one that finishes the blocks first disconnects the other in putDownload
 			for (DownloadList::const_iterator i = qi->getDownloads().begin(); i != qi->getDownloads().end(); ++i)
 			{
 				if ((*i) != d && (*i)->getSegment().contains(d->getSegment()))
@@ -1352,9 +1653,6 @@ void QueueManager::setFile(Download* d)
 						break;
 						
 					found = true;
-					
-					// disconnect slow chunk
-					(*i)->getUserConnection().disconnect();
 					break;
 				}
 			}
@@ -1444,11 +1742,11 @@ void QueueManager::moveFile(const string& source, const string& target)
 	}
 }
 
-void QueueManager::moveFile_(const string& source, const string& target)
+void QueueManager::moveFile_(const string& source, const string& target, File::CopyProgress* p_progress /*= nullptr */)
 {
 	try
 	{
-		File::renameFile(source, target);
+		File::renameFile(source, target, p_progress);
 		getInstance()->fire(QueueManagerListener::FileMoved(), target);
 	}
 	catch (const FileException& /*e1*/)
@@ -1481,11 +1779,13 @@ void QueueManager::moveStuckFile(QueueItem* qi)
 	if (!BOOLSETTING(KEEP_FINISHED_FILES))
 	{
 		fire(QueueManagerListener::Removed(), qi);
+		store.removeItem(target);
 		fileQueue.remove(qi);
 	}
 	else
 	{
 		qi->addSegment(Segment(0, qi->getSize()));
+		store.putItem(qi);
 		fire(QueueManagerListener::StatusUpdated(), qi);
 	}
 	
@@ -1497,7 +1797,7 @@ void QueueManager::rechecked(QueueItem* qi)
 	fire(QueueManagerListener::RecheckDone(), qi->getTarget());
 	fire(QueueManagerListener::StatusUpdated(), qi);
 	
-	setDirty();
+	store.putItem(qi);
 }
 
 void QueueManager::putDownload(Download* aDownload, bool finished, bool reportFinish) noexcept
@@ -1597,7 +1897,13 @@ void QueueManager::putDownload(Download* aDownload, bool finished, bool reportFi
 						else if (aDownload->getType() == Transfer::TYPE_FILE)
 						{
 							aDownload->setOverlapped(false);
+							// the temp target is stored with the first segment
+							const bool l_first = q->getDone().empty();
 							q->addSegment(aDownload->getSegment());
+							if (l_first)
+								store.putItem(q);
+							else
+								store.addSegment(q->getTarget(), aDownload->getSegment());
 						}
 						
 						if (aDownload->getType() != Transfer::TYPE_FILE || q->isFinished())
@@ -1638,6 +1944,7 @@ void QueueManager::putDownload(Download* aDownload, bool finished, bool reportFi
 							if (!BOOLSETTING(KEEP_FINISHED_FILES) || aDownload->getType() == Transfer::TYPE_FULL_LIST)
 							{
 								fire(QueueManagerListener::Removed(), q);
+								store.removeItem(q->getTarget());
 								fileQueue.remove(q);
 							}
 							else
@@ -1647,13 +1954,21 @@ void QueueManager::putDownload(Download* aDownload, bool finished, bool reportFi
 						}
 						else
 						{
+							if (aDownload->getType() == Transfer::TYPE_FILE)
+							{
+								// the blocks were raced by an overlapped chunk, the one left behind has nothing more to get
+								for (DownloadList::const_iterator i = q->getDownloads().begin(); i != q->getDownloads().end(); ++i)
+								{
+									if (*i != aDownload && (*i)->getSegment().overlaps(aDownload->getSegment()))
+										(*i)->getUserConnection().disconnect();
+								}
+							}
 							userQueue.removeDownload(q, aDownload->getUser());
 							if (aDownload->getType() != Transfer::TYPE_FILE || (reportFinish && q->isWaiting()))
 							{
 								fire(QueueManagerListener::StatusUpdated(), q);
 							}
 						}
-						setDirty();
 					}
 				}
 				else
@@ -1680,8 +1995,12 @@ void QueueManager::putDownload(Download* aDownload, bool finished, bool reportFi
 								// since download is not finished, it should never happen that downloaded size is same as segment size
 								dcassert(downloaded < aDownload->getSize());
 								
+								const bool l_first = q->getDone().empty();
 								q->addSegment(Segment(aDownload->getStartPos(), downloaded));
-								setDirty();
+								if (l_first)
+									store.putItem(q);
+								else
+									store.addSegment(q->getTarget(), Segment(aDownload->getStartPos(), downloaded));
 							}
 						}
 					}
@@ -1829,7 +2148,7 @@ void QueueManager::remove(const string& aTarget) noexcept
 		}
 		fileQueue.remove(q);
 		
-		setDirty();
+		store.removeItem(aTarget);
 	}
 	
 	for (auto i = x.begin(); i != x.end(); ++i)
@@ -1877,7 +2196,7 @@ void QueueManager::removeSource(const string& aTarget, const UserPtr& aUser, Fla
 		q->removeSource(aUser, reason);
 		
 		fire(QueueManagerListener::SourcesUpdated(), q);
-		setDirty();
+		store.removeSource(aTarget, aUser);
 	}
 endCheck:
 	if (isRunning && removeConn)
@@ -1909,7 +2228,7 @@ void QueueManager::removeSource(const UserPtr& aUser, Flags::MaskType reason) no
 				userQueue.remove(qi, aUser);
 				qi->removeSource(aUser, reason);
 				fire(QueueManagerListener::SourcesUpdated(), qi);
-				setDirty();
+				store.removeSource(qi->getTarget(), aUser);
 			}
 		}
 		
@@ -1928,7 +2247,7 @@ void QueueManager::removeSource(const UserPtr& aUser, Flags::MaskType reason) no
 				qi->removeSource(aUser, reason);
 				fire(QueueManagerListener::StatusUpdated(), qi);
 				fire(QueueManagerListener::SourcesUpdated(), qi);
-				setDirty();
+				store.removeSource(qi->getTarget(), aUser);
 			}
 		}
 	}
@@ -1962,7 +2281,7 @@ void QueueManager::setPriority(const string& aTarget, QueueItem::Priority p) noe
 				q->getOnlineUsers(getConn);
 			}
 			userQueue.setPriority(q, p);
-			setDirty();
+			store.putItem(q);
 			fire(QueueManagerListener::StatusUpdated(), q);
 		}
 	}
@@ -1995,7 +2314,7 @@ void QueueManager::setAutoPriority(const string& aTarget, bool ap) noexcept
 			{
 				priorities.push_back(make_pair(q->getTarget(), q->calculateAutoPriority()));
 			}
-			setDirty();
+			store.putItem(q);
 			fire(QueueManagerListener::StatusUpdated(), q);
 		}
 	}
@@ -2006,15 +2325,35 @@ void QueueManager::setAutoPriority(const string& aTarget, bool ap) noexcept
 	}
 }
 
+void QueueManager::setMaxSegments(const string& aTarget, uint8_t p_segments) noexcept
+{
+	Lock l(cs);
+	
+	QueueItem* q = fileQueue.find(aTarget);
+	if (q != NULL && q->getMaxSegments() != p_segments)
+	{
+		q->setMaxSegments(p_segments);
+		store.putItem(q);
+	}
+}
+
 void QueueManager::saveQueue(bool force) noexcept
 {
-	if (!dirty && !force)
-		return;
-		
+	store.flush();
+	if (force || store.needsCompaction())
+	{
+		Lock l(cs);
+		store.compact(fileQueue.getQueue(), force);
+		lastSave = GET_TICK();
+	}
+}
+
+void QueueManager::exportQueue(const string& p_file) noexcept
+{
 	try {
 		Lock l(cs);
 		
-		File ff(getQueueFile() + ".tmp", File::WRITE, File::CREATE | File::TRUNCATE);
+		File ff(p_file + ".tmp", File::WRITE, File::CREATE | File::TRUNCATE);
 		BufferedOutputStream<false> f(&ff);
 		
 		f.write(SimpleXML::utf8Header);
@@ -2087,21 +2426,18 @@ void QueueManager::saveQueue(bool force) noexcept
 		f.flush();
 		ff.close();
 		
-		File::deleteFile(getQueueFile() + ".bak");
-		if (File::isExist(getQueueFile()))
+		File::deleteFile(p_file + ".bak");
+		if (File::isExist(p_file))
 		{
-			File::copyFile(getQueueFile(), getQueueFile() + ".bak");
-			File::deleteFile(getQueueFile());
+			File::copyFile(p_file, p_file + ".bak");
+			File::deleteFile(p_file);
 		}
-		File::renameFile(getQueueFile() + ".tmp", getQueueFile());
-		dirty = false;
+		File::renameFile(p_file + ".tmp", p_file);
 	}
 	catch (Exception& e)
 	{
-		LogManager::getInstance()->getInstance()->message("[QueueManager::saveQueue] error: " + e.getError());
+		LogManager::getInstance()->getInstance()->message("[QueueManager::exportQueue] error: " + e.getError());
 	}
-	// Put this here to avoid very many saves tries when disk is full...
-	lastSave = GET_TICK();
 }
 
 class QueueLoader : public SimpleXMLReader::CallBack
@@ -2119,19 +2455,91 @@ class QueueLoader : public SimpleXMLReader::CallBack
 };
 
 void QueueManager::loadQueue() noexcept
+{
+	QueueStore::ItemMap l_items;
+	if (store.load(l_items))
+	{
+		for (auto i = l_items.cbegin(); i != l_items.cend(); ++i)
+		{
+			loadItem(i->second);
+		}
+	}
+	else
+	{
+		// the first start after Queue.xml, it stays there for the older versions
+		Util::migrate(getQueueFile());
+		importQueue(getQueueFile());
+	}
+	
+	Lock l(cs);
+	store.open(fileQueue.getQueue());
+}
+
+void QueueManager::importQueue(const string& p_file) noexcept
 {
 	try {
 		QueueLoader l;
-		Util::migrate(getQueueFile());
-		
-		File f(getQueueFile(), File::READ, File::OPEN);
+		File f(p_file, File::READ, File::OPEN);
 		SimpleXMLReader(&l).parse(f);
-		dirty = false;
 	}
 	catch (const Exception&)
 	{
 		// ...
 	}
+	// the loader adds the items past the journal
+	saveQueue(true);
+}
+
+void QueueManager::loadItem(const QueueStore::Item& p_item)
+{
+	if (p_item.m_size <= 0)
+		return;
+		
+	string target;
+	try
+	{
+		// @todo do something better about existing files
+		target = checkTarget(p_item.m_target,  /*checkExistence*/ false);
+		if (target.empty())
+			return;
+	}
+	catch (const Exception&)
+	{
+		return;
+	}
+	if (fileQueue.find(target))
+		return;
+		
+	QueueItem* qi = fileQueue.add(target, p_item.m_size, 0, p_item.m_priority, p_item.m_temp_target, p_item.m_added ? p_item.m_added : GET_TIME(), p_item.m_tth);
+	for (auto i = p_item.m_segments.cbegin(); i != p_item.m_segments.cend(); ++i)
+	{
+		if (i->getSize() > 0 && i->getStart() >= 0 && i->getEnd() <= qi->getSize())
+			qi->addSegment(*i);
+	}
+	qi->setAutoPriority(p_item.m_auto_priority);
+	if (!qi->getDone().empty())
+		qi->setPriority(qi->calculateAutoPriority());
+	qi->setMaxSegments(max((uint8_t)1, p_item.m_max_segments));
+	
+	fire(QueueManagerListener::Added(), qi);
+	
+	for (auto i = p_item.m_sources.cbegin(); i != p_item.m_sources.cend(); ++i)
+	{
+		if (i->m_cid.isZero())
+			continue;
+		UserPtr user = ClientManager::getInstance()->getUser(i->m_cid);
+		ClientManager::getInstance()->updateNick(user, i->m_nick);
+		user->setFirstNick(i->m_nick);
+		try
+		{
+			HintedUser hintedUser(user, i->m_hint);
+			if (addSource(qi, hintedUser, 0) && user->isOnline())
+				ConnectionManager::getInstance()->getDownloadConnection(hintedUser);
+		}
+		catch (const Exception&)
+		{
+		}
+	}
 }
 
 static const string sDownload = "Download";
@@ -2339,14 +2747,13 @@ void QueueManager::on(ClientManagerListener::UserConnected, const UserPtr& aUser
 	bool hasDown = false;
 	{
 		Lock l(cs);
-		for (int i = 0; i < QueueItem::LAST; ++i)
+		auto j = userQueue.getItems().find(aUser);
+		if (j != userQueue.getItems().end())
 		{
-			auto j = userQueue.getList(i).find(aUser);
-			if (j != userQueue.getList(i).end())
+			for (auto m = j->second.cbegin(); m != j->second.cend(); ++m)
 			{
-				for (auto m = j->second.begin(); m != j->second.end(); ++m)
-					fire(QueueManagerListener::StatusUpdated(), *m);
-				if (i != QueueItem::PAUSED)
+				fire(QueueManagerListener::StatusUpdated(), m->m_qi);
+				if (m->m_priority != QueueItem::PAUSED)
 					hasDown = true;
 			}
 		}
@@ -2362,23 +2769,17 @@ void QueueManager::on(ClientManagerListener::UserConnected, const UserPtr& aUser
 void QueueManager::on(ClientManagerListener::UserDisconnected, const UserPtr& aUser) noexcept
 {
 	Lock l(cs);
-	for (int i = 0; i < QueueItem::LAST; ++i)
+	auto j = userQueue.getItems().find(aUser);
+	if (j != userQueue.getItems().end())
 	{
-		auto j = userQueue.getList(i).find(aUser);
-		if (j != userQueue.getList(i).end())
-		{
-			for (auto m = j->second.begin(); m != j->second.end(); ++m)
-				fire(QueueManagerListener::StatusUpdated(), *m);
-		}
+		for (auto m = j->second.cbegin(); m != j->second.cend(); ++m)
+			fire(QueueManagerListener::StatusUpdated(), m->m_qi);
 	}
 }
 
 void QueueManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept
 {
-	if (dirty && ((lastSave + 10000) < aTick))
-	{
-		saveQueue();
-	}
+	saveQueue();
 	
 	
 	vector<pair<string, QueueItem::Priority>> priorities;
@@ -2544,6 +2945,7 @@ bool QueueManager::handlePartialResult(const HintedUser& aUser, const TTHValue&
 		if (si->getPartialSource())
 		{
 			si->getPartialSource()->setPartialInfo(partialSource.getPartialInfo());
+			qi->invalidateParts();
 		}
 	}
 	
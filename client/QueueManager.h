@@ -26,6 +26,7 @@
 #include "User.h"
 #include "File.h"
 #include "QueueItem.h"
+#include "QueueStore.h"
 #include "Singleton.h"
 #include "DirectoryListing.h"
 #include "MerkleTree.h"
@@ -78,10 +79,17 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 		
 		void setPriority(const string& aTarget, QueueItem::Priority p) noexcept;
 		void setAutoPriority(const string& aTarget, bool ap) noexcept;
+		void setMaxSegments(const string& aTarget, uint8_t p_segments) noexcept;
 		
 		void getTargets(const TTHValue& tth, StringList& sl);
 		const QueueItem::StringMap& lockQueue() noexcept { cs.lock(); return fileQueue.getQueue(); } ;
 		void unlockQueue() noexcept { cs.unlock(); }
+		/** Bytes not done yet of all the queued files, without the running chunks */
+		int64_t getBytesLeft() const
+		{
+			Lock l(cs);
+			return fileQueue.getBytesLeft();
+		}
 		
 		QueueItem::SourceList getSources(const QueueItem* qi) const
 		{
@@ -116,8 +124,13 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 		/** @return The highest priority download the user has, PAUSED may also mean no downloads */
 		QueueItem::Priority hasDownload(const UserPtr& aUser) noexcept;
 		
+		/** Queue.dat and its journal, Queue.xml of the older versions the first time */
 		void loadQueue() noexcept;
+		/** Flush the journal, force (or a long journal) writes a new snapshot */
 		void saveQueue(bool force = false) noexcept;
+		/** The queue in the XML format of Queue.xml */
+		void importQueue(const string& p_file) noexcept;
+		void exportQueue(const string& p_file) noexcept;
 		
 		void noDeleteFileList(const string& path);
 		
@@ -172,44 +185,75 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 		GETSET(string, queueFile, QueueFile);
 		
 		enum { MOVER_LIMIT = 10 * 1024 * 1024 };
-		class FileMover : public Thread
+		/** A finished file being moved from the temp directory to its target */
+		struct FileMove
+		{
+			FileMove() : m_size(0), m_moved(0), m_running(false) { }
+			string m_source;
+			string m_target;
+			string m_device;
+			int64_t m_size;
+			int64_t m_moved;
+			bool m_running;
+		};
+		typedef vector<FileMove> FileMoveList;
+		
+		/** Moves queued and in progress */
+		FileMoveList getFileMoves() const
+		{
+			return mover.getMoves();
+		}
+		
+		/**
+		 * Moves big files on a few threads so that one slow cross-device copy doesn't hold
+		 * back the others. Only one move at a time writes to the same target device.
+		 */
+		class FileMover
 		{
 			public:
-				FileMover() : active(false) { }
-				virtual ~FileMover()
-				{
-					join();
-				}
+				FileMover();
+				~FileMover();
 				
 				void moveFile(const string& source, const string& target);
-				virtual int run();
+				FileMoveList getMoves() const;
 			private:
-				typedef pair<string, string> FilePair;
-				typedef vector<FilePair> FileList;
-				typedef FileList::iterator FileIter;
+				enum { MOVER_THREADS = 4 };
+				enum { MOVER_DEVICE_THREADS = 1 };
 				
-				bool active;
+				typedef list<FileMove> MoveList;
 				
-				FileList files;
-				CriticalSection cs;
+				class Worker : public Thread, private File::CopyProgress
+				{
+					public:
+						Worker() : m_mover(nullptr), m_active(false), m_move(nullptr), m_last_fire(0) { }
+						~Worker()
+						{
+							join();
+						}
+						
+						FileMover* m_mover;
+						bool m_active;
+					private:
+						int run();
+						void onCopyProgress(int64_t p_copied, int64_t p_total) noexcept;
+						
+						FileMove* m_move;
+						uint64_t m_last_fire;
+				};
+				
+				bool pop(FileMove*& p_move);
+				void done(FileMove* p_move);
+				
+				MoveList m_moves;
+				std::map<string, size_t> m_devices; // moves in progress per target device
+				Worker m_workers[MOVER_THREADS];
+				mutable CriticalSection m_cs;
 		} mover;
 		
 		typedef vector<pair<QueueItem::SourceConstIter, QueueItem*> > PFSSourceList;
 		
 		class Rechecker : public Thread
 		{
-				struct DummyOutputStream : OutputStream
-				{
-					virtual size_t write(const void*, size_t n)
-					{
-						return n;
-					}
-					virtual size_t flush()
-					{
-						return 0;
-					}
-				};
-				
 			public:
 				explicit Rechecker(QueueManager* qm_) : qm(qm_), active(false) { }
 				virtual ~Rechecker()
@@ -232,7 +276,7 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 		class FileQueue
 		{
 			public:
-				FileQueue() { }
+				FileQueue() : m_bytes_left(0) { }
 				~FileQueue();
 				void add(QueueItem* qi);
 				QueueItem* add(const string& aTarget, int64_t aSize, Flags::MaskType aFlags, QueueItem::Priority p,
@@ -262,8 +306,14 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 				}
 				void move(QueueItem* qi, const string& aTarget);
 				void remove(QueueItem* qi);
+				/** Bytes not done yet of all the queued files, without the running chunks */
+				int64_t getBytesLeft() const
+				{
+					return m_bytes_left;
+				}
 			private:
 				QueueItem::StringMap queue;
+				int64_t m_bytes_left;
 		};
 		
 		/** QueueItems by target */
@@ -274,6 +324,28 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 		class UserQueue
 		{
 			public:
+				/** An item of a user, the key of UserQueue's order */
+				struct Entry
+				{
+					Entry(QueueItem* p_qi, uint64_t p_order) : m_priority(p_qi->getPriority()), m_order(p_order), m_qi(p_qi), m_no_parts(0) { }
+					
+					bool operator<(const Entry& rhs) const
+					{
+						return m_priority > rhs.m_priority || (m_priority == rhs.m_priority && m_order < rhs.m_order);
+					}
+					
+					QueueItem::Priority m_priority;
+					uint64_t m_order;
+					QueueItem* m_qi;
+					/** Parts generation of the item + 1 when the partial source had nothing needed, 0 if not checked */
+					mutable uint32_t m_no_parts;
+				};
+				/** Highest priority first, then the items with downloaded bytes, then in the order they were added */
+				typedef set<Entry> ItemSet;
+				typedef unordered_map<UserPtr, ItemSet, User::Hash> ItemMap;
+				
+				UserQueue() : m_front(FIRST_ORDER), m_back(FIRST_ORDER), m_running_files(0) { }
+				
 				void add(QueueItem* qi);
 				void add(QueueItem* qi, const UserPtr& aUser);
 				QueueItem* getNext(const UserPtr& aUser, QueueItem::Priority minPrio = QueueItem::LOWEST, int64_t wantedSize = 0, int64_t lastSpeed = 0, bool allowRemove = false);
@@ -285,14 +357,19 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 				void remove(QueueItem* qi, const UserPtr& aUser, bool removeRunning = true);
 				void setPriority(QueueItem* qi, QueueItem::Priority p);
 				
-				const unordered_map<UserPtr, QueueItemList, User::Hash>& getList(size_t i) const
+				const ItemMap& getItems() const
 				{
-					return userQueue[i];
+					return userQueue;
 				}
 				const unordered_map<UserPtr, QueueItemPtr, User::Hash>& getRunning() const
 				{
 					return m_running;
 				}
+				/** Items with at least one download, what FILE_SLOTS limits */
+				size_t getRunningFiles() const
+				{
+					return m_running_files;
+				}
 				
 				string getLastError()
 				{
@@ -302,10 +379,16 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 				}
 				
 			private:
-				/** QueueItems by priority and user (this is where the download order is determined) */
-				unordered_map<UserPtr, QueueItemList, User::Hash> userQueue[QueueItem::LAST];
+				static const uint64_t FIRST_ORDER = 0x8000000000000000ULL;
+				
+				/** QueueItems by user (this is where the download order is determined) */
+				ItemMap userQueue;
+				/** Orders handed out to the items put before and after the others */
+				uint64_t m_front;
+				uint64_t m_back;
 				/** Currently running downloads, a QueueItem is always either here or in the userQueue */
 				unordered_map<UserPtr, QueueItemPtr, User::Hash> m_running;
+				size_t m_running_files;
 				/** Last error message to sent to TransferView */
 				string lastError;
 		};
@@ -324,8 +407,8 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 		unordered_multimap<UserPtr, DirectoryItemPtr, User::Hash> directories;
 		/** Recent searches list, to avoid searching for the same thing too often */
 		deque<string> recent;
-		/** The queue needs to be saved */
-		bool dirty;
+		/** Snapshot and journal of the queue */
+		QueueStore store;
 		/** Next search */
 		uint64_t nextSearch;
 		/** File lists not to delete */
@@ -339,11 +422,10 @@ class QueueManager : public Singleton<QueueManager>, public Speaker<QueueManager
 		
 		void load(const SimpleXML& aXml);
 		void moveFile(const string& source, const string& target);
-		static void moveFile_(const string& source, const string& target);
+		static void moveFile_(const string& source, const string& target, File::CopyProgress* p_progress = nullptr);
 		void moveStuckFile(QueueItem* qi);
 		void rechecked(QueueItem* qi);
-		
-		void setDirty();
+		void loadItem(const QueueStore::Item& p_item);
 		
 		string getListPath(const HintedUser& user);
 		
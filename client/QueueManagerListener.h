@@ -49,8 +49,10 @@ class QueueManagerListener
 		typedef X<12> RecheckNoTree;
 		typedef X<13> RecheckAlreadyFinished;
 		typedef X<14> RecheckDone;
+		typedef X<16> RecheckProgress;
 		
 		typedef X<15> FileMoved;
+		typedef X<17> FileMoveProgress;
 		
 		virtual void on(Added, QueueItem*) noexcept { }
 		virtual void on(Finished, const QueueItem*, const string&, const Download*) noexcept { }
@@ -67,8 +69,12 @@ class QueueManagerListener
 		virtual void on(RecheckNoTree, const string&) noexcept { }
 		virtual void on(RecheckAlreadyFinished, const string&) noexcept { }
 		virtual void on(RecheckDone, const string&) noexcept { }
+		/** Verified bytes, file size and the checking speed in bytes per second */
+		virtual void on(RecheckProgress, const string&, int64_t, int64_t, int64_t) noexcept { }
 		
 		virtual void on(FileMoved, const string&) noexcept { }
+		/** Bytes moved so far and the file size, at most once a second per file */
+		virtual void on(FileMoveProgress, const string&, int64_t, int64_t) noexcept { }
 };
 
 } // namespace dcpp
@@ -0,0 +1,614 @@
+#include "stdinc.h"
+#include "QueueStore.h"
+
+#include "ClientManager.h"
+#include "LogManager.h"
+
+#include <zlib.h>
+
+namespace dcpp
+{
+
+static const char g_snapshot_magic[] = "FLQS";
+static const char g_journal_magic[] = "FLQJ";
+static const uint32_t VERSION = 1;
+static const size_t HEADER_SIZE = 4 + 4 + 8;
+
+enum
+{
+	REC_ITEM = 1,
+	REC_REMOVE,
+	REC_SEGMENT,
+	REC_SOURCE,
+	REC_SOURCE_REMOVE
+};
+
+// little endian whatever the platform, the files may be copied between machines
+static void put8(string& p_buf, uint8_t p_value)
+{
+	p_buf += static_cast<char>(p_value);
+}
+
+static void put32(string& p_buf, uint32_t p_value)
+{
+	for (int i = 0; i < 4; ++i)
+		p_buf += static_cast<char>((p_value >> (i * 8)) & 0xFF);
+}
+
+static void put64(string& p_buf, uint64_t p_value)
+{
+	for (int i = 0; i < 8; ++i)
+		p_buf += static_cast<char>((p_value >> (i * 8)) & 0xFF);
+}
+
+static void putString(string& p_buf, const string& p_value)
+{
+	put32(p_buf, static_cast<uint32_t>(p_value.size()));
+	p_buf += p_value;
+}
+
+static void putRecord(string& p_buf, uint8_t p_type, const string& p_payload)
+{
+	put32(p_buf, static_cast<uint32_t>(p_payload.size()));
+	const size_t l_start = p_buf.size();
+	put8(p_buf, p_type);
+	p_buf += p_payload;
+	put32(p_buf, crc32(crc32(0, nullptr, 0), reinterpret_cast<const Bytef*>(p_buf.data() + l_start), static_cast<uInt>(p_buf.size() - l_start)));
+}
+
+/** Bounds checked reading, once past the end everything reads as zero and isOk() is false */
+class RecordReader
+{
+	public:
+		RecordReader(const char* p_data, size_t p_size) : m_pos(reinterpret_cast<const uint8_t*>(p_data)), m_end(m_pos + p_size), m_ok(true) { }
+
+		bool isOk() const
+		{
+			return m_ok;
+		}
+		bool isEnd() const
+		{
+			return m_pos == m_end;
+		}
+		size_t getLeft() const
+		{
+			return m_end - m_pos;
+		}
+		const char* getPos() const
+		{
+			return reinterpret_cast<const char*>(m_pos);
+		}
+
+		bool skip(size_t p_len)
+		{
+			if (!m_ok || getLeft() < p_len)
+			{
+				m_ok = false;
+				return false;
+			}
+			m_pos += p_len;
+			return true;
+		}
+		uint8_t get8()
+		{
+			const uint8_t* l_pos = m_pos;
+			return skip(1) ? l_pos[0] : 0;
+		}
+		uint32_t get32()
+		{
+			const uint8_t* l_pos = m_pos;
+			if (!skip(4))
+				return 0;
+			uint32_t l_value = 0;
+			for (int i = 3; i >= 0; --i)
+				l_value = (l_value << 8) | l_pos[i];
+			return l_value;
+		}
+		uint64_t get64()
+		{
+			const uint64_t l_low = get32();
+			return l_low | (static_cast<uint64_t>(get32()) << 32);
+		}
+		string getString()
+		{
+			const uint32_t l_len = get32();
+			const char* l_pos = getPos();
+			return skip(l_len) ? string(l_pos, l_len) : Util::emptyString;
+		}
+		bool get(void* p_buf, size_t p_len)
+		{
+			const char* l_pos = getPos();
+			if (!skip(p_len))
+				return false;
+			memcpy(p_buf, l_pos, p_len);
+			return true;
+		}
+
+	private:
+		const uint8_t* m_pos;
+		const uint8_t* m_end;
+		bool m_ok;
+};
+
+/** @return False at the end or at a torn/damaged record */
+static bool getRecord(RecordReader& p_reader, uint8_t& p_type, RecordReader& p_payload)
+{
+	if (p_reader.getLeft() < 4 + 1 + 4)
+		return false;
+	const uint32_t l_len = p_reader.get32();
+	if (p_reader.getLeft() < size_t(l_len) + 1 + 4)
+		return false;
+	const char* l_start = p_reader.getPos();
+	p_reader.skip(1 + l_len);
+	const uint32_t l_crc = p_reader.get32();
+	if (l_crc != crc32(crc32(0, nullptr, 0), reinterpret_cast<const Bytef*>(l_start), 1 + l_len))
+		return false;
+	p_type = static_cast<uint8_t>(l_start[0]);
+	p_payload = RecordReader(l_start + 1, l_len);
+	return true;
+}
+
+static bool getHeader(RecordReader& p_reader, const char* p_magic, uint64_t& p_generation)
+{
+	char l_magic[4];
+	if (!p_reader.get(l_magic, sizeof(l_magic)) || memcmp(l_magic, p_magic, sizeof(l_magic)) != 0)
+		return false;
+	if (p_reader.get32() > VERSION)
+		return false;
+	p_generation = p_reader.get64();
+	return p_reader.isOk();
+}
+
+static bool getItem(RecordReader& p_reader, QueueStore::Item& p_item)
+{
+	p_item.m_target = p_reader.getString();
+	p_item.m_temp_target = p_reader.getString();
+	p_item.m_size = static_cast<int64_t>(p_reader.get64());
+	p_item.m_added = static_cast<time_t>(p_reader.get64());
+	p_reader.get(p_item.m_tth.data, TTHValue::BYTES);
+	p_item.m_priority = static_cast<QueueItem::Priority>(static_cast<int8_t>(p_reader.get8()));
+	p_item.m_auto_priority = p_reader.get8() != 0;
+	p_item.m_max_segments = p_reader.get8();
+	for (uint32_t i = p_reader.get32(); i > 0 && p_reader.isOk(); --i)
+	{
+		const int64_t l_start = static_cast<int64_t>(p_reader.get64());
+		const int64_t l_size = static_cast<int64_t>(p_reader.get64());
+		p_item.m_segments.push_back(Segment(l_start, l_size));
+	}
+	for (uint32_t i = p_reader.get32(); i > 0 && p_reader.isOk(); --i)
+	{
+		uint8_t l_cid[CID::SIZE];
+		p_reader.get(l_cid, sizeof(l_cid));
+		QueueStore::Source l_source;
+		l_source.m_cid = CID(l_cid);
+		l_source.m_nick = p_reader.getString();
+		l_source.m_hint = p_reader.getString();
+		p_item.m_sources.push_back(l_source);
+	}
+	return p_reader.isOk() && !p_item.m_target.empty();
+}
+
+static void eraseSource(vector<QueueStore::Source>& p_sources, const CID& p_cid)
+{
+	for (auto i = p_sources.begin(); i != p_sources.end(); ++i)
+	{
+		if (i->m_cid == p_cid)
+		{
+			p_sources.erase(i);
+			return;
+		}
+	}
+}
+
+/** @return False if the record is damaged */
+static bool applyRecord(uint8_t p_type, RecordReader& p_payload, QueueStore::ItemMap& p_items)
+{
+	if (p_type == REC_ITEM)
+	{
+		QueueStore::Item l_item;
+		if (!getItem(p_payload, l_item))
+			return false;
+		string l_target = l_item.m_target;
+		p_items[l_target] = move(l_item);
+		return true;
+	}
+
+	const string l_target = p_payload.getString();
+	auto l_item = p_items.find(l_target);
+	switch (p_type)
+	{
+		case REC_REMOVE:
+			if (l_item != p_items.end())
+				p_items.erase(l_item);
+			break;
+		case REC_SEGMENT:
+		{
+			const int64_t l_start = static_cast<int64_t>(p_payload.get64());
+			const int64_t l_size = static_cast<int64_t>(p_payload.get64());
+			if (l_item != p_items.end() && p_payload.isOk())
+				l_item->second.m_segments.push_back(Segment(l_start, l_size));
+			break;
+		}
+		case REC_SOURCE:
+		{
+			uint8_t l_cid[CID::SIZE];
+			QueueStore::Source l_source;
+			if (p_payload.get(l_cid, sizeof(l_cid)))
+				l_source.m_cid = CID(l_cid);
+			l_source.m_nick = p_payload.getString();
+			l_source.m_hint = p_payload.getString();
+			if (l_item != p_items.end() && p_payload.isOk())
+			{
+				eraseSource(l_item->second.m_sources, l_source.m_cid);
+				l_item->second.m_sources.push_back(l_source);
+			}
+			break;
+		}
+		case REC_SOURCE_REMOVE:
+		{
+			uint8_t l_cid[CID::SIZE];
+			if (p_payload.get(l_cid, sizeof(l_cid)) && l_item != p_items.end())
+				eraseSource(l_item->second.m_sources, CID(l_cid));
+			break;
+		}
+		default:
+			// a record of a newer version, nothing to do with it
+			break;
+	}
+	return p_payload.isOk();
+}
+
+QueueStore::QueueStore(const string& p_path) :
+	m_snapshot_file(p_path + ".dat"),
+	m_journal_file(p_path + ".jrn"),
+	m_journal_size(0),
+	m_snapshot_size(0),
+	m_generation(0),
+	m_open(false),
+	m_replayed(true),
+	m_writing(false)
+{
+}
+
+QueueStore::~QueueStore()
+{
+	join();
+}
+
+bool QueueStore::isStored(const QueueItem* p_qi)
+{
+	return !p_qi->isSet(QueueItem::FLAG_USER_LIST);
+}
+
+bool QueueStore::isStored(const HintedUser& p_user)
+{
+	return p_user.user && p_user.hint != "DHT";
+}
+
+void QueueStore::writeHeader(string& p_buf, const char* p_magic, uint64_t p_generation)
+{
+	p_buf.append(p_magic, 4);
+	put32(p_buf, VERSION);
+	put64(p_buf, p_generation);
+}
+
+void QueueStore::writeItem(string& p_buf, const QueueItem* p_qi)
+{
+	putString(p_buf, p_qi->getTarget());
+	putString(p_buf, p_qi->getDone().empty() ? Util::emptyString : p_qi->getTempTarget());
+	put64(p_buf, p_qi->getSize());
+	put64(p_buf, p_qi->getAdded());
+	p_buf.append(reinterpret_cast<const char*>(p_qi->getTTH().data), TTHValue::BYTES);
+	put8(p_buf, static_cast<uint8_t>(p_qi->getPriority()));
+	put8(p_buf, p_qi->getAutoPriority() ? 1 : 0);
+	put8(p_buf, p_qi->getMaxSegments());
+
+	put32(p_buf, static_cast<uint32_t>(p_qi->getDone().size()));
+	for (auto i = p_qi->getDone().cbegin(); i != p_qi->getDone().cend(); ++i)
+	{
+		put64(p_buf, i->getStart());
+		put64(p_buf, i->getSize());
+	}
+
+	const size_t l_count_pos = p_buf.size();
+	uint32_t l_count = 0;
+	put32(p_buf, 0);
+	for (auto i = p_qi->getSources().cbegin(); i != p_qi->getSources().cend(); ++i)
+	{
+		if (i->isSet(QueueItem::Source::FLAG_PARTIAL) || !isStored(i->getUser()))
+			continue;
+		const CID& l_cid = i->getUser().user->getCID();
+		p_buf.append(reinterpret_cast<const char*>(l_cid.data()), CID::SIZE);
+		putString(p_buf, ClientManager::getInstance()->getNicks(l_cid, i->getUser().hint)[0]);
+		putString(p_buf, i->getUser().hint);
+		++l_count;
+	}
+	string l_count_buf;
+	put32(l_count_buf, l_count);
+	p_buf.replace(l_count_pos, 4, l_count_buf);
+}
+
+int QueueStore::replay(const string& p_file, ItemMap& p_items, bool& p_damaged)
+{
+	string l_data;
+	try
+	{
+		File l_file(p_file, File::READ, File::OPEN);
+		l_data = l_file.read();
+	}
+	catch (const FileException&)
+	{
+		return -1;
+	}
+
+	RecordReader l_reader(l_data.data(), l_data.size());
+	uint64_t l_generation = 0;
+	if (!getHeader(l_reader, g_journal_magic, l_generation) || l_generation < m_generation)
+		return -1;
+
+	int l_count = 0;
+	uint8_t l_type;
+	RecordReader l_payload(nullptr, 0);
+	while (getRecord(l_reader, l_type, l_payload))
+	{
+		if (!applyRecord(l_type, l_payload, p_items))
+			break;
+		++l_count;
+	}
+	if (!l_reader.isEnd())
+	{
+		p_damaged = true;
+		LogManager::getInstance()->message("[QueueStore] " + p_file + ": the journal is damaged after record " + Util::toString(l_count)); // [!] TODO translate
+	}
+	return l_count;
+}
+
+bool QueueStore::load(ItemMap& p_items)
+{
+	string l_data;
+	try
+	{
+		File l_file(m_snapshot_file, File::READ, File::OPEN);
+		l_data = l_file.read();
+	}
+	catch (const FileException&)
+	{
+		return false;
+	}
+
+	RecordReader l_reader(l_data.data(), l_data.size());
+	uint64_t l_generation = 0;
+	if (!getHeader(l_reader, g_snapshot_magic, l_generation))
+	{
+		LogManager::getInstance()->message("[QueueStore] " + m_snapshot_file + " is damaged"); // [!] TODO translate
+		return false;
+	}
+	uint8_t l_type;
+	RecordReader l_payload(nullptr, 0);
+	while (getRecord(l_reader, l_type, l_payload))
+	{
+		if (l_type == REC_ITEM && !applyRecord(l_type, l_payload, p_items))
+			break;
+	}
+	if (!l_reader.isEnd())
+	{
+		LogManager::getInstance()->message("[QueueStore] " + m_snapshot_file + " is damaged, " + Util::toString(p_items.size()) + " items loaded"); // [!] TODO translate
+	}
+	m_generation = l_generation;
+	m_snapshot_size = l_data.size();
+	l_data.clear();
+
+	// the journal of an interrupted compaction goes first
+	bool l_damaged = false;
+	const int l_old = replay(m_journal_file + ".old", p_items, l_damaged);
+	const int l_current = replay(m_journal_file, p_items, l_damaged);
+	// only an intact empty journal is appended to, new records after a damaged tail would never be replayed
+	m_replayed = l_old >= 0 || l_current != 0 || l_damaged;
+	return true;
+}
+
+void QueueStore::open(const QueueItem::StringMap& p_queue)
+{
+	if (m_replayed)
+	{
+		// a fresh snapshot, the next start doesn't replay the same journal again
+		compact(p_queue, true);
+		return;
+	}
+	Lock l(m_cs);
+	m_pending.clear();
+	openJournal(false);
+	m_open = true;
+}
+
+void QueueStore::openJournal(bool p_truncate)
+{
+	try
+	{
+		m_journal.reset(new File(m_journal_file, File::WRITE, File::OPEN | File::CREATE | (p_truncate ? File::TRUNCATE : 0)));
+		m_journal_size = m_journal->getSize();
+		if (m_journal_size < static_cast<int64_t>(HEADER_SIZE))
+		{
+			string l_header;
+			writeHeader(l_header, g_journal_magic, m_generation);
+			m_journal->setPos(0);
+			m_journal->write(l_header.data(), l_header.size());
+			m_journal->setEOF();
+			m_journal_size = l_header.size();
+		}
+		else
+		{
+			m_journal->setEndPos(0);
+		}
+	}
+	catch (const FileException& e)
+	{
+		m_journal.reset();
+		LogManager::getInstance()->message("[QueueStore] " + m_journal_file + ": " + e.getError()); // [!] TODO translate
+	}
+}
+
+void QueueStore::append(uint8_t p_type, const string& p_payload)
+{
+	Lock l(m_cs);
+	if (!m_open)
+		return;
+	putRecord(m_pending, p_type, p_payload);
+	if (m_pending.size() >= FLUSH_SIZE)
+		flush();
+}
+
+void QueueStore::putItem(const QueueItem* p_qi)
+{
+	if (!isStored(p_qi))
+		return;
+	string l_payload;
+	writeItem(l_payload, p_qi);
+	append(REC_ITEM, l_payload);
+}
+
+void QueueStore::removeItem(const string& p_target)
+{
+	string l_payload;
+	putString(l_payload, p_target);
+	append(REC_REMOVE, l_payload);
+}
+
+void QueueStore::addSegment(const string& p_target, const Segment& p_segment)
+{
+	string l_payload;
+	putString(l_payload, p_target);
+	put64(l_payload, p_segment.getStart());
+	put64(l_payload, p_segment.getSize());
+	append(REC_SEGMENT, l_payload);
+}
+
+void QueueStore::addSource(const string& p_target, const HintedUser& p_user)
+{
+	if (!isStored(p_user))
+		return;
+	const CID& l_cid = p_user.user->getCID();
+	string l_payload;
+	putString(l_payload, p_target);
+	l_payload.append(reinterpret_cast<const char*>(l_cid.data()), CID::SIZE);
+	putString(l_payload, ClientManager::getInstance()->getNicks(l_cid, p_user.hint)[0]);
+	putString(l_payload, p_user.hint);
+	append(REC_SOURCE, l_payload);
+}
+
+void QueueStore::removeSource(const string& p_target, const UserPtr& p_user)
+{
+	string l_payload;
+	putString(l_payload, p_target);
+	l_payload.append(reinterpret_cast<const char*>(p_user->getCID().data()), CID::SIZE);
+	append(REC_SOURCE_REMOVE, l_payload);
+}
+
+void QueueStore::flush()
+{
+	Lock l(m_cs);
+	if (m_pending.empty() || !m_journal)
+		return;
+	try
+	{
+		m_journal->write(m_pending.data(), m_pending.size());
+		m_journal_size += m_pending.size();
+	}
+	catch (const FileException& e)
+	{
+		LogManager::getInstance()->message("[QueueStore] " + m_journal_file + ": " + e.getError()); // [!] TODO translate
+	}
+	m_pending.clear();
+}
+
+bool QueueStore::needsCompaction() const
+{
+	Lock l(m_cs);
+	return !m_writing && m_journal_size > max<int64_t>(MIN_COMPACT_SIZE, m_snapshot_size);
+}
+
+void QueueStore::compact(const QueueItem::StringMap& p_queue, bool p_wait)
+{
+	if (m_writing && !p_wait)
+		return;
+	join();
+
+	string l_snapshot;
+	writeHeader(l_snapshot, g_snapshot_magic, m_generation + 1);
+	string l_payload;
+	for (auto i = p_queue.cbegin(); i != p_queue.cend(); ++i)
+	{
+		if (!isStored(i->second))
+			continue;
+		l_payload.clear();
+		writeItem(l_payload, i->second);
+		putRecord(l_snapshot, REC_ITEM, l_payload);
+	}
+
+	{
+		Lock l(m_cs);
+		// the snapshot has all of it, but until it's on disk the old journal has to have it too
+		flush();
+		m_pending.clear();
+		m_journal.reset();
+		try
+		{
+			File::deleteFile(m_journal_file + ".old");
+			if (File::isExist(m_journal_file))
+				File::renameFile(m_journal_file, m_journal_file + ".old");
+		}
+		catch (const FileException& e)
+		{
+			LogManager::getInstance()->message("[QueueStore] " + m_journal_file + ": " + e.getError()); // [!] TODO translate
+		}
+		++m_generation;
+		openJournal(true);
+		m_open = true;
+		m_replayed = false;
+		m_snapshot_size = l_snapshot.size();
+	}
+
+	m_snapshot.swap(l_snapshot);
+	if (!p_wait)
+	{
+		m_writing = true;
+		try
+		{
+			start();
+			return;
+		}
+		catch (const ThreadException&)
+		{
+			m_writing = false;
+		}
+	}
+	writeSnapshot();
+}
+
+void QueueStore::writeSnapshot()
+{
+	const string l_tmp = m_snapshot_file + ".tmp";
+	try
+	{
+		{
+			File l_file(l_tmp, File::WRITE, File::CREATE | File::TRUNCATE);
+			l_file.write(m_snapshot.data(), m_snapshot.size());
+		}
+		File::renameFile(l_tmp, m_snapshot_file);
+		File::deleteFile(m_journal_file + ".old");
+	}
+	catch (const FileException& e)
+	{
+		LogManager::getInstance()->message("[QueueStore] " + m_snapshot_file + ": " + e.getError()); // [!] TODO translate
+	}
+	string().swap(m_snapshot);
+}
+
+int QueueStore::run()
+{
+	writeSnapshot();
+	m_writing = false;
+	return 0;
+}
+
+} // namespace dcpp
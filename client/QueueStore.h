@@ -0,0 +1,124 @@
+#ifndef DCPLUSPLUS_DCPP_QUEUE_STORE_H
+#define DCPLUSPLUS_DCPP_QUEUE_STORE_H
+
+#include <boost/atomic.hpp>
+
+#include "QueueItem.h"
+#include "Thread.h"
+
+namespace dcpp
+{
+
+class File;
+
+/**
+ * Binary persistence of the download queue: a snapshot of all the items (Queue.dat)
+ * and an append-only journal (Queue.jrn) of what changed since, so a change costs
+ * a record of a few bytes instead of rewriting the whole queue.
+ * When the journal grows, compact() serializes the queue into a new snapshot, under the lock
+ * of the caller but only in memory; the file is written on a thread of its own.
+ *
+ * Both files start with a generation, the journal is replayed only over the snapshot of
+ * its generation (or an older one, when the process died during a compaction).
+ * Every record carries a crc32, a torn tail of the journal is dropped on load.
+ * File lists, partial (PFS) and DHT sources aren't stored, same as in Queue.xml.
+ */
+class QueueStore : private Thread
+{
+	public:
+		struct Source
+		{
+			CID m_cid;
+			string m_nick;
+			string m_hint;
+		};
+		struct Item
+		{
+			Item() : m_size(0), m_added(0), m_priority(QueueItem::DEFAULT), m_auto_priority(false), m_max_segments(1) { }
+			string m_target;
+			string m_temp_target;
+			int64_t m_size;
+			time_t m_added;
+			TTHValue m_tth;
+			QueueItem::Priority m_priority;
+			bool m_auto_priority;
+			uint8_t m_max_segments;
+			vector<Segment> m_segments;
+			vector<Source> m_sources;
+		};
+		typedef unordered_map<string, Item> ItemMap;
+
+		/** @param p_path Path of the files without the extension */
+		explicit QueueStore(const string& p_path);
+		~QueueStore();
+
+		/**
+		 * Read the snapshot and replay the journals over it.
+		 * @return False if there is no snapshot (the queue is still in Queue.xml)
+		 */
+		bool load(ItemMap& p_items);
+		/**
+		 * Start journaling, the changes before are dropped (they are the ones of loading the queue).
+		 * Writes a new snapshot first if the journal of load() wasn't empty.
+		 */
+		void open(const QueueItem::StringMap& p_queue);
+
+		void putItem(const QueueItem* p_qi);
+		void removeItem(const string& p_target);
+		void addSegment(const string& p_target, const Segment& p_segment);
+		void addSource(const string& p_target, const HintedUser& p_user);
+		void removeSource(const string& p_target, const UserPtr& p_user);
+
+		/** Write the buffered records to the journal */
+		void flush();
+		bool needsCompaction() const;
+		/**
+		 * Snapshot p_queue and start a new journal, the caller holds the lock of the queue.
+		 * Unless p_wait the snapshot is written in the background, if the previous one is still
+		 * being written this one is skipped.
+		 */
+		void compact(const QueueItem::StringMap& p_queue, bool p_wait);
+
+	private:
+		enum
+		{
+			FLUSH_SIZE = 64 * 1024,
+			MIN_COMPACT_SIZE = 4 * 1024 * 1024
+		};
+
+		static bool isStored(const QueueItem* p_qi);
+		static bool isStored(const HintedUser& p_user);
+		static void writeItem(string& p_buf, const QueueItem* p_qi);
+		static void writeHeader(string& p_buf, const char* p_magic, uint64_t p_generation);
+
+		void append(uint8_t p_type, const string& p_payload);
+		void openJournal(bool p_truncate);
+		/**
+		 * @param p_damaged Set if the journal stops at a torn or damaged record
+		 * @return Number of records replayed, -1 if the journal doesn't belong to the snapshot
+		 */
+		int replay(const string& p_file, ItemMap& p_items, bool& p_damaged);
+		void writeSnapshot();
+
+		int run();
+
+		const string m_snapshot_file;
+		const string m_journal_file;
+
+		mutable CriticalSection m_cs;
+		unique_ptr<File> m_journal;
+		string m_pending;
+		int64_t m_journal_size;
+		int64_t m_snapshot_size;
+		uint64_t m_generation;
+		bool m_open;
+		bool m_replayed;
+
+		/** Serialized queue for the writer thread */
+		string m_snapshot;
+		boost::atomic<bool> m_writing;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_QUEUE_STORE_H)
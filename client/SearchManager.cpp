@@ -48,11 +48,19 @@ const char* SearchManager::getTypeStr(int type)
 	return l_types[type];
 }
 
+static const size_t UDP_PACKETS_PREALLOCATED = 256;
+static const size_t UDP_PACKETS_MAX = 4096;
+static const int UDP_READ_BATCH = 32;
+
 SearchManager::SearchManager() :
 	port(0),
 	stop(false)
 {
-
+	const unsigned l_count = max(1u, min(4u, boost::thread::hardware_concurrency()));
+	for (unsigned i = 0; i < l_count; ++i)
+	{
+		m_queues.push_back(unique_ptr<UdpQueue>(new UdpQueue(m_packet_pool)));
+	}
 }
 
 SearchManager::~SearchManager()
@@ -84,9 +92,9 @@ void SearchManager::search(const string& aName, int64_t aSize, TypeModes aTypeMo
 	ClientManager::getInstance()->search(aSizeMode, aSize, aTypeMode, normalizeWhitespace(aName), aToken, aOwner);
 }
 
-uint64_t SearchManager::search(StringList& who, const string& aName, int64_t aSize /* = 0 */, TypeModes aTypeMode /* = TYPE_ANY */, SizeModes aSizeMode /* = SIZE_ATLEAST */, const string& aToken /* = Util::emptyString */, const StringList& aExtList, void* aOwner /* = NULL */)
+uint64_t SearchManager::search(StringList& who, const string& aName, int64_t aSize /* = 0 */, TypeModes aTypeMode /* = TYPE_ANY */, SizeModes aSizeMode /* = SIZE_ATLEAST */, const string& aToken /* = Util::emptyString */, const StringList& aExtList, void* aOwner /* = NULL */, SearchQueue::Priority aPriority /* = PRIORITY_INTERACTIVE */)
 {
-	return ClientManager::getInstance()->search(who, aSizeMode, aSize, aTypeMode, normalizeWhitespace(aName), aToken, aExtList, aOwner);
+	return ClientManager::getInstance()->search(who, aSizeMode, aSize, aTypeMode, normalizeWhitespace(aName), aToken, aExtList, aOwner, aPriority);
 }
 
 void SearchManager::listen()
@@ -116,7 +124,7 @@ void SearchManager::disconnect() noexcept
 	if (socket.get())
 	{
 		stop = true;
-		queue.shutdown();
+		stopQueues();
 		socket->disconnect();
 		port = 0;
 		
@@ -131,11 +139,13 @@ void SearchManager::disconnect() noexcept
 #define BUFSIZE 8192
 int SearchManager::run()
 {
-	std::unique_ptr<uint8_t[]> buf(new uint8_t[BUFSIZE]);
-	int len;
-	Socket::addr remoteAddr = { 0 };
+	UdpPacket* l_packets[UDP_READ_BATCH];
+	uint8_t* l_bufs[UDP_READ_BATCH];
+	int l_lens[UDP_READ_BATCH];
+	Socket::addr l_addrs[UDP_READ_BATCH];
+	std::unique_ptr<uint8_t[]> l_scratch(new uint8_t[BUFSIZE]);
 	
-	queue.start();
+	startQueues();
 	while (!stop)
 	{
 		try
@@ -145,9 +155,48 @@ int SearchManager::run()
 				// @todo: remove this workaround for http://bugs.winehq.org/show_bug.cgi?id=22291
 				// if that's fixed by reverting to simpler while (read(...) > 0) {...} code.
 				while (socket->wait(400, Socket::WAIT_READ) != Socket::WAIT_READ);
-				if (stop || (len = socket->read(&buf[0], BUFSIZE, remoteAddr)) <= 0)
+				if (stop)
+					break;
+					
+				int l_count = 0;
+				for (; l_count < UDP_READ_BATCH; ++l_count)
+				{
+					if ((l_packets[l_count] = m_packet_pool.get()) == nullptr)
+						break;
+					l_packets[l_count]->m_data.resize(BUFSIZE);
+					l_bufs[l_count] = (uint8_t*)&l_packets[l_count]->m_data[0];
+				}
+				
+				int n;
+				if (l_count == 0)
+				{
+					// The parsers are too far behind - read the datagram to keep the socket going and drop it
+					l_bufs[0] = l_scratch.get();
+					n = socket->readBatch(l_bufs, l_lens, l_addrs, 1, BUFSIZE);
+					if (n > 0)
+						m_packet_pool.incDropped();
+				}
+				else
+				{
+					n = socket->readBatch(l_bufs, l_lens, l_addrs, l_count, BUFSIZE);
+					for (int i = 0; i < l_count; ++i)
+					{
+						if (i < n)
+						{
+							UdpPacket* p = l_packets[i];
+							p->m_data.resize(l_lens[i]);
+							p->m_addr = l_addrs[i];
+							p->m_resolve = true;
+							dispatch(p);
+						}
+						else
+						{
+							m_packet_pool.release(l_packets[i]);
+						}
+					}
+				}
+				if (n <= 0)
 					break;
-				onData(&buf[0], len, Socket::resolveName(remoteAddr));
 			}
 		}
 		catch (const SocketException& e)
@@ -195,10 +244,95 @@ int SearchManager::run()
 	return 0;
 }
 
+SearchManager::UdpPacketPool::UdpPacketPool() : m_count(UDP_PACKETS_PREALLOCATED), m_dropped(0)
+{
+	m_free.reserve(UDP_PACKETS_MAX);
+	for (size_t i = 0; i < UDP_PACKETS_PREALLOCATED; ++i)
+	{
+		UdpPacket* p = new UdpPacket;
+		p->m_data.reserve(BUFSIZE);
+		m_free.push_back(p);
+	}
+}
+
+SearchManager::UdpPacketPool::~UdpPacketPool()
+{
+	for (auto i = m_free.cbegin(); i != m_free.cend(); ++i)
+	{
+		delete *i;
+	}
+}
+
+SearchManager::UdpPacket* SearchManager::UdpPacketPool::get()
+{
+	{
+		Lock l(cs);
+		if (!m_free.empty())
+		{
+			UdpPacket* p = m_free.back();
+			m_free.pop_back();
+			return p;
+		}
+		if (m_count >= UDP_PACKETS_MAX)
+			return nullptr;
+		++m_count;
+	}
+	UdpPacket* p = new UdpPacket;
+	p->m_data.reserve(BUFSIZE);
+	return p;
+}
+
+void SearchManager::UdpPacketPool::release(UdpPacket* p_packet)
+{
+	p_packet->m_ip.clear();
+	p_packet->m_resolve = false;
+	Lock l(cs);
+	m_free.push_back(p_packet);
+}
+
+void SearchManager::startQueues()
+{
+	for (auto i = m_queues.cbegin(); i != m_queues.cend(); ++i)
+	{
+		(*i)->start();
+	}
+}
+
+void SearchManager::stopQueues()
+{
+	for (auto i = m_queues.cbegin(); i != m_queues.cend(); ++i)
+	{
+		(*i)->shutdown();
+	}
+}
+
+string SearchManager::getRouteKey(const string& x)
+{
+	if (x.compare(0, 4, "$SR ") == 0)
+	{
+		// NMDC results carry no token - keep the results coming through one hub together
+		const string::size_type i = x.rfind(" (");
+		return i == string::npos ? Util::emptyString : x.substr(i);
+	}
+	// ADC: the search token if there is one, the sender's CID otherwise
+	string::size_type i = x.find(" TO");
+	if (i != string::npos)
+	{
+		i += 3;
+		return x.substr(i, x.find_first_of(" \n", i) - i);
+	}
+	return x.substr(0, min<string::size_type>(x.find(' ', 5), 44));
+}
+
+void SearchManager::dispatch(UdpPacket* p_packet)
+{
+	const size_t l_index = m_queues.size() == 1 ? 0 : std::hash<string>()(getRouteKey(p_packet->m_data)) % m_queues.size();
+	m_queues[l_index]->addResult(p_packet);
+}
+
 int SearchManager::UdpQueue::run()
 {
-	string x;
-	string remoteIp;
+	deque<UdpPacket*> l_packets;
 	stop = false;
 	
 	while (true)
@@ -211,182 +345,199 @@ int SearchManager::UdpQueue::run()
 			Lock l(cs);
 			if (resultList.empty()) continue;
 			
-			x = resultList.front().first;
-			remoteIp = resultList.front().second;
-			resultList.pop_front();
+			l_packets.swap(resultList);
 		}
 		
-		if (x.compare(0, 4, "$SR ") == 0)
+		for (auto i = l_packets.cbegin(); i != l_packets.cend(); ++i)
 		{
-			string::size_type i, j;
-			// Directories: $SR <nick><0x20><directory><0x20><free slots>/<total slots><0x05><Hubname><0x20>(<Hubip:port>)
-			// Files:       $SR <nick><0x20><filename><0x05><filesize><0x20><free slots>/<total slots><0x05><Hubname><0x20>(<Hubip:port>)
-			i = 4;
-			if ((j = x.find(' ', i)) == string::npos)
-			{
-				continue;
-			}
-			string nick = x.substr(i, j - i);
-			i = j + 1;
-			
-			// A file has 2 0x05, a directory only one
-			size_t cnt = count(x.begin() + j, x.end(), 0x05);
-			
-			SearchResult::Types type = SearchResult::TYPE_FILE;
-			string file;
-			int64_t size = 0;
-			
-			if (cnt == 1)
+			UdpPacket* p = *i;
+			if (p->m_resolve)
+				p->m_ip = Socket::resolveName(p->m_addr);
+			if (!stop)
+				parse(p->m_data, p->m_ip);
+			m_pool.release(p);
+		}
+		l_packets.clear();
+	}
+	return 0;
+}
+
+void SearchManager::UdpQueue::parse(const string& x, const string& remoteIp)
+{
+	if (x.compare(0, 4, "$SR ") == 0)
+	{
+		string::size_type i, j;
+		// Directories: $SR <nick><0x20><directory><0x20><free slots>/<total slots><0x05><Hubname><0x20>(<Hubip:port>)
+		// Files:       $SR <nick><0x20><filename><0x05><filesize><0x20><free slots>/<total slots><0x05><Hubname><0x20>(<Hubip:port>)
+		i = 4;
+		if ((j = x.find(' ', i)) == string::npos)
+		{
+			return;
+		}
+		string nick = x.substr(i, j - i);
+		i = j + 1;
+		
+		// A file has 2 0x05, a directory only one
+		size_t cnt = count(x.begin() + j, x.end(), 0x05);
+		
+		SearchResult::Types type = SearchResult::TYPE_FILE;
+		string file;
+		int64_t size = 0;
+		
+		if (cnt == 1)
+		{
+			// We have a directory...find the first space beyond the first 0x05 from the back
+			// (dirs might contain spaces as well...clever protocol, eh?)
+			type = SearchResult::TYPE_DIRECTORY;
+			// Get past the hubname that might contain spaces
+			if ((j = x.rfind(0x05)) == string::npos)
 			{
-				// We have a directory...find the first space beyond the first 0x05 from the back
-				// (dirs might contain spaces as well...clever protocol, eh?)
-				type = SearchResult::TYPE_DIRECTORY;
-				// Get past the hubname that might contain spaces
-				if ((j = x.rfind(0x05)) == string::npos)
-				{
-					continue;
-				}
-				// Find the end of the directory info
-				if ((j = x.rfind(' ', j - 1)) == string::npos)
-				{
-					continue;
-				}
-				if (j < i + 1)
-				{
-					continue;
-				}
-				file = x.substr(i, j - i) + '\\';
+				return;
 			}
-			else if (cnt == 2)
+			// Find the end of the directory info
+			if ((j = x.rfind(' ', j - 1)) == string::npos)
 			{
-				if ((j = x.find((char)5, i)) == string::npos)
-				{
-					continue;
-				}
-				file = x.substr(i, j - i);
-				i = j + 1;
-				if ((j = x.find(' ', i)) == string::npos)
-				{
-					continue;
-				}
-				size = Util::toInt64(x.substr(i, j - i));
+				return;
 			}
-			i = j + 1;
-			
-			if ((j = x.find('/', i)) == string::npos)
+			if (j < i + 1)
 			{
-				continue;
+				return;
 			}
-			uint8_t freeSlots = (uint8_t)Util::toInt(x.substr(i, j - i));
-			i = j + 1;
+			file = x.substr(i, j - i) + '\\';
+		}
+		else if (cnt == 2)
+		{
 			if ((j = x.find((char)5, i)) == string::npos)
 			{
-				continue;
+				return;
 			}
-			uint8_t slots = (uint8_t)Util::toInt(x.substr(i, j - i));
+			file = x.substr(i, j - i);
 			i = j + 1;
-			if ((j = x.rfind(" (")) == string::npos)
-			{
-				continue;
-			}
-			string hubName = x.substr(i, j - i);
-			i = j + 2;
-			if ((j = x.rfind(')')) == string::npos)
+			if ((j = x.find(' ', i)) == string::npos)
 			{
-				continue;
+				return;
 			}
+			size = Util::toInt64(x.substr(i, j - i));
+		}
+		i = j + 1;
+		
+		if ((j = x.find('/', i)) == string::npos)
+		{
+			return;
+		}
+		uint8_t freeSlots = (uint8_t)Util::toInt(x.substr(i, j - i));
+		i = j + 1;
+		if ((j = x.find((char)5, i)) == string::npos)
+		{
+			return;
+		}
+		uint8_t slots = (uint8_t)Util::toInt(x.substr(i, j - i));
+		i = j + 1;
+		if ((j = x.rfind(" (")) == string::npos)
+		{
+			return;
+		}
+		string hubName = x.substr(i, j - i);
+		i = j + 2;
+		if ((j = x.rfind(')')) == string::npos)
+		{
+			return;
+		}
+		
+		string hubIpPort = x.substr(i, j - i);
+		string url = ClientManager::getInstance()->findHub(hubIpPort);
+		
+		string encoding = ClientManager::getInstance()->findHubEncoding(url);
+		nick = Text::toUtf8(nick, encoding);
+		file = Text::toUtf8(file, encoding);
+		const bool l_isTTH = isTTHBase64(hubName);
+		if (!l_isTTH) // [+]FlylinkDC++ Team
+			hubName = Text::toUtf8(hubName, encoding);
 			
-			string hubIpPort = x.substr(i, j - i);
-			string url = ClientManager::getInstance()->findHub(hubIpPort);
-			
-			string encoding = ClientManager::getInstance()->findHubEncoding(url);
-			nick = Text::toUtf8(nick, encoding);
-			file = Text::toUtf8(file, encoding);
-			const bool l_isTTH = isTTHBase64(hubName);
-			if (!l_isTTH) // [+]FlylinkDC++ Team
-				hubName = Text::toUtf8(hubName, encoding);
-				
-			UserPtr user = ClientManager::getInstance()->findUser(nick, url);
+		UserPtr user = ClientManager::getInstance()->findUser(nick, url);
+		if (!user)
+		{
+			// Could happen if hub has multiple URLs / IPs
+			user = ClientManager::getInstance()->findLegacyUser(nick);
 			if (!user)
-			{
-				// Could happen if hub has multiple URLs / IPs
-				user = ClientManager::getInstance()->findLegacyUser(nick);
-				if (!user)
-					continue;
-			}
-			if (!remoteIp.empty())
-				user->setLastIP(remoteIp);
-			ClientManager::getInstance()->setIPUser(user, remoteIp);
-			
-			string tth;
-			if (l_isTTH)
-			{
-				tth = hubName.substr(4);
-				StringList names = ClientManager::getInstance()->getHubNames(user->getCID(), Util::emptyString);
-				hubName = names.empty() ? STRING(OFFLINE) : Util::toString(names);
-			}
-			
-			if (tth.empty() && type == SearchResult::TYPE_FILE)
-			{
-				continue;
-			}
-			SearchResultPtr sr(new SearchResult(user, type, slots, freeSlots, size,
-			                                    file, hubName, url, remoteIp, TTHValue(tth), Util::emptyString));
-			SearchManager::getInstance()->fire(SearchManagerListener::SR(), sr);
-			
+				return;
 		}
-		else if (x.compare(1, 4, "RES ") == 0 && x[x.length() - 1] == 0x0a)
+		if (!remoteIp.empty())
+			user->setLastIP(remoteIp);
+		ClientManager::getInstance()->setIPUser(user, remoteIp);
+		
+		string tth;
+		if (l_isTTH)
 		{
-			AdcCommand c(x.substr(0, x.length() - 1));
-			if (c.getParameters().empty())
-				continue;
-			string cid = c.getParam(0);
-			if (cid.size() != 39)
-				continue;
-				
-			UserPtr user = ClientManager::getInstance()->findUser(CID(cid));
-			if (!user)
-				continue;
-				
-			// This should be handled by AdcCommand really...
-			c.getParameters().erase(c.getParameters().begin());
-			
-			SearchManager::getInstance()->onRES(c, user, remoteIp);
-			
+			tth = hubName.substr(4);
+			StringList names = ClientManager::getInstance()->getHubNames(user->getCID(), Util::emptyString);
+			hubName = names.empty() ? STRING(OFFLINE) : Util::toString(names);
 		}
-		if (x.compare(1, 4, "PSR ") == 0 && x[x.length() - 1] == 0x0a)
+		
+		if (tth.empty() && type == SearchResult::TYPE_FILE)
 		{
-			AdcCommand c(x.substr(0, x.length() - 1));
-			if (c.getParameters().empty())
-				continue;
-			string cid = c.getParam(0);
-			if (cid.size() != 39)
-				continue;
-				
-			UserPtr user = ClientManager::getInstance()->findUser(CID(cid));
-			// when user == NULL then it is probably NMDC user, check it later
+			return;
+		}
+		SearchResultPtr sr(new SearchResult(user, type, slots, freeSlots, size,
+		                                    file, hubName, url, remoteIp, TTHValue(tth), Util::emptyString));
+		SearchManager::getInstance()->fire(SearchManagerListener::SR(), sr);
+		
+	}
+	else if (x.compare(1, 4, "RES ") == 0 && x[x.length() - 1] == 0x0a)
+	{
+		AdcCommand c(x.substr(0, x.length() - 1));
+		if (c.getParameters().empty())
+			return;
+		string cid = c.getParam(0);
+		if (cid.size() != 39)
+			return;
 			
-			c.getParameters().erase(c.getParameters().begin());
+		UserPtr user = ClientManager::getInstance()->findUser(CID(cid));
+		if (!user)
+			return;
 			
-			SearchManager::getInstance()->onPSR(c, user, remoteIp);
+		// This should be handled by AdcCommand really...
+		c.getParameters().erase(c.getParameters().begin());
+		
+		SearchManager::getInstance()->onRES(c, user, remoteIp);
+		
+	}
+	if (x.compare(1, 4, "PSR ") == 0 && x[x.length() - 1] == 0x0a)
+	{
+		AdcCommand c(x.substr(0, x.length() - 1));
+		if (c.getParameters().empty())
+			return;
+		string cid = c.getParam(0);
+		if (cid.size() != 39)
+			return;
 			
-		} /*else if(x.compare(1, 4, "SCH ") == 0 && x[x.length() - 1] == 0x0a) {
+		UserPtr user = ClientManager::getInstance()->findUser(CID(cid));
+		// when user == NULL then it is probably NMDC user, check it later
+		
+		c.getParameters().erase(c.getParameters().begin());
+		
+		SearchManager::getInstance()->onPSR(c, user, remoteIp);
+		
+	} /*else if(x.compare(1, 4, "SCH ") == 0 && x[x.length() - 1] == 0x0a) {
             try {
                 respond(AdcCommand(x.substr(0, x.length()-1)));
             } catch(ParseException& ) {
             }
         }*/ // Needs further DoS investigation
-
-
-		Thread::sleep(10);
-	}
-	return 0;
 }
 
 void SearchManager::onData(const uint8_t* buf, size_t aLen, const string& remoteIp)
 {
-	string x((char*)buf, aLen);
-	queue.addResult(x, remoteIp);
+	UdpPacket* p = m_packet_pool.get();
+	if (!p)
+	{
+		m_packet_pool.incDropped();
+		return;
+	}
+	p->m_data.assign((const char*)buf, aLen);
+	p->m_ip = remoteIp;
+	p->m_resolve = false;
+	dispatch(p);
 }
 
 void SearchManager::onRES(const AdcCommand& cmd, const UserPtr& from, const string& remoteIp)
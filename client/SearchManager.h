@@ -19,6 +19,8 @@
 #ifndef DCPLUSPLUS_DCPP_SEARCH_MANAGER_H
 #define DCPLUSPLUS_DCPP_SEARCH_MANAGER_H
 
+#include <boost/atomic.hpp>
+
 #include "SettingsManager.h"
 
 #include "Socket.h"
@@ -73,10 +75,12 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 			search(aName, Util::toInt64(aSize), aTypeMode, aSizeMode, aToken, aOwner);
 		}
 		
-		uint64_t search(StringList& who, const string& aName, int64_t aSize, TypeModes aTypeMode, SizeModes aSizeMode, const string& aToken, const StringList& aExtList, void* aOwner = NULL);
-		uint64_t search(StringList& who, const string& aName, const string& aSize, TypeModes aTypeMode, SizeModes aSizeMode, const string& aToken, const StringList& aExtList, void* aOwner = NULL)
+		uint64_t search(StringList& who, const string& aName, int64_t aSize, TypeModes aTypeMode, SizeModes aSizeMode, const string& aToken, const StringList& aExtList, void* aOwner = NULL,
+		                SearchQueue::Priority aPriority = SearchQueue::PRIORITY_INTERACTIVE);
+		uint64_t search(StringList& who, const string& aName, const string& aSize, TypeModes aTypeMode, SizeModes aSizeMode, const string& aToken, const StringList& aExtList, void* aOwner = NULL,
+		                SearchQueue::Priority aPriority = SearchQueue::PRIORITY_INTERACTIVE)
 		{
-			return search(who, aName, Util::toInt64(aSize), aTypeMode, aSizeMode, aToken, aExtList, aOwner);
+			return search(who, aName, Util::toInt64(aSize), aTypeMode, aSizeMode, aToken, aExtList, aOwner, aPriority);
 		}
 		//static string clean(const string& aSearchString);
 		
@@ -93,19 +97,71 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 		{
 			onData((const uint8_t*)aLine.data(), aLine.length(), Util::emptyString);
 		}
+		size_t getDroppedPackets() const
+		{
+			return m_packet_pool.getDropped();
+		}
 		
 		void onRES(const AdcCommand& cmd, const UserPtr& from, const string& remoteIp = Util::emptyString);
 		void onPSR(const AdcCommand& cmd, UserPtr from, const string& remoteIp = Util::emptyString);
 		AdcCommand toPSR(bool wantResponse, const string& myNick, const string& hubIpPort, const string& tth, const vector<uint16_t>& partialInfo) const;
 		
 	private:
+		/** Incoming datagram, the buffers are reused through UdpPacketPool */
+		struct UdpPacket
+		{
+			string m_data;
+			string m_ip;
+			Socket::addr m_addr;
+			bool m_resolve;
+		};
+		
+		/**
+		 * Preallocated datagrams shared by the receiver and the parser threads,
+		 * so that the receive path doesn't allocate for every packet.
+		 */
+		class UdpPacketPool
+		{
+			public:
+				UdpPacketPool();
+				~UdpPacketPool();
+				
+				/** @return Free packet or NULL when MAX_PACKETS are in flight */
+				UdpPacket* get();
+				void release(UdpPacket* p_packet);
+				
+				size_t getDropped() const
+				{
+					return m_dropped;
+				}
+				void incDropped()
+				{
+					++m_dropped;
+				}
+				
+			private:
+				CriticalSection cs;
+				vector<UdpPacket*> m_free;
+				size_t m_count;
+				boost::atomic<size_t> m_dropped;
+		} m_packet_pool;
+		
+		/**
+		 * Parser thread. Packets are routed to a queue by their search token,
+		 * so results for one search are always reported in the order they came in.
+		 */
 		class UdpQueue: public Thread
 		{
 			public:
-				UdpQueue() : stop(false) {}
+				explicit UdpQueue(UdpPacketPool& p_pool) : m_pool(p_pool), stop(false) {}
 				~UdpQueue()
 				{
 					shutdown();
+					join();
+					for (auto i = resultList.cbegin(); i != resultList.cend(); ++i)
+					{
+						m_pool.release(*i);
+					}
 				}
 				
 				int run();
@@ -114,23 +170,32 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 					stop = true;
 					s.signal();
 				}
-				void addResult(const string& buf, const string& ip)
+				void addResult(UdpPacket* p_packet)
 				{
 					{
 						Lock l(cs);
-						resultList.push_back(make_pair(buf, ip));
+						resultList.push_back(p_packet);
 					}
 					s.signal();
 				}
 				
 			private:
+				void parse(const string& x, const string& remoteIp);
+				
+				UdpPacketPool& m_pool;
 				CriticalSection cs;
 				Semaphore s;
 				
-				deque<pair<string, string>> resultList;
+				deque<UdpPacket*> resultList;
 				
 				bool stop;
-		} queue;
+		};
+		vector<unique_ptr<UdpQueue>> m_queues;
+		
+		void startQueues();
+		void stopQueues();
+		void dispatch(UdpPacket* p_packet);
+		static string getRouteKey(const string& x);
 		
 		CriticalSection cs;
 		std::unique_ptr<Socket> socket;
@@ -19,111 +19,128 @@
 #include "stdinc.h"
 #include "SearchQueue.h"
 
-#include "TimerManager.h"
-#include "QueueManager.h"
+#include "ClientManager.h"
 #include "SearchManager.h"
+#include "SearchResult.h"
+#include "../dht/dht.h"
 
 namespace dcpp
 {
 
-bool SearchQueue::add(const Search& s)
+SearchQueue::SearchQueue() : coalesced(0), dhtFound(0)
+{
+	TimerManager::getInstance()->addListener(this);
+	SearchManager::getInstance()->addListener(this);
+}
+
+SearchQueue::~SearchQueue()
+{
+	SearchManager::getInstance()->removeListener(this);
+	TimerManager::getInstance()->removeListener(this);
+}
+
+void SearchQueue::insert(const Item& aItem)
+{
+	// behind the searches of the same priority
+	auto i = searchQueue.begin();
+	while (i != searchQueue.end() && i->priority >= aItem.priority)
+		++i;
+	searchQueue.insert(i, aItem);
+}
+
+void SearchQueue::add(const Search& s, const StringList& aHubs, Priority aPriority)
 {
 	dcassert(s.owners.size() == 1);
-	dcassert(interval >= 10000); // min interval is 10 seconds.
 	
+	const uint64_t l_tick = GET_TICK();
+	// an automatic TTH search asks DHT first, nobody waits for its results
+	const bool l_dht_first = aPriority == PRIORITY_AUTO && s.fileType == SearchManager::TYPE_TTH &&
+	                         BOOLSETTING(USE_DHT) && dht::DHT::isValidInstance() && dht::DHT::getInstance()->isConnected();
+	                         
 	Lock l(cs);
 	
 	for (auto i = searchQueue.begin(); i != searchQueue.end(); ++i)
 	{
-		// check dupe
-		if (*i == s)
+		// the results come back with the token, only the automatic searches don't care about it
+		if (i->search == s && (i->search.token == s.token || s.token == "auto" || i->search.token == "auto"))
 		{
-			void* aOwner = *s.owners.begin();
-			i->owners.insert(aOwner);
+			i->search.owners.insert(s.owners.begin(), s.owners.end());
+			i->hubs.insert(aHubs.begin(), aHubs.end());
+			++coalesced;
 			
 			// if previous search was autosearch and current one isn't, it should be readded before autosearches
-			if (s.token != "auto" && i->token == "auto")
+			if (aPriority > i->priority)
 			{
+				Item l_item = *i;
 				searchQueue.erase(i);
-				break;
-			}
-			
-			return false;
-		}
-	}
-	
-	if (s.token == "auto")
-	{
-		// Insert last (automatic search)
-		searchQueue.push_back(s);
-	}
-	else
-	{
-		bool added = false;
-		if (searchQueue.empty())
-		{
-			searchQueue.push_front(s);
-			added = true;
-		}
-		else
-		{
-			// Insert before the automatic searches (manual search)
-			for (auto i = searchQueue.cbegin(); i != searchQueue.cend(); ++i)
-			{
-				if (i->token == "auto")
+				if (l_item.search.token == "auto")
+					l_item.search.token = s.token;
+				l_item.priority = aPriority;
+				if (l_item.notBefore)
 				{
-					searchQueue.insert(i, s);
-					added = true;
-					break;
+					l_item.notBefore = 0;
+					dhtWaiting.erase(l_item.search.query);
 				}
+				insert(l_item);
 			}
-		}
-		if (!added)
-		{
-			searchQueue.push_back(s);
+			return;
 		}
 	}
-	return true;
+	
+	Item l_item;
+	l_item.search = s;
+	l_item.priority = aPriority;
+	l_item.hubs.insert(aHubs.begin(), aHubs.end());
+	l_item.added = l_tick;
+	l_item.notBefore = 0;
+	if (l_dht_first && dhtWaiting.insert(s.query).second)
+		l_item.notBefore = l_tick + DHT_WAIT;
+	insert(l_item);
 }
 
-bool SearchQueue::pop(Search& s)
+bool SearchQueue::pop(const string& aHub, uint64_t aTick, Search& s)
 {
-	dcassert(interval);
-	
-	uint64_t now = GET_TICK();
-	if (now <= lastSearchTime + interval)
-		return false;
-		
+	for (auto i = searchQueue.begin(); i != searchQueue.end(); ++i)
 	{
-		Lock l(cs);
-		if (!searchQueue.empty())
+		if (i->notBefore > aTick)
+			continue;
+		StringSet::iterator j = i->hubs.find(aHub);
+		if (j == i->hubs.end())
+			continue;
+			
+		s = i->search;
+		i->hubs.erase(j);
+		if (i->hubs.empty())
 		{
-			s = searchQueue.front();
-			searchQueue.pop_front();
-			lastSearchTime = now;
-			return true;
+			if (i->notBefore)
+				dhtWaiting.erase(i->search.query);
+			searchQueue.erase(i);
 		}
+		return true;
 	}
-	
 	return false;
 }
 
-uint64_t SearchQueue::getSearchTime(void* aOwner)
+uint64_t SearchQueue::getSearchTime(const string& aHub, uint32_t aInterval, void* aOwner) const
 {
-	Lock l(cs);
+	if (aOwner == 0) return 0;
+	
+	const uint64_t l_tick = GET_TICK();
 	
-	if (aOwner == 0) return 0xFFFFFFFF;
+	Lock l(cs);
 	
-	uint64_t x = max(lastSearchTime, uint64_t(GET_TICK() - interval));
+	auto l_last = lastSearchTime.find(aHub);
+	uint64_t x = max(l_last == lastSearchTime.end() ? 0 : l_last->second, l_tick > aInterval ? l_tick - aInterval : 0);
 	
 	for (auto i = searchQueue.cbegin(); i != searchQueue.cend(); ++i)
 	{
-		x += interval;
+		if (!i->hubs.count(aHub))
+			continue;
+			
+		x = max(x + aInterval, i->notBefore);
 		
-		if (i->owners.count(aOwner))
-			return x;
-		else if (i->owners.empty())
-			break;
+		if (i->search.owners.count(aOwner))
+			return x - l_tick;
 	}
 	
 	return 0;
@@ -134,17 +151,113 @@ bool SearchQueue::cancelSearch(void* aOwner)
 	dcassert(aOwner);
 	
 	Lock l(cs);
+	bool l_found = false;
+	for (auto i = searchQueue.begin(); i != searchQueue.end();)
+	{
+		if (i->search.owners.erase(aOwner))
+		{
+			l_found = true;
+			if (i->search.owners.empty())
+			{
+				if (i->notBefore)
+					dhtWaiting.erase(i->search.query);
+				i = searchQueue.erase(i);
+				continue;
+			}
+		}
+		++i;
+	}
+	return l_found;
+}
+
+size_t SearchQueue::getQueued() const
+{
+	Lock l(cs);
+	return searchQueue.size();
+}
+
+void SearchQueue::on(TimerManagerListener::Second, uint64_t aTick) noexcept
+{
+	StringSet l_connected;
+	{
+		ClientManager* l_cm = ClientManager::getInstance();
+		l_cm->lock();
+		const Client::List& l_clients = l_cm->getClients();
+		for (auto i = l_clients.cbegin(); i != l_clients.cend(); ++i)
+		{
+			Client* c = i->second;
+			if (!c->isConnected() || !c->getSearchInterval())
+				continue;
+			l_connected.insert(c->getHubUrl());
+			
+			Search s;
+			{
+				Lock l(cs);
+				uint64_t& l_last = lastSearchTime[c->getHubUrl()];
+				if (aTick <= l_last + c->getSearchInterval() || !pop(c->getHubUrl(), aTick, s))
+					continue;
+				l_last = aTick;
+			}
+			c->search(s.sizeType, s.size, s.fileType, s.query, s.token, s.exts);
+		}
+		l_cm->unlock();
+	}
+	
+	// hubs that went away for good don't keep their searches forever
+	Lock l(cs);
+	for (auto i = searchQueue.begin(); i != searchQueue.end();)
+	{
+		if (i->added + MAX_AGE < aTick)
+		{
+			for (auto j = i->hubs.begin(); j != i->hubs.end();)
+			{
+				if (l_connected.count(*j))
+					++j;
+				else
+					i->hubs.erase(j++);
+			}
+			if (i->hubs.empty())
+			{
+				if (i->notBefore)
+					dhtWaiting.erase(i->search.query);
+				i = searchQueue.erase(i);
+				continue;
+			}
+		}
+		++i;
+	}
+	for (auto i = lastSearchTime.begin(); i != lastSearchTime.end();)
+	{
+		if (l_connected.count(i->first))
+			++i;
+		else
+			i = lastSearchTime.erase(i);
+	}
+}
+
+void SearchQueue::on(SearchManagerListener::SR, const SearchResultPtr& aResult) noexcept
+{
+	if (aResult->getType() != SearchResult::TYPE_FILE)
+		return;
+		
+	Lock l(cs);
+	if (dhtWaiting.empty())
+		return;
+		
+	const string l_tth = aResult->getTTH().toBase32();
+	if (!dhtWaiting.erase(l_tth))
+		return;
+		
+	// a source turned up while the search waited for DHT, the hubs aren't asked
 	for (auto i = searchQueue.begin(); i != searchQueue.end(); ++i)
 	{
-		if (i->owners.count(aOwner))
+		if (i->notBefore && i->search.fileType == SearchManager::TYPE_TTH && i->search.query == l_tth)
 		{
-			i->owners.erase(aOwner);
-			if (i->owners.empty())
-				searchQueue.erase(i);
-			return true;
+			searchQueue.erase(i);
+			++dhtFound;
+			break;
 		}
 	}
-	return false;
 }
 
 }
@@ -18,7 +18,9 @@
 
 #pragma once
 
-#include "Thread.h"
+#include "Singleton.h"
+#include "TimerManager.h"
+#include "SearchManagerListener.h"
 #include "typedefs.h"
 
 namespace dcpp
@@ -39,43 +41,80 @@ struct Search
 		return sizeType == rhs.sizeType &&
 		       size == rhs.size &&
 		       fileType == rhs.fileType &&
-		       query == rhs.query;
+		       query == rhs.query &&
+		       exts == rhs.exts;
 	}
 };
 
-class SearchQueue
+/**
+ * Outgoing searches of all the hubs. A query asked for by several owners or for several hubs
+ * is queued once; every hub takes the searches at its own interval (its flood limit),
+ * the interactive ones first, then those of the remote control, the automatic ones last.
+ * An automatic TTH search goes to DHT first, the hubs get it only if no source turned up meanwhile.
+ */
+class SearchQueue : public Singleton<SearchQueue>, private TimerManagerListener, private SearchManagerListener
 {
 	public:
-	
-		SearchQueue(uint32_t aInterval = 0)
-			: lastSearchTime(0), interval(aInterval)
+		enum Priority
 		{
-		}
-		
-		bool add(const Search& s);
-		bool pop(Search& s);
+			PRIORITY_AUTO,
+			PRIORITY_RPC,
+			PRIORITY_INTERACTIVE
+		};
 		
-		void clear()
-		{
-			Lock l(cs);
-			searchQueue.clear();
-		}
+		/** Queue s for the hubs, an identical query already queued takes the owner and the hubs over */
+		void add(const Search& s, const StringList& aHubs, Priority aPriority);
 		
 		bool cancelSearch(void* aOwner);
 		
-		/** return 0 means not in queue */
-		uint64_t getSearchTime(void* aOwner);
+		/** @return Milliseconds until the search of aOwner goes to the hub, 0 if it isn't queued for it */
+		uint64_t getSearchTime(const string& aHub, uint32_t aInterval, void* aOwner) const;
 		
-		/**
-		    by milli-seconds
-		    0 means no interval, no auto search and manual search is sent immediately
-		*/
-		uint32_t interval;
+		size_t getQueued() const;
+		GETSET(uint64_t, coalesced, Coalesced);
+		GETSET(uint64_t, dhtFound, DhtFound);
 		
 	private:
-		deque<Search>   searchQueue;
-		uint64_t       lastSearchTime;
-		CriticalSection cs;
+		friend class Singleton<SearchQueue>;
+		
+		SearchQueue();
+		~SearchQueue();
+		
+		enum
+		{
+			/** How long an automatic TTH search waits for DHT */
+			DHT_WAIT = 30 * 1000,
+			/** Searches for hubs that stay away are dropped */
+			MAX_AGE = 10 * 60 * 1000
+		};
+		
+		struct Item
+		{
+			Search search;
+			Priority priority;
+			StringSet hubs;
+			uint64_t added;
+			/** Not sent to the hubs before, DHT goes first */
+			uint64_t notBefore;
+		};
+		typedef list<Item> ItemList;
+		
+		/** By priority, then in the order they came */
+		ItemList searchQueue;
+		/** Last search sent to a hub */
+		unordered_map<string, uint64_t> lastSearchTime;
+		/** Queries of the automatic TTH searches waiting for DHT */
+		StringSet dhtWaiting;
+		mutable CriticalSection cs;
+		
+		void insert(const Item& aItem);
+		/** Next search for the hub, removes the hub from it */
+		bool pop(const string& aHub, uint64_t aTick, Search& s);
+		
+		// TimerManagerListener
+		void on(TimerManagerListener::Second, uint64_t aTick) noexcept;
+		// SearchManagerListener
+		void on(SearchManagerListener::SR, const SearchResultPtr& aResult) noexcept;
 };
 
 }
@@ -0,0 +1,189 @@
+#include "stdinc.h"
+#include "SegmentPicker.h"
+
+namespace dcpp
+{
+
+int64_t SegmentPicker::getTargetSize(int64_t p_wanted_size, int64_t p_last_speed) const
+{
+	double donePart = static_cast<double>(m_downloaded) / m_size;
+
+	// We want smaller blocks at the end of the transfer, squaring gives a nice curve...
+	int64_t targetSize = static_cast<int64_t>(static_cast<double>(p_wanted_size) * std::max(0.25, (1. - (donePart * donePart))));
+
+	if (p_last_speed > 0 && !m_running.empty())
+	{
+		// A chunk shouldn't outlast the rest of the file: the source gets the share of what's left
+		// its speed has in the speed of all the running chunks, so slow sources don't take the tail
+		double speeds = static_cast<double>(p_last_speed);
+		for (auto i = m_running.cbegin(); i != m_running.cend(); ++i)
+		{
+			speeds += i->m_speed;
+		}
+		const int64_t share = static_cast<int64_t>(static_cast<double>(m_size - m_downloaded) * p_last_speed / speeds);
+		targetSize = std::min(targetSize, share);
+	}
+
+	if (targetSize > m_block_size)
+	{
+		// Round off to nearest block size
+		return Util::roundDown(targetSize, m_block_size);
+	}
+	return m_block_size;
+}
+
+Segment SegmentPicker::pick(int64_t p_wanted_size, int64_t p_last_speed) const
+{
+	vector<Segment> neededParts;
+
+	const int64_t targetSize = getTargetSize(p_wanted_size, p_last_speed);
+	int64_t start = 0;
+	int64_t curSize = targetSize;
+
+	while (start < m_size)
+	{
+		int64_t end = std::min(m_size, start + curSize);
+		Segment block(start, end - start);
+		bool overlaps = false;
+		for (auto i = m_done.cbegin(); !overlaps && i != m_done.cend(); ++i)
+		{
+			if (curSize <= m_block_size)
+			{
+				int64_t dstart = i->getStart();
+				int64_t dend = i->getEnd();
+				// We accept partial overlaps, only consider the block done if it is fully consumed by the done block
+				if (dstart <= start && dend >= end)
+				{
+					overlaps = true;
+				}
+			}
+			else
+			{
+				overlaps = block.overlaps(*i);
+			}
+		}
+
+		for (auto i = m_running.cbegin(); !overlaps && i != m_running.cend(); ++i)
+		{
+			overlaps = block.overlaps(i->m_segment);
+		}
+
+		if (!overlaps)
+		{
+			if (m_partial)
+			{
+				// store all chunks we could need
+				for (vector<int64_t>::const_iterator j = m_parts.begin(); j + 1 < m_parts.end(); j += 2)
+				{
+					if ((*j <= start && start < * (j + 1)) || (start <= *j && *j < end))
+					{
+						int64_t b = max(start, *j);
+						int64_t e = min(end, *(j + 1));
+
+						// segment must be blockSize aligned
+						dcassert(b % m_block_size == 0);
+						dcassert(e % m_block_size == 0 || e == m_size);
+
+						neededParts.push_back(Segment(b, e - b));
+					}
+				}
+			}
+			else
+			{
+				return block;
+			}
+		}
+
+		if (overlaps && (curSize > m_block_size))
+		{
+			curSize -= m_block_size;
+		}
+		else
+		{
+			start = end;
+			curSize = targetSize;
+		}
+	}
+
+	if (!neededParts.empty())
+	{
+		// select the rarest chunk, the one the fewest partial sources have (random among the equally rare)
+		dcdebug("Found chunks: %d\n", neededParts.size());
+
+		size_t rarest = 0;
+		size_t rarestHolders = numeric_limits<size_t>::max();
+		uint32_t ties = 0;
+		for (size_t i = 0; i < neededParts.size(); ++i)
+		{
+			const size_t holders = m_holders(neededParts[i].getStart());
+			if (holders < rarestHolders)
+			{
+				rarest = i;
+				rarestHolders = holders;
+				ties = 1;
+			}
+			else if (holders == rarestHolders && m_rand(++ties) == 0)
+			{
+				rarest = i;
+			}
+		}
+
+		Segment& selected = neededParts[rarest];
+		selected.setSize(std::min(selected.getSize(), targetSize)); // request only wanted size
+
+		return selected;
+	}
+
+	if (!m_partial && m_overlap && p_last_speed > 0)
+	{
+		return pickOverlap(p_last_speed);
+	}
+
+	return Segment(0, 0);
+}
+
+Segment SegmentPicker::pickOverlap(int64_t p_last_speed) const
+{
+	// overlap slow running chunk, the one that would finish last
+	const Chunk* slowest = nullptr;
+	int64_t slowestPos = 0;
+
+	for (auto i = m_running.cbegin(); i != m_running.cend(); ++i)
+	{
+		const Chunk& d = *i;
+
+		// current chunk mustn't be already overlapped
+		if (d.m_segment.getOverlapped())
+			continue;
+
+		// current chunk must be running at least for 2 seconds
+		if (d.m_start == 0 || m_now - d.m_start < 2000)
+			continue;
+
+		// current chunk mustn't be finished in next 10 seconds
+		if (d.m_seconds_left < 10)
+			continue;
+
+		// overlap current chunk at last block boundary
+		int64_t pos = d.m_pos - (d.m_pos % m_block_size);
+		int64_t size = d.m_segment.getSize() - pos;
+
+		// new user should finish this chunk more than 2x faster
+		int64_t newChunkLeft = size / p_last_speed;
+		if (2 * newChunkLeft < d.m_seconds_left && (!slowest || d.m_seconds_left > slowest->m_seconds_left))
+		{
+			slowest = &d;
+			slowestPos = pos;
+		}
+	}
+
+	if (slowest)
+	{
+		// both chunks race for the blocks, the first to finish them disconnects the other, see QueueManager::putDownload
+		dcdebug("Overlapping... old user: " I64_FMT " s, new user: " I64_FMT " s\n", slowest->m_seconds_left, (slowest->m_segment.getSize() - slowestPos) / p_last_speed);
+		return Segment(slowest->m_segment.getStart() + slowestPos, slowest->m_segment.getSize() - slowestPos, true);
+	}
+	return Segment(0, 0);
+}
+
+} // namespace dcpp
@@ -0,0 +1,85 @@
+#ifndef DCPLUSPLUS_DCPP_SEGMENT_PICKER_H
+#define DCPLUSPLUS_DCPP_SEGMENT_PICKER_H
+
+#include "Util.h"
+#include "Segment.h"
+
+namespace dcpp
+{
+
+/**
+ * The multi-chunk part of QueueItem::getNextSegment on plain data: what is done, what is
+ * running and how fast. It reads no settings and no clock of its own, so SegmentSim can run
+ * it against simulated sources with the same code the client uses.
+ */
+class SegmentPicker
+{
+	public:
+		/** A running chunk of the file, as QueueItem sees its Download */
+		struct Chunk
+		{
+			Chunk() : m_pos(0), m_speed(0), m_seconds_left(0), m_start(0) { }
+			Segment m_segment;
+			int64_t m_pos;          // bytes of the segment already downloaded
+			double m_speed;         // average speed, bytes per second
+			int64_t m_seconds_left;
+			uint64_t m_start;       // tick the chunk started, 0 if not yet
+		};
+		typedef vector<Chunk> ChunkList;
+		typedef set<Segment> SegmentSet;
+
+		/** Partial sources that have the block at the position */
+		typedef std::function<size_t (int64_t)> HoldersFunc;
+		/** Random number below the argument, for the ties between equally rare blocks */
+		typedef std::function<uint32_t (uint32_t)> RandFunc;
+
+		SegmentPicker(int64_t p_size, int64_t p_block_size, const SegmentSet& p_done, const ChunkList& p_running) :
+			m_size(p_size), m_block_size(p_block_size), m_done(p_done), m_running(p_running), m_downloaded(0), m_overlap(false), m_now(0), m_partial(false)
+		{
+		}
+
+		/** Bytes done plus the bytes of the running chunks */
+		void setDownloaded(int64_t p_downloaded)
+		{
+			m_downloaded = p_downloaded;
+		}
+		/** Allow to take over the tail of a slow chunk when nothing else is left, with the tick of now */
+		void setOverlap(bool p_overlap, uint64_t p_now)
+		{
+			m_overlap = p_overlap;
+			m_now = p_now;
+		}
+		/** Block positions of a partial source, pairs of start and end */
+		void setPartial(const vector<int64_t>& p_parts, const HoldersFunc& p_holders, const RandFunc& p_rand)
+		{
+			m_partial = true;
+			m_parts = p_parts;
+			m_holders = p_holders;
+			m_rand = p_rand;
+		}
+
+		/** Next segment for a source with the wanted chunk size and speed, zero-sized if there is none */
+		Segment pick(int64_t p_wanted_size, int64_t p_last_speed) const;
+
+	private:
+		int64_t getTargetSize(int64_t p_wanted_size, int64_t p_last_speed) const;
+		Segment pickOverlap(int64_t p_last_speed) const;
+
+		const int64_t m_size;
+		const int64_t m_block_size;
+		const SegmentSet& m_done;
+		const ChunkList& m_running;
+		int64_t m_downloaded;
+		bool m_overlap;
+		uint64_t m_now;
+		bool m_partial;
+		vector<int64_t> m_parts;
+		HoldersFunc m_holders;
+		RandFunc m_rand;
+
+		SegmentPicker& operator=(const SegmentPicker&);
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SEGMENT_PICKER_H)
@@ -18,6 +18,7 @@
 
 #include "stdinc.h"
 #include "ShareManager.h"
+#include "ShareSnapshot.h"
 
 #include "ResourceManager.h"
 
@@ -38,6 +39,7 @@
 #include "Download.h"
 #include "HashBloom.h"
 #include "SearchResult.h"
+#include "Semaphore.h"
 
 #include "../dht/IndexManager.h"
 
@@ -55,9 +57,18 @@
 namespace dcpp
 {
 
+static const uint64_t SEARCH_CACHE_TIME = 10 * 1000;
+static const size_t SEARCH_CACHE_MAX_ITEMS = 2000;
+static const uint64_t PARTIAL_LIST_CACHE_TIME = 5 * 60 * 1000;
+static const size_t PARTIAL_LIST_CACHE_SIZE = 16 * 1024 * 1024;
+static const size_t HASH_BLOOM_MAX_ITEMS = 4;
+static const size_t HASH_BLOOM_MIN_REMOVED = 1000;
+static const size_t HASH_BLOOM_REMOVED_PERCENT = 10;
+
 ShareManager::ShareManager() : hits(0), xmlListLen(0), bzXmlListLen(0),
 	xmlDirty(true), forceXmlRefresh(false), refreshDirs(false), update(false), initial(true), listN(0),
-	lastXmlUpdate(0), lastFullUpdate(GET_TICK()), bloom(1 << 20), sharedSize(0), m_sweep_guard(0), m_sweep_path(0)
+	lastXmlUpdate(0), lastFullUpdate(GET_TICK()), bloom(1 << 20, true), sharedSize(0), m_sweep_guard(0), m_sweep_path(0),
+	m_search_cache_hits(0), m_search_cache_misses(0), m_share_generation(0), m_partial_lists_size(0), m_hash_bloom_removed(0)
 {
 	SettingsManager::getInstance()->addListener(this);
 	TimerManager::getInstance()->addListener(this);
@@ -67,6 +78,7 @@ ShareManager::ShareManager() : hits(0), xmlListLen(0), bzXmlListLen(0),
 
 ShareManager::~ShareManager()
 {
+	m_watcher.stopWatching();
 	SettingsManager::getInstance()->removeListener(this);
 	TimerManager::getInstance()->removeListener(this);
 	QueueManager::getInstance()->removeListener(this);
@@ -155,14 +167,19 @@ string ShareManager::toRealPath(const TTHValue& tth) const
 	{
 		Lock l(cs);
 		HashFileMap::const_iterator i = tthIndex.find(tth);
-		if (i != tthIndex.end())
+		try
 		{
-			try
+			if (i != tthIndex.end())
 			{
 				return i->second->getRealPath();
 			}
-			catch (const ShareException&) {}
+			const uint32_t l_file = findSnapshotFileL(tth);
+			if (l_file != ShareSnapshot::NONE)
+			{
+				return getSnapshotRealPathL(l_file);
+			}
 		}
+		catch (const ShareException&) {}
 		return Util::emptyString;
 	}
 	
@@ -203,6 +220,12 @@ string ShareManager::toReal(const string& virtualFile)
 		generateXmlList();
 		return getBZXmlFile();
 	}
+	else if (virtualFile.compare(0, 4, "TTH/") == 0)
+	{
+		const uint32_t l_file = findSnapshotFileL(TTHValue(virtualFile.substr(4)));
+		if (l_file != ShareSnapshot::NONE)
+			return getSnapshotRealPathL(l_file);
+	}
 	
 	return findFile(virtualFile)->getRealPath();
 }
@@ -218,6 +241,12 @@ TTHValue ShareManager::getTTH(const string& virtualFile) const
 	{
 		return xmlRoot;
 	}
+	else if (virtualFile.compare(0, 4, "TTH/") == 0)
+	{
+		const TTHValue l_tth(virtualFile.substr(4));
+		if (findSnapshotFileL(l_tth) != ShareSnapshot::NONE)
+			return l_tth;
+	}
 	
 	return findFile(virtualFile)->getTTH();
 }
@@ -277,7 +306,17 @@ AdcCommand ShareManager::getFileInfo(const string& aFile)
 	HashFileIter i = tthIndex.find(val);
 	if (i == tthIndex.end())
 	{
-		throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
+		const uint32_t l_index = findSnapshotFileL(val);
+		if (l_index == ShareSnapshot::NONE)
+		{
+			throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
+		}
+		const ShareSnapshot::FileRecord& l_file = m_snapshot->getFile(l_index);
+		AdcCommand cmd(AdcCommand::CMD_RES);
+		cmd.addParam("FN", Util::toAdcFile(m_snapshot->getFullName(l_file.m_dir) + m_snapshot->getString(l_file.m_name)));
+		cmd.addParam("SI", Util::toString(l_file.m_size));
+		cmd.addParam("TR", val.toBase32());
+		return cmd;
 	}
 	
 	const Directory::File& f = *i->second;
@@ -355,6 +394,36 @@ ShareManager::Directory::File::Set::const_iterator ShareManager::findFile(const
 	return it;
 }
 
+uint32_t ShareManager::findSnapshotFileL(const TTHValue& p_tth) const
+{
+	// tthIndex stays empty until materializeSnapshot() has built the tree
+	if (!m_snapshot || tthIndex.find(p_tth) != tthIndex.end())
+		return ShareSnapshot::NONE;
+	return m_snapshot->findTTH(p_tth);
+}
+
+string ShareManager::getSnapshotRealPathL(uint32_t p_file) const
+{
+	dcassert(m_snapshot);
+	const ShareSnapshot::FileRecord& l_file = m_snapshot->getFile(p_file);
+	const uint32_t l_dirs = m_snapshot->getHeader().m_dirs;
+	if (l_file.m_dir >= l_dirs)
+		throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
+		
+	// the path below the root, the root record has the virtual name as Directory::getRealPath() does
+	string l_path = m_snapshot->getString(l_file.m_name);
+	uint32_t i = l_file.m_dir;
+	while (m_snapshot->getDir(i).m_parent != ShareSnapshot::NONE)
+	{
+		const ShareSnapshot::DirRecord& l_dir = m_snapshot->getDir(i);
+		if (l_dir.m_parent >= i)
+			throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
+		l_path = m_snapshot->getString(l_dir.m_name) + (PATH_SEPARATOR_STR + l_path);
+		i = l_dir.m_parent;
+	}
+	return findRealRoot(m_snapshot->getString(m_snapshot->getDir(i).m_name), l_path);
+}
+
 string ShareManager::validateVirtual(const string& aVirt) const noexcept
 {
     string tmp = aVirt;
@@ -529,6 +598,9 @@ struct ShareLoader : public SimpleXMLReader::CallBack
 
 bool ShareManager::loadCache() noexcept
 {
+	if (loadSnapshot())
+		return true;
+		
 	try {
 		ShareLoader loader(directories);
 		SimpleXMLReader xml(&loader);
@@ -553,6 +625,292 @@ bool ShareManager::loadCache() noexcept
 	return false;
 }
 
+// [+] Binary snapshot of the share (Share.dat), see ShareSnapshot
+static string getSnapshotPath()
+{
+	return Util::getPath(Util::PATH_USER_CONFIG) + "Share.dat";
+}
+
+bool ShareManager::loadSnapshot() noexcept
+{
+	unique_ptr<ShareSnapshot> l_snapshot(new ShareSnapshot());
+	if (!l_snapshot->open(getSnapshotPath()))
+		return false;
+		
+	const ShareSnapshot::Header& l_header = l_snapshot->getHeader();
+	Lock l(cs);
+	// saved by a build with another size of the filter, files.xml.bz2 will do
+	if (!bloom.load(l_snapshot->getBloomTable(), l_header.m_bloom_words, l_snapshot->getBloomCounters(), l_header.m_bloom_counters))
+		return false;
+	sharedSize = l_header.m_shared_size;
+	m_snapshot.reset(l_snapshot.release());
+	incShareGeneration();
+	return true;
+}
+
+void ShareManager::materializeSnapshot()
+{
+	// the reference keeps the records mapped, they are read without cs
+	std::shared_ptr<ShareSnapshot> l_snapshot;
+	{
+		Lock l(cs);
+		l_snapshot = m_snapshot;
+	}
+	if (!l_snapshot)
+		return;
+		
+	const uint64_t l_start = GET_TICK();
+	const ShareSnapshot::Header& l_header = l_snapshot->getHeader();
+	vector<Directory::Ptr> l_dirs(l_header.m_dirs);
+	DirList l_roots;
+	for (uint32_t i = 0; i < l_header.m_dirs; ++i)
+	{
+		const ShareSnapshot::DirRecord& l_dir = l_snapshot->getDir(i);
+		const string l_name = l_snapshot->getString(l_dir.m_name);
+		if (l_dir.m_parent == ShareSnapshot::NONE)
+		{
+			l_dirs[i] = Directory::create(l_name);
+			l_roots.push_back(l_dirs[i]);
+		}
+		else if (l_dir.m_parent < i && l_dirs[l_dir.m_parent])
+		{
+			const Directory::Ptr& l_parent = l_dirs[l_dir.m_parent];
+			l_dirs[i] = Directory::create(l_name, l_parent);
+			l_parent->directories[l_name] = l_dirs[i];
+		}
+	}
+	for (uint32_t i = 0; i < l_header.m_files; ++i)
+	{
+		const ShareSnapshot::FileRecord& l_file = l_snapshot->getFile(i);
+		if (l_file.m_dir >= l_header.m_dirs || !l_dirs[l_file.m_dir])
+			continue;
+			
+		CFlyMediaInfo l_media;
+		l_media.m_bitrate = l_file.m_bitrate;
+		l_media.m_mediaX = l_file.m_media_x;
+		l_media.m_mediaY = l_file.m_media_y;
+		l_media.m_video = l_snapshot->getString(l_file.m_video);
+		l_media.m_audio = l_snapshot->getString(l_file.m_audio);
+		const Directory::Ptr& l_dir = l_dirs[l_file.m_dir];
+		l_dir->files.insert(Directory::File(l_snapshot->getString(l_file.m_name), l_file.m_size, l_dir, TTHValue(l_file.m_tth),
+		                                    l_file.m_hit, l_file.m_ts, static_cast<SearchManager::TypeModes>(l_file.m_ftype), l_media));
+	}
+	
+	{
+		Lock l(cs);
+		for (DirList::iterator i = directories.begin(); i != directories.end(); ++i)
+		{
+			for (DirList::const_iterator j = l_roots.begin(); j != l_roots.end(); ++j)
+			{
+				if (stricmp((*i)->getName(), (*j)->getName()) == 0)
+				{
+					*i = *j;
+					break;
+				}
+			}
+		}
+		m_snapshot.reset();
+		// the bloom of the names came with the snapshot
+		rebuildIndices(false);
+	}
+	LogManager::getInstance()->message("Share loaded from " + getSnapshotPath() + " in " + Util::toString(GET_TICK() - l_start) + " ms"); // [!] TODO translate
+}
+
+/** Strings of Share.dat, in the order the records refer to them; offset 0 is "" */
+class SnapshotStrings
+{
+	public:
+		explicit SnapshotStrings(OutputStream& p_out) : m_out(p_out), m_size(1)
+		{
+			m_out.write("", 1);
+		}
+		uint32_t add(const string& p_str)
+		{
+			if (p_str.empty())
+				return 0;
+			if (m_size + p_str.size() + 1 > numeric_limits<uint32_t>::max())
+				throw FileException("Too many names for " + getSnapshotPath()); // [!] TODO translate
+			const uint32_t l_offset = static_cast<uint32_t>(m_size);
+			m_out.write(p_str.c_str(), p_str.size() + 1);
+			m_size += p_str.size() + 1;
+			return l_offset;
+		}
+		uint32_t add(const string& p_name, const string& p_low_name, uint32_t p_name_offset)
+		{
+			return p_low_name == p_name ? p_name_offset : add(p_low_name);
+		}
+		uint64_t getSize() const
+		{
+			return m_size;
+		}
+	private:
+		OutputStream& m_out;
+		uint64_t m_size;
+		
+		SnapshotStrings& operator=(const SnapshotStrings&);
+};
+
+static bool compareSnapshotTTH(const ShareSnapshot::TTHRecord& a, const ShareSnapshot::TTHRecord& b)
+{
+	return memcmp(a.m_tth, b.m_tth, TTHValue::BYTES) < 0;
+}
+
+static bool equalSnapshotTTH(const ShareSnapshot::TTHRecord& a, const ShareSnapshot::TTHRecord& b)
+{
+	return memcmp(a.m_tth, b.m_tth, TTHValue::BYTES) == 0;
+}
+
+bool ShareManager::buildSnapshotL(string& p_data) const
+{
+	dcassert(!m_snapshot);
+	
+	// breadth first, a parent has its index before its children
+	vector<const Directory*> l_dirs;
+	vector<uint32_t> l_parents;
+	for (DirList::const_iterator i = directories.begin(); i != directories.end(); ++i)
+	{
+		l_dirs.push_back(i->get());
+		l_parents.push_back(ShareSnapshot::NONE);
+	}
+	size_t l_files = 0;
+	for (size_t i = 0; i < l_dirs.size(); ++i)
+	{
+		l_files += l_dirs[i]->files.size();
+		for (Directory::Map::const_iterator j = l_dirs[i]->directories.begin(); j != l_dirs[i]->directories.end(); ++j)
+		{
+			if (j->second)
+			{
+				l_dirs.push_back(j->second.get());
+				l_parents.push_back(static_cast<uint32_t>(i));
+			}
+		}
+	}
+	if (l_dirs.size() >= ShareSnapshot::NONE || l_files >= ShareSnapshot::NONE)
+		return false;
+		
+	ShareSnapshot::Header l_header;
+	memzero(&l_header, sizeof(l_header));
+	memcpy(l_header.m_magic, ShareSnapshot::MAGIC, sizeof(l_header.m_magic));
+	l_header.m_version = ShareSnapshot::VERSION;
+	l_header.m_byte_order = ShareSnapshot::BYTE_ORDER_MARK;
+	l_header.m_dirs = static_cast<uint32_t>(l_dirs.size());
+	l_header.m_files = static_cast<uint32_t>(l_files);
+	l_header.m_dirs_offset = sizeof(l_header);
+	l_header.m_files_offset = l_header.m_dirs_offset + uint64_t(l_header.m_dirs) * sizeof(ShareSnapshot::DirRecord);
+	l_header.m_tths_offset = l_header.m_files_offset + uint64_t(l_header.m_files) * sizeof(ShareSnapshot::FileRecord);
+	l_header.m_shared_size = sharedSize;
+	
+	try
+	{
+		p_data.clear();
+		p_data.reserve(static_cast<size_t>(l_header.m_tths_offset + uint64_t(l_files) * sizeof(ShareSnapshot::TTHRecord)));
+		StringOutputStream l_out(p_data);
+		// the header is patched at the end, with the sizes of the tables
+		l_out.write(&l_header, sizeof(l_header));
+		// the string pool goes last but is known only once the records are written
+		string l_pool;
+		StringOutputStream l_strings_out(l_pool);
+		SnapshotStrings l_strings(l_strings_out);
+		
+		for (size_t i = 0; i < l_dirs.size(); ++i)
+		{
+			const Directory& l_dir = *l_dirs[i];
+			ShareSnapshot::DirRecord l_record;
+			memzero(&l_record, sizeof(l_record));
+			l_record.m_size = l_dir.getSize();
+			l_record.m_parent = l_parents[i];
+			l_record.m_name = l_strings.add(l_dir.getName());
+			l_record.m_low_name = l_strings.add(l_dir.getName(), l_dir.getLowName(), l_record.m_name);
+			l_record.m_file_types = l_dir.getFileTypes();
+			l_out.write(&l_record, sizeof(l_record));
+		}
+		
+		vector<ShareSnapshot::TTHRecord> l_tths;
+		l_tths.reserve(l_files);
+		uint32_t l_index = 0;
+		for (size_t i = 0; i < l_dirs.size(); ++i)
+		{
+			for (Directory::File::Set::const_iterator j = l_dirs[i]->files.begin(); j != l_dirs[i]->files.end(); ++j, ++l_index)
+			{
+				ShareSnapshot::FileRecord l_record;
+				memzero(&l_record, sizeof(l_record));
+				l_record.m_size = j->getSize();
+				memcpy(l_record.m_tth, j->getTTH().data, TTHValue::BYTES);
+				l_record.m_dir = static_cast<uint32_t>(i);
+				l_record.m_name = l_strings.add(j->getName());
+				l_record.m_low_name = l_strings.add(j->getName(), j->getLowName(), l_record.m_name);
+				l_record.m_hit = j->getHit();
+				l_record.m_ts = j->getTS();
+				l_record.m_video = l_strings.add(j->m_media.m_video);
+				l_record.m_audio = l_strings.add(j->m_media.m_audio);
+				l_record.m_ftype = static_cast<uint16_t>(j->getFType());
+				l_record.m_bitrate = j->m_media.m_bitrate;
+				l_record.m_media_x = j->m_media.m_mediaX;
+				l_record.m_media_y = j->m_media.m_mediaY;
+				l_out.write(&l_record, sizeof(l_record));
+				
+				ShareSnapshot::TTHRecord l_tth;
+				memcpy(l_tth.m_tth, l_record.m_tth, TTHValue::BYTES);
+				l_tth.m_file = l_index;
+				l_tth.m_reserved = 0;
+				l_tths.push_back(l_tth);
+			}
+		}
+		
+		// one file per TTH, like tthIndex
+		stable_sort(l_tths.begin(), l_tths.end(), compareSnapshotTTH);
+		l_tths.erase(unique(l_tths.begin(), l_tths.end(), equalSnapshotTTH), l_tths.end());
+		if (!l_tths.empty())
+			l_out.write(&l_tths[0], l_tths.size() * sizeof(ShareSnapshot::TTHRecord));
+		l_header.m_tths = static_cast<uint32_t>(l_tths.size());
+		
+		const vector<uint64_t>& l_table = bloom.getTable();
+		const vector<uint8_t>& l_counters = bloom.getCounters();
+		l_header.m_bloom_offset = l_header.m_tths_offset + uint64_t(l_header.m_tths) * sizeof(ShareSnapshot::TTHRecord);
+		l_header.m_bloom_words = static_cast<uint32_t>(l_table.size());
+		l_header.m_bloom_counters = static_cast<uint32_t>(l_counters.size());
+		if (!l_table.empty())
+			l_out.write(&l_table[0], l_table.size() * sizeof(uint64_t));
+		if (!l_counters.empty())
+			l_out.write(&l_counters[0], l_counters.size());
+			
+		l_header.m_strings_offset = l_header.m_bloom_offset + uint64_t(l_header.m_bloom_words) * sizeof(uint64_t) + l_header.m_bloom_counters;
+		l_header.m_strings_size = l_strings.getSize();
+		l_header.m_file_size = l_header.m_strings_offset + l_header.m_strings_size;
+		
+		p_data += l_pool;
+		memcpy(&p_data[0], &l_header, sizeof(l_header));
+		return true;
+	}
+	catch (const FileException& e)
+	{
+		p_data.clear();
+		LogManager::getInstance()->message(getSnapshotPath() + ": " + e.getError()); // [!] TODO translate
+		return false;
+	}
+}
+
+void ShareManager::saveSnapshot(const string& p_data)
+{
+	const uint64_t l_start = GET_TICK();
+	const string l_path = getSnapshotPath();
+	const string l_tmp = l_path + ".tmp";
+	try
+	{
+		{
+			dcpp::File l_file(l_tmp, dcpp::File::WRITE, dcpp::File::CREATE | dcpp::File::TRUNCATE);
+			l_file.write(p_data);
+		}
+		dcpp::File::renameFile(l_tmp, l_path);
+		dcdebug("Share.dat written in %u ms\n", static_cast<unsigned>(GET_TICK() - l_start));
+	}
+	catch (const FileException& e)
+	{
+		dcpp::File::deleteFile(l_tmp);
+		LogManager::getInstance()->message(l_path + ": " + e.getError()); // [!] TODO translate
+	}
+}
+
 void ShareManager::save(SimpleXML& aXml)
 {
 	Lock l(cs);
@@ -681,6 +1039,8 @@ void ShareManager::addDirectory(const string& realPath, const string& virtualNam
 		
 		shares.insert(std::make_pair(realPath, vName));
 		updateIndices(*merge(dp));
+		incShareGeneration();
+		invalidatePartialListsL('/' + Text::toLower(vName) + '/');
 		
 		setDirty();
 	}
@@ -773,6 +1133,7 @@ void ShareManager::removeDirectory(const string& realPath)
 	{
 		if (stricmp((*j)->getName(), vName) == 0)
 		{
+			removeFromBloom(**j);
 			directories.erase(j++);
 		}
 		else
@@ -792,11 +1153,13 @@ void ShareManager::removeDirectory(const string& realPath)
 		{
 			Directory::Ptr dp = buildTree(i->first, 0, true);
 			dp->setName(i->second);
+			addToBloom(*dp);
 			merge(dp);
 		}
 	}
 	
-	rebuildIndices();
+	// The name bloom is already up to date, only the hash index has to be rebuilt
+	rebuildIndices(false);
 	setDirty();
 }
 
@@ -826,6 +1189,16 @@ int64_t ShareManager::getShareSize(const string& realPath) const noexcept
     
     if (i != shares.end())
 {
+	if (m_snapshot)
+	{
+		// the roots are still empty, the sizes are in the snapshot
+		const ShareSnapshot::Header& l_header = m_snapshot->getHeader();
+		for (uint32_t k = 0; k < l_header.m_dirs && m_snapshot->getDir(k).m_parent == ShareSnapshot::NONE; ++k)
+		{
+			if (stricmp(i->second.c_str(), m_snapshot->getString(m_snapshot->getDir(k).m_name)) == 0)
+				return m_snapshot->getDir(k).m_size;
+		}
+	}
 DirList::const_iterator j = getByVirtual(i->second);
 	if (j != directories.end())
 	{
@@ -838,6 +1211,8 @@ return -1;
 int64_t ShareManager::getShareSize() const noexcept
 {
     Lock l(cs);
+    if (m_snapshot)
+    return m_snapshot->getHeader().m_shared_size;
     int64_t tmp = 0;
     for (HashFileMap::const_iterator i = tthIndex.begin(); i != tthIndex.end(); ++i)
 {
@@ -849,16 +1224,69 @@ return tmp;
 size_t ShareManager::getSharedFiles() const noexcept
 {
     Lock l(cs);
+    if (m_snapshot)
+    return m_snapshot->getHeader().m_tths;
     return tthIndex.size();
 }
 
+bool ShareManager::isTTHShared(const TTHValue& tth) const
+{
+	Lock l(cs);
+	if (tthIndex.find(tth) != tthIndex.end())
+		return true;
+	return m_snapshot && m_snapshot->findTTH(tth) != ShareSnapshot::NONE;
+}
+
+// [+] File name and extension checks shared by buildTree and the share watcher
+bool ShareManager::isShareableFile(const string& name)
+{
+	const string l_ext = Util::getFileExt(name);
+	static const string l_Thumb = "Thumbs.db";
+	return (name != l_Thumb) && (stricmp(name.c_str(), "DCPlusPlus.xml") != 0) &&
+	       (stricmp(name.c_str(), "Favorites.xml") != 0) &&
+	       (name != "ZbThumbnail.info") &&
+	       (name.find("~uTorrentPartFile") != 0) &&// TODO optimize
+	       (stricmp(l_ext.c_str(), ".jc!") != 0) &&
+	       (stricmp(l_ext.c_str(), ".ob!") != 0) &&
+	       (stricmp(l_ext.c_str(), ".dmf") != 0) &&
+	       (stricmp(l_ext.c_str(), ".MTA") != 0) &&
+	       (stricmp(l_ext.c_str(), ".dmfr") != 0) &&
+	       (stricmp(l_ext.c_str(), ".download") != 0) &&
+	       (stricmp(l_ext.c_str(), ".crdownload") != 0) &&
+	       (stricmp(l_ext.c_str(), ".!ut") != 0) &&
+	       (stricmp(l_ext.c_str(), ".!bt") != 0) &&
+	       (stricmp(l_ext.c_str(), ".bc!") != 0) &&
+	       (stricmp(l_ext.c_str(), ".GetRight") != 0) &&
+	       (stricmp(l_ext.c_str(), ".dctmp") != 0) &&
+	       (stricmp(l_ext.c_str(), ".pusd") != 0) &&
+	       (stricmp(l_ext.c_str(), ".dusd") != 0) &&
+	       (stricmp(l_ext.c_str(), ".gltth") != 0) &&
+	       (stricmp(l_ext.c_str(), ".antifrag") != 0);
+}
+
 ShareManager::Directory::Ptr ShareManager::buildTree(const string& aName, const Directory::Ptr& aParent, bool p_is_job)
+{
+	Directory::Ptr dir = Directory::create(Util::getLastDir(aName), aParent);
+	fillTree(aName, dir, p_is_job);
+	return dir;
+}
+
+void ShareManager::fillTree(const string& aName, const Directory::Ptr& dir, bool p_is_job)
+{
+	ScanList l_subdirs;
+	scanDirectory(aName, dir, p_is_job, l_subdirs);
+	for (ScanList::const_iterator i = l_subdirs.begin(); i != l_subdirs.end(); ++i)
+	{
+		fillTree(i->first, i->second, p_is_job);
+	}
+}
+
+void ShareManager::scanDirectory(const string& aName, const Directory::Ptr& dir, bool p_is_job, ScanList& p_subdirs)
 {
 	__int64 l_path_id = 0;
 	if (!p_is_job)
 		l_path_id = CFlylinkDBManager::getInstance()->get_path_id(Text::toLower(aName), true);
-	Directory::Ptr dir = Directory::create(Util::getLastDir(aName), aParent);
-	
+		
 	Directory::File::Set::iterator lastFileIter = dir->files.begin();
 	
 	FileFindIter end;
@@ -944,34 +1372,16 @@ ShareManager::Directory::Ptr ShareManager::buildTree(const string& aName, const
 #endif
 			if ((stricmp(newName, SETTING(TEMP_DOWNLOAD_DIRECTORY)) != 0) && shareFolder(newName))
 			{
-				dir->directories[name] = buildTree(newName, dir, p_is_job);
+				// Subdirectories are filled by the caller, possibly on another thread
+				Directory::Ptr l_subdir = Directory::create(name, dir);
+				dir->directories[name] = l_subdir;
+				p_subdirs.push_back(make_pair(newName, l_subdir));
 			}
 		}
 		else
 		{
 			// Not a directory, assume it's a file...make sure we're not sharing the settings file...
-			const string l_ext = Util::getFileExt(name);
-			static const string l_Thumb = "Thumbs.db";
-			if ((name != l_Thumb) && (stricmp(name.c_str(), "DCPlusPlus.xml") != 0) &&
-			        (stricmp(name.c_str(), "Favorites.xml") != 0) &&
-			        (name != "ZbThumbnail.info") &&
-			        (name.find("~uTorrentPartFile") != 0) &&// TODO optimize
-			        (stricmp(l_ext.c_str(), ".jc!") != 0) &&
-			        (stricmp(l_ext.c_str(), ".ob!") != 0) &&
-			        (stricmp(l_ext.c_str(), ".dmf") != 0) &&
-			        (stricmp(l_ext.c_str(), ".MTA") != 0) &&
-			        (stricmp(l_ext.c_str(), ".dmfr") != 0) &&
-			        (stricmp(l_ext.c_str(), ".download") != 0) &&
-			        (stricmp(l_ext.c_str(), ".crdownload") != 0) &&
-			        (stricmp(l_ext.c_str(), ".!ut") != 0) &&
-			        (stricmp(l_ext.c_str(), ".!bt") != 0) &&
-			        (stricmp(l_ext.c_str(), ".bc!") != 0) &&
-			        (stricmp(l_ext.c_str(), ".GetRight") != 0) &&
-			        (stricmp(l_ext.c_str(), ".dctmp") != 0) &&
-			        (stricmp(l_ext.c_str(), ".pusd") != 0) &&
-			        (stricmp(l_ext.c_str(), ".dusd") != 0) &&
-			        (stricmp(l_ext.c_str(), ".gltth") != 0) &&
-			        (stricmp(l_ext.c_str(), ".antifrag") != 0))
+			if (isShareableFile(name))
 			{
 			
 				const int64_t size = i->getSize();
@@ -1019,7 +1429,6 @@ ShareManager::Directory::Ptr ShareManager::buildTree(const string& aName, const
 	}
 	if (l_path_id && !m_sweep_guard)
 		CFlylinkDBManager::getInstance()->SweepFiles(l_path_id, l_dir_map);
-	return dir;
 }
 
 bool ShareManager::checkHidden(const string& aName) const
@@ -1034,137 +1443,558 @@ bool ShareManager::checkHidden(const string& aName) const
 	return true;
 }
 
-void ShareManager::updateIndices(Directory& dir)
+void ShareManager::updateIndices(Directory& dir, bool p_update_bloom /* = true */)
 {
-	bloom.add(Text::toLower(dir.getName()));
-	
+	if (p_update_bloom)
+		bloom.add(Text::toLower(dir.getName()));
+		
 	for (Directory::MapIter i = dir.directories.begin(); i != dir.directories.end(); ++i)
 	{
-		updateIndices(*i->second);
+		updateIndices(*i->second, p_update_bloom);
 	}
 	
 	dir.size = 0;
 	
 	for (Directory::File::Set::iterator i = dir.files.begin(); i != dir.files.end();)
 	{
-		updateIndices(dir, i++);
+		updateIndices(dir, i++, p_update_bloom);
 	}
 }
 
-void ShareManager::rebuildIndices()
+void ShareManager::addToBloom(const Directory& dir)
 {
-	sharedSize = 0;
-	tthIndex.clear();
-	bloom.clear();
-	
-	for (DirList::const_iterator i = directories.begin(); i != directories.end(); ++i)
+	bloom.add(Text::toLower(dir.getName()));
+	for (Directory::Map::const_iterator i = dir.directories.begin(); i != dir.directories.end(); ++i)
+	{
+		addToBloom(*i->second);
+	}
+	for (Directory::File::Set::const_iterator i = dir.files.begin(); i != dir.files.end(); ++i)
 	{
-		updateIndices(**i);
+		bloom.add(Text::toLower(i->getName()));
 	}
 }
 
-void ShareManager::updateIndices(Directory& dir, const Directory::File::Set::iterator& i)
+void ShareManager::removeFromBloom(const Directory& dir)
 {
-	const Directory::File& f = *i;
-	
-	HashFileIter j = tthIndex.find(f.getTTH());
-	if (j == tthIndex.end())
+	bloom.remove(Text::toLower(dir.getName()));
+	for (Directory::Map::const_iterator i = dir.directories.begin(); i != dir.directories.end(); ++i)
 	{
-		dir.size += f.getSize();
-		sharedSize += f.getSize();
+		removeFromBloom(*i->second);
 	}
-	
-	dir.addType(f.getFType()); //[+]PPA    getFType
-	
-	tthIndex.insert(make_pair(f.getTTH(), i));
-	bloom.add(Text::toLower(f.getName()));
-	
-	if (dht::IndexManager::isValidInstance()) //[+]PPA
+	for (Directory::File::Set::const_iterator i = dir.files.begin(); i != dir.files.end(); ++i)
 	{
-		dht::IndexManager* im = dht::IndexManager::getInstance();
-		if (im && im->isTimeForPublishing())
-			im->publishFile(f.getTTH(), f.getSize());
+		bloom.remove(Text::toLower(i->getName()));
 	}
 }
 
-void ShareManager::refresh(bool dirs /* = false */, bool aUpdate /* = true */, bool block /* = false */) noexcept
+void ShareManager::removeIndices(Directory& dir)
 {
-	if (refreshing.test_and_set())
+	for (Directory::MapIter i = dir.directories.begin(); i != dir.directories.end(); ++i)
 	{
-		LogManager::getInstance()->message(STRING(FILE_LIST_REFRESH_IN_PROGRESS));
-		return;
+		removeIndices(*i->second);
 	}
-	
-	update = aUpdate;
-	refreshDirs = dirs;
-	join();
-	bool cached = false;
-	if (initial)
+	for (Directory::File::Set::const_iterator i = dir.files.begin(); i != dir.files.end(); ++i)
 	{
-		cached = loadCache();
-		initial = false;
+		removeIndices(dir, i);
 	}
-	try {
-		start();
-		if (block && !cached)
+}
+
+void ShareManager::removeIndices(Directory& dir, const Directory::File::Set::const_iterator& i)
+{
+	// Only the first file with a given TTH is indexed and counted, see updateIndices
+	const pair<HashFileMultiMap::iterator, HashFileMultiMap::iterator> l_dups = m_tth_duplicates.equal_range(i->getTTH());
+	HashFileMap::iterator j = tthIndex.find(i->getTTH());
+	if (j == tthIndex.end() || &*j->second != &*i)
+	{
+		for (HashFileMultiMap::iterator k = l_dups.first; k != l_dups.second; ++k)
 		{
-			join();
-		}
-		else {
-			setThreadPriority(Thread::LOW);
+			if (&*k->second == &*i)
+			{
+				m_tth_duplicates.erase(k);
+				break;
+			}
 		}
+		return;
 	}
-	catch (const ThreadException& e)
+	
+	dir.size -= i->getSize();
+	sharedSize -= i->getSize();
+	
+	if (l_dups.first != l_dups.second)
 	{
-		LogManager::getInstance()->message(STRING(FILE_LIST_REFRESH_FAILED) + " " + e.getError());
+		// Another copy is still shared, let it answer for the TTH
+		const Directory::File::Set::const_iterator l_next = l_dups.first->second;
+		m_tth_duplicates.erase(l_dups.first);
+		j->second = l_next;
+		l_next->getParent()->size += l_next->getSize();
+		sharedSize += l_next->getSize();
+		return;
+	}
+	
+	tthIndex.erase(j);
+	++m_hash_bloom_removed;
+	
+	if (dht::IndexManager::isValidInstance())
+	{
+		dht::IndexManager* im = dht::IndexManager::getInstance();
+		if (im)
+			im->unpublishFile(i->getTTH());
 	}
 }
 
-StringPairList ShareManager::getDirectories() const noexcept
+void ShareManager::directoryChangedL(const Directory& dir)
 {
-    Lock l(cs);
-    StringPairList ret;
-    for (StringMap::const_iterator i = shares.begin(); i != shares.end(); ++i)
-{
-ret.push_back(make_pair(i->second, i->first));
-}
-return ret;
+	string l_dir = '/' + Text::toLower(dir.getFullName());
+	std::replace(l_dir.begin(), l_dir.end(), '\\', '/');
+	invalidatePartialListsL(l_dir);
+	incShareGeneration();
+	setDirty();
 }
 
-int ShareManager::run()
+void ShareManager::onWatchedDirectoryAdded(const string& p_path)
 {
-
-	StringPairList dirs = getDirectories();
-	// Don't need to refresh if no directories are shared
-	if (dirs.empty())
-		refreshDirs = false;
+	if (stricmp(p_path, SETTING(TEMP_DOWNLOAD_DIRECTORY)) == 0 || !shareFolder(p_path) || !checkHidden(p_path))
+		return;
 		
-	if (refreshDirs)
+	const string l_parent_path = p_path.substr(0, p_path.size() - 1);
+	Directory::Ptr l_parent;
 	{
-		HashManager::HashPauser pauser;
+		Lock l(cs);
+		l_parent = getDirectory(l_parent_path);
+	}
+	if (!l_parent)
+		return;
 		
-		LogManager::getInstance()->message(STRING(FILE_LIST_REFRESH_INITIATED));
-		sharedSize = 0;
-		lastFullUpdate = GET_TICK();
+	// Scan outside of the lock, same as a refresh does
+	Directory::Ptr dp = buildTree(p_path, l_parent, false);
+	
+	Lock l(cs);
+	if (getDirectory(l_parent_path) != l_parent)
+		return;
 		
-		DirList newDirs;
-		CFlylinkDBManager::getInstance()->LoadPathCache();
-		for (StringPairIter i = dirs.begin(); i != dirs.end(); ++i)
-		{
-			if (checkHidden(i->second))
-			{
-				Directory::Ptr dp = buildTree(i->second, Directory::Ptr(), false);
-				dp->setName(i->first);
-				newDirs.push_back(dp);
-			}
-		}
-		if (m_sweep_path)
-		{
-			m_sweep_path = false;
-			m_sweep_guard = true;
+	Directory::MapIter i = l_parent->directories.find(dp->getName());
+	if (i != l_parent->directories.end())
+	{
+		removeFromBloom(*i->second);
+		removeIndices(*i->second);
+		i->second = dp;
+	}
+	else
+	{
+		l_parent->directories[dp->getName()] = dp;
+	}
+	updateIndices(*dp);
+	directoryChangedL(*l_parent);
+}
+
+void ShareManager::onWatchedDirectoryRemoved(const string& p_path)
+{
+	Lock l(cs);
+	Directory::Ptr l_parent = getDirectory(p_path.substr(0, p_path.size() - 1));
+	if (!l_parent)
+		return;
+		
+	Directory::MapIter i = l_parent->directories.find(Util::getLastDir(p_path));
+	if (i == l_parent->directories.end())
+		return;
+		
+	removeFromBloom(*i->second);
+	removeIndices(*i->second);
+	l_parent->directories.erase(i);
+	directoryChangedL(*l_parent);
+}
+
+void ShareManager::onWatchedFileChanged(const string& p_path)
+{
+	const string l_name = Util::getFileName(p_path);
+	if (!isShareableFile(l_name) || stricmp(p_path, SETTING(TLS_PRIVATE_KEY_FILE)) == 0)
+		return;
+		
+	{
+		Lock l(cs);
+		Directory::Ptr d = getDirectory(p_path);
+		if (!d)
+			return;
+			
+		// A modified file is dropped and added back by TTHDone once it's rehashed
+		Directory::File::Set::const_iterator i = d->findFile(l_name);
+		if (i != d->files.end())
+		{
+			bloom.remove(i->getLowName());
+			removeIndices(*d, i);
+			d->files.erase(i);
+			directoryChangedL(*d);
+		}
+	}
+	
+	try
+	{
+		HashManager::getInstance()->hashFile(p_path, File::getSize(p_path));
+	}
+	catch (const HashException&)
+	{
+	}
+}
+
+void ShareManager::onWatchedFileRemoved(const string& p_path)
+{
+	Lock l(cs);
+	Directory::Ptr d = getDirectory(p_path);
+	if (!d)
+		return;
+		
+	Directory::File::Set::const_iterator i = d->findFile(Util::getFileName(p_path));
+	if (i == d->files.end())
+		return;
+		
+	bloom.remove(i->getLowName());
+	removeIndices(*d, i);
+	d->files.erase(i);
+	directoryChangedL(*d);
+}
+
+void ShareManager::rebuildIndices(bool p_update_bloom /* = true */)
+{
+	sharedSize = 0;
+	tthIndex.clear();
+	m_tth_duplicates.clear();
+	if (p_update_bloom)
+		bloom.clear();
+	m_hash_blooms.clear();
+	m_hash_bloom_removed = 0;
+	incShareGeneration();
+	clearPartialListsL(0);
+	
+	for (DirList::const_iterator i = directories.begin(); i != directories.end(); ++i)
+	{
+		updateIndices(**i, p_update_bloom);
+	}
+}
+
+void ShareManager::updateIndices(Directory& dir, const Directory::File::Set::const_iterator& i, bool p_update_bloom /* = true */)
+{
+	const Directory::File& f = *i;
+	
+	HashFileIter j = tthIndex.find(f.getTTH());
+	if (j == tthIndex.end())
+	{
+		dir.size += f.getSize();
+		sharedSize += f.getSize();
+		tthIndex.insert(make_pair(f.getTTH(), i));
+	}
+	else if (&*j->second == &f)
+	{
+		// Already indexed, the directory is being recounted after a merge
+		dir.size += f.getSize();
+	}
+	else
+	{
+		const pair<HashFileMultiMap::iterator, HashFileMultiMap::iterator> l_dups = m_tth_duplicates.equal_range(f.getTTH());
+		HashFileMultiMap::iterator k = l_dups.first;
+		while (k != l_dups.second && &*k->second != &f)
+			++k;
+		if (k == l_dups.second)
+			m_tth_duplicates.insert(make_pair(f.getTTH(), i));
+	}
+	
+	dir.addType(f.getFType()); //[+]PPA    getFType
+	
+	addToHashBlooms(f.getTTH());
+	if (p_update_bloom)
+		bloom.add(Text::toLower(f.getName()));
+	
+	if (dht::IndexManager::isValidInstance()) //[+]PPA
+	{
+		dht::IndexManager* im = dht::IndexManager::getInstance();
+		if (im && im->isTimeForPublishing())
+			im->publishFile(f.getTTH(), f.getSize());
+	}
+}
+
+void ShareManager::refresh(bool dirs /* = false */, bool aUpdate /* = true */, bool block /* = false */) noexcept
+{
+	if (refreshing.test_and_set())
+	{
+		LogManager::getInstance()->message(STRING(FILE_LIST_REFRESH_IN_PROGRESS));
+		return;
+	}
+	
+	update = aUpdate;
+	refreshDirs = dirs;
+	join();
+	bool cached = false;
+	if (initial)
+	{
+		cached = loadCache();
+		initial = false;
+	}
+	try {
+		start();
+		if (block && !cached)
+		{
+			join();
+		}
+		else {
+			setThreadPriority(Thread::LOW);
+		}
+	}
+	catch (const ThreadException& e)
+	{
+		LogManager::getInstance()->message(STRING(FILE_LIST_REFRESH_FAILED) + " " + e.getError());
+	}
+}
+
+StringPairList ShareManager::getDirectories() const noexcept
+{
+    Lock l(cs);
+    StringPairList ret;
+    for (StringMap::const_iterator i = shares.begin(); i != shares.end(); ++i)
+{
+ret.push_back(make_pair(i->second, i->first));
+}
+return ret;
+}
+
+/**
+ * Parallel scan of the share trees for a full refresh. Every worker has its own queue
+ * of directories (newest first, so each walks depth first) and steals the oldest ones
+ * of the others when it runs dry. At most SCAN_DEVICE_THREADS directories of the same
+ * device are enumerated at once. Subdirectories are linked into their parent before
+ * they are queued, so the trees don't depend on the order the workers finish in.
+ */
+class ShareManager::Scanner
+{
+	public:
+		Scanner(ShareManager& p_share, bool p_is_job) : m_share(p_share), m_is_job(p_is_job), m_pending(0), m_roots(0)
+		{
+			m_queues.resize(SCAN_THREADS);
+		}
+		
+		void add(const string& p_path, const Directory::Ptr& p_dir)
+		{
+			Task l_task;
+			l_task.m_path = p_path;
+			l_task.m_dir = p_dir;
+			l_task.m_device = File::getDeviceKey(p_path);
+			Device& l_device = m_devices[l_task.m_device];
+			if (l_device.m_name.empty())
+				l_device.m_name = p_path;
+			m_queues[m_roots++ % m_queues.size()].push_back(l_task);
+			++m_pending;
+		}
+		
+		void scan()
+		{
+#ifdef _WIN32
+			// CFlyGetSysPath caches lazily, fill it before the workers race on it
+			m_share.m_windows_path.getPath(CSIDL_WINDOWS);
+			m_share.m_appdata_path.getPath(CSIDL_APPDATA);
+			m_share.m_local_appdata_path.getPath(CSIDL_LOCAL_APPDATA);
+			m_share.m_pf_path.getPath(CSIDL_PROGRAM_FILES);
+			m_share.m_pf_x86_path.getPath(CSIDL_PROGRAM_FILESX86);
+#endif
+			vector<unique_ptr<Worker> > l_workers;
+			for (size_t i = 1; i < m_queues.size(); ++i)
+			{
+				try
+				{
+					l_workers.push_back(unique_ptr<Worker>(new Worker(*this, i)));
+					l_workers.back()->start();
+				}
+				catch (const ThreadException& e)
+				{
+					// The queue of a missing worker is stolen by the others
+					dcdebug("ShareManager::Scanner: %s\n", e.getError().c_str());
+					l_workers.pop_back();
+					break;
+				}
+			}
+			work(0);
+			for (auto i = l_workers.cbegin(); i != l_workers.cend(); ++i)
+			{
+				(*i)->join();
+			}
+		}
+		
+		string getReport(uint64_t p_time) const
+		{
+			uint64_t l_dirs = 0;
+			uint64_t l_files = 0;
+			string l_devices;
+			for (auto i = m_devices.cbegin(); i != m_devices.cend(); ++i)
+			{
+				l_dirs += i->second.m_dirs;
+				l_files += i->second.m_files;
+				l_devices += "\r\n" + i->second.m_name + ": " + Util::toString(i->second.m_dirs) + " dirs, " +
+				             Util::toString(i->second.m_files) + " files, " +
+				             Util::toString(i->second.m_files * 1000 / max(p_time, uint64_t(1))) + " files/s";
+			}
+			// [!] TODO translate
+			return "Share scan: " + Util::toString(l_dirs) + " dirs, " + Util::toString(l_files) + " files in " +
+			       Util::toString(p_time) + " ms, " + Util::toString(SCAN_THREADS) + " threads" + l_devices;
+		}
+		
+	private:
+		enum
+		{
+			SCAN_THREADS = 8,
+			SCAN_DEVICE_THREADS = 4,
+			SCAN_IDLE_WAIT = 100,
+			// Limit the look-ahead for a task of a device that isn't saturated
+			SCAN_LOOKUP_DEPTH = 64
+		};
+		
+		struct Task
+		{
+			string m_path;
+			Directory::Ptr m_dir;
+			string m_device;
+		};
+		struct Device
+		{
+			Device() : m_in_flight(0), m_dirs(0), m_files(0) { }
+			string m_name;
+			size_t m_in_flight;
+			uint64_t m_dirs;
+			uint64_t m_files;
+		};
+		
+		class Worker : public Thread
+		{
+			public:
+				Worker(Scanner& p_scanner, size_t p_index) : m_scanner(p_scanner), m_index(p_index) { }
+			private:
+				int run()
+				{
+					m_scanner.work(m_index);
+					return 0;
+				}
+				Scanner& m_scanner;
+				const size_t m_index;
+		};
+		
+		bool pop(size_t p_index, Task& p_task)
+		{
+			for (size_t n = 0; n < m_queues.size(); ++n)
+			{
+				deque<Task>& l_queue = m_queues[(p_index + n) % m_queues.size()];
+				const size_t l_depth = min(l_queue.size(), size_t(SCAN_LOOKUP_DEPTH));
+				for (size_t i = 0; i < l_depth; ++i)
+				{
+					// Own queue from the back, the others from the front
+					const size_t l_pos = n == 0 ? l_queue.size() - 1 - i : i;
+					if (m_devices[l_queue[l_pos].m_device].m_in_flight < SCAN_DEVICE_THREADS)
+					{
+						p_task = l_queue[l_pos];
+						l_queue.erase(l_queue.begin() + l_pos);
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+		
+		void work(size_t p_index)
+		{
+			for (;;)
+			{
+				Task l_task;
+				{
+					Lock l(m_cs);
+					if (m_pending == 0)
+						return;
+					if (pop(p_index, l_task))
+						++m_devices[l_task.m_device].m_in_flight;
+				}
+				if (!l_task.m_dir)
+				{
+					m_sem.wait(SCAN_IDLE_WAIT);
+					continue;
+				}
+				
+				ScanList l_subdirs;
+				m_share.scanDirectory(l_task.m_path, l_task.m_dir, m_is_job, l_subdirs);
+				
+				size_t l_wakeup;
+				{
+					Lock l(m_cs);
+					Device& l_device = m_devices[l_task.m_device];
+					--l_device.m_in_flight;
+					++l_device.m_dirs;
+					l_device.m_files += l_task.m_dir->files.size();
+					for (ScanList::const_iterator i = l_subdirs.begin(); i != l_subdirs.end(); ++i)
+					{
+						Task l_subtask;
+						l_subtask.m_path = i->first;
+						l_subtask.m_dir = i->second;
+						l_subtask.m_device = l_task.m_device;
+						m_queues[p_index].push_back(l_subtask);
+					}
+					m_pending += l_subdirs.size();
+					--m_pending;
+					// Idle workers may take the new directories or the freed device slot, or have to quit
+					l_wakeup = m_pending == 0 ? m_queues.size() : min(l_subdirs.size() + 1, m_queues.size());
+				}
+				for (size_t i = 0; i < l_wakeup; ++i)
+				{
+					m_sem.signal();
+				}
+			}
+		}
+		
+		ShareManager& m_share;
+		const bool m_is_job;
+		vector<deque<Task> > m_queues;
+		map<string, Device> m_devices;
+		// Directories queued or being scanned
+		size_t m_pending;
+		size_t m_roots;
+		CriticalSection m_cs;
+		Semaphore m_sem;
+};
+
+int ShareManager::run()
+{
+	// the tree of Share.dat first, the rescan below can take a while
+	materializeSnapshot();
+	
+	StringPairList dirs = getDirectories();
+	// Don't need to refresh if no directories are shared
+	if (dirs.empty())
+		refreshDirs = false;
+		
+	if (refreshDirs)
+	{
+		HashManager::HashPauser pauser;
+		
+		LogManager::getInstance()->message(STRING(FILE_LIST_REFRESH_INITIATED));
+		sharedSize = 0;
+		lastFullUpdate = GET_TICK();
+		
+		DirList newDirs;
+		CFlylinkDBManager::getInstance()->LoadPathCache();
+		const uint64_t l_scan_start = GET_TICK();
+		Scanner l_scanner(*this, false);
+		for (StringPairIter i = dirs.begin(); i != dirs.end(); ++i)
+		{
+			if (checkHidden(i->second))
+			{
+				Directory::Ptr dp = Directory::create(Util::getLastDir(i->second));
+				dp->setName(i->first);
+				l_scanner.add(i->second, dp);
+				newDirs.push_back(dp);
+			}
+		}
+		l_scanner.scan();
+		LogManager::getInstance()->message(l_scanner.getReport(GET_TICK() - l_scan_start));
+		if (m_sweep_path)
+		{
+			m_sweep_path = false;
+			m_sweep_guard = true;
 			CFlylinkDBManager::getInstance()->SweepPath();
 		}
 		
+		string l_snapshot_data;
 		{
 			Lock l(cs);
 			directories.clear();
@@ -1175,12 +2005,25 @@ int ShareManager::run()
 			}
 			
 			rebuildIndices();
+			if (!buildSnapshotL(l_snapshot_data))
+				l_snapshot_data.clear();
 		}
+		// the disk write does not hold up searches and uploads
+		if (!l_snapshot_data.empty())
+			saveSnapshot(l_snapshot_data);
 		refreshDirs = false;
 		
 		LogManager::getInstance()->message(STRING(FILE_LIST_REFRESH_FINISHED));
 	}
 	
+	// (Re)start watching the shared directories, a running watch keeps going if nothing changed
+	StringList l_roots;
+	for (StringPairIter i = dirs.begin(); i != dirs.end(); ++i)
+	{
+		l_roots.push_back(i->second);
+	}
+	m_watcher.startWatching(l_roots);
+	
 	if (update)
 	{
 		ClientManager::getInstance()->infoUpdated();
@@ -1196,16 +2039,45 @@ int ShareManager::run()
 
 void ShareManager::getBloom(ByteVector& v, size_t k, size_t m, size_t h) const
 {
-	dcdebug("Creating bloom filter, k=%u, m=%u, h=%u\n", k, m, h);
 	Lock l(cs);
 	
-	HashBloom bloom;
-	bloom.reset(k, m, h);
-	for (HashFileMap::const_iterator i = tthIndex.begin(); i != tthIndex.end(); ++i)
+	if (m_hash_bloom_removed > max(HASH_BLOOM_MIN_REMOVED, tthIndex.size() * HASH_BLOOM_REMOVED_PERCENT / 100))
 	{
-		bloom.add(i->first);
+		m_hash_blooms.clear();
+		m_hash_bloom_removed = 0;
+	}
+	
+	const HashBloomMap::key_type l_key(k, m, h);
+	HashBloomMap::iterator i = m_hash_blooms.find(l_key);
+	if (i == m_hash_blooms.end())
+	{
+		dcdebug("Creating bloom filter, k=%u, m=%u, h=%u\n", k, m, h);
+		if (m_hash_blooms.size() >= HASH_BLOOM_MAX_ITEMS)
+		{
+			HashBloomMap::iterator l_oldest = m_hash_blooms.begin();
+			for (HashBloomMap::iterator j = m_hash_blooms.begin(); j != m_hash_blooms.end(); ++j)
+			{
+				if (j->second.m_used < l_oldest->second.m_used)
+					l_oldest = j;
+			}
+			m_hash_blooms.erase(l_oldest);
+		}
+		i = m_hash_blooms.insert(make_pair(l_key, HashBloomItem())).first;
+		i->second.m_bloom.reset(k, m, h);
+		for (HashFileMap::const_iterator j = tthIndex.begin(); j != tthIndex.end(); ++j)
+		{
+			i->second.m_bloom.add(j->first);
+		}
+		if (m_snapshot)
+		{
+			for (uint32_t j = 0; j < m_snapshot->getHeader().m_tths; ++j)
+			{
+				i->second.m_bloom.add(TTHValue(m_snapshot->getTTH(j).m_tth));
+			}
+		}
 	}
-	bloom.copy_to(v);
+	i->second.m_used = GET_TICK();
+	i->second.m_bloom.copy_to(v);
 }
 
 void ShareManager::generateXmlList()
@@ -1282,13 +2154,22 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 	if (dir[0] != '/' || dir[dir.size() - 1] != '/')
 		return 0;
 		
+	const string l_key = (recurse ? 'R' : 'N') + Text::toLower(dir);
+	
+	Lock l(cs);
+	PartialListMap::iterator l_cached = m_partial_lists.find(l_key);
+	if (l_cached != m_partial_lists.end())
+	{
+		l_cached->second.m_used = GET_TICK();
+		return new MemoryInputStream(l_cached->second.m_xml);
+	}
+	
 	string xml = SimpleXML::utf8Header;
 	string tmp;
 	xml += "<FileListing Version=\"1\" CID=\"" + ClientManager::getInstance()->getMe()->getCID().toBase32() + "\" Base=\"" + SimpleXML::escape(dir, tmp, false) + "\" Generator=\"DC++ " DCVERSIONSTRING "\">\r\n";
 	StringOutputStream sos(xml);
 	string indent = "\t";
 	
-	Lock l(cs);
 	if (dir == "/")
 	{
 		for (auto i = directories.cbegin(); i != directories.cend(); ++i)
@@ -1343,7 +2224,74 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 	}
 	
 	xml += "</FileListing>";
-	return new MemoryInputStream(xml);
+	
+	std::shared_ptr<string> l_xml(new string);
+	l_xml->swap(xml);
+	addPartialListL(l_key, l_xml);
+	return new MemoryInputStream(std::shared_ptr<const string>(l_xml));
+}
+
+void ShareManager::addPartialListL(const string& p_key, const std::shared_ptr<const string>& p_xml) const
+{
+	const size_t l_size = p_xml->size();
+	if (l_size > PARTIAL_LIST_CACHE_SIZE / 4)
+		return;
+		
+	// Evict the least recently used lists until the new one fits
+	while (!m_partial_lists.empty() && m_partial_lists_size + l_size > PARTIAL_LIST_CACHE_SIZE)
+	{
+		PartialListMap::iterator l_oldest = m_partial_lists.begin();
+		for (PartialListMap::iterator i = m_partial_lists.begin(); i != m_partial_lists.end(); ++i)
+		{
+			if (i->second.m_used < l_oldest->second.m_used)
+				l_oldest = i;
+		}
+		m_partial_lists_size -= l_oldest->second.m_xml->size();
+		m_partial_lists.erase(l_oldest);
+	}
+	
+	PartialListItem& l_item = m_partial_lists[p_key];
+	dcassert(!l_item.m_xml);
+	l_item.m_xml = p_xml;
+	l_item.m_created = l_item.m_used = GET_TICK();
+	m_partial_lists_size += l_size;
+}
+
+void ShareManager::invalidatePartialListsL(const string& p_dir)
+{
+	// Lists of the ancestors mention the changed directory, lists of the descendants are part of it
+	for (PartialListMap::iterator i = m_partial_lists.begin(); i != m_partial_lists.end();)
+	{
+		const size_t l_len = i->first.size() - 1;
+		const bool l_related = l_len <= p_dir.size() ?
+		                       p_dir.compare(0, l_len, i->first, 1, l_len) == 0 :
+		                       i->first.compare(1, p_dir.size(), p_dir) == 0;
+		if (l_related)
+		{
+			m_partial_lists_size -= i->second.m_xml->size();
+			m_partial_lists.erase(i++);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void ShareManager::clearPartialListsL(uint64_t p_tick)
+{
+	for (PartialListMap::iterator i = m_partial_lists.begin(); i != m_partial_lists.end();)
+	{
+		if (p_tick == 0 || i->second.m_created + PARTIAL_LIST_CACHE_TIME < p_tick)
+		{
+			m_partial_lists_size -= i->second.m_xml->size();
+			m_partial_lists.erase(i++);
+		}
+		else
+		{
+			++i;
+		}
+	}
 }
 
 #define LITERAL(n) n, sizeof(n)-1
@@ -1741,13 +2689,122 @@ if (l->second) l->second->search(aResults, *cur, aSearchType, aSize, aFileType,
 }
 }
 
+// [+] Searches served from Share.dat until the tree is built
+static SearchResultPtr toSearchResult(const ShareSnapshot& p_snapshot, uint32_t p_file)
+{
+	const ShareSnapshot::FileRecord& l_file = p_snapshot.getFile(p_file);
+	return SearchResultPtr(new SearchResult(SearchResult::TYPE_FILE, l_file.m_size,
+	                                        p_snapshot.getFullName(l_file.m_dir) + p_snapshot.getString(l_file.m_name), TTHValue(l_file.m_tth)));
+}
+
+static bool isExcludedName(const StringSearch::List* p_exclude, const char* p_name, size_t p_length)
+{
+	if (p_exclude)
+	{
+		for (auto i = p_exclude->cbegin(); i != p_exclude->cend(); ++i)
+		{
+			if (i->match(p_name, p_length))
+				return true;
+		}
+	}
+	return false;
+}
+
+/** Every term has to match the name of the file or of one of its directories, as in Directory::search */
+static bool matchSnapshotFile(const ShareSnapshot& p_snapshot, const ShareSnapshot::FileRecord& p_file, const StringSearch::List& p_terms, const StringSearch::List* p_exclude)
+{
+	// the pool strings are matched in place, no copy per file
+	const char* l_low_name = p_snapshot.getString(p_file.m_low_name);
+	const size_t l_low_length = strlen(l_low_name);
+	const uint32_t l_dirs = p_snapshot.getHeader().m_dirs;
+	for (auto i = p_terms.cbegin(); i != p_terms.cend(); ++i)
+	{
+		if (i->match(l_low_name, l_low_length))
+			continue;
+		bool l_found = false;
+		for (uint32_t d = p_file.m_dir; !l_found && d < l_dirs;)
+		{
+			const ShareSnapshot::DirRecord& l_dir = p_snapshot.getDir(d);
+			const char* l_dir_name = p_snapshot.getString(l_dir.m_low_name);
+			const size_t l_dir_length = strlen(l_dir_name);
+			l_found = i->match(l_dir_name, l_dir_length) && !isExcludedName(p_exclude, l_dir_name, l_dir_length);
+			if (l_dir.m_parent >= d)
+				break;
+			d = l_dir.m_parent;
+		}
+		if (!l_found)
+			return false;
+	}
+	return true;
+}
+
+void ShareManager::searchSnapshot(const ShareSnapshot& p_snapshot, SearchResultList& aResults, const StringSearch::List& aStrings, int aSearchType, int64_t aSize, int aFileType, StringList::size_type maxResults)
+{
+	// directories are found again once the tree is there
+	if (aFileType == SearchManager::TYPE_DIRECTORY)
+		return;
+		
+	const size_t l_first = aResults.size();
+	const ShareSnapshot::Header& l_header = p_snapshot.getHeader();
+	for (uint32_t i = 0; i < l_header.m_files && aResults.size() < maxResults; ++i)
+	{
+		const ShareSnapshot::FileRecord& l_file = p_snapshot.getFile(i);
+		if (aSearchType == SearchManager::SIZE_ATLEAST && aSize > l_file.m_size)
+			continue;
+		if (aSearchType == SearchManager::SIZE_ATMOST && aSize < l_file.m_size)
+			continue;
+		if (l_file.m_dir >= l_header.m_dirs ||
+		        (aFileType != SearchManager::TYPE_ANY && !(p_snapshot.getDir(l_file.m_dir).m_file_types & (1 << aFileType))))
+			continue;
+		if (!matchSnapshotFile(p_snapshot, l_file, aStrings, nullptr))
+			continue;
+		if (checkType(p_snapshot.getString(l_file.m_name), aFileType))
+			aResults.push_back(toSearchResult(p_snapshot, i));
+	}
+	// the scan runs without cs, the counter is not
+	if (aResults.size() > l_first)
+	{
+		Lock l(cs);
+		setHits(getHits() + aResults.size() - l_first);
+	}
+}
+
+void ShareManager::searchSnapshot(const ShareSnapshot& p_snapshot, SearchResultList& aResults, AdcSearch& aStrings, StringList::size_type maxResults)
+{
+	if (aStrings.isDirectory)
+		return;
+		
+	const size_t l_first = aResults.size();
+	const ShareSnapshot::Header& l_header = p_snapshot.getHeader();
+	for (uint32_t i = 0; i < l_header.m_files && aResults.size() < maxResults; ++i)
+	{
+		const ShareSnapshot::FileRecord& l_file = p_snapshot.getFile(i);
+		if (l_file.m_size < aStrings.gt || l_file.m_size > aStrings.lt)
+			continue;
+		if (!matchSnapshotFile(p_snapshot, l_file, *aStrings.include, &aStrings.exclude))
+			continue;
+		const char* l_low_name = p_snapshot.getString(l_file.m_low_name);
+		if (isExcludedName(&aStrings.exclude, l_low_name, strlen(l_low_name)))
+			continue;
+		const string l_name = p_snapshot.getString(l_file.m_name);
+		if (aStrings.hasExt(l_name))
+			aResults.push_back(toSearchResult(p_snapshot, i));
+	}
+	// the scan runs without cs, the counter is not
+	if (aResults.size() > l_first)
+	{
+		Lock l(cs);
+		setHits(getHits() + aResults.size() - l_first);
+	}
+}
+
 void ShareManager::search(SearchResultList& results, const string& aString, int aSearchType, int64_t aSize, int aFileType, Client* aClient, StringList::size_type maxResults) noexcept
 {
-	Lock l(cs);
 	if (aFileType == SearchManager::TYPE_TTH)
 	{
 		if (isTTHBase64(aString))  //[+]FlylinkDC++
 		{
+			Lock l(cs);
 			TTHValue tth(aString.c_str() + 4);  //[+]FlylinkDC++ 
 			HashFileMap::const_iterator i = tthIndex.find(tth);
 			if (i != tthIndex.end() && i->second->getParent())
@@ -1758,28 +2815,123 @@ void ShareManager::search(SearchResultList& results, const string& aString, int
 				results.push_back(sr);
 				ShareManager::getInstance()->incHits();
 			}
+			else if (m_snapshot)
+			{
+				const uint32_t l_file = m_snapshot->findTTH(tth);
+				if (l_file != ShareSnapshot::NONE)
+				{
+					results.push_back(toSearchResult(*m_snapshot, l_file));
+					incHits();
+				}
+			}
 		}
 		return;
 	}
 	const StringTokenizer<string> t(Text::toLower(aString), '$');
 	const StringList& sl = t.getTokens();
-	if (!bloom.match(sl))
-		return;
-		
-	StringSearch::List ssl;
+	
+	// [+] The order of the terms does not matter - every one of them has to match
+	StringList l_terms;
 	for (auto i = sl.cbegin(); i != sl.cend(); ++i)
 	{
 		if (!i->empty())
 		{
-			ssl.push_back(StringSearch(*i));
+			l_terms.push_back(*i);
 		}
 	}
-	if (ssl.empty())
+	if (l_terms.empty())
+		return;
+	sort(l_terms.begin(), l_terms.end());
+	
+	string l_key = Util::toString(aSearchType) + '|' + Util::toString(aSize) + '|' + Util::toString(aFileType) + '|' + Util::toString(maxResults);
+	for (auto i = l_terms.cbegin(); i != l_terms.cend(); ++i)
+	{
+		l_key += '$';
+		l_key += *i;
+	}
+	if (findCachedSearch(l_key, results, maxResults))
 		return;
 		
-	for (DirList::const_iterator j = directories.begin(); (j != directories.end()) && (results.size() < maxResults); ++j)
+	const size_t l_first = results.size();
+	uint32_t l_generation;
+	StringSearch::List ssl;
+	std::shared_ptr<ShareSnapshot> l_snapshot;
+	{
+		Lock l(cs);
+		l_generation = m_share_generation;
+		if (bloom.match(sl))
+		{
+			for (auto i = l_terms.cbegin(); i != l_terms.cend(); ++i)
+			{
+				ssl.push_back(StringSearch(*i));
+			}
+			
+			if (m_snapshot)
+				l_snapshot = m_snapshot;
+			else
+				for (DirList::const_iterator j = directories.begin(); (j != directories.end()) && (results.size() < maxResults); ++j)
+				{
+					(*j)->search(results, ssl, aSearchType, aSize, aFileType, aClient, maxResults);
+				}
+		}
+	}
+	if (l_snapshot)
+		searchSnapshot(*l_snapshot, results, ssl, aSearchType, aSize, aFileType, maxResults);
+	addCachedSearch(l_key, SearchResultList(results.begin() + l_first, results.end()), l_generation);
+}
+
+bool ShareManager::findCachedSearch(const string& p_key, SearchResultList& p_results, StringList::size_type p_maxResults)
+{
+	const uint64_t l_tick = GET_TICK();
+	const size_t l_first = p_results.size();
+	{
+		Lock l(csSearchCache);
+		SearchCacheMap::const_iterator i = m_search_cache.find(p_key);
+		if (i == m_search_cache.end() || i->second.m_generation != m_share_generation || i->second.m_tick + SEARCH_CACHE_TIME < l_tick)
+		{
+			++m_search_cache_misses;
+			return false;
+		}
+		++m_search_cache_hits;
+		const SearchResultList& l_cached = i->second.m_results;
+		for (auto j = l_cached.cbegin(); j != l_cached.cend() && p_results.size() < p_maxResults; ++j)
+		{
+			p_results.push_back(*j);
+		}
+	}
+	// hits is guarded by cs like in the tree searches, not by csSearchCache
+	if (p_results.size() > l_first)
 	{
-		(*j)->search(results, ssl, aSearchType, aSize, aFileType, aClient, maxResults);
+		Lock l(cs);
+		setHits(getHits() + p_results.size() - l_first);
+	}
+	return true;
+}
+
+void ShareManager::addCachedSearch(const string& p_key, const SearchResultList& p_results, uint32_t p_generation)
+{
+	const uint64_t l_tick = GET_TICK();
+	Lock l(csSearchCache);
+	if (m_search_cache.size() >= SEARCH_CACHE_MAX_ITEMS)
+	{
+		clearSearchCacheL(l_tick);
+		if (m_search_cache.size() >= SEARCH_CACHE_MAX_ITEMS)
+			m_search_cache.clear();
+	}
+	SearchCacheItem& l_item = m_search_cache[p_key];
+	l_item.m_results = p_results;
+	l_item.m_tick = l_tick;
+	l_item.m_generation = p_generation;
+}
+
+void ShareManager::clearSearchCacheL(uint64_t p_tick)
+{
+	for (SearchCacheMap::iterator i = m_search_cache.begin(); i != m_search_cache.end();)
+	{
+		if (i->second.m_generation != m_share_generation || i->second.m_tick + SEARCH_CACHE_TIME < p_tick)
+			m_search_cache.erase(i++);
+		else
+			++i;
 	}
 }
 
@@ -1959,10 +3111,9 @@ void ShareManager::search(SearchResultList& results, const StringList& params, S
 {
 	AdcSearch srch(params);
 	
-	Lock l(cs);
-	
 	if (srch.hasRoot)
 	{
+		Lock l(cs);
 		HashFileMap::const_iterator i = tthIndex.find(srch.root);
 		if (i != tthIndex.end())
 		{
@@ -1972,19 +3123,65 @@ void ShareManager::search(SearchResultList& results, const StringList& params, S
 			results.push_back(sr);
 			incHits();
 		}
+		else if (m_snapshot)
+		{
+			const uint32_t l_file = m_snapshot->findTTH(srch.root);
+			if (l_file != ShareSnapshot::NONE)
+			{
+				results.push_back(toSearchResult(*m_snapshot, l_file));
+				incHits();
+			}
+		}
 		return;
 	}
 	
-	for (StringSearch::List::const_iterator i = srch.includeX.begin(); i != srch.includeX.end(); ++i)
+	// [+] The token differs between the searchers, the rest of the parameters is the query itself
+	StringList l_terms;
+	for (auto i = params.cbegin(); i != params.cend(); ++i)
 	{
-		if (!bloom.match(i->getPattern()))
-			return;
+		if (i->length() > 2 && toCode((*i)[0], (*i)[1]) != toCode('T', 'O'))
+		{
+			l_terms.push_back(*i);
+		}
 	}
+	sort(l_terms.begin(), l_terms.end());
 	
-	for (DirList::const_iterator j = directories.begin(); (j != directories.end()) && (results.size() < maxResults); ++j)
+	string l_key = "ADC|" + Util::toString(maxResults);
+	for (auto i = l_terms.cbegin(); i != l_terms.cend(); ++i)
 	{
-		(*j)->search(results, srch, maxResults);
+		l_key += ' ';
+		l_key += *i;
 	}
+	if (findCachedSearch(l_key, results, maxResults))
+		return;
+		
+	const size_t l_first = results.size();
+	uint32_t l_generation;
+	std::shared_ptr<ShareSnapshot> l_snapshot;
+	{
+		Lock l(cs);
+		l_generation = m_share_generation;
+		bool l_match = true;
+		for (StringSearch::List::const_iterator i = srch.includeX.begin(); i != srch.includeX.end(); ++i)
+		{
+			if (!bloom.match(i->getPattern()))
+			{
+				l_match = false;
+				break;
+			}
+		}
+		
+		if (l_match && m_snapshot)
+			l_snapshot = m_snapshot;
+		else
+			for (DirList::const_iterator j = directories.begin(); l_match && (j != directories.end()) && (results.size() < maxResults); ++j)
+			{
+				(*j)->search(results, srch, maxResults);
+			}
+	}
+	if (l_snapshot)
+		searchSnapshot(*l_snapshot, results, srch, maxResults);
+	addCachedSearch(l_key, SearchResultList(results.begin() + l_first, results.end()), l_generation);
 }
 
 ShareManager::Directory::Ptr ShareManager::getDirectory(const string& fname)
@@ -2063,11 +3260,13 @@ void ShareManager::on(HashManagerListener::TTHDone, const string& fname, const T
 		if (i != d->files.end())
 		{
 			if (root != i->getTTH())
-				tthIndex.erase(i->getTTH());
-			// Get rid of false constness...
-			Directory::File* f = const_cast<Directory::File*>(&(*i));
-			f->setTTH(root);
-			tthIndex.insert(make_pair(f->getTTH(), i));
+			{
+				removeIndices(*d, i);
+				// Get rid of false constness...
+				Directory::File* f = const_cast<Directory::File*>(&(*i));
+				f->setTTH(root);
+				updateIndices(*d, i, false);
+			}
 		}
 		else
 		{
@@ -2080,6 +3279,10 @@ void ShareManager::on(HashManagerListener::TTHDone, const string& fname, const T
 			                                   )).first;
 			updateIndices(*d, it);
 		}
+		incShareGeneration();
+		string l_dir = '/' + Text::toLower(d->getFullName());
+		std::replace(l_dir.begin(), l_dir.end(), '\\', '/');
+		invalidatePartialListsL(l_dir);
 		setDirty();
 		forceXmlRefresh = true;
 	}
@@ -2087,7 +3290,17 @@ void ShareManager::on(HashManagerListener::TTHDone, const string& fname, const T
 
 void ShareManager::on(TimerManagerListener::Minute, uint64_t tick) noexcept
 {
-	if (SETTING(AUTO_REFRESH_TIME) > 0)
+	{
+		Lock l(csSearchCache);
+		clearSearchCacheL(tick);
+	}
+	{
+		Lock l(cs);
+		clearPartialListsL(tick);
+	}
+	
+	// The share watcher keeps the tree up to date, periodic rescans are only needed without it
+	if (SETTING(AUTO_REFRESH_TIME) > 0 && !m_watcher.isComplete())
 	{
 		if (lastFullUpdate + SETTING(AUTO_REFRESH_TIME) * 60 * 1000 <= tick)
 		{
@@ -20,6 +20,7 @@
 #define DCPLUSPLUS_DCPP_SHARE_MANAGER_H
 
 #include <boost/atomic.hpp>
+#include <tuple>
 
 #include "TimerManager.h"
 #include "SearchManager.h"
@@ -31,9 +32,11 @@
 #include "StringSearch.h"
 #include "Singleton.h"
 #include "BloomFilter.h"
+#include "HashBloom.h"
 #include "MerkleTree.h"
 #include "Pointer.h"
 #include "CFlyMediaInfo.h"
+#include "ShareWatcher.h"
 #ifdef _WIN32
 # include <ShlObj.h> //[+]PPA
 #endif
@@ -51,6 +54,7 @@ STANDARD_EXCEPTION(ShareException);
 class SimpleXML;
 class Client;
 class File;
+class ShareSnapshot;
 class OutputStream;
 class MemoryInputStream;
 
@@ -130,10 +134,18 @@ class ShareManager : public Singleton<ShareManager>, private SettingsManagerList
 			return getBZXmlFile();
 		}
 		
-		bool isTTHShared(const TTHValue& tth) const
+		bool isTTHShared(const TTHValue& tth) const;
+		
+		// [+] Search result cache statistics
+		uint64_t getSearchCacheHits() const
+		{
+			Lock l(csSearchCache);
+			return m_search_cache_hits;
+		}
+		uint64_t getSearchCacheMisses() const
 		{
-			Lock l(cs);
-			return tthIndex.find(tth) != tthIndex.end();
+			Lock l(csSearchCache);
+			return m_search_cache_misses;
 		}
 		
 		GETSET(size_t, hits, Hits);
@@ -282,6 +294,10 @@ class ShareManager : public Singleton<ShareManager>, private SettingsManagerList
 				    return ((type == SearchManager::TYPE_ANY) || (fileTypes & (1 << type)));
 				}
 				void addType(uint32_t type) noexcept;
+				uint32_t getFileTypes() const
+				{
+					return fileTypes;
+				}
 				
 				string getADCPath() const noexcept;
 				string getFullName() const noexcept;
@@ -412,32 +428,142 @@ class ShareManager : public Singleton<ShareManager>, private SettingsManagerList
 		StringMap shares;
 		
 		friend class ::dht::IndexManager;
+		friend class ShareWatcher;
 		
 		typedef unordered_map<TTHValue, Directory::File::Set::const_iterator> HashFileMap;
 		typedef HashFileMap::const_iterator HashFileIter;
 		
 		HashFileMap tthIndex;
 		
+		/** Shared files whose TTH is already in tthIndex, one of them takes over when the indexed file goes away */
+		typedef unordered_multimap<TTHValue, Directory::File::Set::const_iterator> HashFileMultiMap;
+		HashFileMultiMap m_tth_duplicates;
+		
 		BloomFilter<5> bloom;
 		
+		/**
+		 * Share.dat of the last run, mapped by loadCache() and answering the searches
+		 * until run() has built the tree from it. Guarded by cs, null afterwards;
+		 * searches take a reference and scan the records without cs.
+		 */
+		std::shared_ptr<ShareSnapshot> m_snapshot;
+		
+		/**
+		 * TTH blooms for the (k, m, h) combinations requested by hubs, guarded by cs.
+		 * Kept up to date in updateIndices; removed files only cost false positives,
+		 * so the blooms are rebuilt lazily once enough of them went away.
+		 */
+		struct HashBloomItem
+		{
+			HashBloomItem() : m_used(0) { }
+			HashBloom m_bloom;
+			uint64_t m_used;
+		};
+		typedef std::map<std::tuple<size_t, size_t, size_t>, HashBloomItem> HashBloomMap;
+		mutable HashBloomMap m_hash_blooms;
+		mutable size_t m_hash_bloom_removed;
+		
+		void addToHashBlooms(const TTHValue& p_tth)
+		{
+			for (HashBloomMap::iterator i = m_hash_blooms.begin(); i != m_hash_blooms.end(); ++i)
+			{
+				i->second.m_bloom.add(p_tth);
+			}
+		}
+		
+		/**
+		 * Short-lived cache of own search results, keyed by the normalized query.
+		 * An entry is valid while its generation matches m_share_generation and
+		 * it is younger than SEARCH_CACHE_TIME.
+		 */
+		struct SearchCacheItem
+		{
+			SearchCacheItem() : m_tick(0), m_generation(0) { }
+			SearchResultList m_results;
+			uint64_t m_tick;
+			uint32_t m_generation;
+		};
+		typedef unordered_map<string, SearchCacheItem> SearchCacheMap;
+		SearchCacheMap m_search_cache;
+		mutable CriticalSection csSearchCache;
+		uint64_t m_search_cache_hits;
+		uint64_t m_search_cache_misses;
+		boost::atomic<uint32_t> m_share_generation;
+		
+		void incShareGeneration()
+		{
+			++m_share_generation;
+		}
+		bool findCachedSearch(const string& p_key, SearchResultList& p_results, StringList::size_type p_maxResults);
+		void addCachedSearch(const string& p_key, const SearchResultList& p_results, uint32_t p_generation);
+		void clearSearchCacheL(uint64_t p_tick);
+		
+		/**
+		 * Generated partial file lists, keyed by the recursion flag and the lowercased
+		 * virtual path. Guarded by cs. An entry is dropped when its subtree changes,
+		 * when it is older than PARTIAL_LIST_CACHE_TIME (hit counters) or when the
+		 * cache exceeds PARTIAL_LIST_CACHE_SIZE (least recently used first).
+		 */
+		struct PartialListItem
+		{
+			PartialListItem() : m_created(0), m_used(0) { }
+			std::shared_ptr<const string> m_xml;
+			uint64_t m_created;
+			uint64_t m_used;
+		};
+		typedef unordered_map<string, PartialListItem> PartialListMap;
+		mutable PartialListMap m_partial_lists;
+		mutable size_t m_partial_lists_size;
+		
+		void addPartialListL(const string& p_key, const std::shared_ptr<const string>& p_xml) const;
+		void invalidatePartialListsL(const string& p_dir);
+		void clearPartialListsL(uint64_t p_tick);
+		
 		Directory::File::Set::const_iterator findFile(const string& virtualFile) const;
+		/** File of the snapshot with the TTH while the tree isn't built yet, ShareSnapshot::NONE if there is none; cs held */
+		uint32_t findSnapshotFileL(const TTHValue& p_tth) const;
+		/** Real path of a file of the snapshot, ShareException if it isn't on the disk any more; cs held */
+		string getSnapshotRealPathL(uint32_t p_file) const;
 		void inc_Hit(const string& p_Path, const string& p_FileName);
 		
 		Directory::Ptr buildTree(const string& aName, const Directory::Ptr& aParent, bool p_is_job);
+		typedef vector<pair<string, Directory::Ptr> > ScanList;
+		void fillTree(const string& aName, const Directory::Ptr& aDirectory, bool p_is_job);
+		void scanDirectory(const string& aName, const Directory::Ptr& aDirectory, bool p_is_job, ScanList& p_subdirs);
+		class Scanner;
 		bool m_sweep_guard;
 		bool m_sweep_path;
 		bool checkHidden(const string& aName) const;
+		static bool isShareableFile(const string& name);
+		
+		// [+] Incremental updates from the share watcher, see ShareWatcher
+		ShareWatcher m_watcher;
+		void onWatchedDirectoryAdded(const string& p_path);
+		void onWatchedDirectoryRemoved(const string& p_path);
+		void onWatchedFileChanged(const string& p_path);
+		void onWatchedFileRemoved(const string& p_path);
+		void removeIndices(Directory& aDirectory);
+		void removeIndices(Directory& dir, const Directory::File::Set::const_iterator& i);
+		void directoryChangedL(const Directory& aDirectory);
 		
-		void rebuildIndices();
+		void rebuildIndices(bool p_update_bloom = true);
 		
-		void updateIndices(Directory& aDirectory);
-		void updateIndices(Directory& dir, const Directory::File::Set::iterator& i);
+		void updateIndices(Directory& aDirectory, bool p_update_bloom = true);
+		void updateIndices(Directory& dir, const Directory::File::Set::const_iterator& i, bool p_update_bloom = true);
+		void removeFromBloom(const Directory& aDirectory);
+		void addToBloom(const Directory& aDirectory);
 		
 		Directory::Ptr merge(const Directory::Ptr& directory);
 		
 		void generateXmlList();
 		StringList notShared;
 		bool loadCache() noexcept;
+		bool loadSnapshot() noexcept;
+		void materializeSnapshot();
+		bool buildSnapshotL(string& p_data) const;
+		static void saveSnapshot(const string& p_data);
+		void searchSnapshot(const ShareSnapshot& p_snapshot, SearchResultList& aResults, const StringSearch::List& aStrings, int aSearchType, int64_t aSize, int aFileType, StringList::size_type maxResults);
+		void searchSnapshot(const ShareSnapshot& p_snapshot, SearchResultList& aResults, AdcSearch& aStrings, StringList::size_type maxResults);
 		DirList::const_iterator getByVirtual(const string& virtualName) const noexcept;
 		pair<Directory::Ptr, string> splitVirtual(const string& virtualPath) const;
 		string findRealRoot(const string& virtualRoot, const string& virtualLeaf) const;
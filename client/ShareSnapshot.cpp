@@ -0,0 +1,157 @@
+#include "stdinc.h"
+#include "ShareSnapshot.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace dcpp
+{
+
+const char ShareSnapshot::MAGIC[4] = { 'F', 'L', 'S', 'S' };
+const uint32_t ShareSnapshot::NONE;
+
+static_assert(sizeof(ShareSnapshot::Header) == 96, "the layout of Share.dat changed, bump ShareSnapshot::VERSION");
+static_assert(sizeof(ShareSnapshot::DirRecord) == 24, "the layout of Share.dat changed, bump ShareSnapshot::VERSION");
+static_assert(sizeof(ShareSnapshot::FileRecord) == 72, "the layout of Share.dat changed, bump ShareSnapshot::VERSION");
+static_assert(sizeof(ShareSnapshot::TTHRecord) == 32, "the layout of Share.dat changed, bump ShareSnapshot::VERSION");
+
+ShareSnapshot::ShareSnapshot() : m_data(nullptr), m_size(0), m_header(nullptr), m_dirs(nullptr), m_files(nullptr), m_tths(nullptr), m_strings(nullptr),
+#ifdef _WIN32
+	m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#else
+	m_file(-1)
+#endif
+{
+}
+
+ShareSnapshot::~ShareSnapshot()
+{
+	close();
+}
+
+void ShareSnapshot::close()
+{
+#ifdef _WIN32
+	if (m_data)
+		::UnmapViewOfFile(m_data);
+	if (m_mapping)
+		::CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		::CloseHandle(m_file);
+	m_mapping = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data)
+		::munmap(const_cast<uint8_t*>(m_data), m_size);
+	if (m_file != -1)
+		::close(m_file);
+	m_file = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_header = nullptr;
+}
+
+static bool isInside(uint64_t p_offset, uint64_t p_count, uint64_t p_item_size, uint64_t p_file_size)
+{
+	return p_offset <= p_file_size && p_count <= (p_file_size - p_offset) / p_item_size;
+}
+
+bool ShareSnapshot::open(const string& p_file)
+{
+	close();
+#ifdef _WIN32
+	m_file = ::CreateFile(Text::toT(p_file).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER l_size;
+	if (!::GetFileSizeEx(m_file, &l_size) || l_size.QuadPart < static_cast<LONGLONG>(sizeof(Header)) || static_cast<uint64_t>(l_size.QuadPart) > numeric_limits<size_t>::max())
+	{
+		close();
+		return false;
+	}
+	m_size = static_cast<size_t>(l_size.QuadPart);
+	m_mapping = ::CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping)
+		m_data = static_cast<const uint8_t*>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	m_file = ::open(Text::fromUtf8(p_file).c_str(), O_RDONLY);
+	if (m_file == -1)
+		return false;
+	struct stat l_stat;
+	if (::fstat(m_file, &l_stat) != 0 || l_stat.st_size < static_cast<off_t>(sizeof(Header)) || static_cast<uint64_t>(l_stat.st_size) > numeric_limits<size_t>::max())
+	{
+		close();
+		return false;
+	}
+	m_size = static_cast<size_t>(l_stat.st_size);
+	void* l_data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_file, 0);
+	m_data = l_data == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(l_data);
+#endif
+	if (!m_data)
+	{
+		close();
+		return false;
+	}
+
+	m_header = reinterpret_cast<const Header*>(m_data);
+	const Header& h = *m_header;
+	if (memcmp(h.m_magic, MAGIC, sizeof(MAGIC)) != 0 || h.m_version != VERSION || h.m_byte_order != BYTE_ORDER_MARK ||
+	        h.m_file_size != m_size ||
+	        !isInside(h.m_dirs_offset, h.m_dirs, sizeof(DirRecord), m_size) ||
+	        !isInside(h.m_files_offset, h.m_files, sizeof(FileRecord), m_size) ||
+	        !isInside(h.m_tths_offset, h.m_tths, sizeof(TTHRecord), m_size) ||
+	        !isInside(h.m_bloom_offset, h.m_bloom_words, sizeof(uint64_t), m_size) ||
+	        !isInside(h.m_bloom_offset + uint64_t(h.m_bloom_words) * sizeof(uint64_t), h.m_bloom_counters, 1, m_size) ||
+	        !isInside(h.m_strings_offset, h.m_strings_size, 1, m_size) ||
+	        h.m_strings_size == 0 || m_data[h.m_strings_offset + h.m_strings_size - 1] != 0 ||
+	        (h.m_dirs_offset | h.m_files_offset | h.m_tths_offset | h.m_bloom_offset) % sizeof(uint64_t) != 0)
+	{
+		close();
+		return false;
+	}
+	m_dirs = reinterpret_cast<const DirRecord*>(m_data + h.m_dirs_offset);
+	m_files = reinterpret_cast<const FileRecord*>(m_data + h.m_files_offset);
+	m_tths = reinterpret_cast<const TTHRecord*>(m_data + h.m_tths_offset);
+	m_strings = reinterpret_cast<const char*>(m_data + h.m_strings_offset);
+	return true;
+}
+
+uint32_t ShareSnapshot::findTTH(const TTHValue& p_tth) const
+{
+	uint32_t l_low = 0;
+	uint32_t l_high = m_header->m_tths;
+	while (l_low < l_high)
+	{
+		const uint32_t l_mid = l_low + (l_high - l_low) / 2;
+		const int l_cmp = memcmp(m_tths[l_mid].m_tth, p_tth.data, TTHValue::BYTES);
+		if (l_cmp == 0)
+			return m_tths[l_mid].m_file < m_header->m_files ? m_tths[l_mid].m_file : NONE;
+		if (l_cmp < 0)
+			l_low = l_mid + 1;
+		else
+			l_high = l_mid;
+	}
+	return NONE;
+}
+
+string ShareSnapshot::getFullName(uint32_t p_dir) const
+{
+	string l_name;
+	// parents come first in the table, a parent index not below the child is a damaged record
+	for (uint32_t i = p_dir; i < m_header->m_dirs; )
+	{
+		const DirRecord& l_dir = m_dirs[i];
+		l_name.insert(0, string(getString(l_dir.m_name)) + '\\');
+		if (l_dir.m_parent >= i)
+			break;
+		i = l_dir.m_parent;
+	}
+	return l_name;
+}
+
+} // namespace dcpp
@@ -0,0 +1,148 @@
+#ifndef DCPLUSPLUS_DCPP_SHARE_SNAPSHOT_H
+#define DCPLUSPLUS_DCPP_SHARE_SNAPSHOT_H
+
+#include "MerkleTree.h"
+
+namespace dcpp
+{
+
+/**
+ * Read-only view of the share saved after a refresh (Share.dat), mapped into memory.
+ * The records are fixed size and stored in the byte order of the machine, so they are
+ * used in place: a TTH lookup is a binary search over the sorted TTH table, the name
+ * searches walk the file table. Nothing is parsed when the file is opened, which is what
+ * lets the client answer searches right away while ShareManager builds its tree
+ * from the same records in the background.
+ *
+ * Layout: Header, DirRecord[m_dirs] (parents before children), FileRecord[m_files],
+ * TTHRecord[m_tths] (sorted, one per TTH), the bloom filter of the names (bits and counters)
+ * and the string pool; the strings are referenced by their offset in the pool, 0 is "".
+ */
+class ShareSnapshot
+{
+	public:
+		enum
+		{
+			VERSION = 1,
+			BYTE_ORDER_MARK = 0x01020304
+		};
+		/** No parent directory, no such file */
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		struct Header
+		{
+			char m_magic[4];
+			uint32_t m_version;
+			uint32_t m_byte_order;
+			uint32_t m_dirs;
+			uint32_t m_files;
+			uint32_t m_tths;
+			uint32_t m_bloom_words;
+			uint32_t m_bloom_counters;
+			uint64_t m_dirs_offset;
+			uint64_t m_files_offset;
+			uint64_t m_tths_offset;
+			uint64_t m_bloom_offset;
+			uint64_t m_strings_offset;
+			uint64_t m_strings_size;
+			/** Sum of the sizes of the distinct TTHs, like ShareManager::getShareSize() */
+			int64_t m_shared_size;
+			/** Whole file, a truncated snapshot is refused */
+			uint64_t m_file_size;
+		};
+		struct DirRecord
+		{
+			int64_t m_size;
+			uint32_t m_parent;
+			uint32_t m_name;
+			uint32_t m_low_name;
+			uint32_t m_file_types;
+		};
+		struct FileRecord
+		{
+			int64_t m_size;
+			uint8_t m_tth[TTHValue::BYTES];
+			uint32_t m_dir;
+			uint32_t m_name;
+			uint32_t m_low_name;
+			uint32_t m_hit;
+			uint32_t m_ts;
+			uint32_t m_video;
+			uint32_t m_audio;
+			uint16_t m_ftype;
+			uint16_t m_bitrate;
+			uint16_t m_media_x;
+			uint16_t m_media_y;
+			uint32_t m_reserved;
+		};
+		struct TTHRecord
+		{
+			uint8_t m_tth[TTHValue::BYTES];
+			uint32_t m_file;
+			uint32_t m_reserved;
+		};
+
+		static const char MAGIC[4];
+
+		ShareSnapshot();
+		~ShareSnapshot();
+
+		/** @return False if the file is missing, of another version or damaged */
+		bool open(const string& p_file);
+
+		const Header& getHeader() const
+		{
+			return *m_header;
+		}
+		const DirRecord& getDir(uint32_t p_index) const
+		{
+			return m_dirs[p_index];
+		}
+		const FileRecord& getFile(uint32_t p_index) const
+		{
+			return m_files[p_index];
+		}
+		const TTHRecord& getTTH(uint32_t p_index) const
+		{
+			return m_tths[p_index];
+		}
+		/** Strings with an offset out of the pool read as "" */
+		const char* getString(uint32_t p_offset) const
+		{
+			return p_offset < m_header->m_strings_size ? m_strings + p_offset : m_strings;
+		}
+		const uint64_t* getBloomTable() const
+		{
+			return reinterpret_cast<const uint64_t*>(m_data + m_header->m_bloom_offset);
+		}
+		const uint8_t* getBloomCounters() const
+		{
+			return reinterpret_cast<const uint8_t*>(getBloomTable() + m_header->m_bloom_words);
+		}
+
+		/** @return Index of the file, NONE if the TTH isn't shared */
+		uint32_t findTTH(const TTHValue& p_tth) const;
+		/** Virtual path of a directory, the way ShareManager::Directory::getFullName() builds it */
+		string getFullName(uint32_t p_dir) const;
+
+	private:
+		void close();
+
+		const uint8_t* m_data;
+		size_t m_size;
+		const Header* m_header;
+		const DirRecord* m_dirs;
+		const FileRecord* m_files;
+		const TTHRecord* m_tths;
+		const char* m_strings;
+#ifdef _WIN32
+		HANDLE m_file;
+		HANDLE m_mapping;
+#else
+		int m_file;
+#endif
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SHARE_SNAPSHOT_H)
@@ -0,0 +1,229 @@
+#include "stdinc.h"
+#include "ShareWatcher.h"
+
+#include "ShareManager.h"
+#include "LogManager.h"
+#include "SettingsManager.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <dirent.h>
+#include <errno.h>
+#endif
+
+namespace dcpp
+{
+
+#ifdef __linux__
+static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+                                   IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+#endif
+
+ShareWatcher::ShareWatcher() : m_stop(false), m_complete(false), m_running(false)
+#ifdef __linux__
+	, m_fd(-1)
+#endif
+{
+}
+
+ShareWatcher::~ShareWatcher()
+{
+	stopWatching();
+}
+
+bool ShareWatcher::startWatching(const StringList& p_roots)
+{
+#ifdef __linux__
+	if (m_running && !m_stop && p_roots == m_roots)
+		return true;
+		
+	stopWatching();
+	m_roots = p_roots;
+	m_stop = false;
+	m_complete = false;
+	if (m_roots.empty())
+		return true;
+		
+	try
+	{
+		start();
+		m_running = true;
+	}
+	catch (const ThreadException& e)
+	{
+		LogManager::getInstance()->message("ShareWatcher: " + e.getError()); // [!] TODO translate
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void ShareWatcher::stopWatching()
+{
+	if (m_running)
+	{
+		m_stop = true;
+		join();
+		m_running = false;
+	}
+	m_complete = false;
+}
+
+int ShareWatcher::run()
+{
+#ifdef __linux__
+	m_fd = inotify_init1(IN_CLOEXEC);
+	if (m_fd < 0)
+	{
+		LogManager::getInstance()->message("ShareWatcher: inotify is not available, using periodic refresh"); // [!] TODO translate
+		return 0;
+	}
+	
+	m_complete = true;
+	for (auto i = m_roots.cbegin(); i != m_roots.cend() && !m_stop; ++i)
+	{
+		addWatches(*i);
+	}
+	if (!m_complete)
+	{
+		LogManager::getInstance()->message("ShareWatcher: not all shared directories could be watched (see fs.inotify.max_user_watches), using periodic refresh"); // [!] TODO translate
+	}
+	dcdebug("ShareWatcher: watching %u directories\n", m_watches.size());
+	
+	// inotify_event requires the alignment of int
+	vector<int> l_buf(64 * 1024 / sizeof(int));
+	while (!m_stop)
+	{
+		pollfd l_pfd = { m_fd, POLLIN, 0 };
+		if (::poll(&l_pfd, 1, 1000) <= 0)
+			continue;
+			
+		const ssize_t l_len = ::read(m_fd, &l_buf[0], l_buf.size() * sizeof(int));
+		if (l_len <= 0)
+			continue;
+			
+		const char* l_pos = reinterpret_cast<const char*>(&l_buf[0]);
+		const char* l_end = l_pos + l_len;
+		while (l_pos < l_end && !m_stop)
+		{
+			const inotify_event* l_event = reinterpret_cast<const inotify_event*>(l_pos);
+			handle(l_event->wd, l_event->mask, l_event->len ? l_event->name : nullptr);
+			l_pos += sizeof(inotify_event) + l_event->len;
+		}
+	}
+	
+	::close(m_fd);
+	m_fd = -1;
+	m_watches.clear();
+	m_paths.clear();
+#endif
+	return 0;
+}
+
+#ifdef __linux__
+void ShareWatcher::addWatches(const string& p_path)
+{
+	const int l_wd = inotify_add_watch(m_fd, p_path.c_str(), WATCH_MASK);
+	if (l_wd < 0)
+	{
+		if (errno != ENOENT && errno != ENOTDIR)
+			m_complete = false;
+		return;
+	}
+	m_watches[l_wd] = p_path;
+	m_paths[p_path] = l_wd;
+	
+	DIR* l_dir = ::opendir(p_path.c_str());
+	if (!l_dir)
+		return;
+		
+	const bool l_hidden = BOOLSETTING(SHARE_HIDDEN);
+	while (const dirent* l_ent = ::readdir(l_dir))
+	{
+		if (l_ent->d_name[0] == '.' && (!l_hidden || l_ent->d_name[1] == 0 || (l_ent->d_name[1] == '.' && l_ent->d_name[2] == 0)))
+			continue;
+		// DT_UNKNOWN is resolved by inotify_add_watch itself thanks to IN_ONLYDIR
+		if (l_ent->d_type == DT_DIR || l_ent->d_type == DT_UNKNOWN)
+			addWatches(p_path + l_ent->d_name + PATH_SEPARATOR);
+	}
+	::closedir(l_dir);
+}
+
+void ShareWatcher::removeWatches(const string& p_path)
+{
+	for (auto i = m_paths.begin(); i != m_paths.end();)
+	{
+		if (i->first.compare(0, p_path.size(), p_path) == 0)
+		{
+			inotify_rm_watch(m_fd, i->second);
+			m_watches.erase(i->second);
+			m_paths.erase(i++);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void ShareWatcher::handle(int p_wd, uint32_t p_mask, const char* p_name)
+{
+	if (p_mask & IN_Q_OVERFLOW)
+	{
+		// Events were lost: fall back to a full scan, ShareManager restarts the watch afterwards
+		dcdebug("ShareWatcher: event queue overflow\n");
+		m_complete = false;
+		m_stop = true;
+		ShareManager::getInstance()->refresh(true);
+		return;
+	}
+	
+	auto l_watch = m_watches.find(p_wd);
+	if (l_watch == m_watches.end())
+		return;
+		
+	if (p_mask & IN_IGNORED)
+	{
+		m_paths.erase(l_watch->second);
+		m_watches.erase(l_watch);
+		return;
+	}
+	
+	// Events of the watched directory itself are handled through its parent
+	if (!p_name)
+		return;
+		
+	const string l_path = l_watch->second + p_name;
+	ShareManager* l_share = ShareManager::getInstance();
+	if (p_mask & IN_ISDIR)
+	{
+		const string l_dir = l_path + PATH_SEPARATOR;
+		if (p_mask & (IN_CREATE | IN_MOVED_TO))
+		{
+			addWatches(l_dir);
+			l_share->onWatchedDirectoryAdded(l_dir);
+		}
+		else if (p_mask & (IN_DELETE | IN_MOVED_FROM))
+		{
+			removeWatches(l_dir);
+			l_share->onWatchedDirectoryRemoved(l_dir);
+		}
+	}
+	else
+	{
+		if (p_mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+		{
+			l_share->onWatchedFileChanged(l_path);
+		}
+		else if (p_mask & (IN_DELETE | IN_MOVED_FROM))
+		{
+			l_share->onWatchedFileRemoved(l_path);
+		}
+	}
+}
+#endif
+
+} // namespace dcpp
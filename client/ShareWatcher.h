@@ -0,0 +1,59 @@
+#ifndef DCPLUSPLUS_DCPP_SHARE_WATCHER_H
+#define DCPLUSPLUS_DCPP_SHARE_WATCHER_H
+
+#include <boost/atomic.hpp>
+
+#include "Thread.h"
+
+namespace dcpp
+{
+
+/**
+ * Watches the shared directories and forwards the changes to ShareManager,
+ * which applies them to the tree in place instead of rescanning the whole share.
+ * Implemented with inotify on Linux; on other platforms startWatching() returns
+ * false and the periodic full refresh stays in charge.
+ */
+class ShareWatcher : public Thread
+{
+	public:
+		ShareWatcher();
+		~ShareWatcher();
+		
+		/**
+		 * Watch the given real paths (with trailing separator) and everything below them.
+		 * Keeps the running watch if the roots didn't change.
+		 * @return True if the platform supports watching
+		 */
+		bool startWatching(const StringList& p_roots);
+		void stopWatching();
+		
+		/** True while every shared directory is watched, so the periodic refresh may be skipped */
+		bool isComplete() const
+		{
+			return m_complete;
+		}
+		
+	private:
+		int run();
+		
+		StringList m_roots;
+		boost::atomic<bool> m_stop;
+		boost::atomic<bool> m_complete;
+		bool m_running;
+		
+#ifdef __linux__
+		int m_fd;
+		// wd -> watched real path with trailing separator, and back
+		unordered_map<int, string> m_watches;
+		unordered_map<string, int> m_paths;
+		
+		void addWatches(const string& p_path);
+		void removeWatches(const string& p_path);
+		void handle(int p_wd, uint32_t p_mask, const char* p_name);
+#endif
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SHARE_WATCHER_H)
@@ -35,7 +35,7 @@ CriticalSection SharedFileStream::critical_section;
 SharedFileStream::SharedFileHandleMap SharedFileStream::file_handle_pool;
 
 SharedFileHandle::SharedFileHandle(const string& aFileName, int access, int mode) :
-	ref_cnt(1), File(aFileName, access, mode)
+	File(aFileName, access, mode), path(aFileName), ref_cnt(1)
 {
 #ifdef _WIN32
 	if (!SETTING(ANTI_FRAG))
@@ -47,20 +47,66 @@ SharedFileHandle::SharedFileHandle(const string& aFileName, int access, int mode
 #endif
 }
 
-SharedFileStream::SharedFileStream(const string& aFileName, int access, int mode): pos(-1)
+void SharedFileHandle::setSize(int64_t newSize)
 {
-	Lock l(critical_section);
+	// no pread()/pwrite() runs meanwhile, they would move the file pointer under SetEndOfFile
+	UniqueLock l(cs);
+#ifdef _WIN32
+	LARGE_INTEGER x;
+	x.QuadPart = newSize;
+	if (!::SetFilePointerEx(h, x, NULL, FILE_BEGIN) || !::SetEndOfFile(h))
+		throw FileException(Util::translateError(GetLastError()));
+#else
+	if (::ftruncate(h, (off_t)newSize) == -1)
+		throw FileException(Util::translateError(errno));
+#endif
+}
+
+SharedFileStream::SharedFileStream(const string& aFileName, int access, int mode) :
+	shared_handle_ptr(nullptr), pos(-1), read_ahead(access == File::READ ? 0 : -1)
+{
+	{
+		Lock l(critical_section);
+		
+		SharedFileHandleMap::const_iterator i = file_handle_pool.find(aFileName);
+		if (i != file_handle_pool.end())
+		{
+			shared_handle_ptr = i->second;
+			shared_handle_ptr->ref_cnt++;
+			return;
+		}
+	}
 	
-	if (file_handle_pool.count(aFileName) > 0)
+	// open it outside of the lock, streams of other files don't have to wait for the disk
+	unique_ptr<SharedFileHandle> handle;
+	try
 	{
-		shared_handle_ptr = file_handle_pool[aFileName];
+		handle.reset(new SharedFileHandle(aFileName, access, mode));
+	}
+	catch (const FileException&)
+	{
+		// another stream may have opened it meanwhile without sharing
+		Lock l(critical_section);
+		SharedFileHandleMap::const_iterator i = file_handle_pool.find(aFileName);
+		if (i == file_handle_pool.end())
+			throw;
+		shared_handle_ptr = i->second;
 		shared_handle_ptr->ref_cnt++;
+		return;
+	}
+	
+	Lock l(critical_section);
+	
+	auto j = file_handle_pool.insert(make_pair(aFileName, handle.get()));
+	if (j.second)
+	{
+		shared_handle_ptr = handle.release();
 	}
 	else
 	{
-		shared_handle_ptr = new SharedFileHandle(aFileName, access, mode);
-		shared_handle_ptr->ref_cnt = 1;
-		file_handle_pool[aFileName] = shared_handle_ptr;
+		// somebody was faster, use theirs
+		shared_handle_ptr = j.first->second;
+		shared_handle_ptr->ref_cnt++;
 	}
 }
 
@@ -68,34 +114,22 @@ SharedFileStream::~SharedFileStream()
 {
 	Lock l(critical_section);
 	
-	shared_handle_ptr->ref_cnt--;
-	
-	if (!shared_handle_ptr->ref_cnt)
-	{
-		for (SharedFileHandleMap::iterator i = file_handle_pool.begin();
-		        i != file_handle_pool.end();
-		        i++)
-		{
-			if (i->second == shared_handle_ptr)
-			{
-				file_handle_pool.erase(i);
-				delete shared_handle_ptr;
-				return;
-			}
-		}
+	if (--shared_handle_ptr->ref_cnt)
+		return;
 		
-		dcassert(0);
-	}
+	dcassert(file_handle_pool.count(shared_handle_ptr->path));
+	file_handle_pool.erase(shared_handle_ptr->path);
+	
+	// close it before anybody can open the file again, a non-shared handle
+	// still open would make the next constructor fail
+	delete shared_handle_ptr;
 }
 
 size_t SharedFileStream::write(const void* buf, size_t len)
 {
-	Lock l(*shared_handle_ptr);
-	
 	dcassert(pos != -1);
 	
-	shared_handle_ptr->setPos(pos);
-	shared_handle_ptr->write(buf, len);
+	shared_handle_ptr->pwrite(buf, len, pos);
 	
 	pos += len;
 	return len;
@@ -103,12 +137,15 @@ size_t SharedFileStream::write(const void* buf, size_t len)
 
 size_t SharedFileStream::read(void* buf, size_t& len)
 {
-	Lock l(*shared_handle_ptr);
-	
 	dcassert(pos != -1);
 	
-	shared_handle_ptr->setPos(pos);
-	len = shared_handle_ptr->read(buf, len);
+	if (read_ahead != -1 && pos + (int64_t)len > read_ahead)
+	{
+		shared_handle_ptr->willNeed(pos, READ_AHEAD_SIZE);
+		read_ahead = pos + READ_AHEAD_SIZE / 2;
+	}
+	
+	len = shared_handle_ptr->pread(buf, len, pos);
 	
 	pos += len;
 	return len;
@@ -116,13 +153,11 @@ size_t SharedFileStream::read(void* buf, size_t& len)
 
 int64_t SharedFileStream::getSize() const
 {
-	Lock l(*shared_handle_ptr);
 	return shared_handle_ptr->getSize();
 }
 
 void SharedFileStream::setSize(int64_t newSize)
 {
-	Lock l(*shared_handle_ptr);
 	shared_handle_ptr->setSize(newSize);
 }
 
@@ -26,20 +26,41 @@
 namespace dcpp
 {
 
-struct SharedFileHandle : File, CriticalSection
+struct SharedFileHandle : File
 {
+	const string        path; // key in the pool
 	int                 ref_cnt;
+	// positional reads and writes take it shared; setSize() takes it exclusive,
+	// on Windows they all move the one file pointer of the handle
+	SharedCriticalSection cs;
 	
 	SharedFileHandle(const string& aFileName, int access, int mode);
 	~SharedFileHandle() noexcept { }
+	
+	size_t pread(void* buf, size_t len, int64_t pos)
+	{
+		SharedLock l(cs);
+		return File::pread(buf, len, pos);
+	}
+	size_t pwrite(const void* buf, size_t len, int64_t pos)
+	{
+		SharedLock l(cs);
+		return File::pwrite(buf, len, pos);
+	}
+	void setSize(int64_t newSize);
 };
 
+/**
+ * All streams of a file share one handle. Reads and writes are positional,
+ * so concurrent uploads of the same file don't wait for each other; the pool
+ * lock is only taken to find or release the handle.
+ */
 class SharedFileStream : public IOStream
 {
 
 	public:
 	
-		typedef map<string, SharedFileHandle*> SharedFileHandleMap;
+		typedef unordered_map<string, SharedFileHandle*> SharedFileHandleMap;
 		
 		SharedFileStream(const string& aFileName, int access, int mode);
 		~SharedFileStream();
@@ -52,7 +73,6 @@ class SharedFileStream : public IOStream
 		
 		size_t flush()
 		{
-			Lock l(*shared_handle_ptr);
 			return shared_handle_ptr->flush();
 		}
 		
@@ -65,8 +85,12 @@ class SharedFileStream : public IOStream
 		static SharedFileHandleMap file_handle_pool;
 		
 	private:
+		enum { READ_AHEAD_SIZE = 4 * 1024 * 1024 };
+		
 		SharedFileHandle* shared_handle_ptr;
 		int64_t pos;
+		// position at which the next read-ahead hint is sent, -1 for streams opened for writing
+		int64_t read_ahead;
 		
 		
 };
@@ -28,6 +28,10 @@
 #include <IPHlpApi.h>
 #pragma comment(lib, "iphlpapi.lib")
 
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
 /// @todo remove when MinGW has this
 #ifdef __MINGW32__
 #ifndef EADDRNOTAVAIL
@@ -453,6 +457,51 @@ int Socket::read(void* aBuffer, int aBufLen, addr &remote)
 	return len;
 }
 
+int Socket::readBatch(uint8_t** aBuffers, int* aLens, addr* aRemotes, int aCount, int aBufLen)
+{
+	dcassert(type == TYPE_UDP);
+	dcassert(aCount > 0);
+	
+#ifdef __linux__
+	static const int MAX_BATCH = 64;
+	mmsghdr l_msgs[MAX_BATCH];
+	iovec l_iov[MAX_BATCH];
+	
+	aCount = min(aCount, MAX_BATCH);
+	memset(l_msgs, 0, sizeof(mmsghdr) * aCount);
+	for (int i = 0; i < aCount; ++i)
+	{
+		l_iov[i].iov_base = aBuffers[i];
+		l_iov[i].iov_len = aBufLen;
+		l_msgs[i].msg_hdr.msg_iov = &l_iov[i];
+		l_msgs[i].msg_hdr.msg_iovlen = 1;
+		l_msgs[i].msg_hdr.msg_name = &aRemotes[i].sa;
+		l_msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+	}
+	
+	int n = 0;
+	do
+	{
+		if (sock == INVALID_SOCKET)
+			return 0;
+		// MSG_WAITFORONE - block for the first datagram only, then take whatever is already queued
+		n = ::recvmmsg(sock, l_msgs, aCount, MSG_WAITFORONE, NULL);
+	}
+	while (n < 0 && getLastError() == EINTR);
+	
+	check(n, true);
+	for (int i = 0; i < n; ++i)
+	{
+		aLens[i] = (int)l_msgs[i].msg_len;
+		stats.totalDown += l_msgs[i].msg_len;
+	}
+	return n;
+#else
+	aLens[0] = read(aBuffers[0], aBufLen, aRemotes[0]);
+	return aLens[0] > 0 ? 1 : aLens[0];
+#endif
+}
+
 int Socket::readAll(void* aBuffer, int aBufLen, uint64_t timeout)
 {
 	uint8_t* buf = (uint8_t*)aBuffer;
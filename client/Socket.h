@@ -166,6 +166,16 @@ class Socket
 		 * @throw SocketException On any failure.
 		 */
 		virtual int read(void* aBuffer, int aBufLen, addr& remote);
+		/**
+		 * Reads up to aCount datagrams from this socket. On Linux all of them are
+		 * fetched with a single recvmmsg call, elsewhere one datagram is read.
+		 * @param aBuffers aCount buffers of aBufLen bytes each.
+		 * @param aLens Receives the size of each datagram read.
+		 * @param aRemotes Receives the sender of each datagram read.
+		 * @return Number of datagrams read, 0 if disconnected and -1 if the call would block.
+		 * @throw SocketException On any failure.
+		 */
+		int readBatch(uint8_t** aBuffers, int* aLens, addr* aRemotes, int aCount, int aBufLen);
 		/**
 		 * Reads data until aBufLen bytes have been read or an error occurs.
 		 * If the socket is closed, or the timeout is reached, the number of bytes read
@@ -97,6 +97,10 @@ class MemoryInputStream : public InputStream
 		{
 			memcpy(buf, src.data(), src.size());
 		}
+		// [+] Reads from a shared immutable buffer without copying it
+		explicit MemoryInputStream(const std::shared_ptr<const string>& src) : pos(0), size(src->size()), buf(nullptr), shared(src)
+		{
+		}
 		
 		~MemoryInputStream()
 		{
@@ -106,7 +110,7 @@ class MemoryInputStream : public InputStream
 		size_t read(void* tgt, size_t& len)
 		{
 			len = min(len, size - pos);
-			memcpy(tgt, buf + pos, len);
+			memcpy(tgt, (buf ? buf : reinterpret_cast<const uint8_t*>(shared->data())) + pos, len);
 			pos += len;
 			return len;
 		}
@@ -120,6 +124,7 @@ class MemoryInputStream : public InputStream
 		size_t pos;
 		size_t size;
 		uint8_t* buf;
+		std::shared_ptr<const string> shared;
 };
 
 class IOStream : public InputStream, public OutputStream
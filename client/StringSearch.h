@@ -74,40 +74,40 @@ class StringSearch
 		/** Match a text against the pattern */
 		bool match(const string& aText, bool p_lower = false) const noexcept
 		{
+			if (p_lower)
+				return match(aText.c_str(), aText.length());
+				
+			// Lower-case representation of UTF-8 string, since we no longer have that 1 char = 1 byte...
+			string lower;
+			Text::toLower(aText, lower);
+			return match(lower.c_str(), lower.length());
+		}
 		
-		    const string::size_type plen = pattern.length();
-		    if (aText.length() < plen)
-	{
-//			static int l_cnt = 0;
-//			dcdebug("aText.length() < plen %d, [name: %s  pattern: %s] [%d %d]\n",
-//				 ++l_cnt,aText.c_str(),pattern.c_str(),aText.length(), pattern.length());
-		return false;
-	}
-	// Lower-case representation of UTF-8 string, since we no longer have that 1 char = 1 byte...
-	string lower;
-	if (!p_lower)
-		Text::toLower(aText, lower);
-		else
-			lower = aText;
-			
+		/** Match a NUL terminated, already lower-case text against the pattern, without copying it */
+		bool match(const char* aText, size_t aLength) const noexcept
+		{
+			const string::size_type plen = pattern.length();
+			if (aLength < plen)
+				return false;
+				
 			// uint8_t to avoid problems with signed char pointer arithmetic
-			uint8_t *tx = (uint8_t*)lower.c_str();
-			uint8_t *px = (uint8_t*)pattern.c_str();
+			const uint8_t* tx = (const uint8_t*)aText;
+			const uint8_t* px = (const uint8_t*)pattern.c_str();
 			
-			uint8_t *end = tx + aText.length() - plen + 1;
+			const uint8_t* end = tx + aLength - plen + 1;
 			while (tx < end)
 			{
 				size_t i = 0;
 				for (; px[i] && (px[i] == tx[i]); ++i)
-						;       // Empty!
-						
-					if (px[i] == 0)
-						return true;
-						
-					tx += delta1[tx[plen]];
-				}
-				
-		return false;
+					;       // Empty!
+					
+				if (px[i] == 0)
+					return true;
+					
+				tx += delta1[tx[plen]];
+			}
+			
+			return false;
 		}
 		
 	private:
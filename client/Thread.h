@@ -52,6 +52,9 @@ typedef boost::recursive_mutex  CriticalSection;
 typedef boost::detail::spinlock FastCriticalSection;
 typedef boost::lock_guard<boost::recursive_mutex> Lock;
 typedef boost::lock_guard<boost::detail::spinlock> FastLock;
+typedef boost::shared_mutex SharedCriticalSection;
+typedef boost::shared_lock<boost::shared_mutex> SharedLock;
+typedef boost::unique_lock<boost::shared_mutex> UniqueLock;
 
 class Thread
 #ifdef _DEBUG
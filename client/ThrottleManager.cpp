@@ -35,9 +35,18 @@ namespace dcpp
 #define CONDWAIT_TIMEOUT        250
 #define MIN_UPLOAD_SPEED_LIMIT  5 * UploadManager::getInstance()->getSlots() + 4
 #define MAX_LIMIT_RATIO         7
+#define BURST_TIME              100     // bucket capacity in milliseconds of traffic
+#define MIN_BURST               4096
+#define IDLE_TIME               1000    // connection doesn't take its share after this time
+
+static const unsigned g_class_weight[ThrottleManager::CLASS_LAST] =
+{
+	2, // CLASS_NORMAL
+	3  // CLASS_MINISLOT
+};
 
 // constructor
-ThrottleManager::ThrottleManager(void) : downTokens(0), upTokens(0), downLimit(0), upLimit(0)
+ThrottleManager::ThrottleManager(void)
 {
 	TimerManager::getInstance()->addListener(this);
 }
@@ -46,10 +55,6 @@ ThrottleManager::ThrottleManager(void) : downTokens(0), upTokens(0), downLimit(0
 ThrottleManager::~ThrottleManager(void)
 {
 	TimerManager::getInstance()->removeListener(this);
-	
-	// release conditional variables on exit
-	downCond.notify_all();
-	upCond.notify_all();
 }
 
 /*
@@ -58,33 +63,22 @@ ThrottleManager::~ThrottleManager(void)
 int ThrottleManager::read(Socket* sock, void* buffer, size_t len)
 {
 	size_t downs = DownloadManager::getInstance()->getDownloadCount();
-	if (!BOOLSETTING(THROTTLE_ENABLE) || downLimit == 0 || downs == 0)
+	if (!BOOLSETTING(THROTTLE_ENABLE) || m_down.getLimit() == 0 || downs == 0)
 		return sock->read(buffer, len);
 		
-	boost::unique_lock<boost::mutex> lock(downMutex);
-	
-	
-	if (downTokens > 0)
+	uint64_t wait = 0;
+	const size_t readSize = m_down.acquire(sock, len, GET_TICK(), wait);
+	if (readSize > 0)
 	{
-		size_t slice = getDownloadLimit() / downs;
-		size_t readSize = min(slice, min(len, downTokens));
-		
 		// read from socket
-		readSize = sock->read(buffer, readSize);
-		
-		if (readSize > 0)
-			downTokens -= readSize;
-			
-		// next code can't be in critical section, so we must unlock here
-		lock.unlock();
-		
-		// give a chance to other transfers to get a token
-		boost::thread::yield();
-		return readSize;
+		const int actual = sock->read(buffer, readSize);
+		if (static_cast<size_t>(max(actual, 0)) < readSize)
+			m_down.release(sock, readSize - max(actual, 0));
+		return actual;
 	}
 	
-	// no tokens, wait for them
-	downCond.timed_wait(lock, boost::posix_time::millisec(CONDWAIT_TIMEOUT));
+	// no tokens, wait for our own bucket - nobody is woken up for nothing
+	Thread::sleep(static_cast<uint32_t>(min<uint64_t>(wait, CONDWAIT_TIMEOUT)));
 	return -1;  // from BufferedSocket: -1 = retry, 0 = connection close
 }
 
@@ -95,39 +89,160 @@ int ThrottleManager::read(Socket* sock, void* buffer, size_t len)
 int ThrottleManager::write(Socket* sock, void* buffer, size_t& len)
 {
 	size_t ups = UploadManager::getInstance()->getUploadCount();
-	if (!BOOLSETTING(THROTTLE_ENABLE) || upLimit == 0 || ups == 0)
+	if (!BOOLSETTING(THROTTLE_ENABLE) || m_up.getLimit() == 0 || ups == 0)
 		return sock->write(buffer, len);
 		
-	boost::unique_lock<boost::mutex> lock(upMutex);
-	
-	if (upTokens > 0)
+	uint64_t wait = 0;
+	const size_t writeSize = m_up.acquire(sock, len, GET_TICK(), wait);
+	if (writeSize > 0)
 	{
-		size_t slice = getUploadLimit() / ups;
-		len = min(slice, min(len, static_cast<size_t>(upTokens)));
-		upTokens -= len;
-		
-		// next code can't be in critical section, so we must unlock here
-		lock.unlock();
+		len = writeSize;
 		
 		// write to socket
-		int sent = sock->write(buffer, len);
-		
-		// give a chance to other transfers to get a token
-		boost::thread::yield();
+		const int sent = sock->write(buffer, len);
+		if (static_cast<size_t>(max(sent, 0)) < writeSize)
+			m_up.release(sock, writeSize - max(sent, 0));
 		return sent;
 	}
 	
-	// no tokens, wait for them
-	upCond.timed_wait(lock, boost::posix_time::millisec(CONDWAIT_TIMEOUT));
+	// no tokens, wait for our own bucket - nobody is woken up for nothing
+	Thread::sleep(static_cast<uint32_t>(min<uint64_t>(wait, CONDWAIT_TIMEOUT)));
 	return 0;   // from BufferedSocket: -1 = failed, 0 = retry
 }
 
+void ThrottleManager::setClass(const Socket* sock, ThrottleClass p_class)
+{
+	m_down.setClass(sock, p_class);
+	m_up.setClass(sock, p_class);
+}
+
+void ThrottleManager::removeSocket(const Socket* sock)
+{
+	m_down.remove(sock);
+	m_up.remove(sock);
+}
+
+void ThrottleManager::Limiter::refill(uint64_t p_tick)
+{
+	if (p_tick > m_last_tick)
+	{
+		const int64_t l_capacity = max<int64_t>(m_limit * BURST_TIME / 1000, MIN_BURST);
+		m_tokens = min<int64_t>(m_tokens + static_cast<int64_t>(m_limit * (p_tick - m_last_tick) / 1000), l_capacity);
+		m_last_tick = p_tick;
+	}
+}
+
+size_t ThrottleManager::Limiter::acquire(const Socket* p_sock, size_t p_wanted, uint64_t p_tick, uint64_t& p_wait)
+{
+	Lock l(cs);
+	if (m_limit == 0)
+		return p_wanted;
+		
+	refill(p_tick);
+	
+	Bucket& b = m_buckets[p_sock];
+	if (b.m_weight == 0)
+	{
+		b.m_weight = g_class_weight[CLASS_NORMAL];
+	}
+	if (!b.m_active)
+	{
+		b.m_active = true;
+		b.m_tokens = 0;
+		b.m_last_tick = p_tick;
+		m_total_weight += b.m_weight;
+	}
+	b.m_last_used = p_tick;
+	
+	// weighted share of the limit among the connections which are transferring right now
+	const int64_t l_rate = max<int64_t>(static_cast<int64_t>(m_limit) * b.m_weight / m_total_weight, 1);
+	const int64_t l_capacity = max<int64_t>(l_rate * BURST_TIME / 1000, MIN_BURST);
+	if (p_tick > b.m_last_tick)
+	{
+		b.m_tokens = min<int64_t>(b.m_tokens + l_rate * static_cast<int64_t>(p_tick - b.m_last_tick) / 1000, l_capacity);
+		b.m_last_tick = p_tick;
+	}
+	
+	const int64_t l_allowed = min<int64_t>(static_cast<int64_t>(p_wanted), min(b.m_tokens, m_tokens));
+	if (l_allowed <= 0)
+	{
+		// time until both buckets hold at least a small chunk again
+		const int64_t l_need = min<int64_t>(static_cast<int64_t>(p_wanted), MIN_BURST);
+		const int64_t l_own = (l_need - b.m_tokens) * 1000 / l_rate;
+		const int64_t l_global = (l_need - m_tokens) * 1000 / static_cast<int64_t>(m_limit);
+		p_wait = static_cast<uint64_t>(max<int64_t>(max(l_own, l_global), 1));
+		return 0;
+	}
+	
+	b.m_tokens -= l_allowed;
+	m_tokens -= l_allowed;
+	return static_cast<size_t>(l_allowed);
+}
+
+void ThrottleManager::Limiter::release(const Socket* p_sock, size_t p_unused)
+{
+	Lock l(cs);
+	m_tokens += p_unused;
+	BucketMap::iterator i = m_buckets.find(p_sock);
+	if (i != m_buckets.end())
+		i->second.m_tokens += p_unused;
+}
+
+void ThrottleManager::Limiter::setLimit(size_t p_limit)
+{
+	Lock l(cs);
+	if (m_limit == 0)
+	{
+		m_tokens = 0;
+		m_last_tick = GET_TICK();
+	}
+	m_limit = p_limit;
+}
+
+void ThrottleManager::Limiter::setClass(const Socket* p_sock, ThrottleClass p_class)
+{
+	Lock l(cs);
+	Bucket& b = m_buckets[p_sock];
+	if (b.m_active)
+		m_total_weight -= b.m_weight;
+	b.m_weight = g_class_weight[p_class];
+	if (b.m_active)
+		m_total_weight += b.m_weight;
+}
+
+void ThrottleManager::Limiter::remove(const Socket* p_sock)
+{
+	Lock l(cs);
+	BucketMap::iterator i = m_buckets.find(p_sock);
+	if (i != m_buckets.end())
+	{
+		if (i->second.m_active)
+			m_total_weight -= i->second.m_weight;
+		m_buckets.erase(i);
+	}
+}
+
+void ThrottleManager::Limiter::removeIdle(uint64_t p_tick)
+{
+	Lock l(cs);
+	for (BucketMap::iterator i = m_buckets.begin(); i != m_buckets.end(); ++i)
+	{
+		Bucket& b = i->second;
+		if (b.m_active && b.m_last_used + IDLE_TIME < p_tick)
+		{
+			// give its share to the others until it transfers again
+			b.m_active = false;
+			m_total_weight -= b.m_weight;
+		}
+	}
+}
+
 /*
  * Returns current download limit.
  */
 size_t ThrottleManager::getDownloadLimit() const
 {
-	return downLimit;
+	return m_down.getLimit();
 }
 
 /*
@@ -135,16 +250,19 @@ size_t ThrottleManager::getDownloadLimit() const
  */
 size_t ThrottleManager::getUploadLimit() const
 {
-	return upLimit;
+	return m_up.getLimit();
 }
 
 // TimerManagerListener
-void ThrottleManager::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexcept
+void ThrottleManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept
 {
+	m_down.removeIdle(aTick);
+	m_up.removeIdle(aTick);
+	
 	if (!BOOLSETTING(THROTTLE_ENABLE))
 	{
-		downLimit = 0;
-		upLimit = 0;
+		m_down.setLimit(0);
+		m_up.setLimit(0);
 		return;
 	}
 	
@@ -169,8 +287,8 @@ void ThrottleManager::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexc
 		SettingsManager::getInstance()->set(SettingsManager::MAX_DOWNLOAD_SPEED_LIMIT_TIME, MAX_LIMIT_RATIO * SETTING(MAX_UPLOAD_SPEED_LIMIT_TIME));
 	}
 	
-	downLimit   = SETTING(MAX_DOWNLOAD_SPEED_LIMIT) * 1024;
-	upLimit     = SETTING(MAX_UPLOAD_SPEED_LIMIT) * 1024;
+	size_t downLimit   = SETTING(MAX_DOWNLOAD_SPEED_LIMIT) * 1024;
+	size_t upLimit     = SETTING(MAX_UPLOAD_SPEED_LIMIT) * 1024;
 	
 	// alternative limiter
 	if (BOOLSETTING(TIME_DEPENDENT_THROTTLE))
@@ -189,20 +307,9 @@ void ThrottleManager::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexc
 		}
 	}
 	
-	// readd tokens
-	if (downLimit > 0)
-	{
-		boost::lock_guard<boost::mutex> lock(downMutex);
-		downTokens = downLimit;
-		downCond.notify_all();
-	}
-	
-	if (upLimit > 0)
-	{
-		boost::lock_guard<boost::mutex> lock(upMutex);
-		upTokens = upLimit;
-		upCond.notify_all();
-	}
+	// tokens are readded on every request in proportion to the elapsed time
+	m_down.setLimit(downLimit);
+	m_up.setLimit(upLimit);
 }
 
 
@@ -23,7 +23,7 @@
 #include "Socket.h"
 #include "TimerManager.h"
 
-#include <boost/thread/condition_variable.hpp>
+#include "Thread.h"
 
 namespace dcpp
 {
@@ -31,12 +31,22 @@ namespace dcpp
 /**
  * Manager for throttling traffic flow speed.
  * Inspired by Token Bucket algorithm: http://en.wikipedia.org/wiki/Token_bucket
+ *
+ * Tokens are refilled in proportion to the elapsed milliseconds instead of once per second.
+ * Every connection has a child bucket under the global one, filled with its weighted share
+ * of the limit, so the bandwidth is split fairly between the active transfers.
  */
 class ThrottleManager :
 	public Singleton<ThrottleManager>, private TimerManagerListener
 {
 	public:
-	
+		enum ThrottleClass
+		{
+			CLASS_NORMAL,
+			CLASS_MINISLOT, // extra slots (file lists, small files) get a bigger share to finish quickly
+			CLASS_LAST
+		};
+		
 		/*
 		 * Limits a traffic and reads a packet from the network
 		 */
@@ -48,6 +58,16 @@ class ThrottleManager :
 		 */
 		int write(Socket* sock, void* buffer, size_t& len);
 		
+		/*
+		 * Sets the weight class of the connection
+		 */
+		void setClass(const Socket* sock, ThrottleClass p_class);
+		
+		/*
+		 * Forgets the child buckets of the connection
+		 */
+		void removeSocket(const Socket* sock);
+		
 		/*
 		 * Returns current download limit.
 		 */
@@ -60,17 +80,58 @@ class ThrottleManager :
 		
 	private:
 	
+		class Limiter
+		{
+			public:
+				Limiter() : m_limit(0), m_tokens(0), m_last_tick(0), m_total_weight(0) { }
+				
+				/*
+				 * Takes up to p_wanted tokens for the socket.
+				 * Returns 0 and the number of milliseconds to wait when there are none.
+				 */
+				size_t acquire(const Socket* p_sock, size_t p_wanted, uint64_t p_tick, uint64_t& p_wait);
+				
+				/*
+				 * Returns the tokens that were not used by the socket operation.
+				 */
+				void release(const Socket* p_sock, size_t p_unused);
+				
+				void setLimit(size_t p_limit);
+				size_t getLimit() const
+				{
+					return m_limit;
+				}
+				void setClass(const Socket* p_sock, ThrottleClass p_class);
+				void remove(const Socket* p_sock);
+				void removeIdle(uint64_t p_tick);
+				
+			private:
+				struct Bucket
+				{
+					Bucket() : m_tokens(0), m_last_tick(0), m_last_used(0), m_weight(0), m_active(false) { }
+					int64_t m_tokens;
+					uint64_t m_last_tick;
+					uint64_t m_last_used;
+					unsigned m_weight;
+					bool m_active;
+				};
+				typedef unordered_map<const Socket*, Bucket> BucketMap;
+				
+				void refill(uint64_t p_tick);
+				
+				CriticalSection cs;
+				BucketMap m_buckets;
+				size_t m_limit;
+				int64_t m_tokens;
+				uint64_t m_last_tick;
+				unsigned m_total_weight;
+		};
+		
 		// download limiter
-		size_t                      downLimit;
-		size_t                      downTokens;
-		boost::condition_variable   downCond;
-		boost::mutex                downMutex;
+		Limiter m_down;
 		
 		// upload limiter
-		size_t                      upLimit;
-		size_t                      upTokens;
-		boost::condition_variable   upCond;
-		boost::mutex                upMutex;
+		Limiter m_up;
 		
 		friend class Singleton<ThrottleManager>;
 		
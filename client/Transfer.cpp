@@ -109,11 +109,26 @@ void Transfer::getParams(const UserConnection& aSource, StringMap& params) const
 	params["fileSIchunkshort"] = Util::formatBytes(getPos());
 	params["fileSIactual"] = Util::toString(getActual());
 	params["fileSIactualshort"] = Util::formatBytes(getActual());
+	params["fileCR"] = Util::toString(getCompressionRatio() * 100.0) + '%';
 	params["speed"] = Util::formatBytes(static_cast<int64_t>(getAverageSpeed())) + "/s";
 	params["time"] = Text::fromT(Util::formatSeconds((GET_TICK() - getStart()) / 1000));
 	params["fileTR"] = getTTH().toBase32();
 }
 
+void Transfer::getSnapshot(Snapshot& p_snapshot) const
+{
+	p_snapshot.m_user = getUser();
+	p_snapshot.m_hub_hint = getUserConnection().getHubUrl();
+	p_snapshot.m_path = getPath();
+	p_snapshot.m_tth = getTTH();
+	p_snapshot.m_type = getType();
+	p_snapshot.m_pos = getPos();
+	p_snapshot.m_size = getSize();
+	p_snapshot.m_actual = getActual();
+	p_snapshot.m_speed = static_cast<int64_t>(getAverageSpeed());
+	p_snapshot.m_start = getStart();
+}
+
 UserPtr Transfer::getUser()
 {
 	return getUserConnection().getUser();
@@ -77,6 +77,12 @@ class Transfer
 		/** Record a sample for average calculation */
 		void tick();
 		
+		/** Bytes on the wire per byte of payload, 1.0 for uncompressed transfers */
+		double getCompressionRatio() const
+		{
+			return pos > 0 ? static_cast<double>(actual) / pos : 1.0;
+		}
+		
 		int64_t getActual() const
 		{
 			return actual;
@@ -106,6 +112,24 @@ class Transfer
 		
 		void getParams(const UserConnection& aSource, StringMap& params) const;
 		
+		/** What is needed to list a transfer, copied under the lock of the owning manager */
+		struct Snapshot
+		{
+			UserPtr m_user;
+			string m_hub_hint;
+			string m_path;
+			TTHValue m_tth;
+			Type m_type;
+			int64_t m_pos;
+			int64_t m_size;
+			int64_t m_actual;
+			int64_t m_speed;
+			uint64_t m_start;
+			bool m_download;
+		};
+		typedef vector<Snapshot> SnapshotList;
+		void getSnapshot(Snapshot& p_snapshot) const;
+		
 		UserPtr getUser();
 		const UserPtr getUser() const;
 		const HintedUser getHintedUser() const;
@@ -0,0 +1,190 @@
+#include "stdinc.h"
+#include "TransferStats.h"
+
+#include "DownloadManager.h"
+#include "UploadManager.h"
+#include "QueueManager.h"
+#include "HashManager.h"
+#include "Transfer.h"
+
+namespace dcpp
+{
+
+TransferStats::TransferStats() : m_current_minute(0), m_hash_left(-1)
+{
+	memzero(&m_last_sample, sizeof(m_last_sample));
+	TimerManager::getInstance()->addListener(this);
+}
+
+TransferStats::~TransferStats()
+{
+	TimerManager::getInstance()->removeListener(this);
+}
+
+static uint32_t toRate(int64_t p_speed)
+{
+	return static_cast<uint32_t>(min<int64_t>(max<int64_t>(p_speed, 0), numeric_limits<uint32_t>::max()));
+}
+
+void TransferStats::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexcept
+{
+	Sample l_sample;
+	memzero(&l_sample, sizeof(l_sample));
+	l_sample.m_down = toRate(DownloadManager::getInstance()->getRunningAverage());
+	l_sample.m_up = toRate(UploadManager::getInstance()->getRunningAverage());
+	l_sample.m_slots = UploadManager::getInstance()->getSlots();
+	l_sample.m_slots_used = static_cast<uint16_t>(l_sample.m_slots - UploadManager::getInstance()->getFreeSlots());
+
+	// hashed bytes are what the hash queue lost since the last second
+	{
+		string l_file;
+		int64_t l_left = 0;
+		size_t l_files = 0;
+		HashManager::getInstance()->getStats(l_file, l_left, l_files);
+		if (m_hash_left >= 0)
+			l_sample.m_hash = toRate(m_hash_left - l_left);
+		m_hash_left = l_left;
+	}
+
+	Transfer::SnapshotList l_transfers;
+	DownloadManager::getInstance()->getSnapshots(l_transfers);
+
+	// the queue keeps its total up to date, the running chunks are not in it yet
+	l_sample.m_queue_left = QueueManager::getInstance()->getBytesLeft();
+	for (auto i = l_transfers.cbegin(); i != l_transfers.cend(); ++i)
+	{
+		if (i->m_type == Transfer::TYPE_FILE)
+			l_sample.m_queue_left -= i->m_pos;
+	}
+	l_sample.m_queue_left = max<int64_t>(l_sample.m_queue_left, 0);
+
+	UploadManager::getInstance()->getSnapshots(l_transfers);
+	unordered_map<string, HubSample> l_hub_samples;
+	for (auto i = l_transfers.cbegin(); i != l_transfers.cend(); ++i)
+	{
+		if (i->m_hub_hint.empty())
+			continue;
+		HubSample& l_hub = l_hub_samples[i->m_hub_hint];
+		uint32_t& l_rate = i->m_download ? l_hub.m_down : l_hub.m_up;
+		l_rate = toRate(static_cast<int64_t>(l_rate) + i->m_speed);
+	}
+
+	const uint64_t l_now = GET_TIME();
+	const uint64_t l_minute = l_now / MINUTES;
+
+	Lock l(m_cs);
+	for (auto i = l_hub_samples.cbegin(); i != l_hub_samples.cend(); ++i)
+	{
+		auto l_series = m_hubs.find(i->first);
+		if (l_series == m_hubs.end())
+		{
+			if (m_hubs.size() >= MAX_HUBS)
+			{
+				// drop the hub idle for the longest time, unless every tracked hub is busy right now
+				auto l_oldest = m_hubs.end();
+				for (auto j = m_hubs.begin(); j != m_hubs.end(); ++j)
+				{
+					if (l_hub_samples.count(j->first) == 0 && (l_oldest == m_hubs.end() || j->second->m_last_active < l_oldest->second->m_last_active))
+						l_oldest = j;
+				}
+				if (l_oldest == m_hubs.end())
+					continue;
+				m_hubs.erase(l_oldest);
+			}
+			l_series = m_hubs.insert(make_pair(i->first, unique_ptr<HubSeries>(new HubSeries()))).first;
+		}
+		l_series->second->m_last_active = l_now;
+	}
+
+	if (l_minute != m_current_minute && m_current_minute)
+	{
+		if (m_minute.m_count)
+		{
+			Sample l_avg = m_last_sample;
+			l_avg.m_down = static_cast<uint32_t>(m_minute.m_down / m_minute.m_count);
+			l_avg.m_up = static_cast<uint32_t>(m_minute.m_up / m_minute.m_count);
+			l_avg.m_hash = static_cast<uint32_t>(m_minute.m_hash / m_minute.m_count);
+			m_minutes.put(m_current_minute, l_avg);
+		}
+		m_minute = Accumulator();
+		for (auto i = m_hubs.begin(); i != m_hubs.end(); ++i)
+		{
+			Accumulator& l_acc = i->second->m_minute;
+			if (l_acc.m_count)
+			{
+				HubSample l_avg;
+				l_avg.m_down = static_cast<uint32_t>(l_acc.m_down / l_acc.m_count);
+				l_avg.m_up = static_cast<uint32_t>(l_acc.m_up / l_acc.m_count);
+				i->second->m_minutes.put(m_current_minute, l_avg);
+			}
+			l_acc = Accumulator();
+		}
+	}
+	m_current_minute = l_minute;
+
+	m_seconds.put(l_now, l_sample);
+	m_minute.m_down += l_sample.m_down;
+	m_minute.m_up += l_sample.m_up;
+	m_minute.m_hash += l_sample.m_hash;
+	++m_minute.m_count;
+	m_last_sample = l_sample;
+
+	for (auto i = m_hubs.begin(); i != m_hubs.end(); ++i)
+	{
+		HubSample l_hub;
+		memzero(&l_hub, sizeof(l_hub));
+		auto l_found = l_hub_samples.find(i->first);
+		if (l_found != l_hub_samples.end())
+			l_hub = l_found->second;
+		i->second->m_seconds.put(l_now, l_hub);
+		Accumulator& l_acc = i->second->m_minute;
+		l_acc.m_down += l_hub.m_down;
+		l_acc.m_up += l_hub.m_up;
+		++l_acc.m_count;
+	}
+}
+
+void TransferStats::getRange(Resolution p_res, time_t& p_from, time_t p_to, vector<Sample>& p_samples) const
+{
+	uint64_t l_from = max<time_t>(p_from, 0) / p_res;
+	const uint64_t l_to = max<time_t>(p_to, 0) / p_res;
+	{
+		Lock l(m_cs);
+		if (p_res == SECONDS)
+			m_seconds.get(l_from, l_to, p_samples);
+		else
+			m_minutes.get(l_from, l_to, p_samples);
+	}
+	p_from = static_cast<time_t>(l_from * p_res);
+}
+
+bool TransferStats::getHubRange(const string& p_hub, Resolution p_res, time_t& p_from, time_t p_to, vector<HubSample>& p_samples) const
+{
+	uint64_t l_from = max<time_t>(p_from, 0) / p_res;
+	const uint64_t l_to = max<time_t>(p_to, 0) / p_res;
+	{
+		Lock l(m_cs);
+		auto i = m_hubs.find(p_hub);
+		if (i == m_hubs.end())
+			return false;
+		if (p_res == SECONDS)
+			i->second->m_seconds.get(l_from, l_to, p_samples);
+		else
+			i->second->m_minutes.get(l_from, l_to, p_samples);
+	}
+	p_from = static_cast<time_t>(l_from * p_res);
+	return true;
+}
+
+StringList TransferStats::getHubs() const
+{
+	StringList l_hubs;
+	Lock l(m_cs);
+	for (auto i = m_hubs.cbegin(); i != m_hubs.cend(); ++i)
+	{
+		l_hubs.push_back(i->first);
+	}
+	return l_hubs;
+}
+
+} // namespace dcpp
@@ -0,0 +1,150 @@
+#ifndef DCPLUSPLUS_DCPP_TRANSFER_STATS_H
+#define DCPLUSPLUS_DCPP_TRANSFER_STATS_H
+
+#include "Singleton.h"
+#include "TimerManager.h"
+#include "CriticalSection.h"
+
+namespace dcpp
+{
+
+/**
+ * Fixed-size history of the transfers: a sample every second for the last hour
+ * and every minute (the average of its seconds) for the last week.
+ * Besides the totals it keeps the rates of up to MAX_HUBS hubs, by the hub hint of the transfers;
+ * when a new hub shows up, the hub idle for the longest time makes room for it.
+ * Slots are addressed by unix time / resolution, seconds without a sample read as zeros.
+ */
+class TransferStats : public Singleton<TransferStats>, private TimerManagerListener
+{
+	public:
+		struct Sample
+		{
+			uint32_t m_down; // B/s
+			uint32_t m_up;
+			uint32_t m_hash;
+			uint16_t m_slots_used;
+			uint16_t m_slots;
+			int64_t m_queue_left; // bytes
+		};
+		struct HubSample
+		{
+			uint32_t m_down;
+			uint32_t m_up;
+		};
+
+		enum Resolution
+		{
+			SECONDS = 1,
+			MINUTES = 60
+		};
+		enum
+		{
+			SECONDS_KEPT = 60 * 60,
+			MINUTES_KEPT = 7 * 24 * 60,
+			MAX_HUBS = 16
+		};
+
+		/**
+		 * Samples of [p_from, p_to] (unix time) that are still kept.
+		 * p_from is moved to the time of the first returned sample, the next ones follow at p_res steps.
+		 */
+		void getRange(Resolution p_res, time_t& p_from, time_t p_to, vector<Sample>& p_samples) const;
+		/** @return False if the hub isn't tracked */
+		bool getHubRange(const string& p_hub, Resolution p_res, time_t& p_from, time_t p_to, vector<HubSample>& p_samples) const;
+		StringList getHubs() const;
+
+	private:
+		friend class Singleton<TransferStats>;
+
+		TransferStats();
+		~TransferStats();
+
+		void on(TimerManagerListener::Second, uint64_t aTick) noexcept;
+
+		template<class T, size_t N>
+		class Ring
+		{
+			public:
+				Ring() : m_first(0), m_last(0)
+				{
+					memzero(m_items, sizeof(m_items));
+				}
+
+				void put(uint64_t p_slot, const T& p_item)
+				{
+					if (m_last == 0 || p_slot > m_last + N)
+					{
+						m_first = p_slot;
+					}
+					else
+					{
+						// the slots skipped since the last sample are zeroed
+						for (uint64_t i = max(m_last + 1, p_slot + 1 - N); i < p_slot; ++i)
+						{
+							memzero(&m_items[i % N], sizeof(T));
+						}
+					}
+					m_items[p_slot % N] = p_item;
+					m_last = max(m_last, p_slot);
+				}
+
+				void get(uint64_t& p_from, uint64_t p_to, vector<T>& p_items) const
+				{
+					if (m_last == 0)
+					{
+						return;
+					}
+					const uint64_t l_oldest = m_last >= N ? max(m_first, m_last + 1 - N) : m_first;
+					p_from = max(p_from, l_oldest);
+					p_to = min(p_to, m_last);
+					for (uint64_t i = p_from; i <= p_to; ++i)
+					{
+						p_items.push_back(m_items[i % N]);
+					}
+				}
+
+			private:
+				T m_items[N];
+				uint64_t m_first;
+				uint64_t m_last;
+		};
+
+		/** Sums of the seconds of the current minute */
+		struct Accumulator
+		{
+			Accumulator()
+			{
+				memzero(this, sizeof(*this));
+			}
+			uint64_t m_down;
+			uint64_t m_up;
+			uint64_t m_hash;
+			uint32_t m_count;
+		};
+
+		struct HubSeries
+		{
+			HubSeries() : m_last_active(0) { }
+			Ring<HubSample, SECONDS_KEPT> m_seconds;
+			Ring<HubSample, MINUTES_KEPT> m_minutes;
+			Accumulator m_minute;
+			uint64_t m_last_active; // unix time of the last second with a transfer
+		};
+		typedef unordered_map<string, unique_ptr<HubSeries>> HubMap;
+
+		Ring<Sample, SECONDS_KEPT> m_seconds;
+		Ring<Sample, MINUTES_KEPT> m_minutes;
+		Accumulator m_minute;
+		Sample m_last_sample;
+		uint64_t m_current_minute;
+		HubMap m_hubs;
+
+		int64_t m_hash_left;
+
+		mutable CriticalSection m_cs;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_TRANSFER_STATS_H)
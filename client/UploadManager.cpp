@@ -385,6 +385,7 @@ ok:
 		
 		// user got a slot
 		aSource.setSlotType(slotType);
+		aSource.setExtraSlot(slotType == UserConnection::EXTRASLOT);
 	}
 	
 	return true;
@@ -402,6 +403,18 @@ int64_t UploadManager::getRunningAverage()
 	return avg;
 }
 
+void UploadManager::getSnapshots(Transfer::SnapshotList& p_list) const
+{
+	Lock l(cs);
+	p_list.reserve(p_list.size() + uploads.size());
+	for (auto i = uploads.cbegin(); i != uploads.cend(); ++i)
+	{
+		p_list.push_back(Transfer::Snapshot());
+		(*i)->getSnapshot(p_list.back());
+		p_list.back().m_download = false;
+	}
+}
+
 bool UploadManager::getAutoSlot()
 {
 	/** A 0 in settings means disable */
@@ -526,7 +539,13 @@ void UploadManager::on(AdcCommand::GET, UserConnection* aSource, const AdcComman
 		if (!l_is_compressed)
 			if (c.hasFlag("ZL", 4))
 			{
-				u->setStream(new FilteredInputStream<ZFilter, true>(u->getStream()));
+				FilteredInputStream<ZFilter, true>* l_zstream = new FilteredInputStream<ZFilter, true>(u->getStream());
+				// [+] Media and archives with unknown extensions rarely compress: start with stored blocks, ZFilter probes later
+				const SearchManager::TypeModes l_type = ShareManager::getFType(u->getPath());
+				l_zstream->getFilter().setIncompressibleHint(l_type == SearchManager::TYPE_VIDEO ||
+				                                             l_type == SearchManager::TYPE_PICTURE ||
+				                                             l_type == SearchManager::TYPE_COMPRESSED);
+				u->setStream(l_zstream);
 				u->setFlag(Upload::FLAG_ZUPLOAD);
 				cmd.addParam("ZL1");
 			}
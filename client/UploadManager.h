@@ -27,6 +27,7 @@
 #include "ClientManager.h"
 #include "ClientManagerListener.h"
 #include "MerkleTree.h"
+#include "Transfer.h"
 
 namespace dcpp
 {
@@ -129,6 +130,9 @@ class UploadManager : private ClientManagerListener, private UserConnectionListe
 			return uploads.size();
 		}
 		
+		/** Appends a copy of every running upload */
+		void getSnapshots(Transfer::SnapshotList& p_list) const;
+		
 		/**
 		 * @remarks This is only used in the tray icons. Could be used in
 		 * MainFrame too.
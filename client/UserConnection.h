@@ -212,6 +212,10 @@ class UserConnection : public Speaker<UserConnectionListener>,
 		{
 			socket->transmitFile(f);
 		}
+		void setExtraSlot(bool p_extra_slot)
+		{
+			if (socket) socket->setExtraSlot(p_extra_slot);
+		}
 		
 		const string& getDirectionString() const
 		{
@@ -26,11 +26,18 @@
 namespace dcpp
 {
 
-ZFilter::ZFilter() : totalIn(0), totalOut(0), compressing(true)
+// Size of input after which the compression ratio is re-evaluated
+static const int64_t ZFILTER_CHUNK_SIZE = 256 * 1024;
+// Chunks compressing worse than this are sent as stored blocks
+static const double ZFILTER_MIN_RATIO = 0.95;
+// Number of stored chunks after which compression is probed again
+static const unsigned ZFILTER_PROBE_CHUNKS = 16;
+
+ZFilter::ZFilter() : totalIn(0), totalOut(0), chunkIn(0), chunkOut(0), storedChunks(0), level(SETTING(MAX_COMPRESSION)), compressing(true)
 {
 	memzero(&zs, sizeof(zs));
 	
-	if (deflateInit(&zs, SETTING(MAX_COMPRESSION)) != Z_OK)
+	if (deflateInit(&zs, level) != Z_OK)
 	{
 		throw Exception(STRING(COMPRESSION_ERROR));
 	}
@@ -42,6 +49,35 @@ ZFilter::~ZFilter()
 	deflateEnd(&zs);
 }
 
+void ZFilter::setIncompressibleHint(bool p_incompressible)
+{
+	dcassert(totalIn == 0);
+	if (p_incompressible && compressing && totalIn == 0)
+	{
+		// Nothing has been fed yet, so deflateParams won't flush anything
+		zs.avail_in = 0;
+		zs.avail_out = 0;
+		setCompressing(false);
+	}
+}
+
+void ZFilter::setCompressing(bool p_compressing)
+{
+	const int err = deflateParams(&zs, p_compressing ? level : 0, Z_DEFAULT_STRATEGY);
+	if (err == Z_BUF_ERROR)
+	{
+		// Pending data didn't fit into the output, parameters stay unchanged until the next chunk
+		return;
+	}
+	if (err != Z_OK)
+	{
+		throw Exception(STRING(COMPRESSION_ERROR));
+	}
+	compressing = p_compressing;
+	storedChunks = 0;
+	dcdebug("ZFilter: dynamically %s compression at " I64_FMT "\n", p_compressing ? "enabled" : "disabled", totalIn);
+}
+
 bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outsize)
 {
 	if (outsize == 0)
@@ -49,35 +85,32 @@ bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outs
 		
 	zs.next_in = (Bytef*)in;
 	zs.next_out = (Bytef*)out;
+	zs.avail_out = outsize;
 	
-	// Check if there's any use compressing; if not, save some cpu...
-	if (compressing && insize > 0 && outsize > 16 && (totalIn > (64 * 1024)) && ((static_cast<double>(totalOut) / totalIn) > 0.95))
+	// Check after every chunk if there's any use compressing; if not, save some cpu...
+	// Stored chunks are probed again periodically as the content may change (e.g. tar with mixed files)
+	if (insize > 0 && outsize > 16 && chunkIn >= ZFILTER_CHUNK_SIZE)
 	{
-		zs.avail_in = 0;
-		zs.avail_out = outsize;
-		if (deflateParams(&zs, 0, Z_DEFAULT_STRATEGY) != Z_OK)
-		{
-			throw Exception(STRING(COMPRESSION_ERROR));
-		}
-		zs.avail_in = insize;
-		compressing = false;
-		dcdebug("Dynamically disabled compression");
-		
-		// Check if we ate all space already...
-		if (zs.avail_out == 0)
+		const bool l_compress = compressing ?
+		                        (static_cast<double>(chunkOut) / chunkIn) <= ZFILTER_MIN_RATIO :
+		                        ++storedChunks >= ZFILTER_PROBE_CHUNKS;
+		chunkIn = chunkOut = 0;
+		if (l_compress != compressing)
 		{
-			outsize = outsize - zs.avail_out;
-			insize = insize - zs.avail_in;
-			totalOut += outsize;
-			totalIn += insize;
-			return true;
+			zs.avail_in = 0;
+			setCompressing(l_compress);
+			
+			// Check if we ate all space already...
+			if (zs.avail_out == 0)
+			{
+				insize = 0;
+				account(insize, outsize); // zs.avail_out == 0, the whole buffer is used
+				return true;
+			}
 		}
 	}
-	else
-	{
-		zs.avail_in = insize;
-		zs.avail_out = outsize;
-	}
+	
+	zs.avail_in = insize;
 	
 	if (insize == 0)
 	{
@@ -87,8 +120,7 @@ bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outs
 			
 		outsize = outsize - zs.avail_out;
 		insize = insize - zs.avail_in;
-		totalOut += outsize;
-		totalIn += insize;
+		account(insize, outsize);
 		return err == Z_OK;
 	}
 	else
@@ -99,8 +131,7 @@ bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outs
 			
 		outsize = outsize - zs.avail_out;
 		insize = insize - zs.avail_in;
-		totalOut += outsize;
-		totalIn += insize;
+		account(insize, outsize);
 		return true;
 	}
 }
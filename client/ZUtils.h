@@ -38,11 +38,31 @@ class ZFilter
 		 * @return True if there's more processing to be done
 		 */
 		bool operator()(const void* in, size_t& insize, void* out, size_t& outsize);
+		/**
+		 * Hint that the content is likely already compressed (video, archives...).
+		 * The filter then starts with stored blocks and only probes compression
+		 * every now and then. Must be called before the first chunk is filtered.
+		 */
+		void setIncompressibleHint(bool p_incompressible);
 	private:
 		z_stream zs;
 		int64_t totalIn;
 		int64_t totalOut;
+		// [+] adaptive compression, re-evaluated for every chunk of input
+		int64_t chunkIn;
+		int64_t chunkOut;
+		unsigned storedChunks;
+		int level;
 		bool compressing;
+		
+		void setCompressing(bool p_compressing);
+		void account(size_t p_insize, size_t p_outsize)
+		{
+			totalIn += p_insize;
+			totalOut += p_outsize;
+			chunkIn += p_insize;
+			chunkOut += p_outsize;
+		}
 };
 
 class UnZFilter
@@ -265,6 +265,22 @@ namespace dht
 		}
 	}
 
+	/*
+	 * Drops a file which is no longer shared from the publish queue,
+	 * the sources already stored by other nodes expire on their own
+	 */
+	void IndexManager::unpublishFile(const TTHValue& tth)
+	{
+		Lock l(cs);
+		for(FileQueue::iterator i = publishQueue.begin(); i != publishQueue.end();)
+		{
+			if(!i->partial && i->tth == tth)
+				i = publishQueue.erase(i);
+			else
+				++i;
+		}
+	}
+
 	/*
 	 * Publishes partially downloaded file
 	 */
@@ -80,6 +80,9 @@ namespace dht
 	/** Publishes shared file */
 	void publishFile(const TTHValue& tth, int64_t size);
 	
+	/** Drops a file which is no longer shared from the publish queue */
+	void unpublishFile(const TTHValue& tth);
+	
 	/** Publishes partially downloaded file */
 	void publishPartialFile(const TTHValue& tth);
 	
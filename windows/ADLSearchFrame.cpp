@@ -260,7 +260,7 @@ LRESULT ADLSearchFrame::onAdd(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl
 	if (dlg.DoModal((HWND)*this) == IDOK)
 	{
 		// Add new search to the end or if selected, just before
-		ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+		ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 		
 		
 		int i = ctrlList.GetNextItem(-1, LVNI_SELECTED);
@@ -300,7 +300,7 @@ LRESULT ADLSearchFrame::onEdit(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCt
 	}
 	
 	// Edit existing
-	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 	ADLSearch search = collection[i];
 	
 	// Invoke dialog with selected search
@@ -320,7 +320,7 @@ LRESULT ADLSearchFrame::onEdit(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCt
 // Remove searches
 LRESULT ADLSearchFrame::onRemove(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
 {
-	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 	
 	// Loop over all selected items
 	int i;
@@ -381,7 +381,7 @@ LRESULT ADLSearchFrame::onHelp(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCt
 // Move selected entries up one step
 LRESULT ADLSearchFrame::onMoveUp(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
 {
-	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 	
 	// Get selection
 	vector<int> sel;
@@ -436,7 +436,7 @@ LRESULT ADLSearchFrame::onMoveUp(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWnd
 // Move selected entries down one step
 LRESULT ADLSearchFrame::onMoveDown(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
 {
-	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 	
 	// Get selection
 	vector<int> sel;
@@ -512,7 +512,7 @@ LRESULT ADLSearchFrame::onItemChanged(int /*idCtrl*/, LPNMHDR pnmh, BOOL& /*bHan
 	if (item->iItem >= 0)
 	{
 		// Set new active status check box
-		ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+		ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 		ADLSearch& search = collection[item->iItem];
 		search.isActive = (ctrlList.GetCheckState(item->iItem) != 0);
 	}
@@ -544,7 +544,7 @@ void ADLSearchFrame::LoadAll()
 	ctrlList.DeleteAllItems();
 	
 	// Load all searches
-	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 	for (unsigned long l = 0; l < collection.size(); l++)
 	{
 		UpdateSearch(l, FALSE);
@@ -554,7 +554,7 @@ void ADLSearchFrame::LoadAll()
 // Update a specific search item
 void ADLSearchFrame::UpdateSearch(int index, BOOL doDelete)
 {
-	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->collection;
+	ADLSearchManager::SearchCollection& collection = ADLSearchManager::getInstance()->getCollection();
 	
 	// Check args
 	if (index >= (int)collection.size())
@@ -228,13 +228,6 @@ bool HubFrame::closeHubByAddr(const tstring& address)
     return false;
 }
 
-void HubFrame::listOpenedHubs(std::map<std::string, bool>& list)
-{
-	for(auto iHub = frames.cbegin(); iHub != frames.cend(); iHub++){
-        list[Text::fromT(iHub->first)] = iHub->second->client->isConnected();
-	}
-}
-
 LRESULT HubFrame::OnForwardMsg(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM lParam, BOOL& /*bHandled*/)
 {
 	LPMSG pMsg = (LPMSG)lParam;
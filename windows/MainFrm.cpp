@@ -724,6 +724,11 @@ LRESULT MainFrame::onSpeaker(UINT /*uMsg*/, WPARAM wParam, LPARAM lParam, BOOL&
 	{
 		PopupManager::getInstance()->AutoRemove();
 	}
+	else if (wParam == CLOSE_HUB)
+	{
+		auto_ptr<tstring> address(reinterpret_cast<tstring*>(lParam));
+		HubFrame::closeHubByAddr(*address);
+	}
 	else if (wParam == SET_PM_TRAY_ICON)
 	{
 		if (bIsPM == false && (!WinUtil::isAppActive || bAppMinimized) && bTrayIcon == true)
@@ -738,18 +743,6 @@ LRESULT MainFrame::onSpeaker(UINT /*uMsg*/, WPARAM wParam, LPARAM lParam, BOOL&
 			bIsPM = true;
 		}
 	}
-    else if(wParam == QUICK_CONNECT_HUB)
-    {
-        const string* server = (string*)lParam;
-        RecentHubEntry r;
-		r.setServer(*server);
-		FavoriteManager::getInstance()->addRecent(r);
-		HubFrame::openWindow(Text::toT(*server));
-    }
-    else if(wParam == SEARCH_SIMPLE)
-    {
-        SearchFrame::openWindow(Text::toT(*(string*)lParam));
-    }
 	
 	return 0;
 }
@@ -82,8 +82,7 @@ class MainFrame : public CMDIFrameWindowImpl<MainFrame>, public CUpdateUI<MainFr
 			SHOW_POPUP,
 			REMOVE_POPUP,
 			SET_PM_TRAY_ICON,
-            QUICK_CONNECT_HUB,
-            SEARCH_SIMPLE
+			CLOSE_HUB
 		};
 		
 		BOOL PreTranslateMessage(MSG* pMsg)
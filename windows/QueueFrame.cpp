@@ -1310,9 +1310,7 @@ LRESULT QueueFrame::onSegments(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/,
 	while ((i = ctrlQueue.GetNextItem(i, LVNI_SELECTED)) != -1)
 	{
 		QueueItemInfo* ii = ctrlQueue.getItemData(i);
-		QueueItem* qi = QueueManager::getInstance()->fileQueue.find(ii->getTarget());
-		
-		qi->setMaxSegments((uint8_t)(wID - 109));
+		QueueManager::getInstance()->setMaxSegments(ii->getTarget(), (uint8_t)(wID - 109));
 		
 		ctrlQueue.updateItem(ctrlQueue.findItem(ii), COLUMN_SEGMENTS);
 	}
@@ -1900,6 +1898,11 @@ void QueueFrame::on(QueueManagerListener::RecheckDone, const string& target) noe
 	onRechecked(target, STRING(DONE));
 }
 
+void QueueFrame::on(QueueManagerListener::RecheckProgress, const string& target, int64_t checked, int64_t total, int64_t speed) noexcept
+{
+	onRechecked(target, Util::toString(total ? checked * 100 / total : 100) + "% (" + Util::formatBytes(speed) + "/s)"); // [!] TODO translate
+}
+
 /**
  * @file
  * $Id: QueueFrame.cpp 568 2011-07-24 18:28:43Z bigmuscle $
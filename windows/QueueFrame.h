@@ -459,6 +459,7 @@ class QueueFrame : public MDITabChildWindowImpl<QueueFrame, RGB(0, 0, 0), IDR_QU
 		void on(QueueManagerListener::RecheckNoTree, const string& target) noexcept;
 		void on(QueueManagerListener::RecheckAlreadyFinished, const string& target) noexcept;
 		void on(QueueManagerListener::RecheckDone, const string& target) noexcept;
+		void on(QueueManagerListener::RecheckProgress, const string& target, int64_t checked, int64_t total, int64_t speed) noexcept;
 };
 
 #endif // !defined(QUEUE_FRAME_H)
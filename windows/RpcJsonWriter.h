@@ -0,0 +1,171 @@
+#pragma once
+
+/**
+ * Streaming JSON encoder: appends straight to the output string, no tree is built.
+ * Strings are expected in UTF-8 and are only escaped, commas are placed automatically.
+ *
+ *  RpcJsonWriter w(out);
+ *  w.beginObject().member("total", 10).key("items").beginArray()...endArray().endObject();
+ */
+class RpcJsonWriter
+{
+public:
+    explicit RpcJsonWriter(std::string &out) : out(out), afterKey(false){}
+
+    RpcJsonWriter &beginObject()
+    {
+        separate();
+        out += '{';
+        first.push_back(true);
+        return *this;
+    }
+
+    RpcJsonWriter &endObject()
+    {
+        first.pop_back();
+        out += '}';
+        return *this;
+    }
+
+    RpcJsonWriter &beginArray()
+    {
+        separate();
+        out += '[';
+        first.push_back(true);
+        return *this;
+    }
+
+    RpcJsonWriter &endArray()
+    {
+        first.pop_back();
+        out += ']';
+        return *this;
+    }
+
+    RpcJsonWriter &key(const char *name)
+    {
+        separate();
+        quote(name, strlen(name));
+        out += ':';
+        afterKey = true;
+        return *this;
+    }
+
+    RpcJsonWriter &value(const std::string &str)
+    {
+        separate();
+        quote(str.c_str(), str.length());
+        return *this;
+    }
+
+    RpcJsonWriter &value(const char *str)
+    {
+        separate();
+        quote(str, strlen(str));
+        return *this;
+    }
+
+    RpcJsonWriter &value(int64_t number)
+    {
+        separate();
+        char buf[24];
+        out.append(buf, snprintf(buf, sizeof(buf), I64_FMT, number));
+        return *this;
+    }
+
+    RpcJsonWriter &value(uint64_t number)
+    {
+        separate();
+        char buf[24];
+        out.append(buf, snprintf(buf, sizeof(buf), U64_FMT, number));
+        return *this;
+    }
+
+    RpcJsonWriter &value(int number)
+    {
+        return value(static_cast<int64_t>(number));
+    }
+
+    RpcJsonWriter &value(unsigned int number)
+    {
+        return value(static_cast<uint64_t>(number));
+    }
+
+    RpcJsonWriter &value(double number)
+    {
+        separate();
+        char buf[32];
+        out.append(buf, snprintf(buf, sizeof(buf), "%.3f", number));
+        return *this;
+    }
+
+    RpcJsonWriter &value(bool flag)
+    {
+        separate();
+        out += flag ? "true" : "false";
+        return *this;
+    }
+
+    RpcJsonWriter &null()
+    {
+        separate();
+        out += "null";
+        return *this;
+    }
+
+    template<typename T>
+    RpcJsonWriter &member(const char *name, const T &val)
+    {
+        return key(name).value(val);
+    }
+
+private:
+    /* comma before every element except the first one of a container */
+    void separate()
+    {
+        if(afterKey){
+            afterKey = false;
+            return;
+        }
+        if(first.empty()){
+            return;
+        }
+        if(!first.back()){
+            out += ',';
+        }
+        first.back() = false;
+    }
+
+    void quote(const char *str, size_t len)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        for(size_t i = 0; i < len; ++i){
+            const unsigned char c = str[i];
+            switch(c)
+            {
+                case '"':   out += "\\\""; break;
+                case '\\':  out += "\\\\"; break;
+                case '\n':  out += "\\n"; break;
+                case '\r':  out += "\\r"; break;
+                case '\t':  out += "\\t"; break;
+                default:
+                {
+                    if(c < 0x20){
+                        out += "\\u00";
+                        out += hex[c >> 4];
+                        out += hex[c & 0xF];
+                    }
+                    else{
+                        out += static_cast<char>(c);
+                    }
+                }
+            }
+        }
+        out += '"';
+    }
+
+    std::string &out;
+    std::vector<bool> first;
+    bool afterKey;
+};
@@ -1,11 +1,93 @@
 #include "stdafx.h"
 #include "RpcServiceHub.h"
 #include "json_spirit_utils.h"
+#include "RpcJsonWriter.h"
 #include "../client/FavoriteManager.h"
-#include "HubFrame.h"
-#include "MainFrm.h" //onSpeaker., TODO:~
+#include "../client/ClientManager.h"
+#include "../client/CommandExecutor.h"
+#include "MainFrm.h"
 
-// TODO: create/update/delate - place to new thread
+namespace
+{
+    /* hubs connected by the remote clients: they have no window, so they are closed here too */
+    StringSet remoteHubs;
+    CriticalSection remoteHubsCs;
+
+    bool isRemoteHub(const std::string &server)
+    {
+        Lock l(remoteHubsCs);
+        return remoteHubs.find(server) != remoteHubs.end();
+    }
+
+    class ConnectHub : public CommandExecutor::Command
+    {
+    public:
+        explicit ConnectHub(const std::string &server) : server(server){}
+
+        void execute()
+        {
+            bool created;
+            Client *client = ClientManager::getInstance()->findOrCreateClient(server, created);
+            if(!created){
+                return;
+            }
+
+            RecentHubEntry r;
+            r.setServer(server);
+            FavoriteManager::getInstance()->addRecent(r);
+
+            {
+                Lock l(remoteHubsCs);
+                remoteHubs.insert(server);
+            }
+            client->connect();
+        }
+
+    private:
+        const std::string server;
+    };
+
+    class CloseHub : public CommandExecutor::Command
+    {
+    public:
+        explicit CloseHub(const std::string &server) : server(server){}
+
+        void execute()
+        {
+            {
+                Lock l(remoteHubsCs);
+                remoteHubs.erase(server);
+            }
+
+            ClientManager *cm = ClientManager::getInstance();
+            cm->lock();
+            Client::List::const_iterator i = cm->getClients().find(server);
+            Client *client = i != cm->getClients().end() ? i->second : nullptr;
+            cm->unlock();
+            if(client){
+                cm->putClient(client);
+            }
+        }
+
+    private:
+        const std::string server;
+    };
+
+    bool isOpenedHub(const std::string &server)
+    {
+        ClientManager *cm = ClientManager::getInstance();
+        cm->lock();
+        const bool opened = cm->getClients().find(server) != cm->getClients().end();
+        cm->unlock();
+        return opened;
+    }
+
+    bool post(CommandExecutor::Command *command)
+    {
+        std::unique_ptr<CommandExecutor::Command> ptr(command);
+        return CommandExecutor::isValidInstance() && CommandExecutor::getInstance()->post(std::move(ptr));
+    }
+}
 
 bool RpcServiceHub::create(const json_spirit::Object &data)
 {
@@ -57,11 +139,7 @@ bool RpcServiceHub::connect(const json_spirit::Object &data)
 {
     json_spirit::Pair_impl<json_spirit::Config_vector<std::string>>::Value_type addr = json_spirit::find_value(data, "server");
     if(addr.type() != json_spirit::null_type && addr.get_str().length() > 0){
-        //TODO: лучше разделить на отдельные потоки, если клиент посылает множетсвенные запросы
-        //     Автостарт у них также отрабатывает в едином - см. MainFrm::onSpeaker(AUTO_CONNECT) autoConnect(...); !
-        PostMessage(MainFrame::getMainFrame()->m_hWnd, 
-                    WM_SPEAKER, MainFrame::QUICK_CONNECT_HUB, (WPARAM)new std::string(addr.get_str()));
-        return true;
+        return post(new ConnectHub(addr.get_str()));
     }
     return false;
 }
@@ -69,7 +147,20 @@ bool RpcServiceHub::connect(const json_spirit::Object &data)
 bool RpcServiceHub::close(const json_spirit::Object &data)
 {
     const std::string &server = json_spirit::find_value(data, "server").get_str();
-    return HubFrame::closeHubByAddr(Text::toT(server));
+    if(!isRemoteHub(server)){
+        /* opened in the UI - the window owns the connection and is closed on the UI thread */
+        MainFrame *mainFrame = MainFrame::getMainFrame();
+        if(!mainFrame || !isOpenedHub(server)){
+            return false;
+        }
+        std::unique_ptr<tstring> address(new tstring(Text::toT(server)));
+        if(!mainFrame->PostMessage(WM_SPEAKER, MainFrame::CLOSE_HUB, (LPARAM)address.get())){
+            return false;
+        }
+        address.release();
+        return true;
+    }
+    return post(new CloseHub(server));
 }
 
 /**
@@ -77,33 +168,52 @@ bool RpcServiceHub::close(const json_spirit::Object &data)
  */
 std::string RpcServiceHub::list(const json_spirit::Object &data)
 {
-    std::string ret = "[";
+    std::string ret;
+    RpcJsonWriter writer(ret);
+    writer.beginArray();
     const FavoriteHubEntry::List& iHubs = FavoriteManager::getInstance()->getFavoriteHubs();
     for(auto idx = iHubs.cbegin(); idx != iHubs.cend(); ++idx){
-		FavoriteHubEntry* entry = *idx;
-        ret += "{server:'" + entry->getServer() + "',name:'" + entry->getName() + "',description:'" + entry->getDescription() + "'},";
+        const FavoriteHubEntry* entry = *idx;
+        writer.beginObject()
+            .member("server",       entry->getServer())
+            .member("name",         entry->getName())
+            .member("description",  entry->getDescription())
+            .endObject();
     }
-    //return ret.substr(0, ret.length()) + "]";
-    return ret += "]"; //yep
+    writer.endArray();
+    return ret;
 }
 
+/**
+ * @response: {"address": true - connected, ..}
+ */
 std::string RpcServiceHub::used(const json_spirit::Object &data)
 {
     std::map<std::string, bool> list;
-    HubFrame::listOpenedHubs(list);
-        
-    std::string ret = "{";
-    for(auto it = list.cbegin(); it != list.end(); it++){
+    {
+        ClientManager *cm = ClientManager::getInstance();
+        cm->lock();
+        const Client::List &clients = cm->getClients();
+        for(auto i = clients.cbegin(); i != clients.cend(); ++i){
+            list[i->second->getHubUrl()] = i->second->isConnected();
+        }
+        cm->unlock();
+    }
+
+    std::string ret;
+    RpcJsonWriter writer(ret);
+    writer.beginObject();
+    for(auto it = list.cbegin(); it != list.cend(); ++it){
         std::string server = it->first;
         size_t pos = server.find("://");
         if(pos != std::string::npos){
             server = server.substr(pos + 3);
         }
-        ret += "'" + server + "':" + ((it->second)? "1":"0") + ",";
+        writer.member(server.c_str(), it->second);
         //TODO: адреса fav возвращать в виде ID
     }
-    //return ret.substr(0, ret.length()) + "}";
-    return ret += "}"; //yep
+    writer.endObject();
+    return ret;
 }
 
 void RpcServiceHub::prepareHubFields(const json_spirit::Object &data, FavoriteHubEntry &entry)
@@ -0,0 +1,88 @@
+#include "stdafx.h"
+#include "RpcServiceQueue.h"
+#include "RpcSnapshots.h"
+#include "../client/QueueManager.h"
+#include "../client/CommandExecutor.h"
+
+namespace
+{
+    /* only what the listing shows, so the queue lock is held for as short as possible */
+    struct QueueRow
+    {
+        string      target;
+        TTHValue    tth;
+        int64_t     size;
+        int64_t     downloaded;
+        time_t      added;
+        int         priority;
+        int         sources;
+        int         online;
+        bool        running;
+    };
+
+    bool lessTarget(const QueueRow &a, const QueueRow &b)
+    {
+        return a.target < b.target;
+    }
+
+    void fillQueue(std::vector<QueueRow> &rows)
+    {
+        QueueManager *qm = QueueManager::getInstance();
+        const QueueItem::StringMap &queue = qm->lockQueue();
+        rows.reserve(queue.size());
+        for(auto i = queue.cbegin(); i != queue.cend(); ++i){
+            const QueueItem *qi = i->second;
+            QueueRow row;
+            row.target      = qi->getTarget();
+            row.tth         = qi->getTTH();
+            row.size        = qi->getSize();
+            row.downloaded  = qi->getDownloadedBytes();
+            row.added       = qi->getAdded();
+            row.priority    = qi->getPriority();
+            row.sources     = static_cast<int>(qi->getSources().size());
+            row.online      = static_cast<int>(qi->countOnlineUsers());
+            row.running     = qi->isRunning();
+            rows.push_back(row);
+        }
+        qm->unlockQueue();
+        std::sort(rows.begin(), rows.end(), lessTarget);
+    }
+
+    void writeQueue(RpcJsonWriter &writer, const QueueRow &row)
+    {
+        writer.beginObject()
+            .member("target",       row.target)
+            .member("tth",          row.tth.toBase32())
+            .member("size",         row.size)
+            .member("downloaded",   row.downloaded)
+            .member("added",        static_cast<int64_t>(row.added))
+            .member("priority",     row.priority)
+            .member("sources",      row.sources)
+            .member("online",       row.online)
+            .member("running",      row.running)
+            .endObject();
+    }
+
+    RpcSnapshots<QueueRow> snapshots(&fillQueue, &writeQueue);
+
+    class ExportQueue : public CommandExecutor::Command
+    {
+    public:
+        void execute()
+        {
+            QueueManager *qm = QueueManager::getInstance();
+            qm->exportQueue(qm->getQueueFile());
+        }
+    };
+}
+
+std::string RpcServiceQueue::list(const json_spirit::Object &data)
+{
+    return snapshots.page(data);
+}
+
+bool RpcServiceQueue::exportXml()
+{
+    std::unique_ptr<CommandExecutor::Command> command(new ExportQueue());
+    return CommandExecutor::isValidInstance() && CommandExecutor::getInstance()->post(std::move(command));
+}
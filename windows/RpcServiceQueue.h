@@ -0,0 +1,21 @@
+#pragma once
+#include "json_spirit.h"
+
+class RpcServiceQueue
+{
+public:
+    /**
+     * @response: {snapshot, total, offset, items: array(object, object,..)}
+     */
+    static std::string list(const json_spirit::Object &data);
+
+    /**
+     * Queue.xml is written by the core executor, it walks the whole queue
+     * @response: true if queued
+     */
+    static bool exportXml();
+
+private:
+    RpcServiceQueue(void){};
+    ~RpcServiceQueue(void){};
+};
@@ -1,19 +1,124 @@
 #include "stdafx.h"
 #include "RpcServiceSearch.h"
 #include "RpcServices.h"
-#include "SearchFrm.h"
-#include "MainFrm.h" //onSpeaker., TODO:~
+#include "../client/SearchManager.h"
+#include "../client/SearchResult.h"
+#include "../client/ClientManager.h"
+#include "../client/CommandExecutor.h"
+
+namespace
+{
+    /**
+     * The search of the remote clients, independent of the search windows.
+     * Results of the last search are kept until they are taken by result().
+     */
+    class RemoteSearch : public SearchManagerListener
+    {
+    public:
+        RemoteSearch() : listening(false), isHash(false){}
+
+        /* called on the executor thread */
+        void start(const std::string &query, bool hash)
+        {
+            {
+                /* not under cs: the results come in with the listeners of SearchManager locked */
+                Lock l(listenCs);
+                if(!listening){
+                    SearchManager::getInstance()->addListener(this);
+                    listening = true;
+                }
+            }
+            ClientManager::getInstance()->cancelSearch((void*)this);
+
+            StringList hubs;
+            {
+                ClientManager *cm = ClientManager::getInstance();
+                cm->lock();
+                const Client::List &clients = cm->getClients();
+                for(auto i = clients.cbegin(); i != clients.cend(); ++i){
+                    if(i->second->isConnected()){
+                        hubs.push_back(i->second->getHubUrl());
+                    }
+                }
+                cm->unlock();
+            }
+
+            std::string searchToken;
+            {
+                Lock l(cs);
+                results.clear();
+                token   = searchToken = Util::toString(Util::rand());
+                isHash  = hash;
+                tth     = hash ? TTHValue(query) : TTHValue();
+            }
+            SearchManager::getInstance()->search(hubs, query, 0, 
+                hash ? SearchManager::TYPE_TTH : SearchManager::TYPE_ANY, SearchManager::SIZE_DONTCARE, searchToken, StringList(), (void*)this, SearchQueue::PRIORITY_RPC);
+        }
+
+        /* the newest results first */
+        void take(int count, std::vector<SearchResultPtr> &ret)
+        {
+            Lock l(cs);
+            for(int i = 0; !results.empty() && i < count; ++i){
+                ret.push_back(results.back());
+                results.pop_back();
+            }
+        }
+
+    private:
+        enum { MAX_RESULTS = 5000 };
+
+        void on(SearchManagerListener::SR, const SearchResultPtr &result) noexcept
+        {
+            Lock l(cs);
+            if(token.empty() || (!result->getToken().empty() && result->getToken() != token)){
+                return;
+            }
+            if(isHash && (result->getType() != SearchResult::TYPE_FILE || result->getTTH() != tth)){
+                return;
+            }
+            if(results.size() >= MAX_RESULTS){
+                results.pop_front();
+            }
+            results.push_back(result);
+        }
+
+        bool listening;
+        CriticalSection listenCs;
+
+        std::deque<SearchResultPtr> results;
+        std::string token;
+        bool isHash;
+        TTHValue tth;
+        CriticalSection cs;
+    };
+
+    RemoteSearch remoteSearch;
+
+    class StartSearch : public CommandExecutor::Command
+    {
+    public:
+        StartSearch(const std::string &query, bool isHash) : query(query), isHash(isHash){}
+
+        void execute()
+        {
+            remoteSearch.start(query, isHash);
+        }
+
+    private:
+        const std::string query;
+        const bool isHash;
+    };
+}
 
 std::string RpcServiceSearch::result(int count)
 {
-    if(SearchFrame::searchResults.empty()){
-        return string();
-    }
+    std::vector<SearchResultPtr> found;
+    remoteSearch.take(count, found);
 
     std::string ret;
-    for(int i = 0; !SearchFrame::searchResults.empty() && i < count; ++i){
-        const SearchResultPtr &res = SearchFrame::searchResults.back();
-        SearchFrame::searchResults.pop_back();
+    for(auto i = found.cbegin(); i != found.cend(); ++i){
+        const SearchResultPtr &res = *i;
 
         ret += "[\"" + safeString(res->getFile()) 
             + "\",\"" + Util::toString(res->getSize()) 
@@ -32,10 +137,8 @@ std::string RpcServiceSearch::result(int count)
 
 bool RpcServiceSearch::simpleSearch(const std::string &query, bool isHash)
 {
-    //StringList clients, extList;
-    //SearchManager::getInstance()->search(clients, query, 0, SearchManager::TypeModes::TYPE_ANY, SearchManager::SizeModes::SIZE_DONTCARE, Util::toString(Util::rand()), extList, NULL);
-    MainFrame::getMainFrame()->PostMessage(WM_SPEAKER, MainFrame::SEARCH_SIMPLE, (LPARAM)new std::string(query));
-    return true;
+    std::unique_ptr<CommandExecutor::Command> command(new StartSearch(query, isHash));
+    return CommandExecutor::isValidInstance() && CommandExecutor::getInstance()->post(std::move(command));
 }
 
 bool RpcServiceSearch::command(const json_spirit::Object &data)
@@ -0,0 +1,143 @@
+#include "stdafx.h"
+#include "RpcServiceTransfers.h"
+#include "RpcSnapshots.h"
+#include "../client/DownloadManager.h"
+#include "../client/UploadManager.h"
+#include "../client/ClientManager.h"
+#include "../client/ConnectionManager.h"
+#include "../client/TransferStats.h"
+#include "json_spirit_utils.h"
+
+namespace
+{
+    void fillTransfers(Transfer::SnapshotList &rows)
+    {
+        DownloadManager::getInstance()->getSnapshots(rows);
+        UploadManager::getInstance()->getSnapshots(rows);
+    }
+
+    void writeTransfer(RpcJsonWriter &writer, const Transfer::Snapshot &row)
+    {
+        // nicks are resolved only for the rows of the page, outside of the transfer locks
+        writer.beginObject()
+            .member("download", row.m_download)
+            .member("type",     static_cast<int>(row.m_type))
+            .member("path",     row.m_path)
+            .member("tth",      row.m_tth.toBase32())
+            .member("nick",     Util::toString(ClientManager::getInstance()->getNicks(row.m_user->getCID(), row.m_hub_hint)))
+            .member("hub",      row.m_hub_hint)
+            .member("pos",      row.m_pos)
+            .member("size",     row.m_size)
+            .member("actual",   row.m_actual)
+            .member("speed",    row.m_speed)
+            .member("elapsed",  static_cast<int64_t>((GET_TICK() - row.m_start) / 1000))
+            .endObject();
+    }
+
+    RpcSnapshots<Transfer::Snapshot> snapshots(&fillTransfers, &writeTransfer);
+
+    int64_t getInt64(const json_spirit::Object &data, const char *name, int64_t def)
+    {
+        const json_spirit::Value &val = json_spirit::find_value(data, name);
+        return val.type() == json_spirit::int_type ? val.get_int64() : def;
+    }
+
+    /* negative times count back from now */
+    time_t toTime(int64_t value, time_t now)
+    {
+        return static_cast<time_t>(value < 0 ? now + value : value);
+    }
+}
+
+std::string RpcServiceTransfers::list(const json_spirit::Object &data)
+{
+    return snapshots.page(data);
+}
+
+std::string RpcServiceTransfers::history(const json_spirit::Object &data)
+{
+    const time_t now    = GET_TIME();
+    time_t from         = toTime(getInt64(data, "from", -300), now);
+    const int64_t until = getInt64(data, "to", 0);
+    const time_t to     = until ? toTime(until, now) : now;
+    const int64_t res   = getInt64(data, "resolution", from >= now - TransferStats::SECONDS_KEPT ? TransferStats::SECONDS : TransferStats::MINUTES);
+    const TransferStats::Resolution resolution = res >= TransferStats::MINUTES ? TransferStats::MINUTES : TransferStats::SECONDS;
+
+    const json_spirit::Value &hub = json_spirit::find_value(data, "hub");
+
+    std::string ret;
+    RpcJsonWriter writer(ret);
+    if(hub.type() == json_spirit::str_type){
+        std::vector<TransferStats::HubSample> points;
+        if(!TransferStats::getInstance()->getHubRange(hub.get_str(), resolution, from, to, points)){
+            return "null";
+        }
+        ret.reserve(points.size() * 16 + 128);
+        writer.beginObject()
+            .member("resolution", static_cast<int>(resolution))
+            .member("from", static_cast<int64_t>(from))
+            .member("hub", hub.get_str())
+            .key("columns").beginArray().value("down").value("up").endArray()
+            .key("points").beginArray();
+        for(auto i = points.cbegin(); i != points.cend(); ++i){
+            writer.beginArray().value(i->m_down).value(i->m_up).endArray();
+        }
+        writer.endArray().endObject();
+        return ret;
+    }
+
+    std::vector<TransferStats::Sample> points;
+    TransferStats::getInstance()->getRange(resolution, from, to, points);
+    ret.reserve(points.size() * 40 + 128);
+    writer.beginObject()
+        .member("resolution", static_cast<int>(resolution))
+        .member("from", static_cast<int64_t>(from))
+        .key("columns").beginArray()
+            .value("down").value("up").value("hash").value("slotsUsed").value("slots").value("queueLeft")
+        .endArray()
+        .key("points").beginArray();
+    for(auto i = points.cbegin(); i != points.cend(); ++i){
+        writer.beginArray()
+            .value(i->m_down)
+            .value(i->m_up)
+            .value(i->m_hash)
+            .value(static_cast<unsigned int>(i->m_slots_used))
+            .value(static_cast<unsigned int>(i->m_slots))
+            .value(i->m_queue_left)
+            .endArray();
+    }
+    writer.endArray().endObject();
+    return ret;
+}
+
+std::string RpcServiceTransfers::hubs(const json_spirit::Object &data)
+{
+    const StringList hubs = TransferStats::getInstance()->getHubs();
+
+    std::string ret;
+    RpcJsonWriter writer(ret);
+    writer.beginArray();
+    for(auto i = hubs.cbegin(); i != hubs.cend(); ++i){
+        writer.value(*i);
+    }
+    writer.endArray();
+    return ret;
+}
+
+std::string RpcServiceTransfers::connections(const json_spirit::Object &data)
+{
+    const ConnectionManager::AttemptStats stats = ConnectionManager::getInstance()->getAttemptStats();
+
+    std::string ret;
+    RpcJsonWriter writer(ret);
+    writer.beginObject()
+        .member("attempts",    stats.m_attempts)
+        .member("connected",   stats.m_connected)
+        .member("timeouts",    stats.m_timeouts)
+        .member("hubDeferred", stats.m_hub_deferred)
+        .member("inFlight",    static_cast<uint64_t>(stats.m_in_flight))
+        .member("waiting",     static_cast<uint64_t>(stats.m_waiting))
+        .member("successRate", stats.m_attempts ? static_cast<double>(stats.m_connected) / stats.m_attempts : 0.0)
+        .endObject();
+    return ret;
+}
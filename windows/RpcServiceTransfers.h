@@ -0,0 +1,36 @@
+#pragma once
+#include "json_spirit.h"
+
+class RpcServiceTransfers
+{
+public:
+    /**
+     * @response: {snapshot, total, offset, items: array(object, object,..)}
+     */
+    static std::string list(const json_spirit::Object &data);
+
+    /**
+     * Request: {from, to, resolution, hub} - all optional.
+     *      from/to: unix time, negative values count back from now (default: the last 5 minutes)
+     *      resolution: 1 or 60 seconds (default: 1 if the range is within the last hour)
+     *      hub: rates of this hub only, see hubs()
+     * @response: {resolution, from, columns: array(name,..), points: array(array(value,..),..)}
+     *      points follow each other at resolution steps starting with from
+     */
+    static std::string history(const json_spirit::Object &data);
+
+    /**
+     * @response: array(hub url,..) - hubs with their own history
+     */
+    static std::string hubs(const json_spirit::Object &data);
+
+    /**
+     * @response: {attempts, connected, timeouts, hubDeferred, inFlight, waiting, successRate}
+     *      counters since the start, successRate is connected / attempts
+     */
+    static std::string connections(const json_spirit::Object &data);
+
+private:
+    RpcServiceTransfers(void){};
+    ~RpcServiceTransfers(void){};
+};
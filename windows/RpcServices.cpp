@@ -1,13 +1,51 @@
 #include "stdafx.h"
 #include "RpcServices.h"
 #include <RCF/JsonRpc.hpp>
+#include <RCF/HttpFrameFilter.hpp>
+#include <boost/bind.hpp>
 
 #include "RpcServiceHub.h"
 #include "RpcServiceSearch.h"
+#include "RpcServiceQueue.h"
+#include "RpcServiceTransfers.h"
+#include "RpcJsonWriter.h"
+#include "../client/ZUtils.h"
 
+/**
+ * -
+ * Request params: array(type, {object})
+ */
 void RpcServices::transfers(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response)
 {
+    const json_spirit::Array &params = request.getJsonParams();
+    if(!checkTypedParams(params, response)){
+        return;
+    }
 
+    switch(params[0].get_int())
+    {
+        case RpcServicesTypes::ServiceTransfers::LIST:
+        {
+            handlerJsonResult(RpcServiceTransfers::list(params[1].get_obj()), response);
+            return;
+        }
+        case RpcServicesTypes::ServiceTransfers::HISTORY:
+        {
+            handlerJsonResult(RpcServiceTransfers::history(params[1].get_obj()), response);
+            return;
+        }
+        case RpcServicesTypes::ServiceTransfers::HUBS:
+        {
+            handlerJsonResult(RpcServiceTransfers::hubs(params[1].get_obj()), response);
+            return;
+        }
+        case RpcServicesTypes::ServiceTransfers::CONNECTIONS:
+        {
+            handlerJsonResult(RpcServiceTransfers::connections(params[1].get_obj()), response);
+            return;
+        }
+    }
+    prepareFailure(RpcServicesTypes::ErrorCodes::ERR_OPERATION_TYPE_INCORRECT, response);
 }
 
 /**
@@ -36,7 +74,7 @@ void RpcServices::hub(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse
     {
         case RpcServicesTypes::ServiceHub::USED:
         {
-            handlerStringResult(RpcServiceHub::used(data), response);
+            handlerJsonResult(RpcServiceHub::used(data), response);
             return;
         }
         case RpcServicesTypes::ServiceHub::CONNECT:
@@ -51,7 +89,7 @@ void RpcServices::hub(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse
         }
         case RpcServicesTypes::ServiceHub::LIST:
         {
-            handlerStringResult(RpcServiceHub::list(data), response);
+            handlerJsonResult(RpcServiceHub::list(data), response);
             return;
         }
         case RpcServicesTypes::ServiceHub::CREATE:
@@ -135,9 +173,31 @@ void RpcServices::search(const RCF::JsonRpcRequest &request,  RCF::JsonRpcRespon
     prepareFailure(RpcServicesTypes::ErrorCodes::ERR_OPERATION_TYPE_INCORRECT, response);
 }
 
+/**
+ * -
+ * Request params: array(type, {object})
+ */
 void RpcServices::queue(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response)
 {
+    const json_spirit::Array &params = request.getJsonParams();
+    if(!checkTypedParams(params, response)){
+        return;
+    }
 
+    switch(params[0].get_int())
+    {
+        case RpcServicesTypes::ServiceQueue::LIST:
+        {
+            handlerJsonResult(RpcServiceQueue::list(params[1].get_obj()), response);
+            return;
+        }
+        case RpcServicesTypes::ServiceQueue::EXPORT:
+        {
+            handlerBooleanResult(RpcServiceQueue::exportXml(), response);
+            return;
+        }
+    }
+    prepareFailure(RpcServicesTypes::ErrorCodes::ERR_OPERATION_TYPE_INCORRECT, response);
 }
 
 void RpcServices::share(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response)
@@ -160,6 +220,103 @@ void RpcServices::hashing(const RCF::JsonRpcRequest &request,  RCF::JsonRpcRespo
     
 }
 
+/**
+ * -
+ * Request params: none
+ * Response: array({name, calls, errors, avgUs, maxUs}, ..)
+ */
+void RpcServices::stats(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response)
+{
+    RCF::RcfServer::JsonRpcStats stats;
+    RCF::getCurrentRcfSession().getRcfServer().getJsonRpcStats(stats);
+
+    std::string ret;
+    RpcJsonWriter writer(ret);
+    writer.beginArray();
+    for(RCF::RcfServer::JsonRpcStats::const_iterator i = stats.begin(); i != stats.end(); ++i){
+        const RCF::JsonRpcMethodStats &method = i->second;
+        writer.beginObject()
+            .member("name", i->first)
+            .member("calls", method.mCalls)
+            .member("errors", method.mErrors)
+            .member("avgUs", method.mCalls ? method.mTotalUs / method.mCalls : 0)
+            .member("maxUs", method.mMaxUs)
+            .endObject();
+    }
+    writer.endArray();
+    handlerJsonResult(ret, response);
+}
+
+std::string RpcServices::encodeContent(const std::string &acceptEncoding, const std::vector<RCF::ByteBuffer> &body, std::vector<char> &encoded)
+{
+    /* small responses fit into a packet anyway */
+    static const size_t MIN_LENGTH = 1024;
+
+    const size_t length = RCF::lengthByteBuffers(body);
+    if(length < MIN_LENGTH){
+        return std::string();
+    }
+
+    const bool gzip = Util::findSubString(acceptEncoding, "gzip") != string::npos;
+    if(!gzip && Util::findSubString(acceptEncoding, "deflate") == string::npos){
+        return std::string();
+    }
+
+    /* zlib stream - what HTTP calls "deflate" */
+    dcpp::ZFilter filter;
+    encoded.resize(length / 2 + 1024);
+    size_t pos = 0;
+    uLong crc = crc32(0, Z_NULL, 0);
+    try{
+        /* one more round without input flushes the stream */
+        for(size_t i = 0, n = body.size(); i <= n; ++i){
+            const bool finish   = i == n;
+            const char *in      = finish ? NULL : body[i].getPtr();
+            size_t left         = finish ? 0 : body[i].getLength();
+            if(!finish){
+                crc = crc32(crc, reinterpret_cast<const Bytef*>(in), static_cast<uInt>(left));
+            }
+            for(bool more = true; more && (left || finish);){
+                if(encoded.size() - pos < 1024){
+                    encoded.resize(encoded.size() * 2);
+                }
+                size_t inSize   = left;
+                size_t outSize  = encoded.size() - pos;
+                more = filter(in, inSize, &encoded[pos], outSize);
+                pos     += outSize;
+                in      += inSize;
+                left    -= inSize;
+            }
+        }
+    }
+    catch(const Exception &){
+        return std::string();
+    }
+
+    if(pos >= length){
+        return std::string();
+    }
+
+    if(!gzip){
+        encoded.resize(pos);
+        return "deflate";
+    }
+
+    /* gzip: the same deflate data, but with its own header and a crc32 + size trailer instead of zlib's */
+    static const char GZIP_HEADER[10] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff' };
+    const size_t data = pos - 2 - 4;
+    std::vector<char> gz(sizeof(GZIP_HEADER) + data + 8);
+    memcpy(&gz[0], GZIP_HEADER, sizeof(GZIP_HEADER));
+    memcpy(&gz[sizeof(GZIP_HEADER)], &encoded[2], data);
+    char *trailer = &gz[sizeof(GZIP_HEADER) + data];
+    for(int i = 0; i < 4; ++i){
+        trailer[i]      = static_cast<char>((crc >> (8 * i)) & 0xFF);
+        trailer[4 + i]  = static_cast<char>((length >> (8 * i)) & 0xFF);
+    }
+    encoded.swap(gz);
+    return "gzip";
+}
+
 inline void RpcServices::prepareSuccess(const std::string &result, RCF::JsonRpcResponse &response)
 {
     json_spirit::mObject &ret = response.getJsonResponse();
@@ -194,5 +351,39 @@ inline void RpcServices::handlerStringResult(const std::string &result, RCF::Jso
     prepareSuccess(result, response);
 }
 
+inline void RpcServices::handlerJsonResult(std::string result, RCF::JsonRpcResponse &response)
+{
+    prepareSuccess(std::string(), response);
+    response.setRawResult(result);
+}
+
+bool RpcServices::checkTypedParams(const json_spirit::Array &params, RCF::JsonRpcResponse &response)
+{
+    if(params.size() != 2){
+        prepareFailure(RpcServicesTypes::ErrorCodes::ERR_PARAM_COUNT_DIFFERENT, response);
+        return false;
+    }
+    if(params[0].type() != json_spirit::int_type || params[1].type() != json_spirit::obj_type){
+        prepareFailure(RpcServicesTypes::ErrorCodes::ERR_PARAM_TYPE_INCORRECT, response);
+        return false;
+    }
+    return true;
+}
+
+void RpcServices::bindTo(RCF::RcfServer &server)
+{
+    server.bindJsonRpc(boost::bind(&RpcServices::transfers, this, _1, _2), "r.transfers");
+    server.bindJsonRpc(boost::bind(&RpcServices::hub, this, _1, _2), "r.hub");
+    server.bindJsonRpc(boost::bind(&RpcServices::search, this, _1, _2), "r.search");
+    server.bindJsonRpc(boost::bind(&RpcServices::queue, this, _1, _2), "r.queue");
+    server.bindJsonRpc(boost::bind(&RpcServices::share, this, _1, _2), "r.share");
+    server.bindJsonRpc(boost::bind(&RpcServices::settings, this, _1, _2), "r.settings");
+    server.bindJsonRpc(boost::bind(&RpcServices::execute, this, _1, _2), "r.execute");
+    server.bindJsonRpc(boost::bind(&RpcServices::hashing, this, _1, _2), "r.hashing");
+    server.bindJsonRpc(boost::bind(&RpcServices::stats, this, _1, _2), "r.stats");
+
+    RCF::setHttpContentEncoder(&RpcServices::encodeContent);
+}
+
 RpcServices::RpcServices(void){}
 RpcServices::~RpcServices(void){}
\ No newline at end of file
@@ -54,6 +54,32 @@ namespace RpcServicesTypes
         };
     };
 
+    namespace ServiceQueue
+    {
+        enum TypeAllow
+        {
+            /* paginated listing: {snapshot, offset, limit} */
+            LIST,
+            /* writes the queue to Queue.xml for the versions without Queue.dat: {} */
+            EXPORT
+        };
+    };
+
+    namespace ServiceTransfers
+    {
+        enum TypeAllow
+        {
+            /* paginated listing of running downloads and uploads: {snapshot, offset, limit} */
+            LIST,
+            /* rates, slots, queue and hashing over time: {from, to, resolution, hub} */
+            HISTORY,
+            /* hubs with their own history */
+            HUBS,
+            /* download connection attempts: sent, answered, timed out */
+            CONNECTIONS
+        };
+    };
+
     namespace ServiceHub
     {
         enum TypeAllow
@@ -103,6 +129,12 @@ public:
   /* hashing operation: calculate, status */
     void hashing(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response);
 
+  /* per-method call counters and latency */
+    void stats(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response);
+
+  /* gzip/deflate of larger responses, see RCF::setHttpContentEncoder() */
+    static std::string encodeContent(const std::string &acceptEncoding, const std::vector<RCF::ByteBuffer> &body, std::vector<char> &encoded);
+
     //INFO: RCF скуп на привязывания, поэтому лучше сводить схожие операции
     //void uploads(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response);
     //void downloads(const RCF::JsonRpcRequest &request,  RCF::JsonRpcResponse &response);
@@ -112,9 +144,16 @@ public:
     RpcServices(void);
     ~RpcServices(void);
 
+  /* registers all the methods above as "r.<name>" and the response compression */
+    void bindTo(RCF::RcfServer &server);
+
 private:
     void prepareSuccess(const std::string &result, RCF::JsonRpcResponse &response);
     void prepareFailure(int error, RCF::JsonRpcResponse &response);
     void handlerBooleanResult(bool result, RCF::JsonRpcResponse &response);
     void handlerStringResult(const std::string &result, RCF::JsonRpcResponse &response);
+    /* result is already JSON and is sent as is */
+    void handlerJsonResult(std::string result, RCF::JsonRpcResponse &response);
+    /* checks for array(type, {object}) */
+    bool checkTypedParams(const json_spirit::Array &params, RCF::JsonRpcResponse &response);
 };
\ No newline at end of file
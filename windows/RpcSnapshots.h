@@ -0,0 +1,121 @@
+#pragma once
+#include "json_spirit.h"
+#include "json_spirit_utils.h"
+#include "RpcJsonWriter.h"
+
+/**
+ * Paginated listings over a copy of the data.
+ * The first page takes the copy and returns its id, the next pages pass the id back
+ * and are served from the same copy, so items don't shift between pages even
+ * if the queue changes meanwhile. Unused copies expire after a minute.
+ *
+ * Request object: {snapshot: id, offset: n, limit: n} - all optional
+ * Response: {snapshot: id, total: n, offset: n, items: [...]}
+ */
+template<class Item>
+class RpcSnapshots
+{
+public:
+    typedef std::vector<Item> List;
+    typedef std::shared_ptr<const List> Ptr;
+    typedef void (*FillFunc)(List &items);
+    typedef void (*WriteFunc)(RpcJsonWriter &writer, const Item &item);
+
+    RpcSnapshots(FillFunc fill, WriteFunc write) : fill(fill), write(write), lastId(0){}
+
+    std::string page(const json_spirit::Object &data)
+    {
+        uint32_t id     = static_cast<uint32_t>(getInt(data, "snapshot", 0));
+        Ptr items       = find(id);
+        if(!items){
+            std::shared_ptr<List> fresh(new List());
+            fill(*fresh);
+            items   = fresh;
+            id      = add(items);
+        }
+
+        const size_t offset = min(static_cast<size_t>(max(getInt(data, "offset", 0), 0)), items->size());
+        const size_t limit  = static_cast<size_t>(min(max(getInt(data, "limit", DEFAULT_LIMIT), 0), static_cast<int>(MAX_LIMIT)));
+        const size_t end    = min(offset + limit, items->size());
+
+        std::string ret;
+        ret.reserve((end - offset) * 160 + 64);
+
+        RpcJsonWriter writer(ret);
+        writer.beginObject()
+            .member("snapshot", id)
+            .member("total", items->size())
+            .member("offset", offset)
+            .key("items").beginArray();
+        for(size_t i = offset; i < end; ++i){
+            write(writer, (*items)[i]);
+        }
+        writer.endArray().endObject();
+        return ret;
+    }
+
+    static int getInt(const json_spirit::Object &data, const char *name, int def)
+    {
+        const json_spirit::Value &val = json_spirit::find_value(data, name);
+        return val.type() == json_spirit::int_type ? val.get_int() : def;
+    }
+
+private:
+    enum
+    {
+        DEFAULT_LIMIT   = 500,
+        MAX_LIMIT       = 5000,
+        MAX_SNAPSHOTS   = 8,
+        SNAPSHOT_TTL    = 60 * 1000
+    };
+
+    struct Entry
+    {
+        Ptr items;
+        uint64_t used;
+    };
+    typedef std::map<uint32_t, Entry> Map;
+
+    Ptr find(uint32_t id)
+    {
+        Lock l(cs);
+        typename Map::iterator i = snapshots.find(id);
+        if(i == snapshots.end()){
+            return Ptr();
+        }
+        i->second.used = GET_TICK();
+        return i->second.items;
+    }
+
+    uint32_t add(const Ptr &items)
+    {
+        Lock l(cs);
+        const uint64_t now = GET_TICK();
+        for(typename Map::iterator i = snapshots.begin(); i != snapshots.end();){
+            if(now - i->second.used > SNAPSHOT_TTL){
+                snapshots.erase(i++);
+            }
+            else{
+                ++i;
+            }
+        }
+        if(snapshots.size() >= MAX_SNAPSHOTS){
+            // ids grow, so the first one is the oldest
+            snapshots.erase(snapshots.begin());
+        }
+        if(++lastId == 0){
+            ++lastId; // 0 means "take a new one"
+        }
+        Entry &entry = snapshots[lastId];
+        entry.items = items;
+        entry.used  = now;
+        return lastId;
+    }
+
+    FillFunc fill;
+    WriteFunc write;
+
+    Map snapshots;
+    uint32_t lastId;
+    CriticalSection cs;
+};
@@ -32,7 +32,6 @@
 #include "../client/SearchManager.h"
 
 TStringSet SearchFrame::lastSearches;
-vector<SearchResultPtr> SearchFrame::searchResults;
 
 int SearchFrame::columnIndexes[] = { COLUMN_FILENAME, COLUMN_HITS, COLUMN_NICK, COLUMN_TYPE, COLUMN_SIZE,
                                      COLUMN_PATH, COLUMN_LOCAL_PATH, COLUMN_SLOTS, COLUMN_CONNECTION, COLUMN_HUB, COLUMN_EXACT_SIZE, COLUMN_IP, COLUMN_TTH
@@ -52,7 +51,6 @@ void SearchFrame::openWindow(const tstring& str /* = Util::emptyString */, LONGL
     if(instance != NULL){
         return;
     }
-    searchResults.clear();
 	SearchFrame* pChild = instance = new SearchFrame();
 	pChild->setInitial(str, size, mode, type);
 	pChild->CreateEx(WinUtil::mdiClient);
@@ -647,7 +645,6 @@ void SearchFrame::on(SearchManagerListener::SR, const SearchResultPtr& aResult)
 		return;
 	}
 
-    searchResults.push_back(aResult);
 	SearchInfo* i = new SearchInfo(aResult);
 	PostMessage(WM_SPEAKER, ADD_RESULT, (LPARAM)i);
 }
@@ -977,7 +974,6 @@ LRESULT SearchFrame::onClose(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/
 		                            
 		bHandled = FALSE;
         instance = NULL;
-        searchResults.clear();
 		return 0;
 	}
 }
@@ -1393,7 +1389,7 @@ LRESULT SearchFrame::onSpeaker(UINT /*uMsg*/, WPARAM wParam, LPARAM lParam, BOOL
 			addSearchResult((SearchInfo*)(lParam));
 			break;
 		case FILTER_RESULT:
-			ctrlStatus.SetText(4, (Util::toStringW(droppedResults) + _T(" ") + TSTRING(FILTERED)).c_str());
+			ctrlStatus.SetText(4, (Util::toStringW(droppedResults.load()) + _T(" ") + TSTRING(FILTERED)).c_str());
 			break;
 		case HUB_ADDED:
 			onHubAdded((HubInfo*)(lParam));
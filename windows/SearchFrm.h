@@ -678,7 +678,8 @@ class SearchFrame : public MDITabChildWindowImpl<SearchFrame, RGB(127, 127, 255)
 		CriticalSection cs;
 		
 		static TStringSet lastSearches;
-		size_t droppedResults;
+		/** Updated by the threads parsing the results */
+		boost::atomic<size_t> droppedResults;
 		
 		bool closed;
 		
@@ -727,12 +728,6 @@ class SearchFrame : public MDITabChildWindowImpl<SearchFrame, RGB(127, 127, 255)
 			HubInfo* hubInfo = new HubInfo(Text::toT(aClient->getHubUrl()), Text::toT(aClient->getHubName()), aClient->getMyIdentity().isOp());
 			PostMessage(WM_SPEAKER, WPARAM(s), LPARAM(hubInfo));
 		}
-
-    public:
-        /**
-         *     .
-         */
-        static vector<SearchResultPtr> searchResults;
 };
 
 #endif // !defined(SEARCH_FRM_H)
@@ -568,16 +568,11 @@ static int Run(LPTSTR /*lpstrCmdLine*/ = NULL, int nCmdShow = SW_SHOWDEFAULT)
     server.addEndpoint( RCF::HttpEndpoint("127.0.0.1", 1271) ) //TODO: available port
             .setRpcProtocol(RCF::Rp_JsonRpc);
 
-    server.bindJsonRpc(boost::bind(&RpcServices::transfers, &services, _1, _2), "r.transfers");
-    server.bindJsonRpc(boost::bind(&RpcServices::hub, &services, _1, _2), "r.hub");
-    server.bindJsonRpc(boost::bind(&RpcServices::search, &services, _1, _2), "r.search");
-    server.bindJsonRpc(boost::bind(&RpcServices::queue, &services, _1, _2), "r.queue");
-    server.bindJsonRpc(boost::bind(&RpcServices::share, &services, _1, _2), "r.share");
-    server.bindJsonRpc(boost::bind(&RpcServices::settings, &services, _1, _2), "r.settings");
-    server.bindJsonRpc(boost::bind(&RpcServices::execute, &services, _1, _2), "r.execute");
-    server.bindJsonRpc(boost::bind(&RpcServices::hashing, &services, _1, _2), "r.hashing");
-
-    RCF::ThreadPoolPtr tpPtr( new RCF::ThreadPool(1, 50) );
+    services.bindTo(server);
+
+    // the calls only read the managers or queue commands for dcpp::CommandExecutor,
+    // nothing waits for the UI here, so a few threads are enough
+    RCF::ThreadPoolPtr tpPtr( new RCF::ThreadPool(1, 8) );
     server.setThreadPool(tpPtr);
 
     server.start();